@@ -31,16 +31,16 @@ private:
     }
     ctx.set_status(boost::beast::http::status::ok);
     ctx.set_content_type("application/json");
-    auto do_stream_chunk = [this, num_str](auto& session, const auto& writeHandler)
+    // pull 风格：上一块写出后才会生成下一块，不占用额外线程
+    auto next_chunk = [i = size_t{0}, total = num_chunks_to_send_, num_str]() mutable -> std::optional<std::string>
     {
-      for (int i = 0; i < num_chunks_to_send_; i++)
+      if (i >= total)
       {
-        auto json = fmt::format(R"("id": {}, "url": "/stream/{}", "args": , "headers": {})",
-                                i, num_str, "\n");
-        if (!writeHandler(json)) { break; }
+        return std::nullopt;
       }
+      return fmt::format(R"("id": {}, "url": "/stream/{}", "args": , "headers": {})", i++, num_str, "\n");
     };
-    ctx.chunked(do_stream_chunk);
+    ctx.chunked_pull(next_chunk);
   }
 };
 
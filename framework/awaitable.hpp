@@ -0,0 +1,23 @@
+#ifndef KHTTPD_FRAMEWORK_AWAITABLE_HPP
+#define KHTTPD_FRAMEWORK_AWAITABLE_HPP
+
+// C++20 协程接口的开关：编译器支持 co_await 时（bazel build --//framework:cpp20，即 -std=c++20）
+// 定义 KHTTPD_HAS_COROUTINES，HttpClient 的 get/post/put/del 与 co_handler 才可用；C++17 构建不受影响
+#include <utility>
+#include <boost/asio/detail/config.hpp>
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+#define KHTTPD_HAS_COROUTINES 1
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+namespace khttpd::framework
+{
+  template <class T = void>
+  using Awaitable = boost::asio::awaitable<T>;
+}
+#endif
+
+#endif // KHTTPD_FRAMEWORK_AWAITABLE_HPP
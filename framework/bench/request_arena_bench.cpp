@@ -0,0 +1,151 @@
+// framework/bench/request_arena_bench.cpp
+// 统计每个请求的堆分配次数：对比 HttpContext 直接使用堆（make_shared）与使用 HttpSession 的
+// 请求级单调内存池（allocate_shared + 每个请求 release）。不启动服务器，按 HttpSession::handle_request
+// 的方式为同一个请求反复创建上下文，并运行一个读取查询参数、路径参数、Cookie、表单并设置属性的处理函数。
+//   bazel run //framework/bench:request_arena_bench -- 200000 8192
+// 参数依次为：请求数 内存池字节数
+#include "framework/context/http_context.hpp"
+#include <fmt/core.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string>
+
+namespace http = boost::beast::http;
+using khttpd::framework::HttpContext;
+using khttpd::framework::ParamList;
+
+namespace
+{
+  std::atomic<std::uint64_t> heap_allocations{0};
+}
+
+void* operator new(std::size_t size)
+{
+  heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+// std::pmr::new_delete_resource() 使用对齐版本
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+  heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  const auto align = static_cast<std::size_t>(alignment);
+  if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+namespace
+{
+  void handle(HttpContext& ctx)
+  {
+    // 与路由器相同：路径参数是指向 path() 的视图
+    const std::string_view path = ctx.path();
+    ParamList params;
+    params.push_back("id", path.substr(path.rfind('/') + 1));
+    ctx.set_path_params(params);
+
+    const auto id = ctx.path_param_view("id");
+    const auto sort = ctx.query_param_view("sort");
+    const auto filter = ctx.query_param_view("filter");
+    const auto session = ctx.get_cookie("session_identifier");
+    const auto theme = ctx.get_cookie("theme");
+    const auto title = ctx.get_form_param("title");
+    ctx.set_attribute("authenticated_user_identifier", std::string_view("alice"));
+    ctx.set_attribute("request_start", std::chrono::steady_clock::now());
+
+    if (!id || !sort || !filter || !session || !theme || !title)
+    {
+      std::abort();
+    }
+    ctx.set_body("ok");
+  }
+
+  struct Result
+  {
+    double allocations_per_request;
+    double ns_per_request;
+  };
+
+  template <class MakeContext>
+  Result run(const int requests, HttpContext::Request& req, HttpContext::Response& res, MakeContext make_context)
+  {
+    std::shared_ptr<HttpContext> ctx;
+    const auto before = heap_allocations.load();
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; ++i)
+    {
+      res = {};
+      ctx = make_context(ctx);
+      handle(*ctx);
+    }
+    ctx.reset();
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return {static_cast<double>(heap_allocations.load() - before) / requests, elapsed / requests};
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  const int requests = argc > 1 ? std::stoi(argv[1]) : 200000;
+  const std::size_t arena_size = argc > 2 ? std::stoul(argv[2]) : 8 * 1024;
+
+  HttpContext::Request req{http::verb::post, "/api/v1/items/12345?sort=created_at&filter=status%3Aactive+owner%3Ame", 11};
+  req.set(http::field::host, "127.0.0.1");
+  req.set(http::field::cookie, "session_identifier=0123456789abcdef0123456789abcdef; theme=dark");
+  req.set(http::field::content_type, "application/x-www-form-urlencoded");
+  req.body() = "title=a+title+that+does+not+fit+in+sso&count=3";
+  req.prepare_payload();
+  HttpContext::Response res;
+
+  const Result heap = run(requests, req, res, [&](std::shared_ptr<HttpContext>&)
+  {
+    return std::make_shared<HttpContext>(req, res);
+  });
+
+  auto buffer = std::make_unique<std::byte[]>(arena_size);
+  std::pmr::monotonic_buffer_resource arena(buffer.get(), arena_size, std::pmr::new_delete_resource());
+  const Result pooled = run(requests, req, res, [&](std::shared_ptr<HttpContext>& previous)
+  {
+    previous.reset();
+    arena.release();
+    return std::allocate_shared<HttpContext>(std::pmr::polymorphic_allocator<HttpContext>(&arena), req, res, &arena);
+  });
+
+  fmt::print("requests: {}, arena: {} bytes\n", requests, arena_size);
+  fmt::print("heap : {:6.2f} allocations/request, {:8.1f} ns/request\n", heap.allocations_per_request,
+             heap.ns_per_request);
+  fmt::print("arena: {:6.2f} allocations/request, {:8.1f} ns/request\n", pooled.allocations_per_request,
+             pooled.ns_per_request);
+  return 0;
+}
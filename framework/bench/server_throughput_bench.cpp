@@ -0,0 +1,96 @@
+// framework/bench/server_throughput_bench.cpp
+// 对比 IoMode::shared 与 IoMode::per_core 的吞吐量。
+// 由于 IoContextPool 是单例且 stop 后不能重启，每个进程只测一种模式：
+//   bazel run //framework/bench:server_throughput_bench -- shared   8 64 10
+//   bazel run //framework/bench:server_throughput_bench -- per_core 8 64 10
+// 参数依次为：模式 工作线程数 并发连接数 持续秒数
+#include "framework/server.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <fmt/core.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using khttpd::framework::IoMode;
+
+int main(int argc, char* argv[])
+{
+  const std::string mode = argc > 1 ? argv[1] : "shared";
+  const int num_threads = argc > 2 ? std::stoi(argv[2]) : static_cast<int>(std::thread::hardware_concurrency());
+  const int connections = argc > 3 ? std::stoi(argv[3]) : 64;
+  const int seconds = argc > 4 ? std::stoi(argv[4]) : 10;
+  const unsigned short port = 18080;
+
+  khttpd::framework::ServerOptions options;
+  options.io_mode = mode == "per_core" ? IoMode::per_core : IoMode::shared;
+
+  auto server = std::make_shared<khttpd::framework::Server>(
+    tcp::endpoint{net::ip::make_address("127.0.0.1"), port}, ".", num_threads, options);
+  server->get_http_router().get("/ping", [](khttpd::framework::HttpContext& ctx)
+  {
+    ctx.set_body("pong");
+  });
+
+  std::thread server_thread([server]() { server->run(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::atomic<bool> running{true};
+  std::atomic<uint64_t> completed{0};
+  std::atomic<uint64_t> failed{0};
+  std::vector<std::thread> clients;
+  clients.reserve(connections);
+
+  for (int i = 0; i < connections; ++i)
+  {
+    clients.emplace_back([&]()
+    {
+      net::io_context ioc;
+      beast::tcp_stream stream(ioc);
+      beast::error_code ec;
+      stream.connect(tcp::endpoint{net::ip::make_address("127.0.0.1"), port}, ec);
+      if (ec)
+      {
+        ++failed;
+        return;
+      }
+
+      http::request<http::empty_body> req{http::verb::get, "/ping", 11};
+      req.set(http::field::host, "127.0.0.1");
+      req.keep_alive(true);
+      beast::flat_buffer buffer;
+
+      while (running.load(std::memory_order_relaxed))
+      {
+        http::write(stream, req, ec);
+        if (ec) break;
+        http::response<http::string_body> res;
+        http::read(stream, buffer, res, ec);
+        if (ec) break;
+        completed.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (ec) ++failed;
+      stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+    });
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  running = false;
+  for (auto& t : clients) t.join();
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  server->stop();
+  server_thread.join();
+
+  fmt::print("mode={} threads={} connections={} requests={} failed={} elapsed={:.2f}s throughput={:.0f} req/s\n",
+             mode, num_threads, connections, completed.load(), failed.load(), elapsed, completed.load() / elapsed);
+  return 0;
+}
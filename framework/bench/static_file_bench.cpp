@@ -0,0 +1,120 @@
+// framework/bench/static_file_bench.cpp
+// 对比启用静态文件缓存（内存 / sendfile）与原来每次请求都解析路径并用 file_body 发送的吞吐量。
+// IoContextPool 是单例且 stop 后不能重启，每个进程只测一种模式：
+//   bazel run //framework/bench:static_file_bench -- cached   8 64 10 4096
+//   bazel run //framework/bench:static_file_bench -- uncached 8 64 10 4096
+// 参数依次为：模式 工作线程数 并发连接数 持续秒数 文件字节数
+// 文件大于 StaticFileOptions::max_in_memory_file_size（默认 256KiB）时 cached 模式走 sendfile
+#include "framework/server.hpp"
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/filesystem.hpp>
+#include <fmt/core.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace fs = boost::filesystem;
+using tcp = net::ip::tcp;
+
+int main(int argc, char* argv[])
+{
+  const std::string mode = argc > 1 ? argv[1] : "cached";
+  const int num_threads = argc > 2 ? std::stoi(argv[2]) : static_cast<int>(std::thread::hardware_concurrency());
+  const int connections = argc > 3 ? std::stoi(argv[3]) : 64;
+  const int seconds = argc > 4 ? std::stoi(argv[4]) : 10;
+  const std::size_t file_size = argc > 5 ? std::stoul(argv[5]) : 4096;
+  const unsigned short port = 18081;
+
+  const fs::path web_root = fs::temp_directory_path() / fs::unique_path("khttpd-static-bench-%%%%-%%%%");
+  fs::create_directories(web_root / "assets");
+  {
+    std::ofstream file((web_root / "assets" / "app.js").string(), std::ios::binary);
+    const std::string block(4096, 'x');
+    for (std::size_t written = 0; written < file_size; written += block.size())
+    {
+      file.write(block.data(), static_cast<std::streamsize>(std::min(block.size(), file_size - written)));
+    }
+  }
+
+  khttpd::framework::ServerOptions options;
+  options.static_files.cache_enabled = mode != "uncached";
+
+  auto server = std::make_shared<khttpd::framework::Server>(
+    tcp::endpoint{net::ip::make_address("127.0.0.1"), port}, web_root.string(), num_threads, options);
+
+  std::thread server_thread([server]() { server->run(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::atomic<bool> running{true};
+  std::atomic<uint64_t> completed{0};
+  std::atomic<uint64_t> failed{0};
+  std::vector<std::thread> clients;
+  clients.reserve(connections);
+
+  for (int i = 0; i < connections; ++i)
+  {
+    clients.emplace_back([&]()
+    {
+      net::io_context ioc;
+      beast::tcp_stream stream(ioc);
+      beast::error_code ec;
+      stream.connect(tcp::endpoint{net::ip::make_address("127.0.0.1"), port}, ec);
+      if (ec)
+      {
+        ++failed;
+        return;
+      }
+
+      http::request<http::empty_body> req{http::verb::get, "/assets/app.js", 11};
+      req.set(http::field::host, "127.0.0.1");
+      req.keep_alive(true);
+      beast::flat_buffer buffer;
+
+      while (running.load(std::memory_order_relaxed))
+      {
+        http::write(stream, req, ec);
+        if (ec) break;
+        http::response_parser<http::string_body> parser;
+        parser.body_limit(file_size + 1);
+        http::read(stream, buffer, parser, ec);
+        if (ec || parser.get().body().size() != file_size)
+        {
+          if (!ec) ec = http::error::partial_message;
+          break;
+        }
+        completed.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (ec) ++failed;
+      stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+    });
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  running = false;
+  for (auto& t : clients) t.join();
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  const auto& stats = server->get_static_file_stats();
+  const uint64_t hits = stats.hits;
+  const uint64_t misses = stats.misses;
+  server->stop();
+  server_thread.join();
+
+  boost::system::error_code ec;
+  fs::remove_all(web_root, ec);
+
+  fmt::print("mode={} threads={} connections={} file_size={} requests={} failed={} elapsed={:.2f}s "
+             "throughput={:.0f} req/s ({:.1f} MiB/s) cache_hits={} cache_misses={}\n",
+             mode, num_threads, connections, file_size, completed.load(), failed.load(), elapsed,
+             completed.load() / elapsed, completed.load() * static_cast<double>(file_size) / elapsed / (1024 * 1024),
+             hits, misses);
+  return 0;
+}
@@ -0,0 +1,168 @@
+// framework/bench/tls_handshake_bench.cpp
+// 测量 HTTPS 新建连接的速率：每个客户端线程循环执行 连接 -> TLS 握手 -> 一个 GET -> 关闭。
+// full 模式每次都是完整握手；resumed 模式复用上一次连接的会话（TLS 1.3 票据 / TLS 1.2 session id），
+// 两者的差值就是会话恢复省下的非对称运算。证书是启动时生成的 localhost 自签名证书（P-256）。
+//   bazel run //framework/bench:tls_handshake_bench -- full    8 32 10
+//   bazel run //framework/bench:tls_handshake_bench -- resumed 8 32 10
+// 参数依次为：模式 工作线程数 并发客户端数 持续秒数
+#include "framework/server.hpp"
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/filesystem.hpp>
+#include <fmt/core.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+namespace fs = boost::filesystem;
+using tcp = net::ip::tcp;
+
+static khttpd::framework::TlsCertificate write_localhost_certificate(const fs::path& dir)
+{
+  EVP_PKEY* key = nullptr;
+  EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+  EVP_PKEY_keygen_init(key_ctx);
+  EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1);
+  EVP_PKEY_keygen(key_ctx, &key);
+  EVP_PKEY_CTX_free(key_ctx);
+
+  X509* cert = X509_new();
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+  X509_set_pubkey(cert, key);
+  X509_NAME* name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  X509_sign(cert, key, EVP_sha256());
+
+  khttpd::framework::TlsCertificate result{(dir / "localhost.crt").string(), (dir / "localhost.key").string()};
+  FILE* out = std::fopen(result.certificate_chain_file.c_str(), "wb");
+  PEM_write_X509(out, cert);
+  std::fclose(out);
+  out = std::fopen(result.private_key_file.c_str(), "wb");
+  PEM_write_PrivateKey(out, key, nullptr, nullptr, 0, nullptr, nullptr);
+  std::fclose(out);
+
+  X509_free(cert);
+  EVP_PKEY_free(key);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  const std::string mode = argc > 1 ? argv[1] : "full";
+  const int num_threads = argc > 2 ? std::stoi(argv[2]) : static_cast<int>(std::thread::hardware_concurrency());
+  const int clients_count = argc > 3 ? std::stoi(argv[3]) : 32;
+  const int seconds = argc > 4 ? std::stoi(argv[4]) : 10;
+  const unsigned short port = 18082;
+  const bool resume = mode == "resumed";
+
+  const fs::path web_root = fs::temp_directory_path() / fs::unique_path("khttpd-tls-bench-%%%%-%%%%");
+  fs::create_directories(web_root);
+
+  khttpd::framework::ServerOptions options;
+  options.ssl_context = khttpd::framework::make_server_ssl_context({write_localhost_certificate(web_root)});
+
+  auto server = std::make_shared<khttpd::framework::Server>(
+    tcp::endpoint{net::ip::make_address("127.0.0.1"), port}, web_root.string(), num_threads, options);
+  server->get_http_router().get("/hello", [](khttpd::framework::HttpContext& ctx)
+  {
+    ctx.set_body("hello");
+  });
+
+  std::thread server_thread([server]() { server->run(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::atomic<bool> running{true};
+  std::atomic<uint64_t> completed{0};
+  std::atomic<uint64_t> reused{0};
+  std::atomic<uint64_t> failed{0};
+  std::vector<std::thread> clients;
+  clients.reserve(clients_count);
+  for (int i = 0; i < clients_count; ++i)
+  {
+    clients.emplace_back([&]()
+    {
+      net::io_context ioc;
+      ssl::context ctx{ssl::context::tls_client};
+      ctx.set_verify_mode(ssl::verify_none);
+      SSL_CTX_set_session_cache_mode(ctx.native_handle(), SSL_SESS_CACHE_CLIENT);
+      SSL_SESSION* session = nullptr;
+
+      http::request<http::empty_body> req{http::verb::get, "/hello", 11};
+      req.set(http::field::host, "localhost");
+      req.keep_alive(false);
+
+      while (running.load(std::memory_order_relaxed))
+      {
+        beast::ssl_stream<beast::tcp_stream> stream(ioc, ctx);
+        SSL_set_tlsext_host_name(stream.native_handle(), "localhost");
+        if (session)
+        {
+          SSL_set_session(stream.native_handle(), session);
+        }
+        beast::error_code ec;
+        beast::get_lowest_layer(stream).connect(tcp::endpoint{net::ip::make_address("127.0.0.1"), port}, ec);
+        if (!ec) stream.handshake(ssl::stream_base::client, ec);
+        if (!ec) http::write(stream, req, ec);
+        beast::flat_buffer buffer;
+        http::response<http::string_body> res;
+        if (!ec) http::read(stream, buffer, res, ec);
+        if (ec)
+        {
+          ++failed;
+          break;
+        }
+        completed.fetch_add(1, std::memory_order_relaxed);
+        if (SSL_session_reused(stream.native_handle()))
+        {
+          reused.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (resume)
+        {
+          // TLS 1.3 的票据在握手之后随应用数据到达，读完响应再取会话
+          if (session) SSL_SESSION_free(session);
+          session = SSL_get1_session(stream.native_handle());
+        }
+        stream.shutdown(ec);
+      }
+      if (session) SSL_SESSION_free(session);
+    });
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  running = false;
+  for (auto& t : clients) t.join();
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  const auto& stats = server->get_session_stats();
+  const uint64_t handshakes = stats.tls_handshakes;
+  const uint64_t resumed = stats.tls_resumed_handshakes;
+  server->stop();
+  server_thread.join();
+
+  boost::system::error_code ec;
+  fs::remove_all(web_root, ec);
+
+  fmt::print("mode={} threads={} clients={} connections={} failed={} elapsed={:.2f}s rate={:.0f} conn/s "
+             "client_reused={} server_handshakes={} server_resumed={}\n",
+             mode, num_threads, clients_count, completed.load(), failed.load(), elapsed,
+             completed.load() / elapsed, reused.load(), handshakes, resumed);
+  return 0;
+}
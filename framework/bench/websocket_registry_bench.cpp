@@ -0,0 +1,167 @@
+// framework/bench/websocket_registry_bench.cpp
+// 测量 WebSocket 会话注册表在连接频繁建立和断开时的吞吐：先放入一批常驻会话，再由多个线程
+// 循环执行 打开（add）-> 按 id 批量发送（查找 batch 个 id）-> 关闭（remove）。
+// global 模式复现原来的做法：一个 std::map 加一把互斥锁，关闭时线性查找；sharded 模式使用 WebsocketSessionRegistry。
+// 不建立网络连接，会话使用未打开的 socket，只测注册表本身。
+//   bazel run //framework/bench:websocket_registry_bench -- global  8 100000 10
+//   bazel run //framework/bench:websocket_registry_bench -- sharded 8 100000 10
+// 参数依次为：模式 线程数 常驻会话数 持续秒数
+#include "framework/websocket/websocket_session.hpp"
+#include "framework/websocket/websocket_session_registry.hpp"
+#include <fmt/core.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using khttpd::framework::WebsocketRouter;
+using khttpd::framework::WebsocketSession;
+using khttpd::framework::WebsocketSessionRegistry;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+namespace
+{
+  class GlobalRegistry
+  {
+  public:
+    void add(const std::shared_ptr<WebsocketSession>& session)
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      sessions_[session->id] = session;
+    }
+
+    void remove(const std::string& id)
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      for (auto item = sessions_.begin(); item != sessions_.end(); ++item)
+      {
+        if (item->first == id)
+        {
+          sessions_.erase(item);
+          break;
+        }
+      }
+    }
+
+    std::vector<std::shared_ptr<WebsocketSession>> find(const std::vector<std::string>& ids)
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      std::vector<std::shared_ptr<WebsocketSession>> found;
+      for (const auto& id : ids)
+      {
+        const auto item = sessions_.find(id);
+        if (item != sessions_.end())
+        {
+          found.push_back(item->second);
+        }
+      }
+      return found;
+    }
+
+  private:
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<WebsocketSession>> sessions_;
+  };
+
+  constexpr int sessions_per_thread = 64;
+  constexpr int batch = 32;
+
+  template <class Registry>
+  std::uint64_t run(Registry& registry, const std::vector<std::shared_ptr<WebsocketSession>>& resident,
+                    const std::vector<std::vector<std::shared_ptr<WebsocketSession>>>& churn, int seconds)
+  {
+    for (const auto& session : resident)
+    {
+      registry.add(session);
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<std::uint64_t> cycles{0};
+    std::vector<std::thread> threads;
+    for (const auto& own : churn)
+    {
+      threads.emplace_back([&registry, &resident, &own, &stop, &cycles]
+      {
+        std::mt19937 rng(std::random_device{}());
+        std::uniform_int_distribution<std::size_t> pick(0, resident.size() - 1);
+        std::vector<std::string> ids(batch);
+        std::uint64_t local = 0;
+        while (!stop.load(std::memory_order_relaxed))
+        {
+          for (const auto& session : own)
+          {
+            registry.add(session);
+          }
+          for (auto& id : ids)
+          {
+            id = resident[pick(rng)]->id;
+          }
+          if (registry.find(ids).size() != ids.size())
+          {
+            std::abort();
+          }
+          for (const auto& session : own)
+          {
+            registry.remove(session->id);
+          }
+          ++local;
+        }
+        cycles.fetch_add(local * own.size());
+      });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+    return cycles.load();
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  const std::string mode = argc > 1 ? argv[1] : "sharded";
+  const int num_threads = argc > 2 ? std::stoi(argv[2]) : static_cast<int>(std::thread::hardware_concurrency());
+  const int resident_count = argc > 3 ? std::stoi(argv[3]) : 100000;
+  const int seconds = argc > 4 ? std::stoi(argv[4]) : 10;
+
+  net::io_context ioc;
+  WebsocketRouter router;
+  std::vector<std::shared_ptr<WebsocketSession>> resident;
+  resident.reserve(resident_count);
+  for (int i = 0; i < resident_count; ++i)
+  {
+    resident.push_back(std::make_shared<WebsocketSession>(tcp::socket(ioc), router, "/bench"));
+  }
+  std::vector<std::vector<std::shared_ptr<WebsocketSession>>> churn(num_threads);
+  for (auto& own : churn)
+  {
+    for (int i = 0; i < sessions_per_thread; ++i)
+    {
+      own.push_back(std::make_shared<WebsocketSession>(tcp::socket(ioc), router, "/bench"));
+    }
+  }
+
+  std::uint64_t connections;
+  if (mode == "global")
+  {
+    GlobalRegistry registry;
+    connections = run(registry, resident, churn, seconds);
+  }
+  else
+  {
+    WebsocketSessionRegistry registry;
+    connections = run(registry, resident, churn, seconds);
+  }
+
+  fmt::print("mode: {}, threads: {}, resident sessions: {}\n", mode, num_threads, resident_count);
+  fmt::print("open/close: {:.0f}/s, bulk sends of {}: {:.0f}/s\n", static_cast<double>(connections) / seconds, batch,
+             static_cast<double>(connections) / sessions_per_thread / seconds);
+  return 0;
+}
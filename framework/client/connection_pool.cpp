@@ -0,0 +1,288 @@
+#include "connection_pool.hpp"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <optional>
+
+namespace khttpd::framework::client
+{
+  PooledConnection::PooledConnection(net::io_context& ioc)
+    : stream(std::in_place_type<PlainStream>, ioc)
+  {
+  }
+
+  PooledConnection::PooledConnection(net::io_context& ioc, ssl::context& ssl_ctx)
+    : stream(std::in_place_type<SslStream>, ioc, ssl_ctx)
+  {
+  }
+
+  beast::tcp_stream& PooledConnection::lowest_layer()
+  {
+    return with_stream([](auto& s) -> beast::tcp_stream& { return beast::get_lowest_layer(s); });
+  }
+
+  bool PooledConnection::healthy()
+  {
+    auto& socket = lowest_layer().socket();
+    // 上一个响应之后还有没读完的数据，说明连接上的消息边界已经乱了
+    if (!socket.is_open() || buffer.size() > 0)
+    {
+      return false;
+    }
+
+    // 非阻塞地窥探一个字节：would_block 表示连接空闲且完好，EOF 或错误表示对端已关闭
+    beast::error_code ec;
+    const bool non_blocking = socket.non_blocking();
+    socket.non_blocking(true, ec);
+    char byte;
+    const std::size_t n = socket.receive(net::buffer(&byte, 1), net::socket_base::message_peek, ec);
+    beast::error_code ignored;
+    socket.non_blocking(non_blocking, ignored);
+    if (ec == net::error::would_block)
+    {
+      return true;
+    }
+    if (ec || n == 0)
+    {
+      return false;
+    }
+    // 明文连接上不该有未请求的数据；TLS 连接上可能是握手之后的会话票据等记录，留给下一次读取
+    return std::holds_alternative<SslStream>(stream);
+  }
+
+  void PooledConnection::close()
+  {
+    beast::error_code ec;
+    auto& socket = lowest_layer().socket();
+    socket.shutdown(net::ip::tcp::socket::shutdown_both, ec);
+    socket.close(ec);
+  }
+
+  ConnectionPool::ConnectionPool(net::io_context& ioc, ConnectionPoolOptions options)
+    : ioc_(ioc), options_(options), sweep_timer_(ioc)
+  {
+  }
+
+  ConnectionPool::~ConnectionPool()
+  {
+    close_idle();
+  }
+
+  std::string ConnectionPool::make_key(const std::string& scheme, const std::string& host, const std::string& port)
+  {
+    return scheme + "://" + host + ":" + port;
+  }
+
+  void ConnectionPool::evict_expired_locked(Host& host, const std::chrono::steady_clock::time_point now)
+  {
+    auto& idle = host.idle;
+    const auto expired = std::remove_if(idle.begin(), idle.end(), [&](const auto& conn)
+    {
+      if (now - conn->idle_since < options_.idle_timeout)
+      {
+        return false;
+      }
+      conn->close();
+      return true;
+    });
+    const auto count = static_cast<std::size_t>(idle.end() - expired);
+    idle.erase(expired, idle.end());
+    host.open -= count;
+    stats_.connections_evicted.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  void ConnectionPool::schedule_sweep_locked()
+  {
+    if (sweep_scheduled_)
+    {
+      return;
+    }
+    // 空闲列表按归还顺序排列，每个主机的第一条最早到期
+    std::optional<std::chrono::steady_clock::time_point> earliest;
+    for (const auto& [key, host] : hosts_)
+    {
+      if (!host.idle.empty() && (!earliest || host.idle.front()->idle_since < *earliest))
+      {
+        earliest = host.idle.front()->idle_since;
+      }
+    }
+    if (!earliest)
+    {
+      return;
+    }
+    sweep_scheduled_ = true;
+    sweep_timer_.expires_at(*earliest + options_.idle_timeout);
+    // 定时器不延长连接池的生命周期，连接池销毁后回调什么都不做
+    sweep_timer_.async_wait([weak = weak_from_this()](const beast::error_code& ec)
+    {
+      if (const auto self = weak.lock())
+      {
+        self->on_sweep(ec);
+      }
+    });
+  }
+
+  void ConnectionPool::on_sweep(const beast::error_code ec)
+  {
+    // 被 close_idle 取消；之后的调度已经不再等待这次回调
+    if (ec == net::error::operation_aborted)
+    {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    sweep_scheduled_ = false;
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = hosts_.begin(); it != hosts_.end();)
+    {
+      evict_expired_locked(it->second, now);
+      if (it->second.open == 0 && it->second.waiters.empty())
+      {
+        it = hosts_.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+    schedule_sweep_locked();
+  }
+
+  void ConnectionPool::acquire(const std::string& key, AcquireHandler handler)
+  {
+    std::shared_ptr<PooledConnection> conn;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Host& host = hosts_[key];
+      evict_expired_locked(host, std::chrono::steady_clock::now());
+      if (!host.idle.empty())
+      {
+        conn = std::move(host.idle.back());
+        host.idle.pop_back();
+      }
+      else if (!options_.enabled || options_.max_connections_per_host == 0 ||
+        host.open < options_.max_connections_per_host)
+      {
+        ++host.open;
+        stats_.connections_created.fetch_add(1, std::memory_order_relaxed);
+      }
+      else
+      {
+        host.waiters.push_back(std::move(handler));
+        stats_.requests_queued.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+
+    // 检查要窥探套接字，在锁外进行。失败的连接占用的名额留给下一条空闲连接，没有的话用来新建连接
+    while (conn && !conn->healthy())
+    {
+      conn->close();
+      conn.reset();
+      stats_.connections_evicted.fetch_add(1, std::memory_order_relaxed);
+      std::lock_guard<std::mutex> lock(mutex_);
+      Host& host = hosts_[key];
+      if (host.idle.empty())
+      {
+        stats_.connections_created.fetch_add(1, std::memory_order_relaxed);
+        break;
+      }
+      --host.open;
+      conn = std::move(host.idle.back());
+      host.idle.pop_back();
+    }
+    if (conn)
+    {
+      stats_.connections_reused.fetch_add(1, std::memory_order_relaxed);
+    }
+    handler(std::move(conn));
+  }
+
+  void ConnectionPool::release(const std::string& key, std::shared_ptr<PooledConnection> conn, bool reusable)
+  {
+    AcquireHandler waiter;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Host& host = hosts_[key];
+      reusable = reusable && conn && options_.enabled &&
+        (options_.max_requests_per_connection == 0 || conn->requests < options_.max_requests_per_connection);
+      if (reusable)
+      {
+        conn->idle_since = std::chrono::steady_clock::now();
+        if (!host.waiters.empty())
+        {
+          // 直接交给排队的请求，不经过空闲列表
+          waiter = std::move(host.waiters.front());
+          host.waiters.pop_front();
+          stats_.connections_reused.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+          host.idle.push_back(std::move(conn));
+          schedule_sweep_locked();
+        }
+      }
+      else
+      {
+        if (conn)
+        {
+          conn->close();
+          conn.reset();
+        }
+        // 名额转给排队的请求，由它新建连接
+        if (!host.waiters.empty())
+        {
+          waiter = std::move(host.waiters.front());
+          host.waiters.pop_front();
+          stats_.connections_created.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (--host.open == 0)
+        {
+          hosts_.erase(key);
+        }
+      }
+    }
+    if (waiter)
+    {
+      net::post(ioc_, [waiter = std::move(waiter), conn = std::move(conn)]() mutable { waiter(std::move(conn)); });
+    }
+  }
+
+  std::size_t ConnectionPool::idle_count(const std::string& key) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = hosts_.find(key);
+    return it == hosts_.end() ? 0 : it->second.idle.size();
+  }
+
+  std::size_t ConnectionPool::open_count(const std::string& key) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = hosts_.find(key);
+    return it == hosts_.end() ? 0 : it->second.open;
+  }
+
+  void ConnectionPool::close_idle()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = hosts_.begin(); it != hosts_.end();)
+    {
+      auto& host = it->second;
+      for (const auto& conn : host.idle)
+      {
+        conn->close();
+      }
+      host.open -= host.idle.size();
+      stats_.connections_evicted.fetch_add(host.idle.size(), std::memory_order_relaxed);
+      host.idle.clear();
+      if (host.open == 0 && host.waiters.empty())
+      {
+        it = hosts_.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+    sweep_timer_.cancel();
+    sweep_scheduled_ = false;
+  }
+}
@@ -0,0 +1,155 @@
+#ifndef KHTTPD_FRAMEWORK_CLIENT_CONNECTION_POOL_HPP
+#define KHTTPD_FRAMEWORK_CLIENT_CONNECTION_POOL_HPP
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace khttpd::framework::client
+{
+  namespace beast = boost::beast;
+  namespace net = boost::asio;
+  namespace ssl = boost::asio::ssl;
+
+  // 复用的空闲连接在收到响应之前失败时，是否换一条新连接重发请求。
+  // 这时无法知道服务端是否已经处理了请求，重发非幂等请求可能让它执行两次
+  enum class RetryPolicy
+  {
+    // 不重发，直接报告错误
+    never,
+    // 只重发幂等方法（GET、HEAD、OPTIONS、TRACE、PUT、DELETE）；请求一个字节都没写出时任何方法都重发
+    idempotent,
+    // 任何方法都重发
+    always,
+  };
+
+  struct ConnectionPoolOptions
+  {
+    // 关闭时每个请求使用新连接，并带上 Connection: close
+    bool enabled = true;
+    // 每个 scheme://host:port 同时打开的连接数上限，用满后新请求排队等待空闲连接；0 表示不限
+    std::size_t max_connections_per_host = 8;
+    // 空闲超过这个时间的连接由定时器关闭
+    std::chrono::seconds idle_timeout{60};
+    // 一个连接最多发送的请求数，之后不再放回池中；0 表示不限
+    std::size_t max_requests_per_connection = 0;
+    RetryPolicy retry = RetryPolicy::idempotent;
+  };
+
+  struct ConnectionPoolStats
+  {
+    // 新建的连接数，以及复用空闲连接发送的请求数
+    std::atomic<uint64_t> connections_created{0};
+    std::atomic<uint64_t> connections_reused{0};
+    // 因空闲超时或取用时检查到对端已关闭而丢弃的空闲连接数
+    std::atomic<uint64_t> connections_evicted{0};
+    // 复用的连接在收到响应之前失败、改用新连接重发的请求数
+    std::atomic<uint64_t> requests_retried{0};
+    // 因连接数达到上限而排队的请求数
+    std::atomic<uint64_t> requests_queued{0};
+  };
+
+  // 连接池中的一条连接，HTTP 与 HTTPS 共用
+  class PooledConnection
+  {
+  public:
+    using PlainStream = beast::tcp_stream;
+    using SslStream = beast::ssl_stream<beast::tcp_stream>;
+
+    explicit PooledConnection(net::io_context& ioc);
+    PooledConnection(net::io_context& ioc, ssl::context& ssl_ctx);
+
+    std::variant<PlainStream, SslStream> stream;
+    // 跨请求保留，响应之后已经读入的数据属于下一个响应
+    beast::flat_buffer buffer;
+    std::size_t requests = 0;
+    std::chrono::steady_clock::time_point idle_since;
+
+    // 读写操作通过 with_stream 按实际的流类型发起
+    template <class F>
+    decltype(auto) with_stream(F&& f)
+    {
+      return std::visit(std::forward<F>(f), stream);
+    }
+
+    beast::tcp_stream& lowest_layer();
+    // 取用空闲连接前的检查：套接字仍然打开，对端没有关闭连接，明文连接上也没有多余的数据
+    bool healthy();
+    void close();
+  };
+
+  // 按 scheme://host:port 分组的 keep-alive 连接池。
+  // acquire 取出一条健康的空闲连接；没有空闲连接时，在上限以内授予一个新建连接的名额（回调参数为空），
+  // 否则排队，直到有连接归还或关闭。每个 acquire 都必须以一次 release 结束。
+  // 有空闲连接期间，io_context 上保留一个清理过期连接的定时器；close_idle 关闭全部空闲连接并取消它
+  class ConnectionPool : public std::enable_shared_from_this<ConnectionPool>
+  {
+  public:
+    // 参数为空表示由调用方新建连接
+    using AcquireHandler = std::function<void(std::shared_ptr<PooledConnection>)>;
+
+    ConnectionPool(net::io_context& ioc, ConnectionPoolOptions options = {});
+    ~ConnectionPool();
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    static std::string make_key(const std::string& scheme, const std::string& host, const std::string& port);
+
+    const ConnectionPoolOptions& options() const { return options_; }
+    const ConnectionPoolStats& stats() const { return stats_; }
+
+    // 没有排队时 handler 在调用线程上同步执行，排队的 handler 投递到 io_context 上执行
+    void acquire(const std::string& key, AcquireHandler handler);
+    // reusable 为 false 或连接为空时关闭连接、释放名额
+    void release(const std::string& key, std::shared_ptr<PooledConnection> conn, bool reusable);
+    // 复用的连接失败、改用新连接重发时调用，名额保持不变
+    void record_retry()
+    {
+      stats_.requests_retried.fetch_add(1, std::memory_order_relaxed);
+      stats_.connections_created.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::size_t idle_count(const std::string& key) const;
+    std::size_t open_count(const std::string& key) const;
+    void close_idle();
+
+  private:
+    struct Host
+    {
+      // 后归还的先取用，较早的连接更快超时关闭
+      std::vector<std::shared_ptr<PooledConnection>> idle;
+      // 空闲与正在使用的连接数，包括已授予、正在建立的连接
+      std::size_t open = 0;
+      std::deque<AcquireHandler> waiters;
+    };
+
+    net::io_context& ioc_;
+    ConnectionPoolOptions options_;
+    ConnectionPoolStats stats_;
+    mutable std::mutex mutex_;
+    // 没有连接也没有排队请求的主机不保留条目
+    std::unordered_map<std::string, Host> hosts_;
+    // 按最早到期的空闲连接触发；只在持有 mutex_ 时操作
+    net::steady_timer sweep_timer_;
+    bool sweep_scheduled_ = false;
+
+    void evict_expired_locked(Host& host, std::chrono::steady_clock::time_point now);
+    void schedule_sweep_locked();
+    void on_sweep(beast::error_code ec);
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_CLIENT_CONNECTION_POOL_HPP
@@ -0,0 +1,308 @@
+#include "dns_cache.hpp"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <charconv>
+
+namespace khttpd::framework::client
+{
+  namespace
+  {
+    // host 本身是 IP 地址、port 是数字时不需要解析
+    bool parse_literal(const std::string& host, const std::string& port, tcp::endpoint& endpoint)
+    {
+      unsigned short port_number = 0;
+      const auto* end = port.data() + port.size();
+      const auto [ptr, ec] = std::from_chars(port.data(), end, port_number);
+      if (ec != std::errc() || ptr != end)
+      {
+        return false;
+      }
+      beast::error_code address_ec;
+      // URL 中的 IPv6 地址可能仍带着方括号
+      std::string address = host;
+      if (address.size() > 2 && address.front() == '[' && address.back() == ']')
+      {
+        address = address.substr(1, address.size() - 2);
+      }
+      const auto ip = net::ip::make_address(address, address_ec);
+      if (address_ec)
+      {
+        return false;
+      }
+      endpoint = tcp::endpoint(ip, port_number);
+      return true;
+    }
+  }
+
+  DnsCache::DnsCache(DnsCacheOptions options, Resolver resolver)
+    : options_(options), resolver_(std::move(resolver))
+  {
+    if (resolver_)
+    {
+      return;
+    }
+    resolver_ioc_ = std::make_shared<net::io_context>(1);
+    resolver_work_.emplace(net::make_work_guard(*resolver_ioc_));
+    // 线程持有 io_context，析构发生在解析线程上时也要等 run() 返回后才销毁它
+    resolver_thread_ = std::thread([ioc = resolver_ioc_] { ioc->run(); });
+    resolver_ = [ioc = resolver_ioc_.get()](const net::any_io_executor&, const std::string& host,
+                                            const std::string& port, ResolveHandler handler)
+    {
+      auto resolver = std::make_shared<tcp::resolver>(*ioc);
+      resolver->async_resolve(host, port, [resolver, handler = std::move(handler)](
+                            beast::error_code ec, tcp::resolver::results_type results)
+                              {
+                                Endpoints endpoints;
+                                endpoints.reserve(results.size());
+                                for (const auto& entry : results)
+                                {
+                                  endpoints.push_back(entry.endpoint());
+                                }
+                                handler(ec, std::move(endpoints));
+                              });
+    };
+  }
+
+  DnsCache::~DnsCache()
+  {
+    if (!resolver_thread_.joinable())
+    {
+      return;
+    }
+    resolver_work_.reset();
+    resolver_ioc_->stop();
+    // 最后一个引用可能在解析完成的回调中释放，此时不能 join 自己
+    if (resolver_thread_.get_id() == std::this_thread::get_id())
+    {
+      resolver_thread_.detach();
+    }
+    else
+    {
+      resolver_thread_.join();
+    }
+  }
+
+  std::shared_ptr<DnsCache> DnsCache::instance()
+  {
+    static const auto cache = std::make_shared<DnsCache>();
+    return cache;
+  }
+
+  DnsCache::Endpoints DnsCache::rotate(Entry& entry)
+  {
+    const auto& endpoints = entry.endpoints;
+    if (endpoints.size() < 2)
+    {
+      return endpoints;
+    }
+    const auto start = entry.next++ % endpoints.size();
+    Endpoints rotated;
+    rotated.reserve(endpoints.size());
+    rotated.insert(rotated.end(), endpoints.begin() + static_cast<std::ptrdiff_t>(start), endpoints.end());
+    rotated.insert(rotated.end(), endpoints.begin(), endpoints.begin() + static_cast<std::ptrdiff_t>(start));
+    return rotated;
+  }
+
+  void DnsCache::resolve(const net::any_io_executor& executor, const std::string& host, const std::string& port,
+                         ResolveHandler handler)
+  {
+    tcp::endpoint literal;
+    if (parse_literal(host, port, literal))
+    {
+      return handler({}, Endpoints{literal});
+    }
+
+    if (!options_.enabled)
+    {
+      stats_.lookups.fetch_add(1, std::memory_order_relaxed);
+      resolver_(executor, host, port, [executor, handler = std::move(handler)](beast::error_code ec, Endpoints endpoints)
+      {
+        net::post(executor, [handler, ec, endpoints = std::move(endpoints)]() mutable
+        {
+          handler(ec, std::move(endpoints));
+        });
+      });
+      return;
+    }
+
+    const std::string key = host + ":" + port;
+    Endpoints endpoints;
+    bool refresh = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto now = std::chrono::steady_clock::now();
+      auto it = entries_.find(key);
+      if (it != entries_.end() && !it->second.endpoints.empty())
+      {
+        Entry& entry = it->second;
+        if (now < entry.expires)
+        {
+          stats_.hits.fetch_add(1, std::memory_order_relaxed);
+          endpoints = rotate(entry);
+        }
+        else if (now < entry.expires + options_.stale_ttl)
+        {
+          stats_.stale_hits.fetch_add(1, std::memory_order_relaxed);
+          endpoints = rotate(entry);
+          refresh = !entry.resolving;
+          entry.resolving = true;
+        }
+        else
+        {
+          // 超过了可用旧结果的时间，只能等待新的解析
+          entry.endpoints.clear();
+        }
+      }
+
+      if (endpoints.empty())
+      {
+        if (it != entries_.end() && it->second.resolving)
+        {
+          stats_.coalesced.fetch_add(1, std::memory_order_relaxed);
+          it->second.waiters.push_back({executor, std::move(handler)});
+          return;
+        }
+        stats_.misses.fetch_add(1, std::memory_order_relaxed);
+        if (it == entries_.end())
+        {
+          trim_locked(now);
+          it = entries_.emplace(key, Entry{}).first;
+        }
+        it->second.resolving = true;
+        it->second.waiters.push_back({executor, std::move(handler)});
+      }
+    }
+
+    if (endpoints.empty() || refresh)
+    {
+      lookup(key, executor, host, port);
+    }
+    if (!endpoints.empty())
+    {
+      handler({}, std::move(endpoints));
+    }
+  }
+
+  void DnsCache::lookup(const std::string& key, const net::any_io_executor& executor, const std::string& host,
+                        const std::string& port)
+  {
+    stats_.lookups.fetch_add(1, std::memory_order_relaxed);
+    resolver_(executor, host, port, [self = shared_from_this(), key](beast::error_code ec, Endpoints endpoints)
+    {
+      self->on_lookup(key, ec, std::move(endpoints));
+    });
+  }
+
+  void DnsCache::on_lookup(const std::string& key, beast::error_code ec, Endpoints endpoints)
+  {
+    std::vector<Waiter> waiters;
+    std::vector<Endpoints> results;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto now = std::chrono::steady_clock::now();
+      const auto it = entries_.find(key);
+      if (it == entries_.end())
+      {
+        return;
+      }
+      Entry& entry = it->second;
+      entry.resolving = false;
+      waiters = std::move(entry.waiters);
+      entry.waiters.clear();
+
+      if (!ec && !endpoints.empty())
+      {
+        entry.endpoints = std::move(endpoints);
+        entry.expires = now + options_.ttl;
+        entry.next = 0;
+        results.reserve(waiters.size());
+        for (std::size_t i = 0; i < waiters.size(); ++i)
+        {
+          results.push_back(rotate(entry));
+        }
+      }
+      else
+      {
+        stats_.failures.fetch_add(1, std::memory_order_relaxed);
+        if (!ec)
+        {
+          ec = net::error::host_not_found;
+        }
+        // 失败的结果不缓存；还在可用期内的旧结果继续使用
+        if (entry.endpoints.empty() || now >= entry.expires + options_.stale_ttl)
+        {
+          entries_.erase(it);
+        }
+      }
+    }
+
+    for (std::size_t i = 0; i < waiters.size(); ++i)
+    {
+      auto& waiter = waiters[i];
+      Endpoints result = results.empty() ? Endpoints{} : std::move(results[i]);
+      net::post(waiter.executor, [handler = std::move(waiter.handler), ec, result = std::move(result)]() mutable
+      {
+        handler(ec, std::move(result));
+      });
+    }
+  }
+
+  void DnsCache::trim_locked(const std::chrono::steady_clock::time_point now)
+  {
+    if (options_.max_entries == 0 || entries_.size() < options_.max_entries)
+    {
+      return;
+    }
+    // 正在解析的条目上挂着等待的请求，不能丢弃
+    for (auto it = entries_.begin(); it != entries_.end();)
+    {
+      if (!it->second.resolving && now >= it->second.expires + options_.stale_ttl)
+      {
+        it = entries_.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+    while (entries_.size() >= options_.max_entries)
+    {
+      auto oldest = entries_.end();
+      for (auto it = entries_.begin(); it != entries_.end(); ++it)
+      {
+        if (!it->second.resolving && (oldest == entries_.end() || it->second.expires < oldest->second.expires))
+        {
+          oldest = it;
+        }
+      }
+      if (oldest == entries_.end())
+      {
+        return;
+      }
+      entries_.erase(oldest);
+    }
+  }
+
+  std::size_t DnsCache::size() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  void DnsCache::clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();)
+    {
+      if (it->second.resolving)
+      {
+        it->second.endpoints.clear();
+        ++it;
+      }
+      else
+      {
+        it = entries_.erase(it);
+      }
+    }
+  }
+}
@@ -0,0 +1,120 @@
+#ifndef KHTTPD_FRAMEWORK_CLIENT_DNS_CACHE_HPP
+#define KHTTPD_FRAMEWORK_CLIENT_DNS_CACHE_HPP
+
+#include <boost/beast/core/error.hpp>
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace khttpd::framework::client
+{
+  namespace beast = boost::beast;
+  namespace net = boost::asio;
+  using tcp = boost::asio::ip::tcp;
+
+  struct DnsCacheOptions
+  {
+    // 关闭时每次都直接解析，不缓存也不合并
+    bool enabled = true;
+    // 解析结果的有效期
+    std::chrono::milliseconds ttl = std::chrono::seconds(60);
+    // 过期之后仍可使用的时间：期间直接返回旧结果，同时在后台刷新；刷新失败时继续使用旧结果
+    std::chrono::milliseconds stale_ttl = std::chrono::seconds(300);
+    // 缓存的主机数上限，超出时先丢弃彻底过期的条目，再丢弃最早过期的条目
+    std::size_t max_entries = 1024;
+  };
+
+  struct DnsCacheStats
+  {
+    // 命中未过期结果、命中过期结果（同时后台刷新）与需要等待解析的次数
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> stale_hits{0};
+    std::atomic<uint64_t> misses{0};
+    // 同一主机已有解析在进行，合并到该次解析上的请求数
+    std::atomic<uint64_t> coalesced{0};
+    // 实际发起的解析次数，以及其中失败的次数
+    std::atomic<uint64_t> lookups{0};
+    std::atomic<uint64_t> failures{0};
+  };
+
+  // 所有客户端共用的 DNS 缓存。
+  // 相同 host:port 的并发解析合并为一次；结果按 ttl 缓存，过期后在 stale_ttl 内先返回旧结果再后台刷新；
+  // 解析出多个 A/AAAA 地址时，每次返回的列表从下一个地址开始轮换，连接失败时仍会依次尝试其余地址
+  class DnsCache : public std::enable_shared_from_this<DnsCache>
+  {
+  public:
+    using Endpoints = std::vector<tcp::endpoint>;
+    using ResolveHandler = std::function<void(beast::error_code, Endpoints)>;
+    // 实际的解析函数，完成时可以在任意线程调用 handler，executor 是发起解析的请求所在的执行器。
+    // 默认在缓存自己的解析线程上使用 tcp::resolver（getaddrinfo），不依赖调用方的线程，测试可以替换
+    using Resolver = std::function<void(const net::any_io_executor& executor, const std::string& host,
+                                        const std::string& port, ResolveHandler handler)>;
+
+    explicit DnsCache(DnsCacheOptions options = {}, Resolver resolver = {});
+    ~DnsCache();
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+
+    // HttpClient 与 WebsocketClient 默认使用的全局缓存
+    static std::shared_ptr<DnsCache> instance();
+
+    // 命中缓存或 host 是 IP 地址时 handler 在调用线程上同步执行，否则投递到 executor 上执行
+    void resolve(const net::any_io_executor& executor, const std::string& host, const std::string& port,
+                 ResolveHandler handler);
+
+    const DnsCacheOptions& options() const { return options_; }
+    const DnsCacheStats& stats() const { return stats_; }
+
+    std::size_t size() const;
+    void clear();
+
+  private:
+    struct Waiter
+    {
+      net::any_io_executor executor;
+      ResolveHandler handler;
+    };
+
+    struct Entry
+    {
+      Endpoints endpoints;
+      std::chrono::steady_clock::time_point expires;
+      // 轮换的起点
+      std::size_t next = 0;
+      bool resolving = false;
+      std::vector<Waiter> waiters;
+    };
+
+    DnsCacheOptions options_;
+    Resolver resolver_;
+    DnsCacheStats stats_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    // 默认解析函数使用的 io_context 与线程：合并到同一次解析上的请求可能来自不同的线程，
+    // 解析的完成不能依赖其中任何一个线程空闲
+    std::shared_ptr<net::io_context> resolver_ioc_;
+    std::optional<net::executor_work_guard<net::io_context::executor_type>> resolver_work_;
+    std::thread resolver_thread_;
+
+    static Endpoints rotate(Entry& entry);
+    void lookup(const std::string& key, const net::any_io_executor& executor, const std::string& host,
+                const std::string& port);
+    void on_lookup(const std::string& key, beast::error_code ec, Endpoints endpoints);
+    void trim_locked(std::chrono::steady_clock::time_point now);
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_CLIENT_DNS_CACHE_HPP
@@ -17,177 +17,199 @@ namespace khttpd::framework::client
     return str;
   }
 
+  bool is_idempotent(const http::verb method)
+  {
+    switch (method)
+    {
+    case http::verb::get:
+    case http::verb::head:
+    case http::verb::options:
+    case http::verb::trace:
+    case http::verb::put:
+    case http::verb::delete_:
+      return true;
+    default:
+      return false;
+    }
+  }
+
   // ==========================================
-  // Abstract Session to handle common logic
+  // Session: 一次请求，连接从 ConnectionPool 取用
   // ==========================================
   class Session : public std::enable_shared_from_this<Session>
   {
-  protected:
+    net::io_context& ioc_;
+    ssl::context* ssl_ctx_; // 为空时是明文 HTTP
+    std::shared_ptr<ConnectionPool> pool_;
+    std::string key_;
+    std::string host_;
+    std::string port_;
     HttpClient::ResponseCallback callback_;
     http::request<http::string_body> req_;
-    http::response<http::string_body> res_;
-    beast::flat_buffer buffer_;
+    std::optional<http::response_parser<http::string_body>> parser_;
     std::chrono::seconds timeout_;
+    std::shared_ptr<DnsCache> dns_;
+    std::shared_ptr<PooledConnection> conn_;
+    // 连接来自空闲列表；这样的连接可能已被对端关闭，失败时换新连接重发一次
+    bool reused_ = false;
 
   public:
-    Session(HttpClient::ResponseCallback callback, std::chrono::seconds timeout)
-      : callback_(std::move(callback)), timeout_(timeout)
+    Session(net::io_context& ioc, ssl::context* ssl_ctx, std::shared_ptr<ConnectionPool> pool,
+            std::shared_ptr<DnsCache> dns, HttpClient::ResponseCallback callback, std::chrono::seconds timeout)
+      : ioc_(ioc), ssl_ctx_(ssl_ctx), pool_(std::move(pool)), callback_(std::move(callback)), timeout_(timeout),
+        dns_(std::move(dns))
     {
     }
 
-    virtual ~Session() = default;
-    virtual void run(const std::string& host, const std::string& port, http::request<http::string_body> req) = 0;
-
-  protected:
-    void on_fail(beast::error_code ec, const char* what)
+    void run(const std::string& scheme, const std::string& host, const std::string& port,
+             http::request<http::string_body> req)
     {
-      // Log if needed: std::cerr << what << ": " << ec.message() << "\n";
-      if (callback_) callback_(ec, {});
+      req_ = std::move(req);
+      host_ = host;
+      port_ = port;
+      key_ = ConnectionPool::make_key(scheme, host, port);
+      if (!pool_->options().enabled)
+      {
+        req_.keep_alive(false);
+      }
+      pool_->acquire(key_, [self = shared_from_this()](std::shared_ptr<PooledConnection> conn)
+      {
+        self->on_acquire(std::move(conn));
+      });
     }
-  };
 
-  // ==========================================
-  // Plain HTTP Session
-  // ==========================================
-  class HttpSession : public Session
-  {
-    beast::tcp_stream stream_;
-    tcp::resolver resolver_;
-
-    // Helper: Downcast shared_from_this to avoid template deduction errors
-    std::shared_ptr<HttpSession> get_shared()
+  private:
+    void on_acquire(std::shared_ptr<PooledConnection> conn)
     {
-      return std::static_pointer_cast<HttpSession>(shared_from_this());
+      if (!conn)
+      {
+        return connect();
+      }
+      conn_ = std::move(conn);
+      reused_ = true;
+      send();
     }
 
-  public:
-    HttpSession(net::io_context& ioc, HttpClient::ResponseCallback cb, std::chrono::seconds timeout)
-      : Session(std::move(cb), timeout), stream_(ioc), resolver_(ioc)
+    void connect()
     {
-    }
+      reused_ = false;
+      if (ssl_ctx_)
+      {
+        conn_ = std::make_shared<PooledConnection>(ioc_, *ssl_ctx_);
+        auto& stream = std::get<PooledConnection::SslStream>(conn_->stream);
+        if (!SSL_set_tlsext_host_name(stream.native_handle(), host_.c_str()))
+        {
+          beast::error_code ec{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()};
+          return on_fail(ec, "ssl_setup");
+        }
+      }
+      else
+      {
+        conn_ = std::make_shared<PooledConnection>(ioc_);
+      }
 
-    void run(const std::string& host, const std::string& port, http::request<http::string_body> req) override
-    {
-      req_ = std::move(req);
-      stream_.expires_after(timeout_);
-      resolver_.async_resolve(host, port,
-                              beast::bind_front_handler(&HttpSession::on_resolve, get_shared()));
+      conn_->lowest_layer().expires_after(timeout_);
+      dns_->resolve(ioc_.get_executor(), host_, port_,
+                    beast::bind_front_handler(&Session::on_resolve, shared_from_this()));
     }
 
-    void on_resolve(beast::error_code ec, tcp::resolver::results_type results)
+    void on_resolve(beast::error_code ec, DnsCache::Endpoints endpoints)
     {
       if (ec) return on_fail(ec, "resolve");
-      stream_.expires_after(timeout_);
-      stream_.async_connect(results,
-                            beast::bind_front_handler(&HttpSession::on_connect, get_shared()));
+      conn_->lowest_layer().expires_after(timeout_);
+      conn_->lowest_layer().async_connect(endpoints,
+                                          beast::bind_front_handler(&Session::on_connect, shared_from_this()));
     }
 
-    void on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type)
+    void on_connect(beast::error_code ec, tcp::endpoint)
     {
       if (ec) return on_fail(ec, "connect");
-      stream_.expires_after(timeout_);
-      http::async_write(stream_, req_,
-                        beast::bind_front_handler(&HttpSession::on_write, get_shared()));
-    }
-
-    void on_write(beast::error_code ec, std::size_t bytes_transferred)
-    {
-      boost::ignore_unused(bytes_transferred);
-      if (ec) return on_fail(ec, "write");
-
-      http::async_read(stream_, buffer_, res_,
-                       beast::bind_front_handler(&HttpSession::on_read, get_shared()));
-    }
-
-    void on_read(beast::error_code ec, std::size_t bytes_transferred)
-    {
-      boost::ignore_unused(bytes_transferred);
-      if (ec) return on_fail(ec, "read");
-
-      stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
-      if (callback_) callback_(ec, std::move(res_));
-    }
-  };
-
-  // ==========================================
-  // HTTPS Session
-  // ==========================================
-  class HttpsSession : public Session
-  {
-    beast::ssl_stream<beast::tcp_stream> stream_;
-    tcp::resolver resolver_;
-
-    std::shared_ptr<HttpsSession> get_shared()
-    {
-      return std::static_pointer_cast<HttpsSession>(shared_from_this());
+      if (!ssl_ctx_)
+      {
+        return send();
+      }
+      conn_->lowest_layer().expires_after(timeout_);
+      std::get<PooledConnection::SslStream>(conn_->stream).async_handshake(
+        ssl::stream_base::client, beast::bind_front_handler(&Session::on_handshake, shared_from_this()));
     }
 
-  public:
-    HttpsSession(net::io_context& ioc, ssl::context& ctx, HttpClient::ResponseCallback cb, std::chrono::seconds timeout)
-      : Session(std::move(cb), timeout), stream_(ioc, ctx), resolver_(ioc)
+    void on_handshake(beast::error_code ec)
     {
+      if (ec) return on_fail(ec, "handshake");
+      send();
     }
 
-    void run(const std::string& host, const std::string& port, http::request<http::string_body> req) override
+    void send()
     {
-      req_ = std::move(req);
-      if (!SSL_set_tlsext_host_name(stream_.native_handle(), host.c_str()))
+      conn_->lowest_layer().expires_after(timeout_);
+      conn_->with_stream([this](auto& stream)
       {
-        beast::error_code ec{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()};
-        return on_fail(ec, "ssl_setup");
-      }
-
-      stream_.next_layer().expires_after(timeout_);
-      resolver_.async_resolve(host, port,
-                              beast::bind_front_handler(&HttpsSession::on_resolve, get_shared()));
+        http::async_write(stream, req_, beast::bind_front_handler(&Session::on_write, shared_from_this()));
+      });
     }
 
-    void on_resolve(beast::error_code ec, tcp::resolver::results_type results)
+    void on_write(beast::error_code ec, std::size_t bytes_transferred)
     {
-      if (ec) return on_fail(ec, "resolve");
-      stream_.next_layer().expires_after(timeout_);
-      beast::get_lowest_layer(stream_).async_connect(results,
-                                                     beast::bind_front_handler(
-                                                       &HttpsSession::on_connect, get_shared()));
-    }
+      if (ec) return retry_or_fail(ec, "write", bytes_transferred > 0);
 
-    void on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type)
-    {
-      if (ec) return on_fail(ec, "connect");
-      stream_.next_layer().expires_after(timeout_);
-      stream_.async_handshake(ssl::stream_base::client,
-                              beast::bind_front_handler(&HttpsSession::on_handshake, get_shared()));
+      parser_.emplace();
+      // HEAD 响应的 Content-Length 描述的是 GET 时的响应体，不能按它等待数据
+      parser_->skip(req_.method() == http::verb::head);
+      conn_->lowest_layer().expires_after(timeout_);
+      conn_->with_stream([this](auto& stream)
+      {
+        http::async_read(stream, conn_->buffer, *parser_,
+                         beast::bind_front_handler(&Session::on_read, shared_from_this()));
+      });
     }
 
-    void on_handshake(beast::error_code ec)
+    void on_read(beast::error_code ec, std::size_t bytes_transferred)
     {
-      if (ec) return on_fail(ec, "handshake");
-      stream_.next_layer().expires_after(timeout_);
-      http::async_write(stream_, req_,
-                        beast::bind_front_handler(&HttpsSession::on_write, get_shared()));
+      boost::ignore_unused(bytes_transferred);
+      if (ec) return retry_or_fail(ec, "read", true);
+
+      ++conn_->requests;
+      auto res = parser_->release();
+      // 双方都没有要求关闭时放回池中，交给同一主机的下一个请求
+      const bool reusable = res.keep_alive() && req_.keep_alive();
+      pool_->release(key_, std::move(conn_), reusable);
+      if (callback_) callback_({}, std::move(res));
     }
 
-    void on_write(beast::error_code ec, std::size_t bytes_transferred)
+    // request_sent 为 false 表示请求一个字节都没有写出，服务端不可能处理过它
+    bool may_retry(const bool request_sent) const
     {
-      boost::ignore_unused(bytes_transferred);
-      if (ec) return on_fail(ec, "write");
-      http::async_read(stream_, buffer_, res_,
-                       beast::bind_front_handler(&HttpsSession::on_read, get_shared()));
+      switch (pool_->options().retry)
+      {
+      case RetryPolicy::never:
+        return false;
+      case RetryPolicy::idempotent:
+        return !request_sent || is_idempotent(req_.method());
+      case RetryPolicy::always:
+        return true;
+      }
+      return false;
     }
 
-    void on_read(beast::error_code ec, std::size_t bytes_transferred)
+    void retry_or_fail(beast::error_code ec, const char* what, const bool request_sent)
     {
-      boost::ignore_unused(bytes_transferred);
-      if (ec) return on_fail(ec, "read");
-
-      stream_.async_shutdown(beast::bind_front_handler(&HttpsSession::on_shutdown, get_shared()));
+      // 空闲连接可能在取用之后才被对端关闭；还没收到任何响应数据时，按 RetryPolicy 换一条新连接重发
+      if (reused_ && (!parser_ || !parser_->got_some()) && ec != beast::error::timeout && may_retry(request_sent))
+      {
+        conn_->close();
+        conn_.reset();
+        pool_->record_retry();
+        return connect();
+      }
+      on_fail(ec, what);
     }
 
-    void on_shutdown(beast::error_code ec)
+    void on_fail(beast::error_code ec, const char* what)
     {
-      if (ec == net::error::eof || ec == ssl::error::stream_truncated)
-        ec = {};
-      if (callback_) callback_(ec, std::move(res_));
+      boost::ignore_unused(what);
+      // Log if needed: std::cerr << what << ": " << ec.message() << "\n";
+      pool_->release(key_, std::move(conn_), false);
+      if (callback_) callback_(ec, {});
     }
   };
 
@@ -200,12 +222,14 @@ namespace khttpd::framework::client
     own_ssl_ctx_->set_default_verify_paths();
     own_ssl_ctx_->set_verify_mode(ssl::verify_none);
     ssl_ctx_ptr_ = own_ssl_ctx_.get();
+    pool_ = std::make_shared<ConnectionPool>(ioc_);
   }
 
   // 2. 全局 IO + 自定义 SSL
   HttpClient::HttpClient(ssl::context& ssl_ctx)
     : ioc_(IoContextPool::instance().get_io_context())
       , ssl_ctx_ptr_(&ssl_ctx)
+      , pool_(std::make_shared<ConnectionPool>(ioc_))
   {
   }
 
@@ -217,12 +241,14 @@ namespace khttpd::framework::client
     own_ssl_ctx_->set_default_verify_paths();
     own_ssl_ctx_->set_verify_mode(ssl::verify_none);
     ssl_ctx_ptr_ = own_ssl_ctx_.get();
+    pool_ = std::make_shared<ConnectionPool>(ioc_);
   }
 
   // 4. 全自定义
   HttpClient::HttpClient(net::io_context& ioc, ssl::context& ssl_ctx)
     : ioc_(ioc)
       , ssl_ctx_ptr_(&ssl_ctx)
+      , pool_(std::make_shared<ConnectionPool>(ioc_))
   {
   }
 
@@ -259,6 +285,27 @@ namespace khttpd::framework::client
     timeout_ = seconds;
   }
 
+  void HttpClient::set_connection_pool(const ConnectionPoolOptions& options)
+  {
+    // 进行中的请求继续使用原来的连接池，完成后随它一起关闭
+    pool_ = std::make_shared<ConnectionPool>(ioc_, options);
+  }
+
+  void HttpClient::set_dns_cache(std::shared_ptr<DnsCache> cache)
+  {
+    dns_ = cache ? std::move(cache) : DnsCache::instance();
+  }
+
+  const ConnectionPoolStats& HttpClient::get_connection_pool_stats() const
+  {
+    return pool_->stats();
+  }
+
+  void HttpClient::close_idle_connections()
+  {
+    pool_->close_idle();
+  }
+
   HttpClient::UrlParts HttpClient::parse_target(const std::string& path_in,
                                                 const std::map<std::string, std::string>& query)
   {
@@ -304,6 +351,18 @@ namespace khttpd::framework::client
                            const std::string& body,
                            const std::map<std::string, std::string>& headers,
                            ResponseCallback callback)
+  {
+    start(ioc_, pool_, method, std::move(path), query_params, body, headers, std::move(callback));
+  }
+
+  void HttpClient::start(net::io_context& ioc,
+                         const std::shared_ptr<ConnectionPool>& pool,
+                         http::verb method,
+                         std::string path,
+                         const std::map<std::string, std::string>& query_params,
+                         const std::string& body,
+                         const std::map<std::string, std::string>& headers,
+                         ResponseCallback callback)
   {
     try
     {
@@ -322,7 +381,7 @@ namespace khttpd::framework::client
         req.prepare_payload();
       }
 
-      std::shared_ptr<Session> session;
+      ssl::context* ssl_ctx = nullptr;
       if (parts.scheme == "https")
       {
         if (!ssl_ctx_ptr_)
@@ -330,13 +389,10 @@ namespace khttpd::framework::client
           if (callback) callback(beast::error_code(beast::errc::operation_not_supported, beast::system_category()), {});
           return;
         }
-        session = std::make_shared<HttpsSession>(ioc_, *ssl_ctx_ptr_, std::move(callback), timeout_);
+        ssl_ctx = ssl_ctx_ptr_;
       }
-      else
-      {
-        session = std::make_shared<HttpSession>(ioc_, std::move(callback), timeout_);
-      }
-      session->run(parts.host, parts.port, std::move(req));
+      auto session = std::make_shared<Session>(ioc, ssl_ctx, pool, dns_, std::move(callback), timeout_);
+      session->run(parts.scheme, parts.host, parts.port, std::move(req));
     }
     catch (const std::exception& e)
     {
@@ -351,17 +407,39 @@ namespace khttpd::framework::client
     const std::string& body,
     const std::map<std::string, std::string>& headers)
   {
-    std::promise<std::pair<beast::error_code, http::response<http::string_body>>> p;
-    auto f = p.get_future();
+    std::pair<beast::error_code, http::response<http::string_body>> result;
+    if (ioc_.get_executor().running_in_this_thread())
+    {
+      // 当前线程正在运行 ioc_（例如全局 IO 池上的路由处理函数）：在这里等待 future 会占住这个线程，
+      // 所有线程都这样等待时请求永远无法完成。改为在调用线程上用私有的 io_context 完成整个请求。
+      // 池中的连接属于 ioc_，不能在私有 io_context 上使用，所以这条路径每次新建连接
+      net::io_context private_ioc{1};
+      ConnectionPoolOptions options;
+      options.enabled = false;
+      const auto pool = std::make_shared<ConnectionPool>(private_ioc, options);
+      // DNS 解析可能合并到其他线程发起的查询上，等待期间私有 io_context 上没有其他任务
+      auto work = net::make_work_guard(private_ioc);
+      start(private_ioc, pool, method, std::move(path), query_params, body, headers,
+            [&result, &work](beast::error_code ec, http::response<http::string_body> res)
+            {
+              result = {ec, std::move(res)};
+              work.reset();
+            });
+      private_ioc.run();
+    }
+    else
+    {
+      std::promise<std::pair<beast::error_code, http::response<http::string_body>>> p;
+      auto f = p.get_future();
 
-    this->request(method, path, query_params, body, headers,
-                  [&p](beast::error_code ec, http::response<http::string_body> res)
-                  {
-                    p.set_value({ec, std::move(res)});
-                  });
+      this->request(method, path, query_params, body, headers,
+                    [&p](beast::error_code ec, http::response<http::string_body> res)
+                    {
+                      p.set_value({ec, std::move(res)});
+                    });
 
-    f.wait();
-    auto result = f.get();
+      result = f.get();
+    }
 
     if (result.first)
     {
@@ -6,6 +6,9 @@
 #include <boost/beast/version.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/dispatch.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/url.hpp>
@@ -20,6 +23,10 @@
 #include <type_traits>
 #include <optional>
 
+#include "awaitable.hpp"
+#include "connection_pool.hpp"
+#include "dns_cache.hpp"
+
 namespace khttpd::framework::client
 {
   namespace beast = boost::beast;
@@ -89,6 +96,15 @@ namespace khttpd::framework::client
     void set_bearer_token(const std::string& token);
     void set_timeout(std::chrono::seconds seconds);
 
+    // Keep-alive 连接池，按 scheme://host:port 复用连接。默认开启，每个主机最多 8 个连接；
+    // 调用时替换整个连接池，已有的空闲连接不再复用
+    void set_connection_pool(const ConnectionPoolOptions& options);
+    const ConnectionPoolStats& get_connection_pool_stats() const;
+    void close_idle_connections();
+
+    // 新建连接时的 DNS 解析走这个缓存，默认是所有客户端共用的 DnsCache::instance()，传空指针恢复默认
+    void set_dns_cache(std::shared_ptr<DnsCache> cache);
+
     // Core Request Method (Used by Macros)
     void request(http::verb method,
                  std::string path, // relative path or full url
@@ -97,7 +113,71 @@ namespace khttpd::framework::client
                  const std::map<std::string, std::string>& headers,
                  ResponseCallback callback);
 
+    // 按 Asio 完成令牌发起请求，完成签名为 void(beast::error_code, http::response<http::string_body>)。
+    // 令牌可以是回调、net::use_future（失败时 future.get() 抛出 system_error）等；
+    // 完成时派发到令牌关联的执行器上，没有关联执行器时在 ioc_ 上执行
+    template <class CompletionToken>
+    auto async_request(http::verb method,
+                       std::string path,
+                       const std::map<std::string, std::string>& query_params,
+                       const std::string& body,
+                       const std::map<std::string, std::string>& headers,
+                       CompletionToken&& token)
+    {
+      return net::async_initiate<CompletionToken, void(beast::error_code, http::response<http::string_body>)>(
+        [this](auto handler, http::verb m, std::string p, const std::map<std::string, std::string>& q,
+               const std::string& b, const std::map<std::string, std::string>& h)
+        {
+          // ResponseCallback 要求可复制，只能移动的 handler（例如协程）放在 shared_ptr 里
+          using Handler = std::decay_t<decltype(handler)>;
+          auto shared = std::make_shared<Handler>(std::move(handler));
+          auto executor = net::get_associated_executor(*shared, ioc_.get_executor());
+          request(m, std::move(p), q, b, h,
+                  [shared, executor](beast::error_code ec, http::response<http::string_body> res)
+                  {
+                    net::dispatch(executor, [shared, ec, res = std::move(res)]() mutable
+                    {
+                      (*shared)(ec, std::move(res));
+                    });
+                  });
+        },
+        token, method, std::move(path), query_params, body, headers);
+    }
+
+#if defined(KHTTPD_HAS_COROUTINES)
+    // 协程接口（C++20）：auto res = co_await client->get("/users", {{"page", "1"}});
+    // 失败时抛出 boost::system::system_error；协程在自己的 executor 上恢复。客户端必须比请求活得更久
+    net::awaitable<http::response<http::string_body>> get(std::string path,
+                                                         std::map<std::string, std::string> query_params = {},
+                                                         std::map<std::string, std::string> headers = {})
+    {
+      co_return co_await async_request(http::verb::get, std::move(path), query_params, "", headers,
+                                       net::use_awaitable);
+    }
+
+    net::awaitable<http::response<http::string_body>> post(std::string path, std::string body,
+                                                          std::map<std::string, std::string> headers = {})
+    {
+      co_return co_await async_request(http::verb::post, std::move(path), {}, body, headers, net::use_awaitable);
+    }
+
+    net::awaitable<http::response<http::string_body>> put(std::string path, std::string body,
+                                                         std::map<std::string, std::string> headers = {})
+    {
+      co_return co_await async_request(http::verb::put, std::move(path), {}, body, headers, net::use_awaitable);
+    }
+
+    net::awaitable<http::response<http::string_body>> del(std::string path,
+                                                         std::map<std::string, std::string> headers = {})
+    {
+      co_return co_await async_request(http::verb::delete_, std::move(path), {}, "", headers, net::use_awaitable);
+    }
+#endif
+
     // Sync Request Method
+    // 在运行 ioc_ 的线程上调用（例如共享 IO 池上的路由处理函数）时，请求在调用线程上的私有 io_context 中完成，
+    // 不会等待其他线程，也就不会在所有线程同时等待时死锁；这条路径不复用连接池中的连接。
+    // 其他线程上调用时，请求在 ioc_ 上执行，调用线程阻塞等待结果
     http::response<http::string_body> request_sync(
       http::verb method,
       std::string path,
@@ -116,6 +196,16 @@ namespace khttpd::framework::client
 
     UrlParts parse_target(const std::string& path, const std::map<std::string, std::string>& query);
 
+    // 在指定的 io_context 与连接池上发起请求，request_sync 的内联路径使用私有的 io_context
+    void start(net::io_context& ioc,
+               const std::shared_ptr<ConnectionPool>& pool,
+               http::verb method,
+               std::string path,
+               const std::map<std::string, std::string>& query_params,
+               const std::string& body,
+               const std::map<std::string, std::string>& headers,
+               ResponseCallback callback);
+
     net::io_context& ioc_;
 
     // SSL Context Management
@@ -125,6 +215,8 @@ namespace khttpd::framework::client
     std::optional<boost::urls::url> base_url_;
     std::map<std::string, std::string> default_headers_;
     std::chrono::seconds timeout_{30};
+    std::shared_ptr<ConnectionPool> pool_;
+    std::shared_ptr<DnsCache> dns_ = DnsCache::instance();
   };
 }
 
@@ -36,6 +36,10 @@ namespace khttpd::framework::client
 
   protected:
     virtual net::any_io_executor get_executor() = 0;
+
+    // 友元关系不会继承，派生的会话通过这里读取客户端的配置
+    const WebsocketDeflateOptions& deflate_options() const { return owner_->deflate_; }
+    DnsCache& dns_cache() const { return *owner_->dns_; }
     virtual void do_write_from_queue() = 0;
 
     void on_queue_write(std::string message)
@@ -107,12 +111,11 @@ namespace khttpd::framework::client
   class PlainWebsocketSession : public WebsocketSessionImpl
   {
     websocket::stream<beast::tcp_stream> ws_;
-    tcp::resolver resolver_;
     WebsocketClient::ConnectCallback connect_cb_;
 
   public:
     PlainWebsocketSession(net::io_context& ioc, WebsocketClient* owner)
-      : WebsocketSessionImpl(owner), ws_(net::make_strand(ioc)), resolver_(ioc)
+      : WebsocketSessionImpl(owner), ws_(net::make_strand(ioc))
     {
     }
 
@@ -124,9 +127,10 @@ namespace khttpd::framework::client
       host_ = host;
       connect_cb_ = std::move(cb);
 
-      resolver_.async_resolve(host, port, beast::bind_front_handler(&PlainWebsocketSession::on_resolve,
-                                                                    std::static_pointer_cast<PlainWebsocketSession>(
-                                                                      shared_from_this()), target, headers));
+      dns_cache().resolve(ws_.get_executor(), host, port,
+                          beast::bind_front_handler(&PlainWebsocketSession::on_resolve,
+                                                    std::static_pointer_cast<PlainWebsocketSession>(shared_from_this()),
+                                                    target, headers));
     }
 
     void close() override
@@ -153,21 +157,22 @@ namespace khttpd::framework::client
 
   private:
     void on_resolve(std::string target, std::map<std::string, std::string> headers, beast::error_code ec,
-                    tcp::resolver::results_type results)
+                    DnsCache::Endpoints endpoints)
     {
       if (ec) return fail(ec);
-      beast::get_lowest_layer(ws_).async_connect(results, beast::bind_front_handler(
+      beast::get_lowest_layer(ws_).async_connect(endpoints, beast::bind_front_handler(
                                                    &PlainWebsocketSession::on_connect,
                                                    std::static_pointer_cast<PlainWebsocketSession>(shared_from_this()),
                                                    target, headers));
     }
 
     void on_connect(std::string target, std::map<std::string, std::string> headers, beast::error_code ec,
-                    tcp::resolver::results_type::endpoint_type)
+                    tcp::endpoint)
     {
       if (ec) return fail(ec);
 
       ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+      ws_.set_option(make_permessage_deflate(deflate_options(), beast::role_type::client));
 
       // Set Headers
       ws_.set_option(websocket::stream_base::decorator([headers](websocket::request_type& req)
@@ -219,12 +224,11 @@ namespace khttpd::framework::client
   class SslWebsocketSession : public WebsocketSessionImpl
   {
     websocket::stream<beast::ssl_stream<beast::tcp_stream>> ws_;
-    tcp::resolver resolver_;
     WebsocketClient::ConnectCallback connect_cb_;
 
   public:
     SslWebsocketSession(net::io_context& ioc, ssl::context& ctx, WebsocketClient* owner)
-      : WebsocketSessionImpl(owner), ws_(net::make_strand(ioc), ctx), resolver_(ioc)
+      : WebsocketSessionImpl(owner), ws_(net::make_strand(ioc), ctx)
     {
     }
 
@@ -241,9 +245,10 @@ namespace khttpd::framework::client
         return fail(beast::error_code(static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()));
       }
 
-      resolver_.async_resolve(host, port, beast::bind_front_handler(&SslWebsocketSession::on_resolve,
-                                                                    std::static_pointer_cast<SslWebsocketSession>(
-                                                                      shared_from_this()), target, headers));
+      dns_cache().resolve(ws_.get_executor(), host, port,
+                          beast::bind_front_handler(&SslWebsocketSession::on_resolve,
+                                                    std::static_pointer_cast<SslWebsocketSession>(shared_from_this()),
+                                                    target, headers));
     }
 
     void close() override
@@ -269,17 +274,17 @@ namespace khttpd::framework::client
 
   private:
     void on_resolve(std::string target, std::map<std::string, std::string> headers, beast::error_code ec,
-                    tcp::resolver::results_type results)
+                    DnsCache::Endpoints endpoints)
     {
       if (ec) return fail(ec);
-      beast::get_lowest_layer(ws_).async_connect(results, beast::bind_front_handler(
+      beast::get_lowest_layer(ws_).async_connect(endpoints, beast::bind_front_handler(
                                                    &SslWebsocketSession::on_connect,
                                                    std::static_pointer_cast<SslWebsocketSession>(shared_from_this()),
                                                    target, headers));
     }
 
     void on_connect(std::string target, std::map<std::string, std::string> headers, beast::error_code ec,
-                    tcp::resolver::results_type::endpoint_type)
+                    tcp::endpoint)
     {
       if (ec) return fail(ec);
       ws_.next_layer().async_handshake(ssl::stream_base::client,
@@ -293,6 +298,7 @@ namespace khttpd::framework::client
       if (ec) return fail(ec);
 
       ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+      ws_.set_option(make_permessage_deflate(deflate_options(), beast::role_type::client));
       ws_.set_option(websocket::stream_base::decorator([headers](websocket::request_type& req)
       {
         req.set(beast::http::field::user_agent, BOOST_BEAST_VERSION_STRING);
@@ -428,4 +434,10 @@ namespace khttpd::framework::client
   void WebsocketClient::set_on_message(MessageHandler handler) { on_message_ = std::move(handler); }
   void WebsocketClient::set_on_error(ErrorHandler handler) { on_error_ = std::move(handler); }
   void WebsocketClient::set_on_close(CloseHandler handler) { on_close_ = std::move(handler); }
+  void WebsocketClient::set_deflate(const WebsocketDeflateOptions& options) { deflate_ = options; }
+
+  void WebsocketClient::set_dns_cache(std::shared_ptr<DnsCache> cache)
+  {
+    dns_ = cache ? std::move(cache) : DnsCache::instance();
+  }
 }
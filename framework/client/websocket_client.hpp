@@ -15,6 +15,9 @@
 #include <map>
 #include <deque>
 
+#include "dns_cache.hpp"
+#include "websocket/websocket_deflate.hpp"
+
 namespace khttpd::framework::client
 {
   namespace beast = boost::beast;
@@ -54,6 +57,10 @@ namespace khttpd::framework::client
     void set_on_message(MessageHandler handler);
     void set_on_error(ErrorHandler handler);
     void set_on_close(CloseHandler handler);
+    // permessage-deflate，需要在 connect 之前设置
+    void set_deflate(const WebsocketDeflateOptions& options);
+    // 解析主机名使用的 DNS 缓存，默认是所有客户端共用的 DnsCache::instance()，传空指针恢复默认
+    void set_dns_cache(std::shared_ptr<DnsCache> cache);
 
   private:
     friend WebsocketSessionImpl;
@@ -70,6 +77,8 @@ namespace khttpd::framework::client
 
     // Headers to send during handshake
     std::map<std::string, std::string> headers_;
+    WebsocketDeflateOptions deflate_;
+    std::shared_ptr<DnsCache> dns_ = DnsCache::instance();
 
     // 多态的内部会话 (持有实际的 websocket stream)
     std::shared_ptr<WebsocketSessionImpl> session_;
@@ -0,0 +1,251 @@
+// framework/compression/compression.cpp
+#include "compression.hpp"
+#include "static_file/header_value.hpp"
+
+#include <fmt/core.h>
+#include <algorithm>
+#include <stdexcept>
+#include <zlib.h>
+#include <zstd.h>
+
+namespace khttpd::framework
+{
+  namespace
+  {
+    // 解析 ";q=0.5"，格式不对时按 1 处理
+    double parse_quality(std::string_view params)
+    {
+      while (!params.empty())
+      {
+        const auto semicolon = params.find(';');
+        const std::string_view param = trim(params.substr(0, semicolon));
+        if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+        {
+          const std::string value(param.substr(2));
+          try
+          {
+            return std::clamp(std::stod(value), 0.0, 1.0);
+          }
+          catch (const std::exception&)
+          {
+            return 1.0;
+          }
+        }
+        if (semicolon == std::string_view::npos)
+        {
+          break;
+        }
+        params.remove_prefix(semicolon + 1);
+      }
+      return 1.0;
+    }
+
+    class ZlibCompressor : public StreamCompressor
+    {
+    public:
+      ZlibCompressor(int window_bits, int level)
+      {
+        if (deflateInit2(&stream_, std::clamp(level, 1, 9), Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+          throw std::runtime_error("deflateInit2 failed");
+        }
+      }
+
+      ~ZlibCompressor() override
+      {
+        deflateEnd(&stream_);
+      }
+
+      void write(std::string_view input, std::string& out, bool flush) override
+      {
+        run(input, out, flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+      }
+
+      void finish(std::string& out) override
+      {
+        run({}, out, Z_FINISH);
+      }
+
+    private:
+      z_stream stream_{};
+
+      void run(std::string_view input, std::string& out, int flush)
+      {
+        if (input.empty() && flush == Z_NO_FLUSH)
+        {
+          return;
+        }
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        stream_.avail_in = static_cast<uInt>(input.size());
+
+        int result;
+        do
+        {
+          const std::size_t offset = out.size();
+          const std::size_t chunk = std::max<std::size_t>(deflateBound(&stream_, stream_.avail_in), 64);
+          out.resize(offset + chunk);
+          stream_.next_out = reinterpret_cast<Bytef*>(out.data() + offset);
+          stream_.avail_out = static_cast<uInt>(chunk);
+          result = deflate(&stream_, flush);
+          out.resize(offset + chunk - stream_.avail_out);
+          if (result == Z_STREAM_ERROR)
+          {
+            throw std::runtime_error("deflate failed");
+          }
+        }
+        while (stream_.avail_in > 0 || stream_.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+      }
+    };
+
+    class ZstdCompressor : public StreamCompressor
+    {
+    public:
+      explicit ZstdCompressor(int level)
+        : context_(ZSTD_createCCtx())
+      {
+        if (!context_)
+        {
+          throw std::runtime_error("ZSTD_createCCtx failed");
+        }
+        check(ZSTD_CCtx_setParameter(context_, ZSTD_c_compressionLevel, level));
+      }
+
+      ~ZstdCompressor() override
+      {
+        ZSTD_freeCCtx(context_);
+      }
+
+      void write(std::string_view input, std::string& out, bool flush) override
+      {
+        run(input, out, flush ? ZSTD_e_flush : ZSTD_e_continue);
+      }
+
+      void finish(std::string& out) override
+      {
+        run({}, out, ZSTD_e_end);
+      }
+
+    private:
+      ZSTD_CCtx* context_;
+
+      static std::size_t check(std::size_t result)
+      {
+        if (ZSTD_isError(result))
+        {
+          throw std::runtime_error(fmt::format("zstd compression failed: {}", ZSTD_getErrorName(result)));
+        }
+        return result;
+      }
+
+      void run(std::string_view input, std::string& out, ZSTD_EndDirective directive)
+      {
+        ZSTD_inBuffer in{input.data(), input.size(), 0};
+        std::size_t remaining;
+        do
+        {
+          const std::size_t offset = out.size();
+          const std::size_t chunk = ZSTD_CStreamOutSize();
+          out.resize(offset + chunk);
+          ZSTD_outBuffer buffer{out.data() + offset, chunk, 0};
+          remaining = check(ZSTD_compressStream2(context_, &buffer, &in, directive));
+          out.resize(offset + buffer.pos);
+        }
+        // continue 时只要输入耗尽即可，flush/end 还要等内部缓冲全部输出
+        while (directive == ZSTD_e_continue ? in.pos < in.size : remaining != 0);
+      }
+    };
+  }
+
+  std::string_view content_coding_name(ContentCoding coding)
+  {
+    switch (coding)
+    {
+    case ContentCoding::gzip:
+      return "gzip";
+    case ContentCoding::deflate:
+      return "deflate";
+    case ContentCoding::zstd:
+      return "zstd";
+    }
+    return {};
+  }
+
+  std::optional<ContentCoding> parse_content_coding(std::string_view name)
+  {
+    if (iequals(name, "gzip") || iequals(name, "x-gzip")) return ContentCoding::gzip;
+    if (iequals(name, "deflate")) return ContentCoding::deflate;
+    if (iequals(name, "zstd")) return ContentCoding::zstd;
+    return std::nullopt;
+  }
+
+  double content_coding_quality(std::string_view accept_encoding, std::string_view coding)
+  {
+    std::optional<double> wildcard;
+    while (!accept_encoding.empty())
+    {
+      const auto comma = accept_encoding.find(',');
+      const std::string_view item = trim(accept_encoding.substr(0, comma));
+      const auto semicolon = item.find(';');
+      const std::string_view name = trim(item.substr(0, semicolon));
+      const double quality = semicolon == std::string_view::npos ? 1.0 : parse_quality(item.substr(semicolon + 1));
+
+      if (iequals(name, coding) || (iequals(name, "x-gzip") && iequals(coding, "gzip")))
+      {
+        return quality;
+      }
+      if (name == "*")
+      {
+        wildcard = quality;
+      }
+
+      if (comma == std::string_view::npos)
+      {
+        break;
+      }
+      accept_encoding.remove_prefix(comma + 1);
+    }
+    return wildcard.value_or(0.0);
+  }
+
+  std::optional<std::string> negotiate_content_coding(std::string_view accept_encoding,
+                                                      const std::vector<std::string>& available)
+  {
+    std::optional<std::string> best;
+    double best_quality = 0.0;
+    for (const auto& coding : available)
+    {
+      const double quality = content_coding_quality(accept_encoding, coding);
+      if (quality > best_quality)
+      {
+        best = coding;
+        best_quality = quality;
+      }
+    }
+    return best;
+  }
+
+  std::unique_ptr<StreamCompressor> StreamCompressor::create(ContentCoding coding, int level)
+  {
+    switch (coding)
+    {
+    case ContentCoding::gzip:
+      // windowBits + 16 输出 gzip 头和尾
+      return std::make_unique<ZlibCompressor>(15 + 16, level);
+    case ContentCoding::deflate:
+      return std::make_unique<ZlibCompressor>(15, level);
+    case ContentCoding::zstd:
+      return std::make_unique<ZstdCompressor>(level);
+    }
+    throw std::invalid_argument("unknown content coding");
+  }
+
+  std::string compress(ContentCoding coding, std::string_view input, int level)
+  {
+    auto compressor = StreamCompressor::create(coding, level);
+    std::string out;
+    out.reserve(input.size() / 2 + 64);
+    compressor->write(input, out, false);
+    compressor->finish(out);
+    return out;
+  }
+}
@@ -0,0 +1,55 @@
+// framework/compression/compression.hpp
+#ifndef KHTTPD_FRAMEWORK_COMPRESSION_COMPRESSION_HPP
+#define KHTTPD_FRAMEWORK_COMPRESSION_COMPRESSION_HPP
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace khttpd::framework
+{
+  // 支持即时压缩的内容编码
+  enum class ContentCoding
+  {
+    gzip,
+    // HTTP 的 deflate 是 zlib 格式（RFC 1950），不是裸 deflate 流
+    deflate,
+    zstd,
+  };
+
+  // Content-Encoding 中使用的名字，例如 "gzip"
+  std::string_view content_coding_name(ContentCoding coding);
+  std::optional<ContentCoding> parse_content_coding(std::string_view name);
+
+  // Accept-Encoding（RFC 9110 12.5.3）中 coding 的 q 值，不可接受时为 0。
+  // 没有列出的编码按 "*" 的 q 值处理，"x-gzip" 视为 "gzip"
+  double content_coding_quality(std::string_view accept_encoding, std::string_view coding);
+
+  // 从 available（按服务端偏好排序）中选出客户端接受的编码：q 值高的优先，q 值相同时按 available 的顺序。
+  // 都不可接受时返回 std::nullopt，此时应发送未压缩的内容
+  std::optional<std::string> negotiate_content_coding(std::string_view accept_encoding,
+                                                      const std::vector<std::string>& available);
+
+  // 流式压缩器，非线程安全。出错时抛出 std::runtime_error
+  class StreamCompressor
+  {
+  public:
+    virtual ~StreamCompressor() = default;
+
+    // 压缩 input 并把输出追加到 out。flush 为 true 时把目前为止的数据全部输出，
+    // 客户端收到后即可解出，用于分块响应；代价是压缩率略有下降
+    virtual void write(std::string_view input, std::string& out, bool flush) = 0;
+    // 输出流的结尾，之后不能再调用 write/finish
+    virtual void finish(std::string& out) = 0;
+
+    // level 为编码自身的压缩级别：gzip/deflate 为 1-9，zstd 为 1-22
+    static std::unique_ptr<StreamCompressor> create(ContentCoding coding, int level);
+  };
+
+  // 一次性压缩整个 input
+  std::string compress(ContentCoding coding, std::string_view input, int level);
+}
+
+#endif // KHTTPD_FRAMEWORK_COMPRESSION_COMPRESSION_HPP
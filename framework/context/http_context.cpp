@@ -3,58 +3,24 @@
 #include <fmt/core.h>
 #include <algorithm> // for std::remove_if
 #include <iomanip>   // for std::quoted (not directly used here, but useful for debugging)
-#include <regex>
+#include <limits>
 #include <boost/beast/version.hpp>
 #include <boost/url/parse.hpp>
 
 namespace khttpd::framework
 {
-  // Helper to trim whitespace from a string
-  std::string HttpContext::trim(const std::string& str)
-  {
-    const size_t first = str.find_first_not_of(" \t\n\r");
-    if (std::string::npos == first)
-    {
-      return str;
-    }
-    const size_t last = str.find_last_not_of(" \t\n\r");
-    return str.substr(first, last - first + 1);
-  }
-
-  // Helper to extract a header value from a block of headers
-  std::string HttpContext::extract_header_value(const std::string& headers, const std::string& header_name)
-  {
-    const std::string search_str = "\r\n" + header_name + ":";
-    size_t pos = headers.find(search_str);
-    if (pos == std::string::npos)
-    {
-      // Also check for start of line for the first header
-      if (headers.rfind(header_name + ":", 0) == 0)
-      {
-        // Check if it starts with header_name:
-        pos = 0;
-      }
-      else
-      {
-        return "";
-      }
-    }
-    else
-    {
-      pos += search_str.length();
-    }
-
-    size_t end_pos = headers.find("\r\n", pos);
-    if (end_pos == std::string::npos)
-    {
-      end_pos = headers.length();
-    }
-    return trim(headers.substr(pos, end_pos - pos));
-  }
-
-
-  HttpContext::HttpContext(Request& req, Response& res)
-    : req_(req), res_(res)
+  HttpContext::HttpContext(Request& req, Response& res, std::pmr::memory_resource* resource)
+    : req_(req),
+      res_(res),
+      resource_(resource),
+      query_params_(resource),
+      decoded_storage_(resource),
+      path_params_(resource),
+      cached_form_params_(resource),
+      cached_multipart_fields_(resource),
+      cached_multipart_files_(resource),
+      extended_data_(resource),
+      cached_cookies_(resource)
   {
     res_.version(req_.version());
     res_.keep_alive(req_.keep_alive());
@@ -103,21 +69,107 @@ namespace khttpd::framework
     return req_.body();
   }
 
+  std::string_view HttpContext::body_view() const
+  {
+    return req_.body();
+  }
+
+  std::string_view HttpContext::decode_query_component(const std::string_view component) const
+  {
+    if (component.find_first_of("%+") == std::string_view::npos)
+    {
+      return component;
+    }
+
+    auto hex = [](const char c) -> int
+    {
+      if (c >= '0' && c <= '9') return c - '0';
+      if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+      if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+      return -1;
+    };
+
+    std::pmr::string& decoded = decoded_storage_.emplace_back();
+    decoded.reserve(component.size());
+    for (size_t i = 0; i < component.size(); ++i)
+    {
+      if (component[i] == '+')
+      {
+        decoded += ' ';
+      }
+      else if (component[i] == '%' && i + 2 < component.size() &&
+        hex(component[i + 1]) >= 0 && hex(component[i + 2]) >= 0)
+      {
+        decoded += static_cast<char>(hex(component[i + 1]) * 16 + hex(component[i + 2]));
+        i += 2;
+      }
+      else
+      {
+        decoded += component[i];
+      }
+    }
+    return decoded;
+  }
+
+  void HttpContext::parse_query_params() const
+  {
+    if (query_parsed_)
+    {
+      return;
+    }
+    query_parsed_ = true;
+
+    const std::string_view target = req_.target();
+    const size_t query_pos = target.find('?');
+    if (query_pos == std::string_view::npos)
+    {
+      return;
+    }
+    std::string_view query = target.substr(query_pos + 1);
+    query = query.substr(0, query.find('#'));
+
+    while (!query.empty())
+    {
+      const size_t amp = query.find('&');
+      const std::string_view pair = query.substr(0, amp);
+      query = amp == std::string_view::npos ? std::string_view{} : query.substr(amp + 1);
+      if (pair.empty())
+      {
+        continue;
+      }
+
+      const size_t eq = pair.find('=');
+      const std::string_view key = pair.substr(0, eq);
+      const std::string_view value = eq == std::string_view::npos ? std::string_view{} : pair.substr(eq + 1);
+      query_params_.push_back(decode_query_component(key), decode_query_component(value));
+    }
+  }
+
+  std::optional<std::string_view> HttpContext::query_param_view(const std::string_view key) const
+  {
+    parse_query_params();
+    return query_params_.find(key);
+  }
+
   std::optional<std::string> HttpContext::get_query_param(const std::string& key) const
   {
-    parse_url_components();
-    for (auto param : parsed_url_.params())
+    if (const auto value = query_param_view(key))
     {
-      if (param.key == key)return std::string(param.value);
+      return std::string(*value);
     }
     return std::nullopt;
   }
 
+  std::optional<std::string_view> HttpContext::path_param_view(const std::string_view key) const
+  {
+    return path_params_.find(key);
+  }
+
   std::optional<std::string> HttpContext::get_path_param(const std::string& key) const
   {
-    if (const auto it = path_params_.find(key); it != path_params_.end())
+    if (const auto value = path_param_view(key))
     {
-      return it->second;
+      return std::string(*value);
     }
     return std::nullopt;
   }
@@ -160,7 +212,7 @@ namespace khttpd::framework
     }
     try
     {
-      cached_json_ = boost::json::parse(body());
+      cached_json_ = boost::json::parse(body_view());
       return cached_json_;
     }
     catch (const boost::system::system_error& e)
@@ -181,175 +233,94 @@ namespace khttpd::framework
     {
       return;
     }
-    if (const auto content_type = get_header(boost::beast::http::field::content_type);
-      !content_type || content_type->find("application/x-www-form-urlencoded") == std::string::npos)
+    form_params_parsed_ = true;
+    if (const std::string_view content_type = req_[boost::beast::http::field::content_type];
+      content_type.find("application/x-www-form-urlencoded") == std::string_view::npos)
     {
-      form_params_parsed_ = true;
       return;
     }
-    const auto query_string = "?" + body();
 
-    if (auto url_query_result = boost::urls::parse_relative_ref(query_string); url_query_result.has_value())
+    // 与查询字符串相同的格式和解码规则，解码结果与键值都存放在 resource_ 中；重复的键以最后一个为准
+    std::string_view form = body_view();
+    while (!form.empty())
     {
-      const auto url = url_query_result.value();
-      for (const auto& param : url.params())
+      const size_t amp = form.find('&');
+      const std::string_view pair = form.substr(0, amp);
+      form = amp == std::string_view::npos ? std::string_view{} : form.substr(amp + 1);
+      if (pair.empty())
       {
-        cached_form_params_[param.key] = param.value;
+        continue;
       }
+
+      const size_t eq = pair.find('=');
+      const std::string_view key = decode_query_component(pair.substr(0, eq));
+      const std::string_view value = eq == std::string_view::npos
+                                       ? std::string_view{}
+                                       : decode_query_component(pair.substr(eq + 1));
+      cached_form_params_.insert_or_assign(std::pmr::string(key, resource_), std::pmr::string(value, resource_));
     }
-    else
-    {
-      fmt::print(stderr, "Error parsing x-www-form-urlencoded body: {}\n", url_query_result.error().message());
-    }
-    form_params_parsed_ = true;
   }
 
   std::optional<std::string> HttpContext::get_form_param(const std::string& key) const
   {
     parse_form_params();
-    if (const auto it = cached_form_params_.find(key); it != cached_form_params_.end())
+    if (const auto it = cached_form_params_.find(std::string_view(key)); it != cached_form_params_.end())
     {
-      return it->second;
+      return std::string(it->second);
     }
     return std::nullopt;
   }
 
-  // Multipart/form-data 解析实现
+  // Multipart/form-data 解析实现：HttpSession 没有在读取时解析（例如关闭了 MultipartOptions::streaming，
+  // 或者直接构造的 HttpContext）时，对内存中的请求体运行同一个解析器，文件内容留在内存中
   void HttpContext::parse_multipart_data() const
   {
     if (multipart_parsed_)
     {
       return;
     }
+    multipart_parsed_ = true;
 
-    auto content_type_header = get_header(boost::beast::http::field::content_type);
-    if (!content_type_header || content_type_header->find("multipart/form-data") == std::string::npos)
+    const auto boundary = multipart_boundary(req_[boost::beast::http::field::content_type]);
+    if (!boundary)
     {
-      multipart_parsed_ = true; // Not multipart, mark as parsed to avoid re-checking
       return;
     }
 
-    // Extract boundary from Content-Type header
-    size_t boundary_pos = content_type_header->find("boundary=");
-    if (boundary_pos == std::string::npos)
+    MultipartOptions options;
+    options.max_total_size = std::numeric_limits<std::uint64_t>::max();
+    options.max_file_size = std::numeric_limits<std::uint64_t>::max();
+    options.max_field_size = std::numeric_limits<std::size_t>::max();
+    options.max_parts = std::numeric_limits<std::size_t>::max();
+    options.memory_threshold = std::numeric_limits<std::size_t>::max();
+    MultipartParser parser(*boundary, options);
+    if (!parser.feed(body_view()) || !parser.finish())
     {
-      fmt::print(stderr, "Multipart/form-data: No boundary found in Content-Type header.\n");
-      multipart_parsed_ = true;
+      fmt::print(stderr, "Multipart/form-data: {}\n", parser.error_message());
       return;
     }
-    std::string boundary = content_type_header->substr(boundary_pos + std::string("boundary=").length());
-    boundary = trim(boundary); // Trim potential quotes or whitespace
-
-    std::string full_boundary = "--" + boundary;
-    std::string final_boundary = full_boundary + "--";
-    std::string body_str = body(); // Get the full request body as string
-
-    size_t current_body_pos = 0;
+    set_multipart_data(parser.release());
+  }
 
-    // Skip preamble before the first boundary
-    current_body_pos = body_str.find(full_boundary);
-    if (current_body_pos == std::string::npos)
+  void HttpContext::set_multipart_data(MultipartFormData data) const
+  {
+    multipart_parsed_ = true;
+    for (auto& [name, value] : data.fields)
     {
-      fmt::print(stderr, "Multipart/form-data: First boundary not found.\n");
-      multipart_parsed_ = true;
-      return;
+      cached_multipart_fields_.insert_or_assign(std::pmr::string(name, resource_), std::pmr::string(value, resource_));
     }
-    current_body_pos += full_boundary.length(); // Move past the first boundary
-
-    // Loop through parts
-    while (current_body_pos < body_str.length())
+    for (auto& [name, file] : data.files)
     {
-      // Find end of headers (first \r\n\r\n after boundary)
-      size_t header_end_pos = body_str.find("\r\n\r\n", current_body_pos);
-      if (header_end_pos == std::string::npos)
-      {
-        fmt::print(stderr, "Multipart/form-data: Malformed part - no header end found.\n");
-        break;
-      }
-
-      std::string part_headers = body_str.substr(current_body_pos, header_end_pos - current_body_pos);
-      // Trim leading \r\n from headers if present (from previous boundary)
-      if (part_headers.length() >= 2 && part_headers[0] == '\r' && part_headers[1] == '\n')
-      {
-        part_headers = part_headers.substr(2);
-      }
-
-      // Find start of next boundary (or final boundary)
-      size_t next_boundary_pos = body_str.find(full_boundary, header_end_pos + 4); // +4 for \r\n\r\n
-      if (next_boundary_pos == std::string::npos)
-      {
-        fmt::print(stderr, "Multipart/form-data: Next boundary not found. Malformed or premature end.\n");
-        break; // Malformed or end of stream
-      }
-
-      std::string part_data = body_str.substr(header_end_pos + 4, next_boundary_pos - (header_end_pos + 4));
-      // Trim trailing \r\n from data before boundary
-      if (part_data.length() >= 2 && part_data[part_data.length() - 2] == '\r' && part_data[part_data.length() - 1] ==
-        '\n')
-      {
-        part_data = part_data.substr(0, part_data.length() - 2);
-      }
-
-      // Parse Content-Disposition
-      std::string content_disposition = extract_header_value(part_headers, "Content-Disposition");
-      if (content_disposition.empty())
-      {
-        fmt::print(stderr, "Multipart/form-data: Part with no Content-Disposition header.\n");
-        current_body_pos = next_boundary_pos + full_boundary.length();
-        continue;
-      }
-
-      std::string name_str;
-      std::string filename_str;
-
-      std::regex disposition_regex("name=\"([^\"]+)\"(?:;\\s*filename=\"([^\"]+)\")?");
-      if (std::smatch matches; std::regex_search(content_disposition, matches, disposition_regex))
-      {
-        if (matches.size() > 1)
-        {
-          name_str = matches[1].str();
-        }
-        if (matches.size() > 2 && matches[2].matched)
-        {
-          // Check if filename group was captured
-          filename_str = matches[2].str();
-        }
-      }
-
-      if (!name_str.empty())
-      {
-        if (!filename_str.empty())
-        {
-          // This is a file part
-          MultipartFile file;
-          file.filename = filename_str;
-          file.content_type = extract_header_value(part_headers, "Content-Type");
-          file.data = part_data;
-          cached_multipart_files_[name_str].push_back(std::move(file));
-        }
-        else
-        {
-          // This is a regular form field
-          cached_multipart_fields_[name_str] = part_data;
-        }
-      }
-
-      current_body_pos = next_boundary_pos + full_boundary.length();
-      if (body_str.substr(next_boundary_pos, final_boundary.length()) == final_boundary)
-      {
-        break; // Reached the final boundary
-      }
+      cached_multipart_files_[std::pmr::string(name, resource_)].push_back(std::move(file));
     }
-
-    multipart_parsed_ = true;
   }
 
   std::optional<std::string> HttpContext::get_multipart_field(const std::string& key) const
   {
     parse_multipart_data();
-    if (const auto it = cached_multipart_fields_.find(key); it != cached_multipart_fields_.end())
+    if (const auto it = cached_multipart_fields_.find(std::string_view(key)); it != cached_multipart_fields_.end())
     {
-      return it->second;
+      return std::string(it->second);
     }
     return std::nullopt;
   }
@@ -357,7 +328,7 @@ namespace khttpd::framework
   const std::vector<MultipartFile>* HttpContext::get_uploaded_files(const std::string& field_name) const
   {
     parse_multipart_data();
-    const auto it = cached_multipart_files_.find(field_name);
+    const auto it = cached_multipart_files_.find(std::string_view(field_name));
     if (it != cached_multipart_files_.end())
     {
       return &it->second;
@@ -371,46 +342,51 @@ namespace khttpd::framework
     {
       return;
     }
+    cookies_parsed_ = true;
 
-    auto cookie_headers = get_headers(boost::beast::http::field::cookie);
-    if (!cookie_headers)
+    auto trim_view = [](std::string_view value)
     {
-      cookies_parsed_ = true;
-      return;
-    }
+      const size_t first = value.find_first_not_of(" \t\n\r");
+      if (first == std::string_view::npos)
+      {
+        return std::string_view{};
+      }
+      return value.substr(first, value.find_last_not_of(" \t\n\r") - first + 1);
+    };
 
-    for (const auto& header_val : *cookie_headers)
+    // 直接在请求头上切分，名字和值只复制一次到 resource_ 中
+    auto range = req_.equal_range(boost::beast::http::field::cookie);
+    for (auto header = range.first; header != range.second; ++header)
     {
-      std::string::size_type pos = 0;
-      while (pos < header_val.length())
+      std::string_view remaining = header->value();
+      while (!remaining.empty())
       {
-        auto end_pos = header_val.find(';', pos);
-        if (end_pos == std::string::npos)
+        const size_t end_pos = remaining.find(';');
+        const std::string_view cookie_pair = remaining.substr(0, end_pos);
+        remaining = end_pos == std::string_view::npos ? std::string_view{} : remaining.substr(end_pos + 1);
+
+        const size_t eq_pos = cookie_pair.find('=');
+        if (eq_pos == std::string_view::npos)
         {
-          end_pos = header_val.length();
+          continue;
         }
-
-        std::string cookie_pair = header_val.substr(pos, end_pos - pos);
-        auto eq_pos = cookie_pair.find('=');
-        if (eq_pos != std::string::npos)
+        const std::string_view key = trim_view(cookie_pair.substr(0, eq_pos));
+        auto it = cached_cookies_.find(key);
+        if (it == cached_cookies_.end())
         {
-          std::string key = trim(cookie_pair.substr(0, eq_pos));
-          std::string value = trim(cookie_pair.substr(eq_pos + 1));
-          cached_cookies_[key].push_back(value);
+          it = cached_cookies_.try_emplace(std::pmr::string(key, resource_)).first;
         }
-
-        pos = end_pos + 1;
+        it->second.emplace_back(trim_view(cookie_pair.substr(eq_pos + 1)));
       }
     }
-    cookies_parsed_ = true;
   }
 
   std::optional<std::string> HttpContext::get_cookie(const std::string& key) const
   {
     parse_cookies();
-    if (auto it = cached_cookies_.find(key); it != cached_cookies_.end() && !it->second.empty())
+    if (auto it = cached_cookies_.find(std::string_view(key)); it != cached_cookies_.end() && !it->second.empty())
     {
-      return it->second.front();
+      return std::string(it->second.front());
     }
     return std::nullopt;
   }
@@ -418,11 +394,12 @@ namespace khttpd::framework
   std::vector<std::string> HttpContext::get_cookies(const std::string& key) const
   {
     parse_cookies();
-    if (auto it = cached_cookies_.find(key); it != cached_cookies_.end())
+    std::vector<std::string> cookies;
+    if (auto it = cached_cookies_.find(std::string_view(key)); it != cached_cookies_.end())
     {
-      return it->second;
+      cookies.assign(it->second.begin(), it->second.end());
     }
-    return {};
+    return cookies;
   }
 
   void HttpContext::set_cookie(const std::string& key, const std::string& value, const CookieOptions& options) const
@@ -478,6 +455,34 @@ namespace khttpd::framework
   {
     res_.chunked(handler != nullptr);
     this->do_stream_chunk = handler;
+    chunk_generator_ = nullptr;
+    async_stream_handler_ = nullptr;
+  }
+
+  void HttpContext::chunked_pull(ChunkGenerator generator)
+  {
+    res_.chunked(generator != nullptr);
+    do_stream_chunk = nullptr;
+    chunk_generator_ = std::move(generator);
+    async_stream_handler_ = nullptr;
+  }
+
+  void HttpContext::chunked_push(AsyncStreamHandler handler)
+  {
+    res_.chunked(handler != nullptr);
+    do_stream_chunk = nullptr;
+    chunk_generator_ = nullptr;
+    async_stream_handler_ = std::move(handler);
+  }
+
+  void HttpContext::read_body(BodyReadHandler handler)
+  {
+    body_read_handler_ = std::move(handler);
+  }
+
+  void HttpContext::defer(DeferHandler handler)
+  {
+    defer_handler_ = std::move(handler);
   }
 
   void HttpContext::set_header(const boost::beast::string_view name, const boost::beast::string_view value) const
@@ -502,6 +507,16 @@ namespace khttpd::framework
 
   void HttpContext::set_path_params(std::map<std::string, std::string> params) const
   {
-    path_params_ = std::move(params);
+    path_params_storage_ = std::move(params);
+    path_params_.clear();
+    for (const auto& [key, value] : path_params_storage_)
+    {
+      path_params_.push_back(key, value);
+    }
+  }
+
+  void HttpContext::set_path_params(const ParamList& params) const
+  {
+    path_params_ = params;
   }
 }
@@ -4,23 +4,26 @@
 #include <boost/beast/http/message.hpp>
 #include <boost/beast/http/string_body.hpp>
 #include <boost/beast/http/status.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/asio/any_io_executor.hpp>
 #include <boost/url/url_view.hpp>
 #include <boost/json.hpp>
 #include <string>
+#include <functional>
+#include <memory>
 #include <map>
 #include <optional>
 #include <vector>
 #include <any>
+#include <array>
+#include <deque>
+#include <exception>
+#include <string_view>
+#include <memory_resource>
+#include "context/multipart_parser.hpp"
 
 namespace khttpd::framework
 {
-  struct MultipartFile
-  {
-    std::string filename;
-    std::string content_type;
-    std::string data;
-  };
-
   struct CookieOptions
   {
     int max_age = -1; // -1 means session cookie, 0 means delete
@@ -32,6 +35,114 @@ namespace khttpd::framework
   };
 
 
+  // 小容量参数表：前 inline_capacity 个参数存放在定长数组中，超出时才从 resource 分配内存。
+  // 名字和值都是视图，由使用方保证被引用的字符串比参数表活得更久。
+  class ParamList
+  {
+  public:
+    static constexpr size_t inline_capacity = 16;
+    using value_type = std::pair<std::string_view, std::string_view>;
+
+    explicit ParamList(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+      : overflow_(resource)
+    {
+    }
+
+    void push_back(std::string_view name, std::string_view value)
+    {
+      if (size_ < inline_capacity)
+      {
+        inline_[size_] = {name, value};
+      }
+      else
+      {
+        overflow_.emplace_back(name, value);
+      }
+      ++size_;
+    }
+
+    // 返回第一个名字匹配的参数值
+    std::optional<std::string_view> find(std::string_view name) const
+    {
+      for (size_t i = 0; i < size_; ++i)
+      {
+        if (const auto& item = (*this)[i]; item.first == name)
+        {
+          return item.second;
+        }
+      }
+      return std::nullopt;
+    }
+
+    const value_type& operator[](size_t i) const
+    {
+      return i < inline_capacity ? inline_[i] : overflow_[i - inline_capacity];
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    void clear()
+    {
+      size_ = 0;
+      overflow_.clear();
+    }
+
+  private:
+    std::array<value_type, inline_capacity> inline_{};
+    std::pmr::vector<value_type> overflow_;
+    size_t size_ = 0;
+  };
+
+  // 分块响应的推送端，由 HttpSession 实现。
+  // write/finish 可以在任意线程调用，数据会在会话的 strand 上按调用顺序写出。
+  // 背压：on_written 在这块数据真正写入 socket 后回调，生产者应等待回调再写下一块；
+  // 连接出错或已结束时，回调会收到非零的 error_code。
+  class ChunkWriter
+  {
+  public:
+    using WriteCallback = std::function<void(boost::beast::error_code)>;
+
+    virtual ~ChunkWriter() = default;
+
+    virtual void write(std::string chunk, WriteCallback on_written = nullptr) = 0;
+    // 写出结束块 (0\r\n\r\n)，之后的 write 都会失败
+    virtual void finish(WriteCallback on_finished = nullptr) = 0;
+  };
+
+  // 流式请求体的读取端，由 HttpSession 实现，见 HttpContext::read_body。
+  // read/finish 可以在任意线程调用，回调在会话的 strand 上执行；同一时间只能有一个未完成的 read
+  class BodyReader
+  {
+  public:
+    // chunk 只在回调期间有效；请求体读完时以空的 chunk 回调。
+    // ec 为 http::error::body_limit 表示请求体超出了路由的 body_limit
+    using ReadCallback = std::function<void(boost::beast::error_code ec, std::string_view chunk)>;
+
+    virtual ~BodyReader() = default;
+
+    // 读取下一块数据，回调返回之前不会继续从连接上读取
+    virtual void read(ReadCallback on_chunk) = 0;
+    // 发送 HttpContext 中已设置的响应；请求体没有读完时，响应后关闭连接。
+    // 最后一个引用释放时还没调用的话会自动调用
+    virtual void finish() = 0;
+  };
+
+  // 延迟响应的完成端，由 HttpSession 实现，见 HttpContext::defer。
+  // complete/fail 可以在任意线程调用，只有第一次调用生效；最后一个引用释放时还没调用的话会自动 complete
+  class ResponseHandle
+  {
+  public:
+    virtual ~ResponseHandle() = default;
+
+    // 会话的 executor：在它上面修改 HttpContext 不会与会话的其他操作并发
+    virtual boost::asio::any_io_executor get_executor() const = 0;
+    // 运行后置拦截器，发送 HttpContext 中已设置的响应
+    virtual void complete() = 0;
+    // 交给路由器的异常处理器生成响应并发送，不运行后置拦截器
+    virtual void fail(std::exception_ptr error) = 0;
+  };
+
   class HttpContext
   {
   public:
@@ -39,15 +150,36 @@ namespace khttpd::framework
     using Response = boost::beast::http::response<boost::beast::http::string_body>;
     using WriteHandler = std::function<bool(const std::string& buffer)>;
     using HttpStreamHandler = std::function<void(HttpContext&, const WriteHandler&)>;
+    // pull 风格：每次调用产出下一块数据，返回 std::nullopt 表示结束；在会话的 io 线程上调用，
+    // 上一块写完后才会请求下一块
+    using ChunkGenerator = std::function<std::optional<std::string>()>;
+    // push 风格：响应头写出后以 ChunkWriter 调用，可以把它交给其他线程或异步操作继续写
+    using AsyncStreamHandler = std::function<void(std::shared_ptr<ChunkWriter>)>;
+    // 分块读取请求体：handler 返回后以 BodyReader 调用，响应在 BodyReader::finish 之后发送
+    using BodyReadHandler = std::function<void(std::shared_ptr<BodyReader>)>;
+    // 延迟响应：handler 返回后以 ResponseHandle 调用，响应在 complete/fail 之后发送
+    using DeferHandler = std::function<void(std::shared_ptr<ResponseHandle>)>;
 
-    HttpContext(Request& req, Response& res);
+    // resource 用于本上下文内部的解析缓存（参数表、表单、Cookie、属性等）。HttpSession 传入每个请求
+    // 开始时重置的单调内存池，使这些分配只是移动指针；resource 必须比 HttpContext 活得更久
+    HttpContext(Request& req, Response& res,
+                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
     ~HttpContext();
+    // 参数表中的视图指向本对象自己的存储（path_params_storage_、decoded_storage_ 等），拷贝后会指向原对象
+    HttpContext(const HttpContext&) = delete;
+    HttpContext& operator=(const HttpContext&) = delete;
 
     const std::string& path() const;
     boost::beast::http::verb method() const;
     std::string body() const;
     std::optional<std::string> get_query_param(const std::string& key) const;
     std::optional<std::string> get_path_param(const std::string& key) const;
+
+    // 零拷贝访问器：返回的视图引用请求缓冲区（或本 HttpContext 内部的解码缓存），
+    // 只在本 HttpContext 及其请求对象存活且未被移动期间有效
+    std::string_view body_view() const;
+    std::optional<std::string_view> query_param_view(std::string_view key) const;
+    std::optional<std::string_view> path_param_view(std::string_view key) const;
     std::optional<std::string> get_header(boost::beast::string_view name) const;
     std::optional<std::string> get_header(boost::beast::http::field name) const;
     std::optional<std::vector<std::string>> get_headers(boost::beast::string_view name) const;
@@ -62,7 +194,20 @@ namespace khttpd::framework
     std::optional<std::string> get_form_param(const std::string& key) const;
 
     std::optional<std::string> get_multipart_field(const std::string& key) const;
+    // 大文件的内容在临时文件中（MultipartFile::path），临时文件在本 HttpContext 析构时删除，
+    // 需要保留时调用 MultipartFile::save_as
     const std::vector<MultipartFile>* get_uploaded_files(const std::string& field_name) const;
+    // 由 HttpSession 在读取请求体的同时解析好的 multipart 数据
+    void set_multipart_data(MultipartFormData data) const;
+
+    // 以 BodyMode::stream 注册的路由在读完请求头时就调用 handler，请求体需要通过 read_body 读取，
+    // body()、表单等访问器此时都是空的；其他路由也可以调用，整个请求体会作为一块交给 BodyReader。
+    // 不调用 read_body 的 handler（例如根据请求头拒绝请求）返回后立即发送响应
+    void read_body(BodyReadHandler handler);
+
+    // handler 返回时还不能给出响应（例如要等待数据库或上游服务），之后再通过 ResponseHandle 完成。
+    // 等待期间会话不占用线程，也不读取同一连接上的下一个请求；不能与 read_body 同时使用
+    void defer(DeferHandler handler);
 
 
     void set_status(boost::beast::http::status status) const;
@@ -81,7 +226,10 @@ namespace khttpd::framework
       set_body_json(boost::json::value_from(t, sp), opts);
     }
 
+    // 旧接口：handler 同步运行，写入的数据先进入会话的发送队列，handler 返回后再异步写出
     void chunked(const HttpStreamHandler& handler);
+    void chunked_pull(ChunkGenerator generator);
+    void chunked_push(AsyncStreamHandler handler);
     void set_header(boost::beast::string_view name, boost::beast::string_view value) const;
     void set_header(boost::beast::http::field name, boost::beast::string_view value) const;
     void set_content_type(boost::beast::string_view type) const;
@@ -91,18 +239,24 @@ namespace khttpd::framework
     Request& get_request() { return req_; }
     Response& get_response() { return res_; }
     HttpStreamHandler get_stream_handler() const { return do_stream_chunk; }
+    const ChunkGenerator& get_chunk_generator() const { return chunk_generator_; }
+    const AsyncStreamHandler& get_async_stream_handler() const { return async_stream_handler_; }
+    const BodyReadHandler& get_body_read_handler() const { return body_read_handler_; }
+    const DeferHandler& get_defer_handler() const { return defer_handler_; }
 
     void set_path_params(std::map<std::string, std::string> params) const;
+    // 参数名与值均为视图，由路由器传入（名字来自路由表，值来自 path()）
+    void set_path_params(const ParamList& params) const;
 
     // Extended data for interceptors/handlers
     void set_attribute(const std::string& key, std::any value) const
     {
-      extended_data_[key] = std::move(value);
+      extended_data_.insert_or_assign(std::pmr::string(key, resource_), std::move(value));
     }
 
     std::any get_attribute(const std::string& key) const
     {
-      auto it = extended_data_.find(key);
+      auto it = extended_data_.find(std::string_view(key));
       if (it != extended_data_.end())
       {
         return it->second;
@@ -113,7 +267,7 @@ namespace khttpd::framework
     template <typename T>
     std::optional<T> get_attribute_as(const std::string& key) const
     {
-      auto it = extended_data_.find(key);
+      auto it = extended_data_.find(std::string_view(key));
       if (it != extended_data_.end())
       {
         try
@@ -129,36 +283,48 @@ namespace khttpd::framework
     }
 
   private:
+    // 以 pmr::string 为键、支持 string_view 查找的映射，节点和字符串都从 resource_ 分配
+    template <class T>
+    using StringMap = std::pmr::map<std::pmr::string, T, std::less<>>;
+
     Request& req_;
     Response& res_;
-    mutable std::map<std::string, std::string> query_params_;
+    std::pmr::memory_resource* const resource_;
+    mutable ParamList query_params_;
+    mutable bool query_parsed_ = false;
+    // 含 %xx 或 '+' 的查询参数解码后的存储，deque 保证已有元素地址不变
+    mutable std::pmr::deque<std::pmr::string> decoded_storage_;
     mutable std::string cached_path_;
     mutable boost::urls::url_view parsed_url_;
     mutable bool url_parsed_ = false;
 
-    mutable std::map<std::string, std::string> path_params_;
+    mutable ParamList path_params_;
+    mutable std::map<std::string, std::string> path_params_storage_; // set_path_params(std::map) 时持有数据
 
     mutable std::optional<boost::json::value> cached_json_;
-    mutable std::map<std::string, std::string> cached_form_params_;
+    mutable StringMap<std::pmr::string> cached_form_params_;
     mutable bool form_params_parsed_ = false;
 
-    mutable std::map<std::string, std::string> cached_multipart_fields_;
-    mutable std::map<std::string, std::vector<MultipartFile>> cached_multipart_files_;
+    mutable StringMap<std::pmr::string> cached_multipart_fields_;
+    mutable StringMap<std::vector<MultipartFile>> cached_multipart_files_;
     mutable bool multipart_parsed_ = false;
     HttpStreamHandler do_stream_chunk = nullptr;
+    ChunkGenerator chunk_generator_ = nullptr;
+    AsyncStreamHandler async_stream_handler_ = nullptr;
+    BodyReadHandler body_read_handler_ = nullptr;
+    DeferHandler defer_handler_ = nullptr;
 
-    mutable std::map<std::string, std::any> extended_data_;
+    mutable StringMap<std::any> extended_data_;
 
-    mutable std::map<std::string, std::vector<std::string>> cached_cookies_;
+    mutable StringMap<std::pmr::vector<std::pmr::string>> cached_cookies_;
     mutable bool cookies_parsed_ = false;
     void parse_cookies() const;
 
     void parse_url_components() const;
+    void parse_query_params() const;
+    std::string_view decode_query_component(std::string_view component) const;
     void parse_form_params() const;
     void parse_multipart_data() const;
-
-    static std::string trim(const std::string& str);
-    static std::string extract_header_value(const std::string& headers, const std::string& header_name);
   };
 }
 #endif // KHTTPD_FRAMEWORK_CONTEXT_HTTP_CONTEXT_HPP_
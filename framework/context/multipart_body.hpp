@@ -0,0 +1,75 @@
+// framework/context/multipart_body.hpp
+#ifndef KHTTPD_FRAMEWORK_CONTEXT_MULTIPART_BODY_HPP
+#define KHTTPD_FRAMEWORK_CONTEXT_MULTIPART_BODY_HPP
+
+#include <boost/beast/core/buffers_range.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/http/error.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <memory>
+
+#include "context/multipart_parser.hpp"
+
+namespace khttpd::framework
+{
+  // 只用于读取请求的 Beast Body：收到的请求体直接交给 MultipartParser，不保存在内存中。
+  // 构造 parser 时传入解析器，例如 request_parser<MultipartBody>(std::move(header_parser), multipart_parser)
+  struct MultipartBody
+  {
+    using value_type = std::shared_ptr<MultipartParser>;
+
+    class reader
+    {
+    public:
+      template <bool isRequest, class Fields>
+      reader(boost::beast::http::header<isRequest, Fields>&, value_type& body)
+        : body_(body)
+      {
+      }
+
+      void init(const boost::optional<std::uint64_t>&, boost::beast::error_code& ec)
+      {
+        ec = {};
+      }
+
+      template <class ConstBufferSequence>
+      std::size_t put(const ConstBufferSequence& buffers, boost::beast::error_code& ec)
+      {
+        std::size_t bytes = 0;
+        for (const auto buffer : boost::beast::buffers_range_ref(buffers))
+        {
+          if (!body_->feed({static_cast<const char*>(buffer.data()), buffer.size()}))
+          {
+            ec = error(body_->error());
+            return bytes;
+          }
+          bytes += buffer.size();
+        }
+        ec = {};
+        return bytes;
+      }
+
+      void finish(boost::beast::error_code& ec)
+      {
+        ec = body_->finish() ? boost::beast::error_code{} : error(body_->error());
+      }
+
+    private:
+      value_type& body_;
+
+      // 具体原因由会话通过 MultipartParser::error() 判断，这里只需要让读取失败
+      static boost::beast::error_code error(MultipartParser::Error error)
+      {
+        if (error == MultipartParser::Error::too_large)
+        {
+          return boost::beast::http::error::body_limit;
+        }
+        return boost::beast::http::error::bad_transfer_encoding;
+      }
+    };
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_CONTEXT_MULTIPART_BODY_HPP
@@ -0,0 +1,567 @@
+// framework/context/multipart_parser.cpp
+#include "multipart_parser.hpp"
+#include "static_file/header_value.hpp"
+
+#include <boost/filesystem.hpp>
+#include <fmt/core.h>
+#include <algorithm>
+
+namespace khttpd::framework
+{
+  namespace fs = boost::filesystem;
+  namespace beast = boost::beast;
+
+  namespace
+  {
+    // 依次取出 "; key=value" 形式的参数，值可以是带反斜杠转义的 quoted-string
+    class ParameterReader
+    {
+    public:
+      explicit ParameterReader(std::string_view input) : input_(input)
+      {
+      }
+
+      bool next(std::string_view& key, std::string& value)
+      {
+        while (!input_.empty())
+        {
+          const std::size_t eq = input_.find_first_of("=;");
+          if (eq == std::string_view::npos || input_[eq] == ';')
+          {
+            // 没有值的参数，跳过
+            input_ = eq == std::string_view::npos ? std::string_view{} : input_.substr(eq + 1);
+            continue;
+          }
+          key = trim(input_.substr(0, eq));
+          input_ = trim(input_.substr(eq + 1));
+          value.clear();
+          if (!input_.empty() && input_.front() == '"')
+          {
+            std::size_t i = 1;
+            for (; i < input_.size() && input_[i] != '"'; ++i)
+            {
+              if (input_[i] == '\\' && i + 1 < input_.size())
+              {
+                ++i;
+              }
+              value += input_[i];
+            }
+            input_.remove_prefix(std::min(i + 1, input_.size()));
+            const std::size_t semicolon = input_.find(';');
+            input_ = semicolon == std::string_view::npos ? std::string_view{} : input_.substr(semicolon + 1);
+          }
+          else
+          {
+            const std::size_t semicolon = input_.find(';');
+            value = std::string(trim(input_.substr(0, semicolon)));
+            input_ = semicolon == std::string_view::npos ? std::string_view{} : input_.substr(semicolon + 1);
+          }
+          return true;
+        }
+        return false;
+      }
+
+    private:
+      std::string_view input_;
+    };
+
+    // RFC 8187 的扩展参数：charset'language'percent-encoded
+    std::string decode_extended_value(std::string_view value)
+    {
+      const std::size_t first = value.find('\'');
+      const std::size_t second = first == std::string_view::npos ? first : value.find('\'', first + 1);
+      if (second == std::string_view::npos)
+      {
+        return std::string(value);
+      }
+      value.remove_prefix(second + 1);
+
+      auto hex = [](const char c) -> int
+      {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+      };
+      std::string decoded;
+      decoded.reserve(value.size());
+      for (std::size_t i = 0; i < value.size(); ++i)
+      {
+        if (value[i] == '%' && i + 2 < value.size() && hex(value[i + 1]) >= 0 && hex(value[i + 2]) >= 0)
+        {
+          decoded += static_cast<char>(hex(value[i + 1]) * 16 + hex(value[i + 2]));
+          i += 2;
+        }
+        else
+        {
+          decoded += value[i];
+        }
+      }
+      return decoded;
+    }
+
+    bool write_all(beast::file& file, std::string_view data, beast::error_code& ec)
+    {
+      while (!data.empty())
+      {
+        const std::size_t written = file.write(data.data(), data.size(), ec);
+        if (ec)
+        {
+          return false;
+        }
+        data.remove_prefix(written);
+      }
+      return true;
+    }
+  }
+
+  MultipartTempFile::~MultipartTempFile()
+  {
+    if (!released_)
+    {
+      boost::system::error_code ec;
+      fs::remove(path_, ec);
+    }
+  }
+
+  bool MultipartFile::save_as(const std::string& destination) const
+  {
+    beast::error_code ec;
+    if (!path.empty())
+    {
+      boost::system::error_code rename_ec;
+      fs::rename(path, destination, rename_ec);
+      if (!rename_ec)
+      {
+        if (temp_file)
+        {
+          temp_file->release();
+        }
+        return true;
+      }
+
+      // 跨文件系统等情况下不能重命名，复制一份
+      beast::file source;
+      beast::file target;
+      source.open(path.c_str(), beast::file_mode::scan, ec);
+      if (!ec)
+      {
+        target.open(destination.c_str(), beast::file_mode::write, ec);
+      }
+      char buffer[64 * 1024];
+      while (!ec)
+      {
+        const std::size_t n = source.read(buffer, sizeof(buffer), ec);
+        if (ec || n == 0)
+        {
+          break;
+        }
+        write_all(target, {buffer, n}, ec);
+      }
+    }
+    else if (data.size() == size)
+    {
+      beast::file target;
+      target.open(destination.c_str(), beast::file_mode::write, ec);
+      if (!ec)
+      {
+        write_all(target, data, ec);
+      }
+    }
+    else
+    {
+      // 内容交给了 MultipartSink，这里没有数据
+      return false;
+    }
+
+    if (ec)
+    {
+      fmt::print(stderr, "Failed to save uploaded file '{}' to {}: {}\n", filename, destination, ec.message());
+      return false;
+    }
+    return true;
+  }
+
+  std::optional<std::string> multipart_boundary(std::string_view content_type)
+  {
+    const std::size_t semicolon = content_type.find(';');
+    if (!iequals(trim(content_type.substr(0, semicolon)), "multipart/form-data") ||
+      semicolon == std::string_view::npos)
+    {
+      return std::nullopt;
+    }
+
+    ParameterReader parameters(content_type.substr(semicolon + 1));
+    std::string_view key;
+    std::string value;
+    while (parameters.next(key, value))
+    {
+      if (iequals(key, "boundary"))
+      {
+        if (value.empty())
+        {
+          return std::nullopt;
+        }
+        return value;
+      }
+    }
+    return std::nullopt;
+  }
+
+  MultipartParser::MultipartParser(std::string boundary, const MultipartOptions& options)
+    : options_(options), delimiter_("\r\n--" + boundary), buffer_("\r\n")
+  {
+  }
+
+  MultipartParser::~MultipartParser() = default;
+
+  bool MultipartParser::fail(const Error error, std::string message)
+  {
+    error_ = error;
+    error_message_ = std::move(message);
+    buffer_.clear();
+    sink_.reset();
+    beast::error_code ec;
+    temp_.close(ec);
+    // 未完成分段的临时文件随 file_ 一起删除
+    file_ = {};
+    return false;
+  }
+
+  bool MultipartParser::feed(std::string_view data)
+  {
+    if (error_ != Error::none)
+    {
+      return false;
+    }
+    total_size_ += data.size();
+    if (total_size_ > options_.max_total_size)
+    {
+      return fail(Error::too_large, "multipart body exceeds max_total_size");
+    }
+    if (state_ == State::done)
+    {
+      return true;
+    }
+
+    buffer_.append(data);
+    std::size_t pos = 0;
+    bool need_more = false;
+    while (!need_more)
+    {
+      switch (state_)
+      {
+      case State::preamble:
+        {
+          const std::size_t found = buffer_.find(delimiter_, pos);
+          if (found == std::string::npos)
+          {
+            // 只保留可能是分隔符开头的部分
+            pos = std::max(pos, buffer_.size() - std::min(buffer_.size(), delimiter_.size() - 1));
+            need_more = true;
+            break;
+          }
+          pos = found + delimiter_.size();
+          state_ = State::after_delimiter;
+          break;
+        }
+      case State::after_delimiter:
+        {
+          // 分隔符后面是 "--"（结束）或可选的空白加 CRLF
+          std::size_t p = pos;
+          while (p < buffer_.size() && (buffer_[p] == ' ' || buffer_[p] == '\t'))
+          {
+            ++p;
+          }
+          if (p - pos > options_.max_header_size)
+          {
+            return fail(Error::too_large, "multipart delimiter line is too long");
+          }
+          if (buffer_.size() - p < 2)
+          {
+            need_more = true;
+            break;
+          }
+          if (p == pos && buffer_.compare(p, 2, "--") == 0)
+          {
+            pos = buffer_.size();
+            state_ = State::done;
+            need_more = true;
+            break;
+          }
+          if (buffer_.compare(p, 2, "\r\n") != 0)
+          {
+            return fail(Error::malformed, "malformed multipart delimiter");
+          }
+          pos = p + 2;
+          state_ = State::headers;
+          break;
+        }
+      case State::headers:
+        {
+          if (buffer_.size() - pos < 2)
+          {
+            need_more = true;
+            break;
+          }
+          std::size_t end;
+          std::size_t next;
+          if (buffer_.compare(pos, 2, "\r\n") == 0)
+          {
+            // 没有任何分段头部
+            end = pos;
+            next = pos + 2;
+          }
+          else
+          {
+            end = buffer_.find("\r\n\r\n", pos);
+            next = end + 4;
+          }
+          if (end == std::string::npos || end - pos > options_.max_header_size)
+          {
+            if (buffer_.size() - pos > options_.max_header_size)
+            {
+              return fail(Error::too_large, "multipart part headers exceed max_header_size");
+            }
+            need_more = true;
+            break;
+          }
+          if (!parse_part_headers(std::string_view(buffer_).substr(pos, end - pos)) || !begin_part())
+          {
+            return false;
+          }
+          pos = next;
+          state_ = State::body;
+          break;
+        }
+      case State::body:
+        {
+          const std::size_t found = buffer_.find(delimiter_, pos);
+          if (found == std::string::npos)
+          {
+            const std::size_t keep = std::min(buffer_.size() - pos, delimiter_.size() - 1);
+            if (!write_part(std::string_view(buffer_).substr(pos, buffer_.size() - keep - pos)))
+            {
+              return false;
+            }
+            pos = buffer_.size() - keep;
+            need_more = true;
+            break;
+          }
+          if (!write_part(std::string_view(buffer_).substr(pos, found - pos)) || !end_part())
+          {
+            return false;
+          }
+          pos = found + delimiter_.size();
+          state_ = State::after_delimiter;
+          break;
+        }
+      case State::done:
+        pos = buffer_.size();
+        need_more = true;
+        break;
+      }
+    }
+    buffer_.erase(0, pos);
+    return true;
+  }
+
+  bool MultipartParser::finish()
+  {
+    if (error_ != Error::none)
+    {
+      return false;
+    }
+    if (state_ != State::done)
+    {
+      return fail(Error::malformed, "multipart body ended before the closing delimiter");
+    }
+    return true;
+  }
+
+  bool MultipartParser::parse_part_headers(std::string_view headers)
+  {
+    part_ = {};
+    is_file_ = false;
+    bool has_name = false;
+    while (!headers.empty())
+    {
+      const std::size_t line_end = headers.find("\r\n");
+      const std::string_view line = headers.substr(0, line_end);
+      headers = line_end == std::string_view::npos ? std::string_view{} : headers.substr(line_end + 2);
+
+      const std::size_t colon = line.find(':');
+      if (colon == std::string_view::npos)
+      {
+        return fail(Error::malformed, "malformed multipart part header");
+      }
+      const std::string_view name = trim(line.substr(0, colon));
+      const std::string_view value = trim(line.substr(colon + 1));
+
+      if (iequals(name, "Content-Type"))
+      {
+        part_.content_type = std::string(value);
+      }
+      else if (iequals(name, "Content-Disposition"))
+      {
+        const std::size_t semicolon = value.find(';');
+        if (!iequals(trim(value.substr(0, semicolon)), "form-data") || semicolon == std::string_view::npos)
+        {
+          continue;
+        }
+        ParameterReader parameters(value.substr(semicolon + 1));
+        std::string_view key;
+        std::string parameter;
+        bool has_extended_filename = false;
+        while (parameters.next(key, parameter))
+        {
+          if (iequals(key, "name"))
+          {
+            part_.name = parameter;
+            has_name = true;
+          }
+          else if (iequals(key, "filename*"))
+          {
+            part_.filename = decode_extended_value(parameter);
+            has_extended_filename = true;
+            is_file_ = true;
+          }
+          else if (iequals(key, "filename") && !has_extended_filename)
+          {
+            part_.filename = parameter;
+            is_file_ = true;
+          }
+        }
+      }
+    }
+    skip_ = !has_name;
+    return true;
+  }
+
+  bool MultipartParser::begin_part()
+  {
+    if (++parts_ > options_.max_parts)
+    {
+      return fail(Error::too_large, "multipart body exceeds max_parts");
+    }
+    field_value_.clear();
+    if (skip_ || !is_file_)
+    {
+      return true;
+    }
+
+    file_ = {};
+    file_.filename = part_.filename;
+    file_.content_type = part_.content_type;
+    if (options_.file_sink)
+    {
+      sink_ = options_.file_sink(part_);
+    }
+    return true;
+  }
+
+  bool MultipartParser::write_part(const std::string_view data)
+  {
+    if (skip_ || data.empty())
+    {
+      return true;
+    }
+    if (!is_file_)
+    {
+      if (field_value_.size() + data.size() > options_.max_field_size)
+      {
+        return fail(Error::too_large, fmt::format("multipart field '{}' exceeds max_field_size", part_.name));
+      }
+      field_value_.append(data);
+      return true;
+    }
+
+    file_.size += data.size();
+    if (file_.size > options_.max_file_size)
+    {
+      return fail(Error::too_large, fmt::format("uploaded file '{}' exceeds max_file_size", part_.filename));
+    }
+    if (sink_)
+    {
+      if (!sink_->write(data))
+      {
+        return fail(Error::io_error, fmt::format("multipart sink rejected '{}'", part_.filename));
+      }
+      return true;
+    }
+    if (temp_.is_open())
+    {
+      beast::error_code ec;
+      if (!write_all(temp_, data, ec))
+      {
+        return fail(Error::io_error, fmt::format("failed to write {}: {}", file_.path, ec.message()));
+      }
+      return true;
+    }
+    file_.data.append(data);
+    return file_.data.size() <= options_.memory_threshold || spill_to_disk();
+  }
+
+  bool MultipartParser::spill_to_disk()
+  {
+    boost::system::error_code fs_ec;
+    fs::path directory = options_.temp_directory.empty()
+                           ? fs::temp_directory_path(fs_ec)
+                           : fs::path(options_.temp_directory);
+    if (fs_ec)
+    {
+      return fail(Error::io_error, fmt::format("no temporary directory: {}", fs_ec.message()));
+    }
+
+    file_.path = (directory / fs::unique_path("khttpd-upload-%%%%-%%%%-%%%%-%%%%")).string();
+    beast::error_code ec;
+    // write_new：文件已存在时失败，不会覆盖别人的文件
+    temp_.open(file_.path.c_str(), beast::file_mode::write_new, ec);
+    if (ec)
+    {
+      return fail(Error::io_error, fmt::format("failed to create {}: {}", file_.path, ec.message()));
+    }
+    file_.temp_file = std::make_shared<MultipartTempFile>(file_.path);
+    if (!write_all(temp_, file_.data, ec))
+    {
+      return fail(Error::io_error, fmt::format("failed to write {}: {}", file_.path, ec.message()));
+    }
+    std::string().swap(file_.data);
+    return true;
+  }
+
+  bool MultipartParser::end_part()
+  {
+    if (!skip_ && !is_file_)
+    {
+      result_.fields.emplace_back(std::move(part_.name), std::move(field_value_));
+    }
+    else if (!skip_)
+    {
+      if (sink_)
+      {
+        const bool finished = sink_->finish(file_);
+        sink_.reset();
+        if (!finished)
+        {
+          return fail(Error::io_error, fmt::format("multipart sink failed to finish '{}'", part_.filename));
+        }
+      }
+      if (temp_.is_open())
+      {
+        beast::error_code ec;
+        temp_.close(ec);
+        if (ec)
+        {
+          return fail(Error::io_error, fmt::format("failed to write {}: {}", file_.path, ec.message()));
+        }
+      }
+      result_.files.emplace_back(std::move(part_.name), std::move(file_));
+    }
+    file_ = {};
+    field_value_.clear();
+    is_file_ = false;
+    skip_ = false;
+    return true;
+  }
+}
@@ -0,0 +1,186 @@
+// framework/context/multipart_parser.hpp
+#ifndef KHTTPD_FRAMEWORK_CONTEXT_MULTIPART_PARSER_HPP
+#define KHTTPD_FRAMEWORK_CONTEXT_MULTIPART_PARSER_HPP
+
+#include <boost/beast/core/file.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace khttpd::framework
+{
+  // 上传文件落盘时使用的临时文件，最后一个持有者析构时删除
+  class MultipartTempFile
+  {
+  public:
+    explicit MultipartTempFile(std::string path) : path_(std::move(path))
+    {
+    }
+
+    MultipartTempFile(const MultipartTempFile&) = delete;
+    MultipartTempFile& operator=(const MultipartTempFile&) = delete;
+    ~MultipartTempFile();
+
+    const std::string& path() const { return path_; }
+    // 文件已被移走（例如 MultipartFile::save_as 重命名），析构时不再删除
+    void release() { released_ = true; }
+
+  private:
+    std::string path_;
+    bool released_ = false;
+  };
+
+  struct MultipartFile
+  {
+    std::string filename;
+    std::string content_type;
+    // 不超过 MultipartOptions::memory_threshold 的文件内容保存在这里
+    std::string data;
+    // 更大的文件写入临时文件，data 为空；请求结束、最后一个 MultipartFile 副本析构时删除
+    std::string path;
+    std::shared_ptr<MultipartTempFile> temp_file;
+    // 文件内容的字节数，交给 MultipartSink 的文件同样会统计
+    std::uint64_t size = 0;
+
+    bool in_memory() const { return path.empty(); }
+
+    // 把内容保存到 destination：临时文件优先重命名，失败（例如跨文件系统）时复制；
+    // 内容交给了 MultipartSink 时返回 false
+    bool save_as(const std::string& destination) const;
+  };
+
+  // 文件分段的头信息，用于决定把内容交给哪个 MultipartSink
+  struct MultipartPartInfo
+  {
+    std::string name;
+    std::string filename;
+    std::string content_type;
+  };
+
+  // 用户提供的文件内容接收端，例如直接上传到对象存储。write 在读取请求体的 io 线程上按顺序调用，
+  // 返回 false 时中止解析并以 500 响应
+  class MultipartSink
+  {
+  public:
+    virtual ~MultipartSink() = default;
+
+    virtual bool write(std::string_view data) = 0;
+    // 分段结束，可以在 file 中记录位置（例如 path）；返回 false 表示失败
+    virtual bool finish(MultipartFile& file) = 0;
+  };
+
+  // 返回 nullptr 时按默认方式处理（小文件放在内存，大文件落盘）
+  using MultipartSinkFactory = std::function<std::unique_ptr<MultipartSink>(const MultipartPartInfo& part)>;
+
+  struct MultipartOptions
+  {
+    // 在读取请求体的同时解析 multipart/form-data，大文件直接写入临时文件，不在内存中保留整个请求体。
+    // 关闭后请求体先完整读入内存，在第一次访问时解析
+    bool streaming = true;
+    // 整个 multipart 请求体的上限，超过时返回 413；同时作为这类请求的 body_limit
+    std::uint64_t max_total_size = 1024ull * 1024 * 1024;
+    // 单个文件的上限，超过时返回 413
+    std::uint64_t max_file_size = 512ull * 1024 * 1024;
+    // 普通字段保存在内存中，单个字段的上限
+    std::size_t max_field_size = 1024 * 1024;
+    // 分段个数与单个分段头部的上限
+    std::size_t max_parts = 1000;
+    std::size_t max_header_size = 16 * 1024;
+    // 超过该大小的文件写入临时文件
+    std::size_t memory_threshold = 64 * 1024;
+    // 临时文件所在的目录，为空时使用系统临时目录
+    std::string temp_directory;
+    MultipartSinkFactory file_sink;
+  };
+
+  // 解析结果，按在请求体中出现的顺序排列
+  struct MultipartFormData
+  {
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::vector<std::pair<std::string, MultipartFile>> files;
+  };
+
+  // 从 Content-Type 中取出 boundary 参数（可以带引号），不是 multipart/form-data 时返回 std::nullopt
+  std::optional<std::string> multipart_boundary(std::string_view content_type);
+
+  // 增量的 multipart/form-data (RFC 7578) 解析器：请求体可以按任意大小分块传入，
+  // 只保留可能是分隔符开头的少量数据，文件内容直接交给内存、临时文件或 MultipartSink
+  class MultipartParser
+  {
+  public:
+    enum class Error
+    {
+      none,
+      malformed,
+      // 超过了 max_total_size、max_file_size、max_field_size、max_parts 或 max_header_size
+      too_large,
+      // 写临时文件或 MultipartSink 失败
+      io_error,
+    };
+
+    MultipartParser(std::string boundary, const MultipartOptions& options);
+    ~MultipartParser();
+
+    MultipartParser(const MultipartParser&) = delete;
+    MultipartParser& operator=(const MultipartParser&) = delete;
+
+    // 返回 false 表示出错，之后的数据都会被忽略
+    bool feed(std::string_view data);
+    // 请求体结束；没有读到结束分隔符时视为格式错误
+    bool finish();
+
+    bool done() const { return state_ == State::done; }
+    Error error() const { return error_; }
+    const std::string& error_message() const { return error_message_; }
+
+    // 取出解析结果，只应在 finish() 成功之后调用
+    MultipartFormData release() { return std::move(result_); }
+
+  private:
+    enum class State
+    {
+      preamble,
+      after_delimiter,
+      headers,
+      body,
+      // 读到结束分隔符，之后的数据（epilogue）全部忽略
+      done,
+    };
+
+    const MultipartOptions& options_;
+    // "\r\n--" + boundary；请求体前面补一个 "\r\n"，第一个分隔符也能用同样的方式匹配
+    const std::string delimiter_;
+    State state_ = State::preamble;
+    Error error_ = Error::none;
+    std::string error_message_;
+    std::string buffer_;
+    std::uint64_t total_size_ = 0;
+    std::size_t parts_ = 0;
+
+    // 当前分段
+    MultipartPartInfo part_;
+    std::string field_value_;
+    MultipartFile file_;
+    std::unique_ptr<MultipartSink> sink_;
+    boost::beast::file temp_;
+    bool is_file_ = false;
+    // 没有 Content-Disposition name 的分段，内容直接丢弃
+    bool skip_ = false;
+
+    MultipartFormData result_;
+
+    bool fail(Error error, std::string message);
+    bool parse_part_headers(std::string_view headers);
+    bool begin_part();
+    bool write_part(std::string_view data);
+    bool end_part();
+    bool spill_to_disk();
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_CONTEXT_MULTIPART_PARSER_HPP
@@ -1,6 +1,7 @@
 // framework/context/websocket_context.cpp
 #include "websocket_context.hpp"
 #include "websocket/websocket_session.hpp"
+#include "websocket/websocket_topics.hpp"
 #include <fmt/core.h>
 
 #include <utility>
@@ -40,4 +41,21 @@ namespace khttpd::framework
       fmt::print(stderr, "Error: Attempted to send WS message to expired session (path: {}).\n", path);
     }
   }
+
+  bool WebsocketContext::subscribe(const std::string& topic)
+  {
+    const auto session_shared_ptr = session_weak_ptr.lock();
+    return session_shared_ptr && WebsocketTopics::instance().subscribe(topic, session_shared_ptr);
+  }
+
+  bool WebsocketContext::unsubscribe(const std::string& topic)
+  {
+    const auto session_shared_ptr = session_weak_ptr.lock();
+    return session_shared_ptr && WebsocketTopics::instance().unsubscribe(topic, *session_shared_ptr);
+  }
+
+  std::size_t WebsocketContext::publish(const std::string& topic, const std::string& msg, bool is_text_msg)
+  {
+    return websocket::publish(topic, msg, is_text_msg);
+  }
 }
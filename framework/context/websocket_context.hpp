@@ -31,6 +31,12 @@ namespace khttpd::framework
 
     void send(const std::string& msg, bool is_text = true);
 
+    // 当前会话订阅/退订主题，会话关闭时自动退订
+    bool subscribe(const std::string& topic);
+    bool unsubscribe(const std::string& topic);
+    // 向主题的所有订阅者发送，返回订阅者数
+    std::size_t publish(const std::string& topic, const std::string& msg, bool is_text = true);
+
     void set_attribute(const std::string& key, std::any value) {
         extended_data[key] = std::move(value);
     }
@@ -12,6 +12,10 @@ namespace khttpd::framework
 #define KHTTPD_ROUTE(VERB, PATH, METHOD_NAME) \
 router.VERB(base_path() + PATH, bind_handler(&std::decay_t<decltype(*this)>::METHOD_NAME))
 #endif
+#ifndef KHTTPD_ASYNC_ROUTE
+#define KHTTPD_ASYNC_ROUTE(VERB, PATH, METHOD_NAME) \
+router.VERB##_async(base_path() + PATH, bind_async_handler(&std::decay_t<decltype(*this)>::METHOD_NAME))
+#endif
 #ifndef KHTTPD_WSROUTE
 #define KHTTPD_WSROUTE_NULL_HANDLER nullptr
 
@@ -82,6 +86,12 @@ router.VERB(base_path() + PATH, bind_handler(&std::decay_t<decltype(*this)>::MET
     {
       return std::bind(method_ptr, this->shared_from_this(), std::placeholders::_1);
     }
+
+    template <typename MethodPtr>
+    auto bind_async_handler(MethodPtr method_ptr)
+    {
+      return std::bind(method_ptr, this->shared_from_this(), std::placeholders::_1, std::placeholders::_2);
+    }
   };
 } // namespace khttpd::framework
 
@@ -0,0 +1,1516 @@
+#include "http2_session.hpp"
+
+#include "context/http_context.hpp"
+#include "static_file/static_file_response.hpp"
+#include <boost/url/parse.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <fmt/core.h>
+#include <nghttp2/nghttp2.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+using namespace khttpd::framework;
+
+namespace
+{
+  // 每次写操作最多合并的帧数据量
+  constexpr std::size_t max_write_size = 64 * 1024;
+  constexpr std::size_t read_buffer_size = 16 * 1024;
+
+  // HTTP/2 禁止逐跳头部（RFC 9113 8.2.2），HTTP/1.1 的响应头转换时去掉
+  bool is_connection_specific(const std::string_view name)
+  {
+    return beast::iequals(name, "connection") || beast::iequals(name, "keep-alive") ||
+      beast::iequals(name, "proxy-connection") || beast::iequals(name, "transfer-encoding") ||
+      beast::iequals(name, "upgrade");
+  }
+
+  nghttp2_nv make_nv(const std::string_view name, const std::string_view value)
+  {
+    return {
+      reinterpret_cast<std::uint8_t*>(const_cast<char*>(name.data())),
+      reinterpret_cast<std::uint8_t*>(const_cast<char*>(value.data())),
+      name.size(), value.size(), NGHTTP2_NV_FLAG_NONE
+    };
+  }
+
+  // HTTP2-Settings 请求头是不带填充的 base64url（RFC 7540 3.2.1）
+  std::optional<std::string> decode_base64url(const std::string_view input)
+  {
+    std::string output;
+    output.reserve(input.size() * 3 / 4);
+    std::uint32_t bits = 0;
+    int count = 0;
+    for (const char c : input)
+    {
+      int value;
+      if (c >= 'A' && c <= 'Z') value = c - 'A';
+      else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+      else if (c >= '0' && c <= '9') value = c - '0' + 52;
+      else if (c == '-') value = 62;
+      else if (c == '_') value = 63;
+      else if (c == '=') break;
+      else return std::nullopt;
+      bits = (bits << 6) | static_cast<std::uint32_t>(value);
+      count += 6;
+      if (count >= 8)
+      {
+        count -= 8;
+        output.push_back(static_cast<char>((bits >> count) & 0xff));
+      }
+    }
+    return output;
+  }
+
+  http::status multipart_error_status(const MultipartParser::Error error)
+  {
+    switch (error)
+    {
+    case MultipartParser::Error::io_error:
+      return http::status::internal_server_error;
+    case MultipartParser::Error::malformed:
+      return http::status::bad_request;
+    default:
+      return http::status::payload_too_large;
+    }
+  }
+}
+
+struct Http2Session::StreamState
+{
+  explicit StreamState(const std::int32_t stream_id)
+    : id(stream_id)
+  {
+  }
+
+  struct PendingChunk
+  {
+    std::string data;
+    ChunkWriter::WriteCallback on_written;
+    bool last = false;
+  };
+
+  const std::int32_t id;
+  http::request<http::string_body> req;
+  http::response<http::string_body> res;
+  // 引用 req 与 res，声明在它们之后，保证先析构
+  std::shared_ptr<HttpContext> ctx;
+  std::size_t header_list_size = 0;
+  bool headers_done = false;
+  bool request_ended = false;
+  bool responded = false;
+  // 流已关闭（正常结束、被重置或连接断开），之后的读写都直接失败
+  bool closed = false;
+  // 等待客户端发送请求头或请求体的截止时间，见 Http2Session::set_stream_deadline
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+
+  // 请求体：默认读入 req.body()；multipart 请求交给 multipart 解析；BodyMode::stream 路由由 handler 读取
+  std::uint64_t body_limit = 0;
+  std::uint64_t body_received = 0;
+  std::shared_ptr<MultipartParser> multipart;
+  bool streamed = false;
+  // 已拒绝或 handler 不再读取的请求体，收到的数据直接丢弃
+  bool discarding = false;
+  bool body_too_large = false;
+  bool buffered_body_read = false;
+  // 收到但还没交给 handler 的数据，占用的窗口在交出之后才归还，handler 读得慢时客户端随之暂停
+  std::string body_buffer;
+  std::string body_chunk;
+  BodyReader::ReadCallback pending_read;
+
+  // 响应体的数据来源，nghttp2 需要发送 DATA 帧时从中读取
+  std::unique_ptr<ResponseSource> response;
+  std::deque<PendingChunk> chunks;
+  std::size_t chunk_offset = 0;
+  bool chunk_closed = false;
+  HttpContext::ChunkGenerator chunk_generator;
+};
+
+class Http2Session::ResponseSource
+{
+public:
+  virtual ~ResponseSource() = default;
+
+  // 按 nghttp2_data_source_read_callback 的约定填充 buf：返回写入的字节数，
+  // 数据结束时在 data_flags 中设置 NGHTTP2_DATA_FLAG_EOF，暂时没有数据时返回 NGHTTP2_ERR_DEFERRED
+  virtual ssize_t read(std::uint8_t* buf, std::size_t length, std::uint32_t* data_flags) = 0;
+};
+
+// 用 Beast 的 Body::writer 取出响应体，string_body、span_body、file_body 与 StaticFileBody 都经由它发送
+template <class Body>
+class Http2Session::BodyResponseSource : public ResponseSource
+{
+public:
+  BodyResponseSource(http::response<Body>&& res, std::shared_ptr<const StaticFile> file)
+    : res_(std::move(res)), file_(std::move(file)), writer_(res_.base(), res_.body())
+  {
+    writer_.init(ec_);
+  }
+
+  const http::response_header<>& header() const { return res_.base(); }
+
+  ssize_t read(std::uint8_t* buf, std::size_t length, std::uint32_t* data_flags) override
+  {
+    std::size_t copied = 0;
+    while (copied < length)
+    {
+      if (current_ == buffers_.size())
+      {
+        if (!more_)
+        {
+          *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+          break;
+        }
+        if (!next())
+        {
+          // 响应头已经发出，只能重置这个流
+          return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
+        continue;
+      }
+      auto& buffer = buffers_[current_];
+      const std::size_t size = std::min(length - copied, buffer.size());
+      std::memcpy(buf + copied, buffer.data(), size);
+      buffer += size;
+      copied += size;
+      if (buffer.size() == 0)
+      {
+        ++current_;
+      }
+    }
+    return static_cast<ssize_t>(copied);
+  }
+
+private:
+  http::response<Body> res_;
+  // span_body 引用缓存中的文件内容，随响应一起持有
+  std::shared_ptr<const StaticFile> file_;
+  typename Body::writer writer_;
+  beast::error_code ec_;
+  // 上一次 get 返回的缓冲区，file_body 的缓冲区在下一次 get 之前有效
+  std::vector<net::const_buffer> buffers_;
+  std::size_t current_ = 0;
+  bool more_ = true;
+
+  bool next()
+  {
+    buffers_.clear();
+    current_ = 0;
+    if (!ec_)
+    {
+      if (auto result = writer_.get(ec_); !ec_)
+      {
+        if (!result)
+        {
+          more_ = false;
+          return true;
+        }
+        for (const auto buffer : beast::buffers_range_ref(result->first))
+        {
+          if (buffer.size() > 0)
+          {
+            buffers_.push_back(buffer);
+          }
+        }
+        more_ = result->second;
+        return true;
+      }
+    }
+    fmt::print(stderr, "Http2Session serialize response error: {}\n", ec_.message());
+    return false;
+  }
+};
+
+// 分块响应：数据块按顺序作为 DATA 帧发出，结束块对应 END_STREAM
+class Http2Session::ChunkResponseSource : public ResponseSource
+{
+public:
+  ChunkResponseSource(StreamState& stream, net::any_io_executor executor)
+    : stream_(stream), executor_(std::move(executor))
+  {
+  }
+
+  ssize_t read(std::uint8_t* buf, std::size_t length, std::uint32_t* data_flags) override
+  {
+    auto& chunks = stream_.chunks;
+    std::size_t copied = 0;
+    while (copied < length && !chunks.empty())
+    {
+      auto& chunk = chunks.front();
+      const std::size_t size = std::min(length - copied, chunk.data.size() - stream_.chunk_offset);
+      std::memcpy(buf + copied, chunk.data.data() + stream_.chunk_offset, size);
+      copied += size;
+      stream_.chunk_offset += size;
+      if (stream_.chunk_offset < chunk.data.size())
+      {
+        break;
+      }
+
+      // 数据已经交给帧缓冲区；回调中可能会继续排入新的数据块，不能在 nghttp2 的回调中执行
+      const bool last = chunk.last;
+      if (chunk.on_written)
+      {
+        net::post(executor_, [on_written = std::move(chunk.on_written)]
+        {
+          on_written({});
+        });
+      }
+      chunks.pop_front();
+      stream_.chunk_offset = 0;
+      if (last)
+      {
+        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+        return static_cast<ssize_t>(copied);
+      }
+    }
+    if (copied == 0)
+    {
+      // enqueue_chunk 排入新数据后调用 nghttp2_session_resume_data
+      return NGHTTP2_ERR_DEFERRED;
+    }
+    return static_cast<ssize_t>(copied);
+  }
+
+private:
+  StreamState& stream_;
+  net::any_io_executor executor_;
+};
+
+class Http2Session::AsyncBodyReader : public BodyReader
+{
+public:
+  AsyncBodyReader(std::shared_ptr<Http2Session> session, std::shared_ptr<StreamState> stream)
+    : session_(std::move(session)), stream_(std::move(stream))
+  {
+  }
+
+  ~AsyncBodyReader() override
+  {
+    finish();
+  }
+
+  void read(ReadCallback on_chunk) override
+  {
+    net::dispatch(session_->lowest_layer().get_executor(),
+                  [session = session_, stream = stream_, on_chunk = std::move(on_chunk)]() mutable
+                  {
+                    session->read_body_chunk(stream, std::move(on_chunk));
+                  });
+  }
+
+  void finish() override
+  {
+    if (finished_.exchange(true))
+    {
+      return;
+    }
+    net::dispatch(session_->lowest_layer().get_executor(), [session = session_, stream = stream_]
+    {
+      session->finish_body_read(stream);
+    });
+  }
+
+private:
+  std::shared_ptr<Http2Session> session_;
+  std::shared_ptr<StreamState> stream_;
+  std::atomic<bool> finished_{false};
+};
+
+class Http2Session::AsyncResponseHandle : public ResponseHandle
+{
+public:
+  AsyncResponseHandle(std::shared_ptr<Http2Session> session, std::shared_ptr<StreamState> stream)
+    : session_(std::move(session)), stream_(std::move(stream))
+  {
+  }
+
+  ~AsyncResponseHandle() override
+  {
+    complete();
+  }
+
+  net::any_io_executor get_executor() const override
+  {
+    return session_->lowest_layer().get_executor();
+  }
+
+  void complete() override
+  {
+    finish(nullptr);
+  }
+
+  void fail(std::exception_ptr error) override
+  {
+    finish(std::move(error));
+  }
+
+private:
+  void finish(std::exception_ptr error)
+  {
+    if (finished_.exchange(true))
+    {
+      return;
+    }
+    net::dispatch(session_->lowest_layer().get_executor(),
+                  [session = session_, stream = stream_, error = std::move(error)]
+                  {
+                    session->finish_deferred(stream, error);
+                  });
+  }
+
+  std::shared_ptr<Http2Session> session_;
+  std::shared_ptr<StreamState> stream_;
+  std::atomic<bool> finished_{false};
+};
+
+class Http2Session::AsyncChunkWriter : public ChunkWriter
+{
+public:
+  AsyncChunkWriter(std::shared_ptr<Http2Session> session, std::shared_ptr<StreamState> stream)
+    : session_(std::move(session)), stream_(std::move(stream))
+  {
+  }
+
+  void write(std::string chunk, WriteCallback on_written) override
+  {
+    net::dispatch(session_->lowest_layer().get_executor(),
+                  [session = session_, stream = stream_, chunk = std::move(chunk),
+                    on_written = std::move(on_written)]() mutable
+                  {
+                    session->enqueue_chunk(stream, std::move(chunk), std::move(on_written), false);
+                  });
+  }
+
+  void finish(WriteCallback on_finished) override
+  {
+    net::dispatch(session_->lowest_layer().get_executor(),
+                  [session = session_, stream = stream_, on_finished = std::move(on_finished)]() mutable
+                  {
+                    session->enqueue_chunk(stream, {}, std::move(on_finished), true);
+                  });
+  }
+
+private:
+  std::shared_ptr<Http2Session> session_;
+  std::shared_ptr<StreamState> stream_;
+};
+
+// StaticFileResponder 生成的响应作为这个流的响应发送；文件内容要切成 DATA 帧，不能用 sendfile
+class Http2Session::StaticFileSink
+{
+public:
+  StaticFileSink(Http2Session& session, std::shared_ptr<StreamState> stream)
+    : session_(session), stream_(std::move(stream))
+  {
+  }
+
+  template <class Body>
+  void send(http::response<Body>&& res, std::shared_ptr<const StaticFile> file)
+  {
+    session_.send_response(stream_, std::move(res), std::move(file));
+  }
+
+  bool send_file_zero_copy(std::shared_ptr<const StaticFile>& file, const ByteRange* range)
+  {
+    boost::ignore_unused(file, range);
+    return false;
+  }
+
+private:
+  Http2Session& session_;
+  std::shared_ptr<StreamState> stream_;
+};
+
+// nghttp2 的回调，user_data 为 Http2Session
+struct Http2Session::Callbacks
+{
+  static Http2Session& self(void* user_data)
+  {
+    return *static_cast<Http2Session*>(user_data);
+  }
+
+  static std::shared_ptr<StreamState> find(Http2Session& session, const std::int32_t stream_id)
+  {
+    const auto it = session.streams_.find(stream_id);
+    return it == session.streams_.end() ? nullptr : it->second;
+  }
+
+  static int on_begin_headers(nghttp2_session*, const nghttp2_frame* frame, void* user_data)
+  {
+    if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST)
+    {
+      return 0;
+    }
+    auto& session = self(user_data);
+    const auto stream = std::make_shared<StreamState>(frame->hd.stream_id);
+    session.streams_.emplace(stream->id, stream);
+    // 请求头可能分成 HEADERS 与多个 CONTINUATION 帧，收齐之前按 header_read 计时
+    session.set_stream_deadline(*stream, session.options_.timeouts.header_read);
+    if (!session.writing_)
+    {
+      session.update_expiry();
+    }
+    return 0;
+  }
+
+  static int on_header(nghttp2_session*, const nghttp2_frame* frame, const std::uint8_t* name, std::size_t name_length,
+                       const std::uint8_t* value, std::size_t value_length, std::uint8_t, void* user_data)
+  {
+    auto& session = self(user_data);
+    const auto stream = find(session, frame->hd.stream_id);
+    // 请求体之后的 trailer 不传给 handler
+    if (frame->hd.type != NGHTTP2_HEADERS || !stream || stream->headers_done)
+    {
+      return 0;
+    }
+
+    // 与 SETTINGS_MAX_HEADER_LIST_SIZE 的算法相同：每个字段额外计 32 字节
+    stream->header_list_size += name_length + value_length + 32;
+    if (stream->header_list_size > session.options_.http2.max_header_list_size)
+    {
+      // 重置这个流，连接上的其他流不受影响
+      return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+    }
+
+    const std::string_view n(reinterpret_cast<const char*>(name), name_length);
+    const std::string_view v(reinterpret_cast<const char*>(value), value_length);
+    auto& req = stream->req;
+    if (n == ":method")
+    {
+      req.method_string(v);
+    }
+    else if (n == ":path")
+    {
+      req.target(v);
+    }
+    else if (n == ":authority")
+    {
+      // 替代 HTTP/1.1 的 Host，两者都有时以 :authority 为准
+      req.set(http::field::host, v);
+    }
+    else if (n == "host")
+    {
+      if (req.find(http::field::host) == req.end())
+      {
+        req.set(http::field::host, v);
+      }
+    }
+    else if (n == "cookie")
+    {
+      // HTTP/2 允许把 Cookie 拆成多个字段，交给 handler 之前按 HTTP/1.1 的格式合并
+      if (const auto it = req.find(http::field::cookie); it != req.end())
+      {
+        req.set(http::field::cookie, std::string(it->value()) + "; " + std::string(v));
+      }
+      else
+      {
+        req.set(http::field::cookie, v);
+      }
+    }
+    else if (n.empty() || n.front() != ':')
+    {
+      req.insert(n, v);
+    }
+    return 0;
+  }
+
+  static int on_frame_recv(nghttp2_session*, const nghttp2_frame* frame, void* user_data)
+  {
+    auto& session = self(user_data);
+    const bool end_stream = (frame->hd.flags & NGHTTP2_FLAG_END_STREAM) != 0;
+    switch (frame->hd.type)
+    {
+    case NGHTTP2_HEADERS:
+      if (const auto stream = find(session, frame->hd.stream_id))
+      {
+        if (frame->headers.cat == NGHTTP2_HCAT_REQUEST)
+        {
+          session.on_request_headers(stream, end_stream);
+        }
+        else if (end_stream)
+        {
+          session.on_request_end(stream);
+        }
+      }
+      break;
+    case NGHTTP2_DATA:
+      if (const auto stream = find(session, frame->hd.stream_id); stream && end_stream)
+      {
+        session.on_request_end(stream);
+      }
+      break;
+    default:
+      break;
+    }
+    return 0;
+  }
+
+  static int on_data_chunk_recv(nghttp2_session*, std::uint8_t, std::int32_t stream_id, const std::uint8_t* data,
+                                std::size_t length, void* user_data)
+  {
+    auto& session = self(user_data);
+    if (const auto stream = find(session, stream_id))
+    {
+      session.on_request_data(stream, {reinterpret_cast<const char*>(data), length});
+    }
+    else
+    {
+      session.consume(stream_id, length);
+    }
+    return 0;
+  }
+
+  static int on_frame_send(nghttp2_session* nghttp2, const nghttp2_frame* frame, void* user_data)
+  {
+    if ((frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA) ||
+      (frame->hd.flags & NGHTTP2_FLAG_END_STREAM) == 0)
+    {
+      return 0;
+    }
+    // 响应已经发完而请求体还在上传（已拒绝或 handler 没有读完），让客户端停止发送（RFC 9113 8.1）
+    const auto stream = find(self(user_data), frame->hd.stream_id);
+    if (stream && stream->discarding && !stream->request_ended)
+    {
+      nghttp2_submit_rst_stream(nghttp2, NGHTTP2_FLAG_NONE, stream->id, NGHTTP2_NO_ERROR);
+    }
+    return 0;
+  }
+
+  static int on_stream_close(nghttp2_session*, std::int32_t stream_id, std::uint32_t, void* user_data)
+  {
+    self(user_data).on_stream_close(stream_id);
+    return 0;
+  }
+
+  static ssize_t read_response(nghttp2_session*, std::int32_t, std::uint8_t* buf, std::size_t length,
+                               std::uint32_t* data_flags, nghttp2_data_source* source, void*)
+  {
+    return static_cast<StreamState*>(source->ptr)->response->read(buf, length, data_flags);
+  }
+};
+
+Http2Session::Http2Session(Transport&& transport, HttpRouter& router, StaticFileCache& static_files,
+                           const HttpSessionOptions& options, HttpSessionStats& stats)
+  : transport_(std::move(transport)),
+    router_(router),
+    static_files_(static_files),
+    options_(options),
+    stats_(stats),
+    read_buffer_(read_buffer_size),
+    stream_timer_(lowest_layer().get_executor())
+{
+}
+
+Http2Session::~Http2Session()
+{
+  nghttp2_session_del(session_);
+}
+
+bool Http2Session::start()
+{
+  nghttp2_session_callbacks* callbacks = nullptr;
+  nghttp2_session_callbacks_new(&callbacks);
+  nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, &Callbacks::on_begin_headers);
+  nghttp2_session_callbacks_set_on_header_callback(callbacks, &Callbacks::on_header);
+  nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &Callbacks::on_frame_recv);
+  nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, &Callbacks::on_data_chunk_recv);
+  nghttp2_session_callbacks_set_on_frame_send_callback(callbacks, &Callbacks::on_frame_send);
+  nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &Callbacks::on_stream_close);
+
+  // 请求体占用的窗口由 consume 手动归还，BodyMode::stream 的请求体因此受 handler 读取速度的约束
+  nghttp2_option* option = nullptr;
+  nghttp2_option_new(&option);
+  nghttp2_option_set_no_auto_window_update(option, 1);
+
+  const int rv = nghttp2_session_server_new2(&session_, callbacks, this, option);
+  nghttp2_option_del(option);
+  nghttp2_session_callbacks_del(callbacks);
+  if (rv != 0)
+  {
+    fmt::print(stderr, "Http2Session create error: {}\n", nghttp2_strerror(rv));
+    return false;
+  }
+
+  const auto& http2 = options_.http2;
+  const nghttp2_settings_entry settings[] = {
+    {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, http2.max_concurrent_streams},
+    {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, http2.initial_window_size},
+    {NGHTTP2_SETTINGS_MAX_HEADER_LIST_SIZE, http2.max_header_list_size},
+  };
+  nghttp2_submit_settings(session_, NGHTTP2_FLAG_NONE, settings, std::size(settings));
+  // 连接级窗口没有对应的 SETTINGS，以 WINDOW_UPDATE 调大
+  nghttp2_session_set_local_window_size(session_, NGHTTP2_FLAG_NONE, 0,
+                                        static_cast<std::int32_t>(http2.connection_window_size));
+  ++stats_.http2_connections;
+  return true;
+}
+
+void Http2Session::run(const std::string_view received)
+{
+  if (!start())
+  {
+    return do_close();
+  }
+  if (!received.empty() && !receive(received))
+  {
+    return do_write();
+  }
+  update_expiry();
+  do_read();
+  do_write();
+}
+
+void Http2Session::run_upgraded(const std::string_view settings, http::request<http::string_body>&& request,
+                                const std::string_view received)
+{
+  const auto payload = decode_base64url(settings);
+  if (!payload || !start())
+  {
+    return do_close();
+  }
+  // 升级请求成为半关闭的流 1，HTTP2-Settings 视为客户端的第一个 SETTINGS 帧
+  const int rv = nghttp2_session_upgrade2(session_, reinterpret_cast<const std::uint8_t*>(payload->data()),
+                                          payload->size(), request.method() == http::verb::head, nullptr);
+  if (rv != 0)
+  {
+    fmt::print(stderr, "Http2Session upgrade error: {}\n", nghttp2_strerror(rv));
+    return do_close();
+  }
+
+  auto stream = std::make_shared<StreamState>(1);
+  streams_.emplace(stream->id, stream);
+  stream->req = std::move(request);
+  stream->req.version(20);
+  stream->headers_done = true;
+  stream->request_ended = true;
+  ++stats_.http2_streams;
+  handle_request(stream);
+
+  if (!received.empty() && !receive(received))
+  {
+    return do_write();
+  }
+  update_expiry();
+  do_read();
+  do_write();
+}
+
+void Http2Session::set_expiry(const std::chrono::milliseconds timeout)
+{
+  if (timeout.count() > 0)
+  {
+    lowest_layer().expires_after(timeout);
+  }
+  else
+  {
+    lowest_layer().expires_never();
+  }
+}
+
+void Http2Session::update_expiry()
+{
+  set_expiry(streams_.empty() ? options_.timeouts.keep_alive_idle : std::chrono::milliseconds::zero());
+}
+
+void Http2Session::set_stream_deadline(StreamState& stream, const std::chrono::milliseconds timeout)
+{
+  if (timeout.count() > 0)
+  {
+    stream.deadline = std::chrono::steady_clock::now() + timeout;
+  }
+  else if (stream.deadline)
+  {
+    stream.deadline.reset();
+  }
+  else
+  {
+    return;
+  }
+  arm_stream_timer();
+}
+
+void Http2Session::arm_stream_timer()
+{
+  std::optional<std::chrono::steady_clock::time_point> earliest;
+  for (const auto& [id, stream] : streams_)
+  {
+    if (stream->deadline && (!earliest || *stream->deadline < *earliest))
+    {
+      earliest = stream->deadline;
+    }
+  }
+  if (closed_ || !earliest)
+  {
+    stream_timer_.cancel();
+    return;
+  }
+  stream_timer_.expires_at(*earliest);
+  stream_timer_.async_wait(beast::bind_front_handler(&Http2Session::on_stream_timer, shared_from_this()));
+}
+
+void Http2Session::on_stream_timer(beast::error_code ec)
+{
+  if (ec == net::error::operation_aborted || closed_)
+  {
+    return;
+  }
+
+  // 定时器到期与重新设置之间可能有流的截止时间被推后，按当前时间逐个检查
+  const auto now = std::chrono::steady_clock::now();
+  bool header_timeout = false;
+  for (const auto& [id, stream] : streams_)
+  {
+    if (!stream->deadline || *stream->deadline > now)
+    {
+      continue;
+    }
+    stream->deadline.reset();
+    if (!stream->headers_done)
+    {
+      ++stats_.header_timeouts;
+      header_timeout = true;
+    }
+    else
+    {
+      ++stats_.body_timeouts;
+      nghttp2_submit_rst_stream(session_, NGHTTP2_FLAG_NONE, id, NGHTTP2_CANCEL);
+    }
+  }
+  if (header_timeout)
+  {
+    // 没有收齐的头部块之后只能是它的 CONTINUATION 帧，整个连接都被阻塞；发送 GOAWAY，写完之后关闭连接
+    nghttp2_session_terminate_session(session_, NGHTTP2_NO_ERROR);
+  }
+  arm_stream_timer();
+  do_write();
+}
+
+bool Http2Session::receive(const std::string_view data)
+{
+  in_nghttp2_ = true;
+  const auto rv = nghttp2_session_mem_recv(session_, reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+  in_nghttp2_ = false;
+  if (rv < 0)
+  {
+    // 协议错误：发送 GOAWAY，写完之后关闭连接
+    if (rv != NGHTTP2_ERR_BAD_CLIENT_MAGIC)
+    {
+      fmt::print(stderr, "Http2Session receive error: {}\n", nghttp2_strerror(static_cast<int>(rv)));
+    }
+    nghttp2_session_terminate_session(session_, NGHTTP2_PROTOCOL_ERROR);
+    return false;
+  }
+  return true;
+}
+
+void Http2Session::do_read()
+{
+  if (closed_ || !nghttp2_session_want_read(session_))
+  {
+    return;
+  }
+  with_transport([this](auto& stream)
+  {
+    stream.async_read_some(net::buffer(read_buffer_),
+                           beast::bind_front_handler(&Http2Session::on_read, shared_from_this()));
+  });
+}
+
+void Http2Session::on_read(beast::error_code ec, std::size_t bytes_transferred)
+{
+  if (ec)
+  {
+    if (ec == beast::error::timeout)
+    {
+      // 写超时由 on_write 计数
+      if (!writing_) ++stats_.idle_timeouts;
+    }
+    else if (ec != net::error::eof && ec != net::ssl::error::stream_truncated &&
+      ec != net::error::operation_aborted)
+    {
+      fmt::print(stderr, "Http2Session on_read error: {}\n", ec.message());
+    }
+    return do_close();
+  }
+
+  if (!receive({read_buffer_.data(), bytes_transferred}))
+  {
+    return do_write();
+  }
+  do_write();
+  do_read();
+}
+
+void Http2Session::do_write()
+{
+  if (writing_ || in_nghttp2_ || closed_)
+  {
+    return;
+  }
+
+  // 把 nghttp2 已经准备好的帧合并为一次写操作
+  write_buffer_.clear();
+  in_nghttp2_ = true;
+  while (write_buffer_.size() < max_write_size)
+  {
+    const std::uint8_t* data = nullptr;
+    const auto size = nghttp2_session_mem_send(session_, &data);
+    if (size < 0)
+    {
+      in_nghttp2_ = false;
+      fmt::print(stderr, "Http2Session send error: {}\n", nghttp2_strerror(static_cast<int>(size)));
+      return do_close();
+    }
+    if (size == 0)
+    {
+      break;
+    }
+    write_buffer_.insert(write_buffer_.end(), data, data + size);
+  }
+  in_nghttp2_ = false;
+
+  if (write_buffer_.empty())
+  {
+    // GOAWAY 已经发出且没有活动的流，或者对端关闭了会话
+    if (!nghttp2_session_want_read(session_) && !nghttp2_session_want_write(session_))
+    {
+      do_close();
+    }
+    return;
+  }
+
+  writing_ = true;
+  set_expiry(options_.timeouts.write);
+  with_transport([this](auto& stream)
+  {
+    net::async_write(stream, net::buffer(write_buffer_),
+                     beast::bind_front_handler(&Http2Session::on_write, shared_from_this()));
+  });
+}
+
+void Http2Session::on_write(beast::error_code ec, std::size_t bytes_transferred)
+{
+  boost::ignore_unused(bytes_transferred);
+  writing_ = false;
+  if (ec)
+  {
+    if (ec == beast::error::timeout)
+    {
+      ++stats_.write_timeouts;
+    }
+    else if (ec != net::error::operation_aborted)
+    {
+      fmt::print(stderr, "Http2Session on_write error: {}\n", ec.message());
+    }
+    return do_close();
+  }
+
+  do_write();
+  if (!writing_ && !closed_)
+  {
+    update_expiry();
+  }
+}
+
+void Http2Session::do_close()
+{
+  if (closed_)
+  {
+    return;
+  }
+  closed_ = true;
+  stream_timer_.cancel();
+
+  // 结束所有流：未完成的回调收到错误，它们持有的会话引用随之释放
+  std::vector<std::int32_t> stream_ids;
+  for (const auto& [id, stream] : streams_)
+  {
+    stream_ids.push_back(id);
+  }
+  for (const auto id : stream_ids)
+  {
+    on_stream_close(id);
+  }
+
+  // GOAWAY 已经告知对端会话结束，TLS 连接不再等待 close_notify 的往返；未完成的读操作随之结束
+  beast::error_code ec;
+  lowest_layer().socket().shutdown(tcp::socket::shutdown_both, ec);
+  lowest_layer().cancel();
+}
+
+void Http2Session::on_request_headers(const std::shared_ptr<StreamState>& stream, const bool end_stream)
+{
+  ++stats_.http2_streams;
+  auto& req = stream->req;
+  req.version(20);
+  stream->headers_done = true;
+  set_stream_deadline(*stream, std::chrono::milliseconds::zero());
+
+  std::string path(req.target().substr(0, req.target().find('?')));
+  if (const auto url = boost::urls::parse_relative_ref(req.target()); url.has_value())
+  {
+    path = url.value().path();
+  }
+  const RouteOptions* route = router_.find_route_options(req.method(), path);
+
+  // 与 HttpSession::prepare_body 相同的规则
+  stream->body_limit = options_.body_limit;
+  std::optional<std::string> boundary;
+  if (route && route->body_mode == BodyMode::stream)
+  {
+    stream->streamed = true;
+  }
+  else if (options_.multipart.streaming && (boundary = multipart_boundary(req[http::field::content_type])))
+  {
+    stream->body_limit = options_.multipart.max_total_size;
+    stream->multipart = std::make_shared<MultipartParser>(std::move(*boundary), options_.multipart);
+  }
+  if (route && route->body_limit)
+  {
+    stream->body_limit = stream->multipart ? std::min(stream->body_limit, *route->body_limit) : *route->body_limit;
+  }
+
+  // HTTP/2 的请求可以不带 Content-Length，没有时在收到数据时检查
+  if (const auto length = req[http::field::content_length]; !length.empty())
+  {
+    std::uint64_t value = 0;
+    const auto [end, error] = std::from_chars(length.data(), length.data() + length.size(), value);
+    if (error == std::errc() && end == length.data() + length.size() && value > stream->body_limit)
+    {
+      return reject_request(stream, http::status::payload_too_large);
+    }
+  }
+
+  if (stream->streamed)
+  {
+    // handler 读取请求体时才按 body_read 计时，见 deliver_body_chunk
+    handle_request(stream);
+  }
+  else if (!end_stream)
+  {
+    set_stream_deadline(*stream, options_.timeouts.body_read);
+  }
+  if (end_stream)
+  {
+    on_request_end(stream);
+  }
+}
+
+void Http2Session::on_request_data(const std::shared_ptr<StreamState>& stream, const std::string_view data)
+{
+  if (stream->discarding)
+  {
+    return consume(stream->id, data.size());
+  }
+
+  stream->body_received += data.size();
+  if (stream->body_received > stream->body_limit)
+  {
+    consume(stream->id, data.size());
+    if (stream->streamed)
+    {
+      // 与 HTTP/1.1 一样由 BodyReader::read 报告 body_limit
+      stream->body_too_large = true;
+      discard_body(*stream);
+      return deliver_body_chunk(stream);
+    }
+    return reject_request(stream, http::status::payload_too_large);
+  }
+
+  if (stream->streamed)
+  {
+    stream->body_buffer.append(data);
+    return deliver_body_chunk(stream);
+  }
+
+  consume(stream->id, data.size());
+  if (stream->multipart)
+  {
+    if (!stream->multipart->feed(data))
+    {
+      reject_request(stream, multipart_error_status(stream->multipart->error()));
+    }
+    return;
+  }
+  stream->req.body().append(data);
+}
+
+void Http2Session::on_request_end(const std::shared_ptr<StreamState>& stream)
+{
+  stream->request_ended = true;
+  set_stream_deadline(*stream, std::chrono::milliseconds::zero());
+  if (stream->streamed)
+  {
+    return deliver_body_chunk(stream);
+  }
+  if (stream->discarding)
+  {
+    return;
+  }
+  if (stream->multipart && !stream->multipart->finish())
+  {
+    return reject_request(stream, multipart_error_status(stream->multipart->error()));
+  }
+  handle_request(stream);
+}
+
+void Http2Session::on_stream_close(const std::int32_t stream_id)
+{
+  const auto it = streams_.find(stream_id);
+  if (it == streams_.end())
+  {
+    return;
+  }
+  const auto stream = std::move(it->second);
+  streams_.erase(it);
+
+  stream->closed = true;
+  stream->chunk_closed = true;
+  stream->chunk_generator = nullptr;
+  const auto executor = lowest_layer().get_executor();
+  for (auto& chunk : stream->chunks)
+  {
+    if (chunk.on_written)
+    {
+      net::post(executor, [on_written = std::move(chunk.on_written)]
+      {
+        on_written(net::error::operation_aborted);
+      });
+    }
+  }
+  stream->chunks.clear();
+  if (stream->pending_read)
+  {
+    net::post(executor, [on_chunk = std::move(stream->pending_read)]
+    {
+      on_chunk(net::error::operation_aborted, {});
+    });
+    stream->pending_read = nullptr;
+  }
+
+  if (stream->deadline)
+  {
+    arm_stream_timer();
+  }
+  if (!writing_ && !closed_)
+  {
+    update_expiry();
+  }
+}
+
+void Http2Session::handle_request(const std::shared_ptr<StreamState>& stream)
+{
+  stream->ctx = std::make_shared<HttpContext>(stream->req, stream->res);
+  auto& ctx = *stream->ctx;
+  if (stream->multipart)
+  {
+    ctx.set_multipart_data(stream->multipart->release());
+    stream->multipart.reset();
+  }
+
+  try
+  {
+    if (router_.run_pre_interceptors(ctx) == InterceptorResult::Stop)
+    {
+      router_.run_post_interceptors(ctx);
+      send_context_response(stream);
+      return;
+    }
+
+    bool static_file_served = false;
+    router_.dispatch(ctx, [this, &stream, &static_file_served]
+    {
+      const auto method = stream->req.method();
+      if (method == http::verb::get || method == http::verb::head)
+      {
+        static_file_served = serve_static_file(stream);
+      }
+      return static_file_served;
+    });
+
+    if (static_file_served)
+    {
+      return;
+    }
+
+    // handler 要读取请求体，响应等 BodyReader::finish 之后再处理
+    if (const auto& handler = ctx.get_body_read_handler())
+    {
+      handler(std::make_shared<AsyncBodyReader>(shared_from_this(), stream));
+      return;
+    }
+
+    // handler 延迟了响应，等 ResponseHandle 完成；同一连接上的其他流照常处理
+    if (const auto& handler = ctx.get_defer_handler())
+    {
+      const auto response = std::make_shared<AsyncResponseHandle>(shared_from_this(), stream);
+      try
+      {
+        handler(response);
+      }
+      catch (...)
+      {
+        response->fail(std::current_exception());
+      }
+      return;
+    }
+
+    router_.run_post_interceptors(ctx);
+    send_context_response(stream);
+  }
+  catch (...)
+  {
+    router_.handle_exception(std::current_exception(), ctx);
+    if (stream->streamed && !stream->request_ended)
+    {
+      discard_body(*stream);
+    }
+    send_response(stream, std::move(stream->res));
+  }
+}
+
+bool Http2Session::serve_static_file(const std::shared_ptr<StreamState>& stream)
+{
+  // path() 已经去除了查询字符串
+  const std::string& request_path = stream->ctx->path();
+  StaticFileSink sink(*this, stream);
+  StaticFileResponder<http::request<http::string_body>, StaticFileSink> responder(
+    stream->req, static_files_.options(), sink);
+  return responder.respond(static_files_.lookup(request_path), request_path);
+}
+
+void Http2Session::reject_request(const std::shared_ptr<StreamState>& stream, const http::status status)
+{
+  discard_body(*stream);
+  if (stream->responded)
+  {
+    return;
+  }
+  fmt::print(stderr, "Rejected HTTP/2 request {}: {}\n", stream->req.target(),
+             stream->multipart && !stream->multipart->error_message().empty()
+               ? stream->multipart->error_message()
+               : "body exceeds body_limit");
+  stream->multipart.reset();
+
+  // 只结束这个流，连接上的其他请求照常处理
+  http::response<http::string_body> res{status, stream->req.version()};
+  res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+  res.set(http::field::content_type, "text/plain");
+  res.body() = std::string(http::obsolete_reason(status));
+  res.prepare_payload();
+  send_response(stream, std::move(res));
+}
+
+void Http2Session::send_context_response(const std::shared_ptr<StreamState>& stream)
+{
+  // handler 没有读完请求体就响应了，剩下的数据不再需要
+  if (stream->streamed && !stream->request_ended)
+  {
+    discard_body(*stream);
+  }
+  if (stream->res.chunked())
+  {
+    start_chunked_response(stream);
+  }
+  else
+  {
+    send_response(stream, std::move(stream->res));
+  }
+}
+
+template <class Body>
+void Http2Session::send_response(const std::shared_ptr<StreamState>& stream, http::response<Body>&& res,
+                                 std::shared_ptr<const StaticFile> file)
+{
+  if (stream->closed || stream->responded)
+  {
+    return;
+  }
+  // HEAD 与没有响应体的响应只发 HEADERS 帧
+  if (stream->req.method() == http::verb::head || std::is_same_v<Body, http::empty_body>)
+  {
+    submit_response(*stream, res.base(), nullptr);
+    return;
+  }
+  auto source = std::make_unique<BodyResponseSource<Body>>(std::move(res), std::move(file));
+  const auto& header = source->header();
+  submit_response(*stream, header, std::move(source));
+}
+
+void Http2Session::submit_response(StreamState& stream, const http::response_header<>& header,
+                                   std::unique_ptr<ResponseSource> source)
+{
+  // HTTP/2 的字段名必须是小写；nghttp2 会复制这些字符串，只需在提交期间有效
+  const std::string status = std::to_string(header.result_int());
+  std::vector<std::string> names;
+  names.reserve(std::distance(header.begin(), header.end()));
+  std::vector<nghttp2_nv> fields;
+  fields.reserve(names.capacity() + 1);
+  fields.push_back(make_nv(":status", status));
+  for (const auto& field : header)
+  {
+    const auto name = field.name_string();
+    if (is_connection_specific(name))
+    {
+      continue;
+    }
+    auto& lower = names.emplace_back(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+    {
+      return static_cast<char>(std::tolower(c));
+    });
+    fields.push_back(make_nv(lower, field.value()));
+  }
+
+  stream.responded = true;
+  stream.response = std::move(source);
+  nghttp2_data_provider provider{};
+  provider.source.ptr = &stream;
+  provider.read_callback = &Callbacks::read_response;
+  const int rv = nghttp2_submit_response(session_, stream.id, fields.data(), fields.size(),
+                                         stream.response ? &provider : nullptr);
+  if (rv != 0)
+  {
+    fmt::print(stderr, "Http2Session submit response error: {}\n", nghttp2_strerror(rv));
+  }
+  do_write();
+}
+
+void Http2Session::start_chunked_response(const std::shared_ptr<StreamState>& stream)
+{
+  if (stream->closed || stream->responded)
+  {
+    return;
+  }
+  stream->res.body().clear();
+  stream->chunks.clear();
+  stream->chunk_offset = 0;
+  stream->chunk_closed = false;
+  submit_response(*stream, stream->res.base(),
+                  std::make_unique<ChunkResponseSource>(*stream, lowest_layer().get_executor()));
+
+  // 与 HTTP/1.1 不同，不必等响应头写出，数据块排在 HEADERS 帧之后发送
+  auto& ctx = *stream->ctx;
+  try
+  {
+    if (const auto& generator = ctx.get_chunk_generator())
+    {
+      stream->chunk_generator = generator;
+      do_pull_chunk(stream);
+    }
+    else if (const auto& handler = ctx.get_async_stream_handler())
+    {
+      handler(std::make_shared<AsyncChunkWriter>(shared_from_this(), stream));
+    }
+    else if (const auto legacy_handler = ctx.get_stream_handler())
+    {
+      legacy_handler(ctx, [this, &stream](const std::string& buffer)
+      {
+        enqueue_chunk(stream, buffer, nullptr, false);
+        return !stream->chunk_closed;
+      });
+      enqueue_chunk(stream, {}, nullptr, true);
+    }
+    else
+    {
+      enqueue_chunk(stream, {}, nullptr, true);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    fmt::print(stderr, "Http2Session stream handler exception: {}\n", e.what());
+    abort_stream(*stream, "stream handler");
+  }
+}
+
+void Http2Session::enqueue_chunk(const std::shared_ptr<StreamState>& stream, std::string data,
+                                 ChunkWriter::WriteCallback on_written, const bool last)
+{
+  if (stream->chunk_closed)
+  {
+    if (on_written)
+    {
+      net::post(lowest_layer().get_executor(), [on_written = std::move(on_written)]
+      {
+        on_written(net::error::operation_aborted);
+      });
+    }
+    return;
+  }
+
+  // 空数据块不产生 DATA 帧
+  if (data.empty() && !last)
+  {
+    if (on_written)
+    {
+      net::post(lowest_layer().get_executor(), [on_written = std::move(on_written)]
+      {
+        on_written({});
+      });
+    }
+    return;
+  }
+
+  stream->chunk_closed = last;
+  stream->chunks.push_back({std::move(data), std::move(on_written), last});
+  nghttp2_session_resume_data(session_, stream->id);
+  do_write();
+}
+
+void Http2Session::do_pull_chunk(const std::shared_ptr<StreamState>& stream)
+{
+  std::optional<std::string> chunk;
+  try
+  {
+    chunk = stream->chunk_generator();
+  }
+  catch (const std::exception& e)
+  {
+    fmt::print(stderr, "Http2Session chunk generator exception: {}\n", e.what());
+    return abort_stream(*stream, "chunk generator");
+  }
+
+  if (!chunk)
+  {
+    return enqueue_chunk(stream, {}, nullptr, true);
+  }
+  enqueue_chunk(stream, std::move(*chunk), [self = shared_from_this(), stream](beast::error_code ec)
+  {
+    if (!ec && stream->chunk_generator)
+    {
+      self->do_pull_chunk(stream);
+    }
+  }, false);
+}
+
+void Http2Session::abort_stream(StreamState& stream, const char* what)
+{
+  // 响应头已经发出，无法再返回错误状态码；重置这个流，客户端据此判断响应不完整，连接上的其他流不受影响
+  fmt::print(stderr, "Http2Session aborting stream {} after {} failure\n", stream.id, what);
+  stream.chunk_closed = true;
+  stream.chunk_generator = nullptr;
+  nghttp2_submit_rst_stream(session_, NGHTTP2_FLAG_NONE, stream.id, NGHTTP2_INTERNAL_ERROR);
+  do_write();
+}
+
+void Http2Session::read_body_chunk(const std::shared_ptr<StreamState>& stream, BodyReader::ReadCallback on_chunk)
+{
+  if (!stream->streamed)
+  {
+    // 请求体已经在内存中，作为一块交出
+    const std::string_view body = stream->buffered_body_read ? std::string_view{} : std::string_view(stream->req.body());
+    stream->buffered_body_read = true;
+    return on_chunk({}, body);
+  }
+  if (stream->closed)
+  {
+    return on_chunk(net::error::operation_aborted, {});
+  }
+  stream->pending_read = std::move(on_chunk);
+  deliver_body_chunk(stream);
+}
+
+void Http2Session::deliver_body_chunk(const std::shared_ptr<StreamState>& stream)
+{
+  if (!stream->pending_read)
+  {
+    return;
+  }
+  auto on_chunk = std::move(stream->pending_read);
+  stream->pending_read = nullptr;
+  set_stream_deadline(*stream, std::chrono::milliseconds::zero());
+
+  if (stream->body_too_large)
+  {
+    return on_chunk(http::error::body_limit, {});
+  }
+  if (!stream->body_buffer.empty())
+  {
+    const std::size_t size = std::min(stream->body_buffer.size(), std::max<std::size_t>(options_.body_chunk_size, 1));
+    stream->body_chunk.assign(stream->body_buffer, 0, size);
+    stream->body_buffer.erase(0, size);
+    // 数据已经交给 handler，归还窗口让客户端继续发送
+    consume(stream->id, size);
+    do_write();
+    return on_chunk({}, stream->body_chunk);
+  }
+  if (stream->request_ended)
+  {
+    return on_chunk({}, {});
+  }
+  // handler 在等待下一块数据，每块重新计时
+  stream->pending_read = std::move(on_chunk);
+  set_stream_deadline(*stream, options_.timeouts.body_read);
+}
+
+void Http2Session::finish_body_read(const std::shared_ptr<StreamState>& stream)
+{
+  stream->pending_read = nullptr;
+  if (stream->closed)
+  {
+    return;
+  }
+  try
+  {
+    router_.run_post_interceptors(*stream->ctx);
+  }
+  catch (...)
+  {
+    router_.handle_exception(std::current_exception(), *stream->ctx);
+  }
+  send_context_response(stream);
+}
+
+void Http2Session::finish_deferred(const std::shared_ptr<StreamState>& stream, const std::exception_ptr& error)
+{
+  if (stream->closed)
+  {
+    return;
+  }
+  if (error)
+  {
+    router_.handle_exception(error, *stream->ctx);
+    if (stream->streamed && !stream->request_ended)
+    {
+      discard_body(*stream);
+    }
+    return send_response(stream, std::move(stream->res));
+  }
+  try
+  {
+    router_.run_post_interceptors(*stream->ctx);
+  }
+  catch (...)
+  {
+    router_.handle_exception(std::current_exception(), *stream->ctx);
+  }
+  send_context_response(stream);
+}
+
+void Http2Session::discard_body(StreamState& stream)
+{
+  stream.discarding = true;
+  // 不再等待请求体，剩余的数据到达时直接丢弃
+  set_stream_deadline(stream, std::chrono::milliseconds::zero());
+  consume(stream.id, stream.body_buffer.size());
+  stream.body_buffer.clear();
+  stream.body_buffer.shrink_to_fit();
+  do_write();
+}
+
+void Http2Session::consume(const std::int32_t stream_id, const std::size_t size)
+{
+  if (size > 0 && session_)
+  {
+    // 流已经关闭时只归还连接级窗口
+    nghttp2_session_consume(session_, stream_id, size);
+  }
+}
@@ -0,0 +1,145 @@
+// framework/http2/http2_session.hpp
+#ifndef KHTTPD_FRAMEWORK_HTTP2_HTTP2_SESSION_HPP
+#define KHTTPD_FRAMEWORK_HTTP2_HTTP2_SESSION_HPP
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "router/http_router.hpp"
+#include "session/http_session_options.hpp"
+#include "static_file/static_file_cache.hpp"
+
+struct nghttp2_session;
+
+namespace khttpd::framework
+{
+  namespace beast = boost::beast;
+  namespace http = beast::http;
+  namespace net = boost::asio;
+  using tcp = boost::asio::ip::tcp;
+
+  // 处理一个 HTTP/2 连接。帧的编解码、HPACK、流量控制与并发流限制由 nghttp2 完成，
+  // 每个流的请求与 HTTP/1.1 一样经过 HttpRouter 的拦截器、路由与静态文件处理，handler 看到的是同样的 HttpContext。
+  // 由 HttpSession 在协商出 h2（ALPN）或识别出 h2c 之后创建，接管它的连接
+  class Http2Session : public std::enable_shared_from_this<Http2Session>
+  {
+  public:
+    using Transport = std::variant<beast::tcp_stream, beast::ssl_stream<beast::tcp_stream>>;
+
+    Http2Session(Transport&& transport, HttpRouter& router, StaticFileCache& static_files,
+                 const HttpSessionOptions& options, HttpSessionStats& stats);
+    ~Http2Session();
+
+    Http2Session(const Http2Session&) = delete;
+    Http2Session& operator=(const Http2Session&) = delete;
+
+    // received 为 HttpSession 已经从连接上读到的数据，prior knowledge 时以完整的连接前言开头
+    void run(std::string_view received = {});
+    // h2c 升级：101 响应已经写出。settings 是 HTTP2-Settings 请求头的原始值，request 作为流 1 处理
+    void run_upgraded(std::string_view settings, http::request<http::string_body>&& request,
+                      std::string_view received);
+
+  private:
+    struct StreamState;
+    class ResponseSource;
+    template <class Body>
+    class BodyResponseSource;
+    class ChunkResponseSource;
+    class AsyncBodyReader;
+    class AsyncChunkWriter;
+    class AsyncResponseHandle;
+    class StaticFileSink;
+    struct Callbacks;
+
+    Transport transport_;
+    HttpRouter& router_;
+    StaticFileCache& static_files_;
+    const HttpSessionOptions& options_;
+    HttpSessionStats& stats_;
+    nghttp2_session* session_ = nullptr;
+    // 正在处理的流；流关闭时移除，仍在使用它的 BodyReader 与 ChunkWriter 各自持有一份
+    std::map<std::int32_t, std::shared_ptr<StreamState>> streams_;
+    std::vector<char> read_buffer_;
+    std::vector<char> write_buffer_;
+    bool writing_ = false;
+    // nghttp2 的回调中不能再调用 nghttp2_session_mem_send，写操作留到 mem_recv 返回之后
+    bool in_nghttp2_ = false;
+    bool closed_ = false;
+    // 按等待客户端的流中最早的截止时间触发，见 set_stream_deadline
+    net::steady_timer stream_timer_;
+
+    template <class F>
+    void with_transport(F&& f)
+    {
+      std::visit(std::forward<F>(f), transport_);
+    }
+
+    beast::tcp_stream& lowest_layer()
+    {
+      return std::visit([](auto& stream) -> beast::tcp_stream& { return beast::get_lowest_layer(stream); },
+                        transport_);
+    }
+
+    void set_expiry(std::chrono::milliseconds timeout);
+    // 有写操作时按写超时，没有活动的流时按 keep-alive 空闲超时；有流时连接本身不限时，由各个流的截止时间约束
+    void update_expiry();
+    // 流在等待客户端时各自计时：请求头按 header_read，请求体按 body_read；handler 处理期间不限时。
+    // timeout 为 0 时清除截止时间
+    void set_stream_deadline(StreamState& stream, std::chrono::milliseconds timeout);
+    void arm_stream_timer();
+    // 请求头超时时发送 GOAWAY（未完成的头部块会阻塞整个连接），请求体超时时以 RST_STREAM 重置这个流
+    void on_stream_timer(beast::error_code ec);
+    bool start();
+    bool receive(std::string_view data);
+
+    void do_read();
+    void on_read(beast::error_code ec, std::size_t bytes_transferred);
+    void do_write();
+    void on_write(beast::error_code ec, std::size_t bytes_transferred);
+    void do_close();
+
+    // 请求头收齐后，按路由选项决定请求体的读取方式；需要时立即调用 handler
+    void on_request_headers(const std::shared_ptr<StreamState>& stream, bool end_stream);
+    void on_request_data(const std::shared_ptr<StreamState>& stream, std::string_view data);
+    void on_request_end(const std::shared_ptr<StreamState>& stream);
+    void on_stream_close(std::int32_t stream_id);
+    void handle_request(const std::shared_ptr<StreamState>& stream);
+    bool serve_static_file(const std::shared_ptr<StreamState>& stream);
+    void reject_request(const std::shared_ptr<StreamState>& stream, http::status status);
+
+    void send_context_response(const std::shared_ptr<StreamState>& stream);
+    template <class Body>
+    void send_response(const std::shared_ptr<StreamState>& stream, http::response<Body>&& res,
+                       std::shared_ptr<const StaticFile> file = nullptr);
+    void submit_response(StreamState& stream, const http::response_header<>& header,
+                         std::unique_ptr<ResponseSource> source);
+
+    // 分块响应：HTTP/2 没有分块编码，每块数据作为 DATA 帧发送
+    void start_chunked_response(const std::shared_ptr<StreamState>& stream);
+    void enqueue_chunk(const std::shared_ptr<StreamState>& stream, std::string data,
+                       ChunkWriter::WriteCallback on_written, bool last);
+    void do_pull_chunk(const std::shared_ptr<StreamState>& stream);
+    void abort_stream(StreamState& stream, const char* what);
+
+    void read_body_chunk(const std::shared_ptr<StreamState>& stream, BodyReader::ReadCallback on_chunk);
+    void deliver_body_chunk(const std::shared_ptr<StreamState>& stream);
+    void finish_body_read(const std::shared_ptr<StreamState>& stream);
+    // ResponseHandle 完成时调用；流已经关闭（例如客户端取消了请求）时什么都不做
+    void finish_deferred(const std::shared_ptr<StreamState>& stream, const std::exception_ptr& error);
+    // 不再读取的请求体（已拒绝或 handler 提前响应），收到的数据直接归还窗口
+    void discard_body(StreamState& stream);
+    // 归还已经处理完的请求体数据占用的流量控制窗口
+    void consume(std::int32_t stream_id, std::size_t size);
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_HTTP2_HTTP2_SESSION_HPP
@@ -0,0 +1,275 @@
+#include "compression_interceptor.hpp"
+#include "static_file/header_value.hpp"
+
+#include <boost/beast/http/field.hpp>
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
+namespace khttpd::framework
+{
+  namespace http = boost::beast::http;
+
+  namespace
+  {
+    // push 风格的分块响应：压缩后再交给会话的 ChunkWriter，每块都 flush 以便客户端及时解出
+    class CompressingChunkWriter : public ChunkWriter
+    {
+    public:
+      CompressingChunkWriter(std::shared_ptr<ChunkWriter> inner, std::unique_ptr<StreamCompressor> compressor)
+        : inner_(std::move(inner)), compressor_(std::move(compressor))
+      {
+      }
+
+      void write(std::string chunk, WriteCallback on_written) override
+      {
+        // 压缩和交给会话要在同一把锁里完成，否则并发写入时压缩流的字节会乱序
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        std::string out;
+        // 结束之后的写入原样交给会话，由它回调错误
+        if (!finished_)
+        {
+          compressor_->write(chunk, out, true);
+        }
+        inner_->write(std::move(out), std::move(on_written));
+      }
+
+      void finish(WriteCallback on_finished) override
+      {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        std::string out;
+        if (!finished_)
+        {
+          finished_ = true;
+          compressor_->finish(out);
+        }
+        if (!out.empty())
+        {
+          inner_->write(std::move(out));
+        }
+        inner_->finish(std::move(on_finished));
+      }
+
+    private:
+      const std::shared_ptr<ChunkWriter> inner_;
+      // 内层 writer 可能在 write 里直接回调，回调中再次写入时在同一线程上重入
+      std::recursive_mutex mutex_;
+      std::unique_ptr<StreamCompressor> compressor_;
+      bool finished_ = false;
+    };
+
+    bool has_token(std::string_view value, std::string_view token)
+    {
+      while (!value.empty())
+      {
+        const auto comma = value.find(',');
+        if (iequals(trim(value.substr(0, comma)), token))
+        {
+          return true;
+        }
+        if (comma == std::string_view::npos)
+        {
+          break;
+        }
+        value.remove_prefix(comma + 1);
+      }
+      return false;
+    }
+
+    void add_vary_accept_encoding(HttpContext::Response& res)
+    {
+      const auto vary = res[http::field::vary];
+      if (vary.empty())
+      {
+        res.set(http::field::vary, "Accept-Encoding");
+      }
+      else if (!has_token(vary, "Accept-Encoding") && !has_token(vary, "*"))
+      {
+        res.set(http::field::vary, std::string(vary) + ", Accept-Encoding");
+      }
+    }
+
+    // 编码后的表示与原来的字节不同，强 ETag 需要区分，例如 "abc" -> "abc-gzip"
+    void mark_etag(HttpContext::Response& res, std::string_view coding)
+    {
+      const auto etag = res[http::field::etag];
+      if (etag.size() >= 2 && etag.front() == '"' && etag.back() == '"')
+      {
+        std::string marked(etag.substr(0, etag.size() - 1));
+        marked.append("-").append(coding).append("\"");
+        res.set(http::field::etag, marked);
+      }
+    }
+  }
+
+  CompressionInterceptor::CompressionInterceptor(CompressionOptions options)
+    : options_(std::move(options))
+  {
+  }
+
+  void CompressionInterceptor::handle_response(HttpContext& ctx)
+  {
+    auto& res = ctx.get_response();
+    const auto& req = ctx.get_request();
+    if (req.method() == http::verb::head || !compressible(res))
+    {
+      return;
+    }
+    if (!res.chunked() && res.body().size() < options_.min_size)
+    {
+      return;
+    }
+    if (res.chunked() && !options_.compress_chunked)
+    {
+      return;
+    }
+
+    // 即使这次不压缩，响应内容也取决于 Accept-Encoding
+    add_vary_accept_encoding(res);
+
+    const auto accept_encoding = req[http::field::accept_encoding];
+    if (accept_encoding.empty())
+    {
+      return;
+    }
+    // 客户端更偏好 identity 时不压缩
+    const ContentCoding* selected = nullptr;
+    double best_quality = content_coding_quality(accept_encoding, "identity");
+    for (const auto& coding : options_.encodings)
+    {
+      const double quality = content_coding_quality(accept_encoding, content_coding_name(coding));
+      if (quality > best_quality)
+      {
+        selected = &coding;
+        best_quality = quality;
+      }
+    }
+    if (!selected)
+    {
+      return;
+    }
+
+    const ContentCoding coding = *selected;
+    const std::string_view name = content_coding_name(coding);
+    if (res.chunked())
+    {
+      compress_stream(ctx, coding);
+    }
+    else
+    {
+      std::string compressed = compress(coding, res.body(), level(coding));
+      if (compressed.size() >= res.body().size())
+      {
+        // 不可压缩的内容，发送原文
+        return;
+      }
+      res.body() = std::move(compressed);
+      res.prepare_payload();
+    }
+    res.set(http::field::content_encoding, name);
+    mark_etag(res, name);
+  }
+
+  bool CompressionInterceptor::compressible(const HttpContext::Response& res) const
+  {
+    const unsigned status = res.result_int();
+    if (status < 200 || status == 204 || status == 206 || status == 304)
+    {
+      return false;
+    }
+    if (res.find(http::field::content_encoding) != res.end() || res.find(http::field::content_range) != res.end())
+    {
+      return false;
+    }
+    if (has_token(res[http::field::cache_control], "no-transform"))
+    {
+      return false;
+    }
+
+    std::string_view type = res[http::field::content_type];
+    type = type.substr(0, type.find(';'));
+    if (type.empty())
+    {
+      return false;
+    }
+    for (const auto& prefix : options_.content_types)
+    {
+      if (type.size() >= prefix.size() &&
+        std::equal(prefix.begin(), prefix.end(), type.begin(), [](char a, char b) { return (a | 0x20) == (b | 0x20); }))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int CompressionInterceptor::level(ContentCoding coding) const
+  {
+    return coding == ContentCoding::zstd ? options_.zstd_level : options_.gzip_level;
+  }
+
+  void CompressionInterceptor::compress_stream(HttpContext& ctx, ContentCoding coding) const
+  {
+    const int compression_level = level(coding);
+
+    if (auto generator = ctx.get_chunk_generator())
+    {
+      std::shared_ptr<StreamCompressor> compressor = StreamCompressor::create(coding, compression_level);
+      ctx.chunked_pull([generator = std::move(generator), compressor, done = false]() mutable
+        -> std::optional<std::string>
+        {
+          while (!done)
+          {
+            std::string out;
+            auto chunk = generator();
+            if (!chunk)
+            {
+              done = true;
+              compressor->finish(out);
+              return out.empty() ? std::nullopt : std::optional<std::string>(std::move(out));
+            }
+            compressor->write(*chunk, out, true);
+            // 空块会被会话当作普通数据跳过，这里直接请求下一块
+            if (!out.empty())
+            {
+              return out;
+            }
+          }
+          return std::nullopt;
+        });
+    }
+    else if (auto handler = ctx.get_async_stream_handler())
+    {
+      ctx.chunked_push([handler = std::move(handler), coding, compression_level](std::shared_ptr<ChunkWriter> writer)
+      {
+        handler(std::make_shared<CompressingChunkWriter>(std::move(writer),
+                                                         StreamCompressor::create(coding, compression_level)));
+      });
+    }
+    else if (auto legacy_handler = ctx.get_stream_handler())
+    {
+      ctx.chunked([legacy_handler = std::move(legacy_handler), coding, compression_level](
+        HttpContext& context, const HttpContext::WriteHandler& write)
+        {
+          const auto compressor = StreamCompressor::create(coding, compression_level);
+          bool open = true;
+          legacy_handler(context, [&](const std::string& buffer)
+          {
+            std::string out;
+            compressor->write(buffer, out, true);
+            if (!out.empty())
+            {
+              open = write(out);
+            }
+            return open;
+          });
+          std::string out;
+          compressor->finish(out);
+          if (open && !out.empty())
+          {
+            write(out);
+          }
+        });
+    }
+  }
+}
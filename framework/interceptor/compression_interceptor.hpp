@@ -0,0 +1,51 @@
+#ifndef KHTTPD_FRAMEWORK_INTERCEPTOR_COMPRESSION_INTERCEPTOR_HPP_
+#define KHTTPD_FRAMEWORK_INTERCEPTOR_COMPRESSION_INTERCEPTOR_HPP_
+
+#include "interceptor/interceptor.hpp"
+#include "compression/compression.hpp"
+
+#include <string>
+#include <vector>
+
+namespace khttpd::framework
+{
+  struct CompressionOptions
+  {
+    // 按服务端偏好排序，客户端 q 值相同时靠前的优先
+    std::vector<ContentCoding> encodings = {ContentCoding::zstd, ContentCoding::gzip, ContentCoding::deflate};
+    // 小于该字节数的 string_body 响应不压缩；分块响应的总长度未知，总是压缩
+    std::size_t min_size = 1024;
+    // gzip 与 deflate 共用
+    int gzip_level = 6;
+    int zstd_level = 3;
+    // 按 Content-Type 前缀匹配（不含参数）；没有 Content-Type 的响应不压缩
+    std::vector<std::string> content_types = {
+      "text/", "application/json", "application/javascript", "application/xml", "image/svg+xml",
+    };
+    bool compress_chunked = true;
+  };
+
+  // 可选的后置拦截器，按 Accept-Encoding 压缩动态响应：
+  //   router.add_interceptor(std::make_shared<CompressionInterceptor>());
+  // 后置拦截器按注册的逆序运行，应当最先注册，使其在其他拦截器修改完响应之后才压缩。
+  // 已有 Content-Encoding、带 Cache-Control: no-transform 的响应以及 HEAD 请求不处理；
+  // 静态文件不经过后置拦截器，使用 StaticFileOptions::precompressed 的预压缩文件
+  class CompressionInterceptor : public Interceptor
+  {
+  public:
+    explicit CompressionInterceptor(CompressionOptions options = {});
+
+    void handle_response(HttpContext& ctx) override;
+
+    const CompressionOptions& options() const { return options_; }
+
+  private:
+    const CompressionOptions options_;
+
+    bool compressible(const HttpContext::Response& res) const;
+    int level(ContentCoding coding) const;
+    void compress_stream(HttpContext& ctx, ContentCoding coding) const;
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_INTERCEPTOR_COMPRESSION_INTERCEPTOR_HPP_
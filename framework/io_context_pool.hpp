@@ -7,6 +7,8 @@
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
 
 namespace khttpd::framework
 {
@@ -85,6 +87,104 @@ namespace khttpd::framework
     std::vector<std::thread> threads_;
     std::once_flag stop_flag_;
   };
+
+  // 每个线程独占一个 io_context 的线程池 (one io_context per core)
+  // 与 IoContextPool 不同，这里的 handler 不会在线程之间迁移，也不会争用同一个调度队列。
+  // 由 Server 在 IoMode::per_core 模式下持有，不是单例。
+  class PerCoreIoContextPool
+  {
+  public:
+    explicit PerCoreIoContextPool(unsigned int count)
+    {
+      if (count == 0) count = std::max(1u, std::thread::hardware_concurrency());
+
+      contexts_.reserve(count);
+      work_guards_.reserve(count);
+      for (unsigned int i = 0; i < count; ++i)
+      {
+        // concurrency_hint = 1：告诉 asio 只有一个线程运行该 io_context，调度器因此把 run() 内投递的 handler
+        // 放进线程私有队列、少做一次唤醒；内部锁仍然保留，acceptor 分发连接与 stop() 会从其他线程投递任务
+        // （完全去掉锁需要 BOOST_ASIO_CONCURRENCY_HINT_UNSAFE，这里不安全）
+        contexts_.emplace_back(std::make_unique<boost::asio::io_context>(1));
+        work_guards_.emplace_back(boost::asio::make_work_guard(*contexts_.back()));
+      }
+    }
+
+    ~PerCoreIoContextPool()
+    {
+      stop();
+    }
+
+    size_t size() const
+    {
+      return contexts_.size();
+    }
+
+    boost::asio::io_context& get_io_context(size_t index)
+    {
+      return *contexts_[index];
+    }
+
+    // 轮询获取下一个 io_context
+    boost::asio::io_context& get_next_io_context()
+    {
+      return *contexts_[next_.fetch_add(1, std::memory_order_relaxed) % contexts_.size()];
+    }
+
+    // 为第 1..N-1 个 io_context 各启动一个线程，当前线程运行第 0 个，阻塞直到 stop()
+    void run()
+    {
+      {
+        std::lock_guard<std::mutex> lock(threads_mutex_);
+        for (size_t i = 1; i < contexts_.size(); ++i)
+        {
+          threads_.emplace_back([ioc = contexts_[i].get()]()
+          {
+            ioc->run();
+          });
+        }
+      }
+      contexts_[0]->run();
+    }
+
+    void stop()
+    {
+      std::call_once(stop_flag_, [this]()
+      {
+        for (auto& guard : work_guards_)
+        {
+          guard.reset();
+        }
+        for (auto& ioc : contexts_)
+        {
+          ioc->stop();
+        }
+
+        std::lock_guard<std::mutex> lock(threads_mutex_);
+        for (auto& t : threads_)
+        {
+          // stop() 可能在某个 io 线程内被调用，不能 join 自己
+          if (t.joinable() && t.get_id() != std::this_thread::get_id())
+          {
+            t.join();
+          }
+          else if (t.joinable())
+          {
+            t.detach();
+          }
+        }
+        threads_.clear();
+      });
+    }
+
+  private:
+    std::vector<std::unique_ptr<boost::asio::io_context>> contexts_;
+    std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work_guards_;
+    std::vector<std::thread> threads_;
+    std::mutex threads_mutex_;
+    std::atomic<size_t> next_{0};
+    std::once_flag stop_flag_;
+  };
 }
 
 #endif // KHTTPD_FRAMEWORK_CLIENT_IO_CONTEXT_POOL_HPP
@@ -0,0 +1,46 @@
+#ifndef KHTTPD_FRAMEWORK_ROUTER_AWAITABLE_HANDLER_HPP
+#define KHTTPD_FRAMEWORK_ROUTER_AWAITABLE_HANDLER_HPP
+
+#include "awaitable.hpp"
+#include "router/http_router.hpp"
+
+#if defined(KHTTPD_HAS_COROUTINES)
+#include <exception>
+#include <memory>
+
+namespace khttpd::framework
+{
+  using AwaitableHandler = std::function<Awaitable<void>(HttpContext&)>;
+
+  // 把协程 handler 包装成 HttpHandler，用普通的路由方法注册：
+  //   router.get("/users/:id", co_handler([](HttpContext& ctx) -> Awaitable<> { ... co_await ...; }));
+  // 协程经由 HttpContext::defer 在会话的 executor 上运行，co_await 挂起期间不占用线程；
+  // 协程返回后运行后置拦截器并发送响应，抛出的异常交给路由器的异常处理器
+  inline HttpHandler co_handler(AwaitableHandler handler)
+  {
+    // 协程帧可能引用 handler 的捕获，协程结束之前一直持有
+    auto shared = std::make_shared<AwaitableHandler>(std::move(handler));
+    return [shared](HttpContext& ctx)
+    {
+      ctx.defer([shared, &ctx](std::shared_ptr<ResponseHandle> response)
+      {
+        const auto executor = response->get_executor();
+        boost::asio::co_spawn(executor, (*shared)(ctx),
+                              [shared, response = std::move(response)](std::exception_ptr error)
+                              {
+                                if (error)
+                                {
+                                  response->fail(error);
+                                }
+                                else
+                                {
+                                  response->complete();
+                                }
+                              });
+      });
+    };
+  }
+}
+#endif
+
+#endif // KHTTPD_FRAMEWORK_ROUTER_AWAITABLE_HANDLER_HPP
@@ -2,6 +2,7 @@
 #include "http_router.hpp"
 #include <fmt/core.h>
 #include <algorithm>
+#include <cctype>
 
 namespace khttpd::framework
 {
@@ -96,57 +97,299 @@ namespace khttpd::framework
     return {std::regex(regex_str), param_names, literal_segments, dynamic_segments};
   }
 
+  namespace
+  {
+    bool is_param_name(std::string_view name)
+    {
+      if (name.empty() || !(std::isalpha(static_cast<unsigned char>(name.front())) || name.front() == '_'))
+      {
+        return false;
+      }
+      return std::all_of(name.begin(), name.end(), [](char c)
+      {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+      });
+    }
+
+    // 段内是否嵌有参数，例如 "file-:id.txt"
+    bool has_embedded_param(std::string_view segment)
+    {
+      for (size_t i = segment.find(':'); i != std::string_view::npos; i = segment.find(':', i + 1))
+      {
+        if (i + 1 < segment.size() && (std::isalpha(static_cast<unsigned char>(segment[i + 1])) || segment[i + 1] ==
+          '_'))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool accepts(const RouteEntry& entry, const boost::beast::http::verb method)
+    {
+      // 方法不匹配时，GET/HEAD 继续查找（可能由静态文件处理），其他方法由该路由返回 405
+      return entry.handlers.count(method) > 0 ||
+        (method != boost::beast::http::verb::get && method != boost::beast::http::verb::head);
+    }
+  }
+
+  bool HttpRouter::insert_into_tree(RouteEntry& entry)
+  {
+    const std::string_view pattern = entry.original_path;
+    if (pattern.empty() || pattern.front() != '/' || entry.param_names.size() > PathParamValues::capacity)
+    {
+      return false;
+    }
+
+    enum class SegmentKind { literal, param, catch_all };
+    std::vector<std::pair<SegmentKind, std::string_view>> segments;
+    size_t pos = 1;
+    while (true)
+    {
+      const size_t slash = pattern.find('/', pos);
+      const bool last = slash == std::string_view::npos;
+      std::string_view segment = pattern.substr(pos, last ? std::string_view::npos : slash - pos);
+
+      if (!segment.empty() && segment.front() == ':' && is_param_name(segment.substr(1)))
+      {
+        // 与正则实现一致：最后一个参数可以匹配包含 '/' 的剩余路径
+        segments.emplace_back(last ? SegmentKind::catch_all : SegmentKind::param, segment);
+      }
+      else if (has_embedded_param(segment))
+      {
+        return false;
+      }
+      else
+      {
+        segments.emplace_back(SegmentKind::literal, segment);
+      }
+
+      if (last) break;
+      pos = slash + 1;
+    }
+
+    RouteNode* node = &root_;
+    for (const auto& [kind, segment] : segments)
+    {
+      std::unique_ptr<RouteNode>* child;
+      if (kind == SegmentKind::literal)
+      {
+        auto it = node->static_children.find(segment);
+        if (it == node->static_children.end())
+        {
+          it = node->static_children.emplace(std::string(segment), nullptr).first;
+        }
+        child = &it->second;
+      }
+      else
+      {
+        child = kind == SegmentKind::param ? &node->param_child : &node->catch_all_child;
+      }
+      if (!*child)
+      {
+        *child = std::make_unique<RouteNode>();
+        // 与 parse_path_pattern 的计数一致：空的字面段不计入
+        (*child)->literal_segments_count = node->literal_segments_count +
+          (kind == SegmentKind::literal && !segment.empty() ? 1 : 0);
+        (*child)->dynamic_segments_count = node->dynamic_segments_count + (kind == SegmentKind::literal ? 0 : 1);
+      }
+      node = child->get();
+    }
+
+    if (node->entry)
+    {
+      // 形状相同但参数名不同的路由，例如 "/users/:id" 与 "/users/:uid"
+      fmt::print(stderr, "Route '{}' conflicts with '{}', it will only be matched after the tree lookup fails.\n",
+                 entry.original_path, node->entry->original_path);
+      return false;
+    }
+    node->entry = &entry;
+    return true;
+  }
+
+  bool HttpRouter::can_beat(const RouteNode& node, const int remaining_segments, const RouteEntry& best)
+  {
+    // 剩余的段全部按字面段匹配时的结果，是这个分支上能达到的最高特异性
+    const int max_literal = node.literal_segments_count + remaining_segments;
+    if (max_literal != best.literal_segments_count)
+    {
+      return max_literal > best.literal_segments_count;
+    }
+    return node.dynamic_segments_count < best.dynamic_segments_count;
+  }
+
+  void HttpRouter::match_node(const RouteNode& node, const std::string_view path, const size_t pos,
+                              const int remaining_segments, const boost::beast::http::verb method,
+                              PathParamValues& params, const RouteEntry*& best, PathParamValues& best_params)
+  {
+    // 先走静态段，通常第一次下降就能得到 best，之后不可能比它更具体的分支直接跳过
+    if (best && !can_beat(node, remaining_segments, *best))
+    {
+      return;
+    }
+
+    if (pos == std::string_view::npos)
+    {
+      if (node.entry && accepts(*node.entry, method))
+      {
+        best = node.entry;
+        best_params = params;
+      }
+      return;
+    }
+
+    const size_t slash = path.find('/', pos);
+    const std::string_view segment = path.substr(pos, slash == std::string_view::npos ? slash : slash - pos);
+    const size_t next = slash == std::string_view::npos ? slash : slash + 1;
+
+    if (const auto it = node.static_children.find(segment); it != node.static_children.end())
+    {
+      match_node(*it->second, path, next, remaining_segments - 1, method, params, best, best_params);
+    }
+
+    if (node.param_child && !segment.empty())
+    {
+      params.values[params.size++] = segment;
+      match_node(*node.param_child, path, next, remaining_segments - 1, method, params, best, best_params);
+      --params.size;
+    }
+
+    if (node.catch_all_child)
+    {
+      params.values[params.size++] = path.substr(pos);
+      match_node(*node.catch_all_child, path, std::string_view::npos, 0, method, params, best, best_params);
+      --params.size;
+    }
+  }
+
+  const RouteEntry* HttpRouter::find_route(const std::string_view path, const boost::beast::http::verb method,
+                                           PathParamValues& params,
+                                           std::match_results<std::string_view::const_iterator>& matches) const
+  {
+    const RouteEntry* matched = nullptr;
+    if (!path.empty() && path.front() == '/')
+    {
+      const std::string_view relative = path.substr(1);
+      const int segments = static_cast<int>(std::count(relative.begin(), relative.end(), '/')) + 1;
+      PathParamValues values;
+      match_node(root_, relative, 0, segments, method, values, matched, params);
+    }
+
+    // regex_routes_ 已按特异性排序，到了不比前缀树结果更具体的路由就可以停止
+    for (const auto* entry : regex_routes_)
+    {
+      if (matched && !RouteEntry::compare_specificity(*entry, *matched))
+      {
+        break;
+      }
+      if (accepts(*entry, method) && std::regex_match(path.begin(), path.end(), matches, entry->path_regex))
+      {
+        return entry;
+      }
+    }
+    matches = {};
+    return matched;
+  }
+
   void HttpRouter::add_route(const std::string& path_pattern, const boost::beast::http::verb method,
-                             HttpHandler handler)
+                             HttpHandler handler, RouteOptions route_options)
   {
     for (auto& entry : routes_)
     {
-      if (entry.original_path == path_pattern)
+      if (entry->original_path == path_pattern)
       {
-        entry.handlers[method] = std::move(handler);
+        entry->handlers[method] = std::move(handler);
+        entry->options[method] = route_options;
         fmt::print("Updated handler for route: {} {}\n", boost::beast::http::to_string(method), path_pattern);
         return;
       }
     }
 
-    RouteEntry new_entry;
-    new_entry.original_path = path_pattern;
+    auto new_entry = std::make_unique<RouteEntry>();
+    new_entry->original_path = path_pattern;
     auto [regex, params, literal_count, dynamic_count] = parse_path_pattern(path_pattern);
-    new_entry.path_regex = std::move(regex);
-    new_entry.param_names = std::move(params);
-    new_entry.literal_segments_count = literal_count;
-    new_entry.dynamic_segments_count = dynamic_count;
-    new_entry.handlers[method] = std::move(handler);
-
+    new_entry->path_regex = std::move(regex);
+    new_entry->param_names = std::move(params);
+    new_entry->literal_segments_count = literal_count;
+    new_entry->dynamic_segments_count = dynamic_count;
+    new_entry->handlers[method] = std::move(handler);
+    new_entry->options[method] = route_options;
+
+    RouteEntry& entry = *new_entry;
     routes_.push_back(std::move(new_entry));
-    std::sort(routes_.begin(), routes_.end(), RouteEntry::compare_specificity);
+    if (!insert_into_tree(entry))
+    {
+      regex_routes_.push_back(&entry);
+      std::sort(regex_routes_.begin(), regex_routes_.end(), [](const RouteEntry* a, const RouteEntry* b)
+      {
+        return RouteEntry::compare_specificity(*a, *b);
+      });
+    }
     fmt::print("Registered dynamic route: {} {} (literal:{}, dynamic:{})\n",
                boost::beast::http::to_string(method), path_pattern, literal_count, dynamic_count);
   }
 
-  void HttpRouter::get(const std::string& path, HttpHandler handler)
+  void HttpRouter::get(const std::string& path, HttpHandler handler, RouteOptions route_options)
+  {
+    add_route(path, boost::beast::http::verb::get, std::move(handler), route_options);
+  }
+
+  void HttpRouter::post(const std::string& path, HttpHandler handler, RouteOptions route_options)
   {
-    add_route(path, boost::beast::http::verb::get, std::move(handler));
+    add_route(path, boost::beast::http::verb::post, std::move(handler), route_options);
   }
 
-  void HttpRouter::post(const std::string& path, HttpHandler handler)
+  void HttpRouter::put(const std::string& path, HttpHandler handler, RouteOptions route_options)
   {
-    add_route(path, boost::beast::http::verb::post, std::move(handler));
+    add_route(path, boost::beast::http::verb::put, std::move(handler), route_options);
   }
 
-  void HttpRouter::put(const std::string& path, HttpHandler handler)
+  void HttpRouter::del(const std::string& path, HttpHandler handler, RouteOptions route_options)
   {
-    add_route(path, boost::beast::http::verb::put, std::move(handler));
+    add_route(path, boost::beast::http::verb::delete_, std::move(handler), route_options);
+  }
+
+  void HttpRouter::options(const std::string& path, HttpHandler handler, RouteOptions route_options)
+  {
+    add_route(path, boost::beast::http::verb::options, std::move(handler), route_options);
+  }
+
+  HttpHandler HttpRouter::wrap_async(AsyncHttpHandler handler)
+  {
+    // 会话在 handler 返回后立即调用 defer 的回调；持有 handler，即使路由在此期间被替换也不会失效
+    auto shared = std::make_shared<AsyncHttpHandler>(std::move(handler));
+    return [shared](HttpContext& ctx)
+    {
+      ctx.defer([shared, &ctx](std::shared_ptr<ResponseHandle> response)
+      {
+        (*shared)(ctx, std::move(response));
+      });
+    };
   }
 
-  void HttpRouter::del(const std::string& path, HttpHandler handler)
+  void HttpRouter::get_async(const std::string& path, AsyncHttpHandler handler, RouteOptions route_options)
   {
-    add_route(path, boost::beast::http::verb::delete_, std::move(handler));
+    add_route(path, boost::beast::http::verb::get, wrap_async(std::move(handler)), route_options);
   }
 
-  void HttpRouter::options(const std::string& path, HttpHandler handler)
+  void HttpRouter::post_async(const std::string& path, AsyncHttpHandler handler, RouteOptions route_options)
   {
-    add_route(path, boost::beast::http::verb::options, std::move(handler));
+    add_route(path, boost::beast::http::verb::post, wrap_async(std::move(handler)), route_options);
+  }
+
+  void HttpRouter::put_async(const std::string& path, AsyncHttpHandler handler, RouteOptions route_options)
+  {
+    add_route(path, boost::beast::http::verb::put, wrap_async(std::move(handler)), route_options);
+  }
+
+  void HttpRouter::del_async(const std::string& path, AsyncHttpHandler handler, RouteOptions route_options)
+  {
+    add_route(path, boost::beast::http::verb::delete_, wrap_async(std::move(handler)), route_options);
+  }
+
+  void HttpRouter::options_async(const std::string& path, AsyncHttpHandler handler, RouteOptions route_options)
+  {
+    add_route(path, boost::beast::http::verb::options, wrap_async(std::move(handler)), route_options);
   }
 
   void HttpRouter::add_interceptor(std::shared_ptr<Interceptor> interceptor)
@@ -174,36 +417,59 @@ namespace khttpd::framework
     }
   }
 
+  const RouteOptions* HttpRouter::find_route_options(const boost::beast::http::verb method,
+                                                      const std::string_view path) const
+  {
+    // 与 dispatch 使用同一个查找
+    PathParamValues values;
+    std::match_results<std::string_view::const_iterator> matches;
+    const RouteEntry* matched = find_route(path, method, values, matches);
+    if (!matched)
+    {
+      return nullptr;
+    }
+    const auto it = matched->options.find(method);
+    return it != matched->options.end() ? &it->second : nullptr;
+  }
+
   bool HttpRouter::dispatch(HttpContext& ctx, const std::function<bool()>& static_file_fun) const
   {
-    const std::string request_path = ctx.path();
+    const std::string_view request_path = ctx.path();
     const boost::beast::http::verb request_method = ctx.method();
 
-    for (const auto& entry : routes_)
+    PathParamValues values;
+    std::match_results<std::string_view::const_iterator> matches;
+    if (const RouteEntry* matched = find_route(request_path, request_method, values, matches))
     {
-      if (std::smatch matches; std::regex_match(request_path, matches, entry.path_regex))
+      const auto method_it = matched->handlers.find(request_method);
+      if (method_it == matched->handlers.end())
+      {
+        handle_method_not_allowed(ctx, matched->handlers); // 传递允许的方法映射
+        return true;
+      }
+      if (!matched->param_names.empty())
       {
-        if (const auto method_it = entry.handlers.find(request_method); method_it != entry.handlers.end())
+        ParamList path_params;
+        for (size_t i = 0; i < matched->param_names.size(); ++i)
         {
-          std::map<std::string, std::string> path_params;
-          for (size_t i = 0; i < entry.param_names.size(); ++i)
+          if (!matches.empty())
           {
             if (i + 1 < matches.size())
             {
-              path_params[entry.param_names[i]] = matches[i + 1].str();
+              path_params.push_back(matched->param_names[i],
+                                    request_path.substr(matches.position(i + 1), matches.length(i + 1)));
             }
           }
-          ctx.set_path_params(std::move(path_params));
-
-          method_it->second(ctx);
-          return true;
-        }
-        if (request_method != boost::beast::http::verb::get && request_method != boost::beast::http::verb::head)
-        {
-          handle_method_not_allowed(ctx, entry.handlers); // 传递允许的方法映射
-          return true;
+          else if (i < values.size)
+          {
+            path_params.push_back(matched->param_names[i], values.values[i]);
+          }
         }
+        ctx.set_path_params(path_params);
       }
+
+      method_it->second(ctx);
+      return true;
     }
 
     if (!static_file_fun || !static_file_fun())
@@ -11,19 +11,45 @@
 #include <vector>
 #include <regex>
 #include <memory>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
 
 namespace khttpd::framework
 {
   using HttpHandler = std::function<void(HttpContext&)>;
+  // 异步 handler：返回时不发送响应，设置好响应后调用 ResponseHandle::complete（或 fail）才发送，可以在任意线程调用；
+  // 在此之前会话不占用线程，完成后照常运行后置拦截器，失败时交给异常处理器
+  using AsyncHttpHandler = std::function<void(HttpContext&, std::shared_ptr<ResponseHandle>)>;
   using UnknownExceptionHandler = std::function<void(HttpContext&)>;
 
+  // 请求体的读取方式
+  enum class BodyMode
+  {
+    // 读完整个请求体再调用 handler
+    buffer,
+    // 读完请求头就调用 handler，请求体由 handler 通过 HttpContext::read_body 分块读取，不在内存中缓存
+    stream,
+  };
+
+  // 路由级别的选项，在读完请求头、读取请求体之前生效
+  struct RouteOptions
+  {
+    // 覆盖 HttpSessionOptions::body_limit，Content-Length 超出时不调用 handler，直接返回 413；
+    // multipart 请求取它与 multipart.max_total_size 中较小的一个
+    std::optional<std::uint64_t> body_limit;
+    BodyMode body_mode = BodyMode::buffer;
+  };
+
   // 路由条目结构
   struct RouteEntry
   {
     std::string original_path;
-    std::regex path_regex;
+    std::regex path_regex; // 仅用于无法放入前缀树的路由（例如 "/file-:id.txt" 这种参数嵌在段内的写法）
     std::vector<std::string> param_names;
     std::map<boost::beast::http::verb, HttpHandler> handlers;
+    std::map<boost::beast::http::verb, RouteOptions> options;
     int literal_segments_count = 0;
     int dynamic_segments_count = 0;
 
@@ -41,16 +67,47 @@ namespace khttpd::framework
     }
   };
 
+  // 一次匹配中捕获到的路径参数，按出现顺序存放，值直接引用请求路径，不做拷贝
+  struct PathParamValues
+  {
+    static constexpr size_t capacity = ParamList::inline_capacity;
+    std::array<std::string_view, capacity> values;
+    size_t size = 0;
+  };
+
+  // 基于路径段的前缀树节点
+  // 匹配优先级：静态段 > :param（匹配一个非空段）> 末尾的 :param（匹配剩余全部路径，可包含 '/'）
+  struct RouteNode
+  {
+    std::map<std::string, std::unique_ptr<RouteNode>, std::less<>> static_children;
+    std::unique_ptr<RouteNode> param_child;
+    std::unique_ptr<RouteNode> catch_all_child;
+    RouteEntry* entry = nullptr; // 在此节点结束的路由
+    // 从根到此节点经过的字面段与参数段数量，即在此结束的路由的特异性
+    int literal_segments_count = 0;
+    int dynamic_segments_count = 0;
+  };
+
   class HttpRouter
   {
   public:
     HttpRouter();
 
-    void get(const std::string& path, HttpHandler handler);
-    void post(const std::string& path, HttpHandler handler);
-    void put(const std::string& path, HttpHandler handler);
-    void del(const std::string& path, HttpHandler handler);
-    void options(const std::string& path, HttpHandler handler);
+    void get(const std::string& path, HttpHandler handler, RouteOptions route_options = {});
+    void post(const std::string& path, HttpHandler handler, RouteOptions route_options = {});
+    void put(const std::string& path, HttpHandler handler, RouteOptions route_options = {});
+    void del(const std::string& path, HttpHandler handler, RouteOptions route_options = {});
+    void options(const std::string& path, HttpHandler handler, RouteOptions route_options = {});
+
+    // 注册异步 handler。名字与同步版本区分开，std::bind 生成的对象可以用两种参数调用，重载会产生歧义
+    void get_async(const std::string& path, AsyncHttpHandler handler, RouteOptions route_options = {});
+    void post_async(const std::string& path, AsyncHttpHandler handler, RouteOptions route_options = {});
+    void put_async(const std::string& path, AsyncHttpHandler handler, RouteOptions route_options = {});
+    void del_async(const std::string& path, AsyncHttpHandler handler, RouteOptions route_options = {});
+    void options_async(const std::string& path, AsyncHttpHandler handler, RouteOptions route_options = {});
+
+    // 会话读完请求头后调用：返回将处理该请求的路由为这个方法注册的选项，没有对应的 handler 时返回 nullptr
+    const RouteOptions* find_route_options(boost::beast::http::verb method, std::string_view path) const;
 
     void add_interceptor(std::shared_ptr<Interceptor> interceptor);
     InterceptorResult run_pre_interceptors(HttpContext& ctx) const;
@@ -65,17 +122,36 @@ namespace khttpd::framework
     bool dispatch(HttpContext& ctx, const std::function<bool()>& static_file_fun = nullptr) const;
 
   private:
-    std::vector<RouteEntry> routes_;
+    std::vector<std::unique_ptr<RouteEntry>> routes_;
+    RouteNode root_;
+    std::vector<RouteEntry*> regex_routes_; // 按 compare_specificity 排序
     std::vector<std::shared_ptr<Interceptor>> interceptors_;
 
     std::vector<std::shared_ptr<ExceptionHandlerBase>> exception_handlers_;
     UnknownExceptionHandler unknown_exception_handler_;
 
-    void add_route(const std::string& path_pattern, boost::beast::http::verb method, HttpHandler handler);
+    void add_route(const std::string& path_pattern, boost::beast::http::verb method, HttpHandler handler,
+                   RouteOptions route_options);
+
+    // 把异步 handler 包装成经由 HttpContext::defer 延迟响应的同步 handler
+    static HttpHandler wrap_async(AsyncHttpHandler handler);
 
     static std::tuple<std::regex, std::vector<std::string>, int, int> parse_path_pattern(
       const std::string& path_pattern);
 
+    bool insert_into_tree(RouteEntry& entry);
+    // 在 node 之下剩余 remaining_segments 个请求路径段时，是否还可能找到比 best 更具体的路由
+    static bool can_beat(const RouteNode& node, int remaining_segments, const RouteEntry& best);
+    // 在前缀树中查找能处理该请求的路由（可能是方法不匹配、需要返回 405 的路由），
+    // 有多个时按 compare_specificity 保留最具体的一个；同样具体时保留先找到的（静态段优先）
+    static void match_node(const RouteNode& node, std::string_view path, size_t pos, int remaining_segments,
+                           boost::beast::http::verb method, PathParamValues& params, const RouteEntry*& best,
+                           PathParamValues& best_params);
+    // 选出处理该请求的路由，与按特异性逐个匹配所有路由的结果一致：前缀树的结果之外，
+    // 只需再检查排在它前面（更具体）的正则路由。命中正则路由时 matches 保存捕获组，否则 params 保存路径参数
+    const RouteEntry* find_route(std::string_view path, boost::beast::http::verb method, PathParamValues& params,
+                                 std::match_results<std::string_view::const_iterator>& matches) const;
+
     static void handle_not_found(HttpContext& ctx);
     static void handle_method_not_allowed(HttpContext& ctx,
                                           const std::map<boost::beast::http::verb, HttpHandler>& allowed_methods);
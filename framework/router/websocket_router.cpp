@@ -2,6 +2,8 @@
 #include "websocket_router.hpp"
 #include <fmt/core.h>
 #include "websocket/websocket_session.hpp"
+#include "websocket/websocket_session_registry.hpp"
+#include "websocket/websocket_topics.hpp"
 
 namespace khttpd::framework
 {
@@ -15,8 +17,35 @@ namespace khttpd::framework
     return WebsocketSession::send_message(ids, msg, is_text);
   }
 
+  size_t websocket::publish(const std::string& topic, const std::string& msg, const bool is_text)
+  {
+    return WebsocketTopics::instance().publish(topic, std::make_shared<const std::string>(msg), is_text);
+  }
+
   WebsocketRouter::WebsocketRouter() = default;
 
+  bool WebsocketRouter::subscribe(const std::string& topic, const std::string& session_id)
+  {
+    const auto session = WebsocketSessionRegistry::instance().find(session_id);
+    return session && WebsocketTopics::instance().subscribe(topic, session);
+  }
+
+  bool WebsocketRouter::unsubscribe(const std::string& topic, const std::string& session_id)
+  {
+    const auto session = WebsocketSessionRegistry::instance().find(session_id);
+    return session && WebsocketTopics::instance().unsubscribe(topic, *session);
+  }
+
+  size_t WebsocketRouter::publish(const std::string& topic, const std::string& msg, const bool is_text)
+  {
+    return websocket::publish(topic, msg, is_text);
+  }
+
+  size_t WebsocketRouter::subscriber_count(const std::string& topic) const
+  {
+    return WebsocketTopics::instance().subscriber_count(topic);
+  }
+
   void WebsocketRouter::add_handler(const std::string& path,
                                     WebsocketOpenHandler on_open,
                                     WebsocketMessageHandler on_message,
@@ -13,6 +13,8 @@ namespace khttpd::framework
   {
     bool send_message(const std::string& id, const std::string& msg, bool is_text);
     size_t send_message(const std::vector<std::string>& ids, const std::string& msg, bool is_text);
+    // 向主题的所有订阅者发送，消息只构造一份；返回订阅者数
+    size_t publish(const std::string& topic, const std::string& msg, bool is_text);
   }
 
   using WebsocketOpenHandler = std::function<void(WebsocketContext&)>;
@@ -40,6 +42,12 @@ namespace khttpd::framework
                      WebsocketCloseHandler on_close = {nullptr},
                      WebsocketErrorHandler on_error = {nullptr});
 
+    // 按会话 id 订阅/退订主题，会话不存在时返回 false；会话自己的 handler 中也可以用 WebsocketContext::subscribe
+    bool subscribe(const std::string& topic, const std::string& session_id);
+    bool unsubscribe(const std::string& topic, const std::string& session_id);
+    size_t publish(const std::string& topic, const std::string& msg, bool is_text = true);
+    size_t subscriber_count(const std::string& topic) const;
+
     void dispatch_open(const std::string& path, WebsocketContext& ctx);
     void dispatch_message(const std::string& path, WebsocketContext& ctx);
     void dispatch_close(const std::string& path, WebsocketContext& ctx);
@@ -3,58 +3,124 @@
 #include "session/http_session.hpp" // 需要HttpSession
 #include <fmt/core.h>
 #include <boost/filesystem.hpp>
+#include <boost/asio/post.hpp>
 #include <utility>
 
 #include "io_context_pool.hpp"
 
 namespace khttpd::framework
 {
-  Server::Server(const tcp::endpoint& endpoint, std::string web_root, int num_threads)
-    : signals_(IoContextPool::instance(num_threads).get_io_context(), SIGINT, SIGTERM),
+  namespace
+  {
+#if defined(SO_REUSEPORT)
+    using reuse_port_option = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+  }
+
+  Server::Server(const tcp::endpoint& endpoint, std::string web_root, int num_threads, ServerOptions options)
+    : per_core_pool_(options.io_mode == IoMode::per_core
+                       ? std::make_unique<PerCoreIoContextPool>(num_threads > 0 ? num_threads : 0)
+                       : nullptr),
+      // per_core 模式不创建共享的 IoContextPool，信号在第 0 个 io_context 上处理，也就是调用 run() 的线程
+      signals_(per_core_pool_
+                 ? per_core_pool_->get_io_context(0)
+                 : IoContextPool::instance(num_threads).get_io_context(),
+               SIGINT, SIGTERM),
       web_root_(std::move(web_root)),
-      acceptor_(net::make_strand(IoContextPool::instance().get_io_context()))
+      options_(options),
+      acceptor_(per_core_pool_
+                  ? net::any_io_executor(per_core_pool_->get_io_context(0).get_executor())
+                  : net::any_io_executor(net::make_strand(IoContextPool::instance().get_io_context()))),
+      static_files_(web_root_, options_.static_files)
+  {
+    boost::beast::error_code ec;
+
+    if (per_core_pool_)
+    {
+#if defined(SO_REUSEPORT)
+      // 每个 io_context 一个 acceptor，内核按连接把负载分散到各个监听 socket。
+      // 端口为 0 时由第一个 acceptor 分配，其余的绑定到同一个端口
+      tcp::endpoint bind_endpoint = endpoint;
+      for (size_t i = 0; i < per_core_pool_->size(); ++i)
+      {
+        auto acceptor = std::make_unique<tcp::acceptor>(per_core_pool_->get_io_context(i));
+        open_acceptor(*acceptor, bind_endpoint, true);
+        bind_endpoint = acceptor->local_endpoint();
+        per_core_acceptors_.push_back(std::move(acceptor));
+      }
+#else
+      fmt::print(stderr, "Warning: SO_REUSEPORT is not supported, using a single acceptor in per_core mode.\n");
+      auto acceptor = std::make_unique<tcp::acceptor>(per_core_pool_->get_io_context(0));
+      open_acceptor(*acceptor, endpoint, false);
+      per_core_acceptors_.push_back(std::move(acceptor));
+      distribute_accepted_ = true;
+#endif
+    }
+    else
+    {
+      open_acceptor(acceptor_, endpoint, false);
+    }
+
+    // 检查 web_root 路径
+    if (!boost::filesystem::exists(web_root_, ec))
+    {
+      fmt::print(stderr, "Warning: Web root directory '{}' does not exist. Static file serving may fail. Error: {}\n",
+                 web_root_, ec.message());
+    }
+    else if (!boost::filesystem::is_directory(web_root_, ec))
+    {
+      fmt::print(stderr, "Warning: Web root path '{}' is not a directory. Static file serving may fail. Error: {}\n",
+                 web_root_, ec.message());
+    }
+  }
+
+  Server::~Server() = default;
+
+  void Server::open_acceptor(tcp::acceptor& acceptor, const tcp::endpoint& endpoint, bool reuse_port)
   {
     boost::beast::error_code ec;
 
-    acceptor_.open(endpoint.protocol(), ec);
+    acceptor.open(endpoint.protocol(), ec);
     if (ec)
     {
       fmt::print(stderr, "Server open error: {}\n", ec.message());
       throw std::runtime_error(fmt::format("Failed to open acceptor: {}", ec.message()));
     }
 
-    acceptor_.set_option(net::socket_base::reuse_address(true), ec);
+    acceptor.set_option(net::socket_base::reuse_address(true), ec);
     if (ec)
     {
       fmt::print(stderr, "Server set_option reuse_address error: {}\n", ec.message());
       throw std::runtime_error(fmt::format("Failed to set reuse_address: {}", ec.message()));
     }
 
-    acceptor_.bind(endpoint, ec);
+#if defined(SO_REUSEPORT)
+    if (reuse_port)
+    {
+      acceptor.set_option(reuse_port_option(true), ec);
+      if (ec)
+      {
+        fmt::print(stderr, "Server set_option reuse_port error: {}\n", ec.message());
+        throw std::runtime_error(fmt::format("Failed to set reuse_port: {}", ec.message()));
+      }
+    }
+#else
+    boost::ignore_unused(reuse_port);
+#endif
+
+    acceptor.bind(endpoint, ec);
     if (ec)
     {
       fmt::print(stderr, "Server bind error: {}\n", ec.message());
       throw std::runtime_error(fmt::format("Failed to bind acceptor: {}", ec.message()));
     }
 
-    acceptor_.listen(net::socket_base::max_listen_connections, ec);
+    acceptor.listen(net::socket_base::max_listen_connections, ec);
     if (ec)
     {
       fmt::print(stderr, "Server listen error: {}\n", ec.message());
       throw std::runtime_error(fmt::format("Failed to listen: {}", ec.message()));
     }
-
-    // 检查 web_root 路径
-    if (!boost::filesystem::exists(web_root_, ec))
-    {
-      fmt::print(stderr, "Warning: Web root directory '{}' does not exist. Static file serving may fail. Error: {}\n",
-                 web_root_, ec.message());
-    }
-    else if (!boost::filesystem::is_directory(web_root_, ec))
-    {
-      fmt::print(stderr, "Warning: Web root path '{}' is not a directory. Static file serving may fail. Error: {}\n",
-                 web_root_, ec.message());
-    }
   }
 
   HttpRouter& Server::get_http_router()
@@ -82,16 +148,53 @@ namespace khttpd::framework
     return websocket_router_;
   }
 
-  void Server::run()
+  const HttpSessionStats& Server::get_session_stats() const
+  {
+    return session_stats_;
+  }
+
+  const StaticFileCacheStats& Server::get_static_file_stats() const
+  {
+    return static_files_.stats();
+  }
+
+  tcp::endpoint Server::local_endpoint() const
   {
-    fmt::print("Server listening on {}:{}\n", acceptor_.local_endpoint().address().to_string(),
-               acceptor_.local_endpoint().port());
+    return per_core_pool_ ? per_core_acceptors_.front()->local_endpoint() : acceptor_.local_endpoint();
+  }
 
+  void Server::run()
+  {
     signals_.async_wait(beast::bind_front_handler(&Server::handle_signal, shared_from_this()));
 
-    do_accept();
+    if (options_.io_mode == IoMode::per_core)
+    {
+      const auto endpoint = local_endpoint();
+      fmt::print("Server listening on {}:{} ({} io_context, {} acceptor)\n", endpoint.address().to_string(),
+                 endpoint.port(), per_core_pool_->size(), per_core_acceptors_.size());
+
+      for (auto& acceptor : per_core_acceptors_)
+      {
+        // 在 acceptor 所属的 io_context 上发起 accept
+        net::post(acceptor->get_executor(), [self = shared_from_this(), acceptor = acceptor.get()]()
+        {
+          self->do_accept(*acceptor);
+        });
+      }
+
+      static_files_.start_watching(per_core_pool_->get_io_context(0).get_executor());
+      per_core_pool_->run();
+    }
+    else
+    {
+      fmt::print("Server listening on {}://{}:{}\n", options_.ssl_context ? "https" : "http",
+                 acceptor_.local_endpoint().address().to_string(), acceptor_.local_endpoint().port());
 
-    IoContextPool::instance().get_io_context().run();
+      do_accept(acceptor_);
+      static_files_.start_watching(IoContextPool::instance().get_io_context().get_executor());
+
+      IoContextPool::instance().get_io_context().run();
+    }
 
     fmt::print("Server workers stopped.\n");
   }
@@ -105,18 +208,46 @@ namespace khttpd::framework
       fmt::print(stderr, "Server acceptor close error: {}\n", ec.message());
     }
 
-    IoContextPool::instance().stop();
+    static_files_.stop_watching();
+
+    if (per_core_pool_)
+    {
+      // 先停止并等待所有 io 线程退出，之后再关闭 acceptor 就不存在并发访问
+      per_core_pool_->stop();
+      for (auto& acceptor : per_core_acceptors_)
+      {
+        acceptor->close(ec);
+      }
+    }
+    else
+    {
+      IoContextPool::instance().stop();
+    }
     fmt::print("Server stopped.\n");
   }
 
-  void Server::do_accept()
+  net::any_io_executor Server::next_session_executor(tcp::acceptor& acceptor)
+  {
+    if (options_.io_mode == IoMode::shared)
+    {
+      return net::make_strand(IoContextPool::instance().get_io_context());
+    }
+    if (distribute_accepted_)
+    {
+      return per_core_pool_->get_next_io_context().get_executor();
+    }
+    // 单线程 io_context 无需 strand，连接留在接受它的线程上
+    return acceptor.get_executor();
+  }
+
+  void Server::do_accept(tcp::acceptor& acceptor)
   {
-    acceptor_.async_accept(
-      net::make_strand(IoContextPool::instance().get_io_context()),
-      beast::bind_front_handler(&Server::on_accept, shared_from_this()));
+    acceptor.async_accept(
+      next_session_executor(acceptor),
+      beast::bind_front_handler(&Server::on_accept, shared_from_this(), &acceptor));
   }
 
-  void Server::on_accept(boost::beast::error_code ec, tcp::socket socket)
+  void Server::on_accept(tcp::acceptor* acceptor, boost::beast::error_code ec, tcp::socket socket)
   {
     if (ec)
     {
@@ -127,12 +258,13 @@ namespace khttpd::framework
     }
     else
     {
-      std::make_shared<HttpSession>(std::move(socket), http_router_, websocket_router_, web_root_)->run();
+      std::make_shared<HttpSession>(std::move(socket), http_router_, websocket_router_, static_files_,
+                                    options_.session, session_stats_, options_.ssl_context.get())->run();
     }
 
-    if (acceptor_.is_open())
+    if (acceptor->is_open())
     {
-      do_accept();
+      do_accept(*acceptor);
     }
   }
 
@@ -3,6 +3,7 @@
 #define KHTTPD_FRAMEWORK_SERVER_HPP
 
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/context.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/asio/signal_set.hpp>
 #include <thread>
@@ -13,17 +14,43 @@
 // 包含完整定义，因为 Server 现在拥有它们
 #include "router/http_router.hpp"
 #include "router/websocket_router.hpp"
+#include "session/http_session_options.hpp"
+#include "static_file/static_file_cache.hpp"
+#include "tls/tls_context.hpp"
 
 namespace khttpd::framework
 {
   namespace net = boost::asio;
   using tcp = boost::asio::ip::tcp;
 
+  class PerCoreIoContextPool;
+
+  // IO 线程模型
+  enum class IoMode
+  {
+    // 所有工作线程运行 IoContextPool 中同一个 io_context，单个 acceptor（默认）
+    shared,
+    // 每个工作线程独占一个 io_context，并拥有自己的 SO_REUSEPORT acceptor，
+    // 连接从 accept 到关闭都在同一个线程上处理
+    per_core,
+  };
+
+  struct ServerOptions
+  {
+    IoMode io_mode = IoMode::shared;
+    HttpSessionOptions session;
+    StaticFileOptions static_files;
+    // 设置后所有连接都使用 TLS（HTTPS 与 wss），可以用 make_server_ssl_context 创建；
+    // 所有 io 线程共享同一个 context，会话缓存与票据密钥因此对所有连接有效
+    std::shared_ptr<net::ssl::context> ssl_context;
+  };
+
   class Server : public std::enable_shared_from_this<Server>
   {
   public:
     // 构造函数：现在只接受端口和线程数量。路由器在内部创建。
-    Server(const tcp::endpoint& endpoint, std::string web_root, int num_threads = 1);
+    Server(const tcp::endpoint& endpoint, std::string web_root, int num_threads = 1, ServerOptions options = {});
+    ~Server();
 
     HttpRouter& get_http_router();
     const HttpRouter& get_http_router() const; // const 版本
@@ -33,6 +60,15 @@ namespace khttpd::framework
     WebsocketRouter& get_websocket_router();
     const WebsocketRouter& get_websocket_router() const; // const 版本
 
+    // 因超时关闭的会话计数，可用于调整 ServerOptions::session.timeouts
+    const HttpSessionStats& get_session_stats() const;
+
+    // 静态文件缓存的命中、淘汰与失效计数
+    const StaticFileCacheStats& get_static_file_stats() const;
+
+    // 实际监听的地址；构造时端口为 0 的话，这里是系统分配的端口
+    tcp::endpoint local_endpoint() const;
+
     void run();
 
     void stop();
@@ -41,16 +77,29 @@ namespace khttpd::framework
     // std::optional<net::io_context> ioc_;
     // int num_threads_;
     std::vector<std::thread> threads_;
+    // IoMode::per_core 专用：每个线程一个 io_context；先于 signals_ 和 acceptor_ 构造，它们在这里运行
+    std::unique_ptr<PerCoreIoContextPool> per_core_pool_;
     net::signal_set signals_;
     const std::string web_root_;
+    const ServerOptions options_;
 
     tcp::acceptor acceptor_;
 
+    // IoMode::per_core 专用：每个 io_context 一个 acceptor
+    std::vector<std::unique_ptr<tcp::acceptor>> per_core_acceptors_;
+    // 平台不支持 SO_REUSEPORT 时，只有一个 acceptor，把连接轮询分发给各个 io_context
+    bool distribute_accepted_ = false;
+
     HttpRouter http_router_;
     WebsocketRouter websocket_router_;
+    HttpSessionStats session_stats_;
+    StaticFileCache static_files_;
+
+    static void open_acceptor(tcp::acceptor& acceptor, const tcp::endpoint& endpoint, bool reuse_port);
+    net::any_io_executor next_session_executor(tcp::acceptor& acceptor);
 
-    void do_accept();
-    void on_accept(boost::beast::error_code ec, tcp::socket socket);
+    void do_accept(tcp::acceptor& acceptor);
+    void on_accept(tcp::acceptor* acceptor, boost::beast::error_code ec, tcp::socket socket);
     void handle_signal(const boost::beast::error_code& error, int signal_number);
   };
 }
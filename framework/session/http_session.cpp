@@ -1,340 +1,1374 @@
 #include "http_session.hpp"
 
-#include <thread>
-
 #include "context/http_context.hpp"
+#include "http2/http2_session.hpp"
+#include "static_file/static_file_response.hpp"
+#include <boost/url/parse.hpp>
 #include <fmt/core.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <string_view>
 #include <utility>
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
 
 using namespace khttpd::framework;
 
-HttpSession::HttpSession(tcp::socket&& socket, HttpRouter& router, WebsocketRouter& ws_router,
-                         const std::string& web_root)
-  : stream_(std::move(socket)),
-    router_(router),
-    websocket_router_(ws_router),
-    web_root_path_(web_root)
-{
-  boost::system::error_code ec;
-  // 在构造函数中规范化 web_root 路径，避免重复操作
-  canonical_web_root_path_ = boost::filesystem::canonical(web_root_path_, ec);
-  if (ec)
+namespace
+{
+  // 客户端直接以 HTTP/2 开始时发送的连接前言（RFC 9113 3.4）
+  constexpr std::string_view http2_preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+}
+
+template <class Body>
+class HttpSession::PendingResponseImpl : public PendingResponse
+{
+public:
+  explicit PendingResponseImpl(http::response<Body>&& res)
+    : res_(std::move(res)), serializer_(res_)
+  {
+  }
+
+  bool prepare(std::vector<net::const_buffer>& buffers, beast::error_code& ec) override
+  {
+    prepared_ = 0;
+    serializer_.next(ec, [&](beast::error_code&, const auto& sequence)
+    {
+      for (const auto buffer : beast::buffers_range_ref(sequence))
+      {
+        buffers.push_back(buffer);
+        prepared_ += buffer.size();
+      }
+    });
+    // 内存中的响应体第一次就会连同响应头一起全部取出；文件等响应体需要写完一段再读下一段
+    return in_memory_body && !res_.chunked();
+  }
+
+  void consume() override
+  {
+    if (prepared_ > 0)
+    {
+      serializer_.consume(prepared_);
+      prepared_ = 0;
+    }
+  }
+
+  bool is_done() override
+  {
+    return serializer_.is_done();
+  }
+
+  bool keep_alive() const override
+  {
+    return res_.keep_alive();
+  }
+
+private:
+  static constexpr bool in_memory_body = std::is_same_v<Body, http::string_body> ||
+    std::is_same_v<Body, http::empty_body> || std::is_same_v<Body, http::span_body<const char>>;
+
+  http::response<Body> res_;
+  http::response_serializer<Body> serializer_;
+  std::size_t prepared_ = 0;
+};
+
+template <class Body>
+void HttpSession::send_response(http::response<Body>&& res)
+{
+  auto pending = std::make_unique<PendingResponseImpl<Body>>(std::move(res));
+  pending->static_file = std::move(static_file_);
+  queue_response(std::move(pending));
+}
+
+HttpSession::HttpSession(tcp::socket&& socket, HttpRouter& router, WebsocketRouter& ws_router,
+                         StaticFileCache& static_files, const HttpSessionOptions& options, HttpSessionStats& stats,
+                         net::ssl::context* ssl_context)
+  : stream_(make_stream(std::move(socket), ssl_context)),
+    router_(router),
+    websocket_router_(ws_router),
+    static_files_(static_files),
+    options_(options),
+    stats_(stats)
+#if defined(__linux__)
+    , sendfile_timer_(lowest_layer().get_executor())
+#endif
+{
+  if (options_.request_arena_size > 0)
+  {
+    arena_buffer_.reset(new std::byte[options_.request_arena_size]);
+    request_arena_.emplace(arena_buffer_.get(), options_.request_arena_size, std::pmr::new_delete_resource());
+  }
+}
+
+std::variant<beast::tcp_stream, HttpSession::SslStream> HttpSession::make_stream(
+  tcp::socket&& socket, net::ssl::context* ssl_context)
+{
+  if (ssl_context)
+  {
+    return std::variant<beast::tcp_stream, SslStream>(std::in_place_type<SslStream>, std::move(socket), *ssl_context);
+  }
+  return std::variant<beast::tcp_stream, SslStream>(std::in_place_type<beast::tcp_stream>, std::move(socket));
+}
+
+void HttpSession::run()
+{
+  net::dispatch(lowest_layer().get_executor(),
+                beast::bind_front_handler(&HttpSession::do_handshake, shared_from_this()));
+}
+
+void HttpSession::do_handshake()
+{
+  auto* stream = std::get_if<SslStream>(&stream_);
+  if (!stream)
+  {
+    return do_read();
+  }
+  // 握手计入读取请求头的时间
+  set_expiry(options_.timeouts.header_read);
+  stream->async_handshake(net::ssl::stream_base::server,
+                          beast::bind_front_handler(&HttpSession::on_handshake, shared_from_this()));
+}
+
+void HttpSession::on_handshake(const beast::error_code& ec)
+{
+  if (ec == beast::error::timeout)
+  {
+    ++stats_.header_timeouts;
+    return;
+  }
+  if (ec)
+  {
+    // 扫描器和不支持的客户端很常见，只计数不打印
+    ++stats_.tls_handshake_failures;
+    return;
+  }
+  ++stats_.tls_handshakes;
+  SSL* ssl = std::get<SslStream>(stream_).native_handle();
+  if (SSL_session_reused(ssl))
+  {
+    ++stats_.tls_resumed_handshakes;
+  }
+  const unsigned char* protocol = nullptr;
+  unsigned int protocol_length = 0;
+  SSL_get0_alpn_selected(ssl, &protocol, &protocol_length);
+  if (std::string_view(reinterpret_cast<const char*>(protocol), protocol_length) == "h2")
+  {
+    return start_http2({});
+  }
+  do_read();
+}
+
+void HttpSession::set_expiry(const std::chrono::milliseconds timeout)
+{
+  if (timeout.count() > 0)
+  {
+    lowest_layer().expires_after(timeout);
+  }
+  else
+  {
+    lowest_layer().expires_never();
+  }
+}
+
+void HttpSession::do_read()
+{
+  // keep-alive 连接上没有已缓冲的数据时，先以空闲超时等待下一个请求的首字节
+  if (!first_request_ && buffer_.size() == 0 && !parser_)
+  {
+    set_expiry(options_.timeouts.keep_alive_idle);
+    with_stream([this](auto& stream)
+    {
+      stream.async_read_some(buffer_.prepare(1024),
+                             beast::bind_front_handler(&HttpSession::on_idle, shared_from_this()));
+    });
+    return;
+  }
+  if (first_request_ && !is_tls() && options_.http2.h2c)
+  {
+    first_request_ = false;
+    // 前言可能分多次到达，截止时间只在这里设置一次
+    set_expiry(options_.timeouts.header_read);
+    return do_read_preface();
+  }
+  first_request_ = false;
+  do_read_header();
+}
+
+void HttpSession::do_read_preface()
+{
+  with_stream([this](auto& stream)
+  {
+    stream.async_read_some(buffer_.prepare(1024),
+                           beast::bind_front_handler(&HttpSession::on_read_preface, shared_from_this()));
+  });
+}
+
+void HttpSession::on_read_preface(const beast::error_code& ec, std::size_t bytes_transferred)
+{
+  if (ec == beast::error::timeout)
+  {
+    ++stats_.header_timeouts;
+    return;
+  }
+  if (ec)
+  {
+    return on_idle(ec, bytes_transferred);
+  }
+
+  buffer_.commit(bytes_transferred);
+  const auto data = buffer_.data();
+  const std::string_view received(static_cast<const char*>(data.data()), data.size());
+  const std::size_t compared = std::min(received.size(), http2_preface.size());
+  if (received.substr(0, compared) != http2_preface.substr(0, compared))
+  {
+    // 普通的 HTTP/1.1 请求，已经读到的数据留在 buffer_ 中由 parser 处理
+    return do_read_header(false);
+  }
+  if (received.size() < http2_preface.size())
+  {
+    return do_read_preface();
+  }
+  start_http2(received);
+}
+
+void HttpSession::on_idle(const beast::error_code& ec, std::size_t bytes_transferred)
+{
+  if (ec == beast::error::timeout)
+  {
+    ++stats_.idle_timeouts;
+    return;
+  }
+  if (ec == net::error::eof)
+  {
+    return do_close();
+  }
+  // 很多 HTTPS 客户端不发送 close_notify 就直接断开连接，这不是错误
+  if (ec == net::ssl::error::stream_truncated)
+  {
+    return;
+  }
+  if (ec)
+  {
+    fmt::print(stderr, "HttpSession on_idle error: {}\n", ec.message());
+    return;
+  }
+
+  buffer_.commit(bytes_transferred);
+  do_read_header();
+}
+
+void HttpSession::do_read_header(const bool restart_timer)
+{
+  // 流水线预读可能已经解析了请求的一部分，接着读即可
+  if (!parser_)
+  {
+    parser_.emplace();
+    // 请求体的上限取决于请求类型，读完请求头之后再设置
+    parser_->body_limit(std::numeric_limits<std::uint64_t>::max());
+  }
+  if (restart_timer)
+  {
+    set_expiry(options_.timeouts.header_read);
+  }
+  with_stream([this](auto& stream)
+  {
+    http::async_read_header(stream, buffer_, *parser_,
+                            beast::bind_front_handler(&HttpSession::on_read_header, shared_from_this()));
+  });
+}
+
+void HttpSession::on_read_header(const beast::error_code& ec, std::size_t bytes_transferred)
+{
+  if (ec == beast::error::timeout)
+  {
+    ++stats_.header_timeouts;
+    return;
+  }
+  if (ec || parser_->is_done())
+  {
+    return on_read(ec, bytes_transferred);
+  }
+
+  set_expiry(options_.timeouts.body_read);
+  switch (prepare_body())
+  {
+  case BodyAction::too_large:
+    return reject_request(http::status::payload_too_large);
+  case BodyAction::stream:
+    return start_streamed_request();
+  case BodyAction::multipart:
+    return read_multipart_body();
+  case BodyAction::read:
+    break;
+  }
+  with_stream([this](auto& stream)
+  {
+    http::async_read(stream, buffer_, *parser_, beast::bind_front_handler(&HttpSession::on_read, shared_from_this()));
+  });
+}
+
+HttpSession::BodyAction HttpSession::prepare_body()
+{
+  const auto& header = parser_->get();
+  std::string path(header.target().substr(0, header.target().find('?')));
+  if (const auto url = boost::urls::parse_relative_ref(header.target()); url.has_value())
+  {
+    path = url.value().path();
+  }
+  const RouteOptions* route = router_.find_route_options(header.method(), path);
+
+  BodyAction action = BodyAction::read;
+  body_limit_ = options_.body_limit;
+  if (route && route->body_mode == BodyMode::stream)
+  {
+    action = BodyAction::stream;
+  }
+  else if (options_.multipart.streaming && multipart_boundary(header[http::field::content_type]))
+  {
+    action = BodyAction::multipart;
+    body_limit_ = options_.multipart.max_total_size;
+  }
+  if (route && route->body_limit)
+  {
+    body_limit_ = action == BodyAction::multipart ? std::min(body_limit_, *route->body_limit) : *route->body_limit;
+  }
+
+  // Beast 只在请求头结束时检查 Content-Length，而这时还不知道路由，所以在这里检查；分块请求体由 parser 在读取时检查
+  if (const auto length = parser_->content_length(); length && *length > body_limit_)
+  {
+    return BodyAction::too_large;
+  }
+  parser_->body_limit(body_limit_);
+  return action;
+}
+
+void HttpSession::read_multipart_body()
+{
+  // 换成边读边解析的 parser，请求体不再完整保存在内存中
+  auto boundary = multipart_boundary(parser_->get()[http::field::content_type]);
+  multipart_ = std::make_shared<MultipartParser>(std::move(*boundary), options_.multipart);
+  multipart_parser_.emplace(std::move(*parser_), multipart_);
+  parser_.reset();
+  multipart_parser_->body_limit(body_limit_);
+  with_stream([this](auto& stream)
+  {
+    http::async_read(stream, buffer_, *multipart_parser_,
+                     beast::bind_front_handler(&HttpSession::on_read, shared_from_this()));
+  });
+}
+
+void HttpSession::start_streamed_request()
+{
+  // 请求体留在连接上，handler 调用 read_body 之后才开始读取
+  body_parser_.emplace(std::move(*parser_));
+  parser_.reset();
+  body_parser_->body_limit(body_limit_);
+  process_request();
+}
+
+void HttpSession::on_read(const beast::error_code& ec, std::size_t bytes_transferred)
+{
+  boost::ignore_unused(bytes_transferred);
+
+  if (ec == http::error::end_of_stream)
+  {
+    return do_close();
+  }
+  if (ec == beast::error::timeout)
+  {
+    ++stats_.body_timeouts;
+    return;
+  }
+  if (ec == http::error::body_limit)
+  {
+    return reject_request(http::status::payload_too_large);
+  }
+  if (ec && multipart_ && multipart_->error() != MultipartParser::Error::none)
+  {
+    return reject_request(multipart_->error() == MultipartParser::Error::io_error
+                            ? http::status::internal_server_error
+                            : multipart_->error() == MultipartParser::Error::malformed
+                            ? http::status::bad_request
+                            : http::status::payload_too_large);
+  }
+  if (ec)
+  {
+    fmt::print(stderr, "HttpSession on_read error: {}\n", ec.message());
+    return;
+  }
+
+  process_request();
+}
+
+void HttpSession::process_request()
+{
+  if (multipart_parser_)
+  {
+    // 请求体已经解析到 multipart_ 中，req_ 只保留请求头
+    req_ = http::request<http::string_body>(std::move(multipart_parser_->release().base()));
+    multipart_parser_.reset();
+  }
+  else if (body_parser_)
+  {
+    // 请求体还没有读取，req_ 只保留请求头
+    req_ = http::request<http::string_body>(body_parser_->get().base());
+  }
+  else
+  {
+    req_ = parser_->release();
+    parser_.reset();
+  }
+
+  if (beast::websocket::is_upgrade(req_))
+  {
+    fmt::print("Detected WebSocket upgrade request for target: {}\n", req_.target());
+    after_pending_writes([self = shared_from_this()]
+    {
+      self->handle_websocket_upgrade();
+    });
+    return;
+  }
+
+  if (is_h2c_upgrade())
+  {
+    after_pending_writes([self = shared_from_this()]
+    {
+      self->upgrade_to_http2();
+    });
+    return;
+  }
+
+  handle_request();
+}
+
+void HttpSession::reject_request(const http::status status)
+{
+  const auto& header = multipart_parser_ ? multipart_parser_->get().base() : parser_->get().base();
+  fmt::print(stderr, "Rejected request {}: {}\n", header.target(),
+             multipart_ && !multipart_->error_message().empty()
+               ? multipart_->error_message()
+               : "body exceeds body_limit");
+
+  // 请求体没有读完，连接上剩下的数据无法再解析，响应后关闭连接
+  http::response<http::string_body> res{status, header.version()};
+  res.keep_alive(false);
+  res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+  res.set(http::field::content_type, "text/plain");
+  res.body() = std::string(http::obsolete_reason(status));
+  res.prepare_payload();
+  parser_.reset();
+  multipart_parser_.reset();
+  multipart_.reset();
+  send_response(std::move(res));
+}
+
+bool HttpSession::parse_buffered_request()
+{
+  parser_.emplace();
+  parser_->body_limit(std::numeric_limits<std::uint64_t>::max());
+  beast::error_code ec;
+  while (buffer_.size() > 0 && !parser_->is_done())
+  {
+    // 请求头不完整时 put 不消耗任何数据；请求头完整时 put 在请求头结束处返回，请求体则会消耗已有的部分
+    const bool header_done = parser_->is_header_done();
+    const std::size_t used = parser_->put(buffer_.data(), ec);
+    buffer_.consume(used);
+    if (ec == http::error::need_more)
+    {
+      return false;
+    }
+    if (ec)
+    {
+      pipeline_error_ = ec;
+      parser_.reset();
+      return false;
+    }
+    if (!header_done && parser_->is_header_done() && !parser_->is_done())
+    {
+      const BodyAction action = prepare_body();
+      if (action == BodyAction::too_large)
+      {
+        // 保留 parser_，前面的响应写完后由 reject_request 用它的请求头响应
+        pipeline_error_ = http::error::body_limit;
+        return false;
+      }
+      // 流式与 multipart 请求体留给 on_read_header 处理
+      if (action != BodyAction::read)
+      {
+        return false;
+      }
+    }
+    if (used == 0)
+    {
+      break;
+    }
+  }
+  if (parser_->is_done())
+  {
+    return true;
+  }
+  if (buffer_.size() == 0 && !parser_->got_some())
+  {
+    parser_.reset();
+  }
+  return false;
+}
+
+class HttpSession::AsyncBodyReader : public BodyReader
+{
+public:
+  explicit AsyncBodyReader(std::shared_ptr<HttpSession> session)
+    : session_(std::move(session))
+  {
+  }
+
+  ~AsyncBodyReader() override
+  {
+    finish();
+  }
+
+  void read(ReadCallback on_chunk) override
+  {
+    net::dispatch(session_->lowest_layer().get_executor(),
+                  [session = session_, on_chunk = std::move(on_chunk)]() mutable
+                  {
+                    session->read_body_chunk(std::move(on_chunk));
+                  });
+  }
+
+  void finish() override
+  {
+    if (finished_.exchange(true))
+    {
+      return;
+    }
+    net::dispatch(session_->lowest_layer().get_executor(), [session = session_]
+    {
+      session->finish_body_read();
+    });
+  }
+
+private:
+  std::shared_ptr<HttpSession> session_;
+  std::atomic<bool> finished_{false};
+};
+
+class HttpSession::AsyncResponseHandle : public ResponseHandle
+{
+public:
+  explicit AsyncResponseHandle(std::shared_ptr<HttpSession> session)
+    : session_(std::move(session))
+  {
+  }
+
+  ~AsyncResponseHandle() override
+  {
+    complete();
+  }
+
+  net::any_io_executor get_executor() const override
+  {
+    return session_->lowest_layer().get_executor();
+  }
+
+  void complete() override
+  {
+    finish(nullptr);
+  }
+
+  void fail(std::exception_ptr error) override
+  {
+    finish(std::move(error));
+  }
+
+private:
+  void finish(std::exception_ptr error)
+  {
+    if (finished_.exchange(true))
+    {
+      return;
+    }
+    net::dispatch(session_->lowest_layer().get_executor(), [session = session_, error = std::move(error)]
+    {
+      session->finish_deferred(error);
+    });
+  }
+
+  std::shared_ptr<HttpSession> session_;
+  std::atomic<bool> finished_{false};
+};
+
+void HttpSession::handle_request()
+{
+  res_ = {};
+
+  if (request_arena_)
+  {
+    // 上一个请求的上下文已经不再使用（它的响应已移出或已写完），先析构再整体回收内存池
+    ctx.reset();
+    request_arena_->release();
+    ctx = std::allocate_shared<HttpContext>(std::pmr::polymorphic_allocator<HttpContext>(&*request_arena_),
+                                            req_, res_, &*request_arena_);
+  }
+  else
+  {
+    ctx = std::make_shared<HttpContext>(req_, res_);
+  }
+  if (multipart_)
+  {
+    ctx->set_multipart_data(multipart_->release());
+    multipart_.reset();
+  }
+  buffered_body_read_ = false;
+  body_finish_requested_ = false;
+
+  try
+  {
+    // 1. Run Pre-interceptors
+    if (router_.run_pre_interceptors(*ctx) == InterceptorResult::Stop)
+    {
+      // Interceptor decided to stop (rejected or responded directly)
+      // Run post-interceptors on the response generated by the interceptor
+      router_.run_post_interceptors(*ctx);
+      send_context_response();
+      return;
+    }
+
+    bool static_file_served = false;
+    // 2. Dispatch to routes or static files
+    router_.dispatch(*ctx, [this, &static_file_served]
+    {
+      // 处理 GET 请求以尝试服务静态文件
+      if (req_.method() == http::verb::get || req_.method() == http::verb::head)
+      {
+        static_file_served = do_serve_static_file();
+      }
+      return static_file_served;
+    });
+
+    // If static file was served, the response is already sent.
+    // We skip post-interceptors and explicit send_response.
+    if (static_file_served)
+    {
+      return;
+    }
+
+    // handler 要读取请求体，响应等 BodyReader::finish 之后再处理
+    if (const auto& handler = ctx->get_body_read_handler())
+    {
+      handler(std::make_shared<AsyncBodyReader>(shared_from_this()));
+      return;
+    }
+
+    // handler 延迟了响应，等 ResponseHandle 完成；期间会话上没有进行中的操作，不占用线程
+    if (const auto& handler = ctx->get_defer_handler())
+    {
+      const auto response = std::make_shared<AsyncResponseHandle>(shared_from_this());
+      try
+      {
+        handler(response);
+      }
+      catch (...)
+      {
+        response->fail(std::current_exception());
+      }
+      return;
+    }
+
+    // 3. Run Post-interceptors (always run if we reached here, i.e., dynamic route or 404)
+    router_.run_post_interceptors(*ctx);
+    send_context_response();
+  }
+  catch (...)
+  {
+    router_.handle_exception(std::current_exception(), *ctx);
+    // Ensure response is sent if not already (we assume exception happened before sending)
+    // We might want to clear previous body if it was partially written in buffer?
+    // res_ is wrapped in ctx, and handle_exception modifies ctx/res_.
+    end_streamed_body();
+    send_response(std::move(res_));
+  }
+}
+
+void HttpSession::end_streamed_body()
+{
+  if (body_parser_)
+  {
+    // 请求体没有读完，连接上剩下的数据无法再解析
+    if (!body_parser_->is_done())
+    {
+      res_.keep_alive(false);
+    }
+    body_parser_.reset();
+  }
+}
+
+void HttpSession::send_context_response()
+{
+  end_streamed_body();
+  if (res_.chunked())
+  {
+    send_chunked_response();
+  }
+  else
+  {
+    send_response(std::move(res_));
+  }
+}
+
+void HttpSession::read_body_chunk(BodyReader::ReadCallback on_chunk)
+{
+  if (!body_parser_)
+  {
+    // 请求体已经在内存中，作为一块交出
+    const std::string_view body = buffered_body_read_ ? std::string_view{} : std::string_view(req_.body());
+    buffered_body_read_ = true;
+    return on_chunk({}, body);
+  }
+  if (body_parser_->is_done())
+  {
+    return on_chunk({}, {});
+  }
+
+  body_reading_ = true;
+  body_chunk_.resize(std::max<std::size_t>(options_.body_chunk_size, 1));
+  auto& body = body_parser_->get().body();
+  body.data = body_chunk_.data();
+  body.size = body_chunk_.size();
+  set_expiry(options_.timeouts.body_read);
+  with_stream([this, &on_chunk](auto& stream)
+  {
+    http::async_read_some(stream, buffer_, *body_parser_,
+                          [self = shared_from_this(), on_chunk = std::move(on_chunk)](
+                          beast::error_code ec, std::size_t bytes_transferred)
+                          {
+                            self->on_read_body_chunk(on_chunk, ec, bytes_transferred);
+                          });
+  });
+}
+
+void HttpSession::on_read_body_chunk(const BodyReader::ReadCallback& on_chunk, beast::error_code ec,
+                                     std::size_t bytes_transferred)
+{
+  boost::ignore_unused(bytes_transferred);
+  body_reading_ = false;
+  if (body_finish_requested_)
+  {
+    return finish_body_read();
+  }
+  // 缓冲区写满时 Beast 返回 need_buffer，这正是我们要的一块
+  if (ec == http::error::need_buffer)
+  {
+    ec = {};
+  }
+  if (ec == beast::error::timeout)
+  {
+    ++stats_.body_timeouts;
+  }
+
+  const std::size_t size = body_chunk_.size() - body_parser_->get().body().size;
+  if (!ec && size == 0 && !body_parser_->is_done())
+  {
+    // 只读到了分块编码的块头，没有数据，空的 chunk 会被当成结束，继续读
+    return read_body_chunk(on_chunk);
+  }
+  on_chunk(ec, std::string_view(body_chunk_.data(), ec ? 0 : size));
+}
+
+void HttpSession::finish_body_read()
+{
+  // 还有未完成的读取时，parser 与缓冲区仍在使用，等它完成再发送响应
+  body_finish_requested_ = body_reading_;
+  if (body_reading_)
+  {
+    return;
+  }
+  try
+  {
+    router_.run_post_interceptors(*ctx);
+  }
+  catch (...)
+  {
+    router_.handle_exception(std::current_exception(), *ctx);
+  }
+  send_context_response();
+}
+
+void HttpSession::finish_deferred(const std::exception_ptr& error)
+{
+  if (error)
+  {
+    // 与 handler 直接抛出异常时一样，不运行后置拦截器
+    router_.handle_exception(error, *ctx);
+    end_streamed_body();
+    return send_response(std::move(res_));
+  }
+  try
+  {
+    router_.run_post_interceptors(*ctx);
+  }
+  catch (...)
+  {
+    router_.handle_exception(std::current_exception(), *ctx);
+  }
+  send_context_response();
+}
+
+// StaticFileResponder 生成的响应经由流水线队列发送，明文连接上的文件用 sendfile 发送
+class HttpSession::StaticFileSink
+{
+public:
+  explicit StaticFileSink(HttpSession& session)
+    : session_(session)
+  {
+  }
+
+  template <class Body>
+  void send(http::response<Body>&& res, std::shared_ptr<const StaticFile> file)
+  {
+    session_.static_file_ = std::move(file);
+    session_.send_response(std::move(res));
+  }
+
+  bool send_file_zero_copy(std::shared_ptr<const StaticFile>& file, const ByteRange* range)
   {
-    fmt::print(stderr, "Error canonicalizing web_root_path_ '{}': {}\n", web_root_path_.string(), ec.message());
-    // 如果 web_root 本身就无效，后续静态文件服务都会失败
-    disable_web_root_ = true;
+#if defined(__linux__)
+    // sendfile 绕过了 TLS 加密，TLS 连接经由 file_body 发送
+    if (!session_.is_tls())
+    {
+      session_.send_file_zero_copy(std::move(file), range);
+      return true;
+    }
+#endif
+    boost::ignore_unused(file, range);
+    return false;
   }
-}
 
-void HttpSession::run()
+private:
+  HttpSession& session_;
+};
+
+// 尝试服务静态文件
+bool HttpSession::do_serve_static_file()
 {
-  net::dispatch(stream_.get_executor(),
-                beast::bind_front_handler(&HttpSession::do_read, shared_from_this()));
+  // path() 已经去除了查询字符串
+  const std::string& request_path = ctx->path();
+  StaticFileSink sink(*this);
+  StaticFileResponder<http::request<http::string_body>, StaticFileSink> responder(
+    req_, static_files_.options(), sink);
+  return responder.respond(static_files_.lookup(request_path), request_path);
 }
 
-void HttpSession::do_read()
+#if defined(__linux__)
+void HttpSession::send_file_zero_copy(std::shared_ptr<const StaticFile> file, const ByteRange* range)
 {
-  req_ = {};
-  http::async_read(stream_, buffer_, req_,
-                   beast::bind_front_handler(&HttpSession::on_read, shared_from_this()));
+  static_file_ = std::move(file);
+  sendfile_offset_ = range ? range->first : 0;
+  sendfile_end_ = range ? range->last + 1 : static_file_->size;
+
+  sendfile_res_.emplace(range ? http::status::partial_content : http::status::ok, req_.version());
+  sendfile_res_->keep_alive(req_.keep_alive());
+  set_static_file_headers(*sendfile_res_, *static_file_);
+  sendfile_res_->set(http::field::content_type, static_file_->content_type);
+  if (range)
+  {
+    sendfile_res_->set(http::field::content_range, format_content_range(*range, static_file_->size));
+  }
+  sendfile_res_->content_length(sendfile_end_ - sendfile_offset_);
+  sendfile_sr_.emplace(*sendfile_res_);
+
+  after_pending_writes([self = shared_from_this()]
+  {
+    self->set_expiry(self->options_.timeouts.write);
+    // sendfile 只用于明文连接
+    http::async_write_header(std::get<beast::tcp_stream>(self->stream_), *self->sendfile_sr_,
+                             beast::bind_front_handler(&HttpSession::on_sendfile_header, self));
+  });
 }
 
-void HttpSession::on_read(const beast::error_code& ec, std::size_t bytes_transferred)
+void HttpSession::on_sendfile_header(beast::error_code ec, std::size_t bytes_transferred)
 {
   boost::ignore_unused(bytes_transferred);
-
-  if (ec == http::error::end_of_stream)
+  if (ec == beast::error::timeout)
   {
-    return do_close();
+    ++stats_.write_timeouts;
+    return;
   }
   if (ec)
   {
-    fmt::print(stderr, "HttpSession on_read error: {}\n", ec.message());
+    fmt::print(stderr, "HttpSession on_sendfile_header error: {}\n", ec.message());
     return;
   }
 
-  if (beast::websocket::is_upgrade(req_))
+  lowest_layer().expires_never();
+  if (options_.timeouts.write.count() > 0)
   {
-    fmt::print("Detected WebSocket upgrade request for target: {}\n", req_.target());
-    handle_websocket_upgrade();
+    sendfile_timer_.expires_after(options_.timeouts.write);
+    sendfile_timer_.async_wait(beast::bind_front_handler(&HttpSession::on_sendfile_timeout, shared_from_this()));
+  }
+
+  lowest_layer().socket().native_non_blocking(true, ec);
+  if (ec)
+  {
+    fmt::print(stderr, "HttpSession native_non_blocking error: {}\n", ec.message());
+    sendfile_timer_.cancel();
     return;
   }
 
-  handle_request();
+  do_sendfile();
 }
 
-void HttpSession::handle_request()
+void HttpSession::do_sendfile()
 {
-  res_ = {};
+  // 每次最多发送的字节数；发送够一轮后让出线程，避免一个快速客户端独占 io 线程
+  constexpr std::uint64_t max_chunk = 1024 * 1024;
+  constexpr std::uint64_t max_per_turn = 8 * max_chunk;
 
-  ctx = std::make_shared<HttpContext>(req_, res_);
+  auto& socket = lowest_layer().socket();
+  const std::uint64_t end = sendfile_end_;
+  std::uint64_t sent_this_turn = 0;
 
-  try
+  while (sendfile_offset_ < end)
   {
-    // 1. Run Pre-interceptors
-    if (router_.run_pre_interceptors(*ctx) == InterceptorResult::Stop)
+    if (sent_this_turn >= max_per_turn)
     {
-      // Interceptor decided to stop (rejected or responded directly)
-      // Run post-interceptors on the response generated by the interceptor
-      router_.run_post_interceptors(*ctx);
-
-      if (res_.chunked())
-      {
-        send_chunked_response();
-      }
-      else
-      {
-        send_response(std::move(res_));
-      }
+      net::post(lowest_layer().get_executor(), beast::bind_front_handler(&HttpSession::do_sendfile, shared_from_this()));
       return;
     }
 
-    bool static_file_served = false;
-    // 2. Dispatch to routes or static files
-    router_.dispatch(*ctx, [this, &static_file_served]
+    off_t offset = static_cast<off_t>(sendfile_offset_);
+    const ssize_t n = ::sendfile(socket.native_handle(), static_file_->fd, &offset,
+                                 static_cast<std::size_t>(std::min(end - sendfile_offset_, max_chunk)));
+    if (n > 0)
     {
-      // 处理 GET 请求以尝试服务静态文件
-      if (req_.method() == http::verb::get || req_.method() == http::verb::head)
-      {
-        static_file_served = do_serve_static_file();
-      }
-      return static_file_served;
-    });
-
-    // If static file was served, the response is already sent.
-    // We skip post-interceptors and explicit send_response.
-    if (static_file_served)
+      sent_this_turn += static_cast<std::uint64_t>(n);
+      sendfile_offset_ = static_cast<std::uint64_t>(offset);
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
     {
+      socket.async_wait(tcp::socket::wait_write,
+                        beast::bind_front_handler(&HttpSession::on_sendfile_wait, shared_from_this()));
       return;
     }
 
-    // 3. Run Post-interceptors (always run if we reached here, i.e., dynamic route or 404)
-    router_.run_post_interceptors(*ctx);
+    // n == 0 表示文件在发送过程中被截断。Content-Length 已经发出，只能关闭连接
+    fmt::print(stderr, "HttpSession sendfile error for {}: {}\n", static_file_->path,
+               n == 0 ? "unexpected end of file" : std::strerror(errno));
+    sendfile_timer_.cancel();
+    sendfile_sr_.reset();
+    sendfile_res_.reset();
+    beast::error_code ec;
+    socket.shutdown(tcp::socket::shutdown_both, ec);
+    return;
+  }
 
-    if (res_.chunked())
-    {
-      send_chunked_response();
-    }
-    else
+  sendfile_timer_.cancel();
+  const bool keep_alive = sendfile_res_->keep_alive();
+  sendfile_sr_.reset();
+  sendfile_res_.reset();
+  on_write(keep_alive, {}, 0);
+}
+
+void HttpSession::on_sendfile_wait(beast::error_code ec)
+{
+  if (ec)
+  {
+    if (ec != net::error::operation_aborted)
     {
-      send_response(std::move(res_));
+      fmt::print(stderr, "HttpSession sendfile wait error: {}\n", ec.message());
     }
+    return;
   }
-  catch (...)
+  do_sendfile();
+}
+
+void HttpSession::on_sendfile_timeout(beast::error_code ec)
+{
+  // 定时器被取消，或者已经发送完毕
+  if (ec == net::error::operation_aborted || !sendfile_sr_)
   {
-    router_.handle_exception(std::current_exception(), *ctx);
-    // Ensure response is sent if not already (we assume exception happened before sending)
-    // We might want to clear previous body if it was partially written in buffer?
-    // res_ is wrapped in ctx, and handle_exception modifies ctx/res_.
-    send_response(std::move(res_));
+    return;
   }
+  ++stats_.write_timeouts;
+  // 关闭 socket 会以 operation_aborted 结束正在等待的 async_wait
+  lowest_layer().socket().close(ec);
 }
+#endif
 
-// 尝试服务静态文件
-bool HttpSession::do_serve_static_file()
+class HttpSession::AsyncChunkWriter : public ChunkWriter
 {
-  // 确保 web_root_path_ 是有效的
-  if (canonical_web_root_path_.empty())
+public:
+  explicit AsyncChunkWriter(std::shared_ptr<HttpSession> session)
+    : session_(std::move(session)), generation_(session_->chunk_generation_)
   {
-    // web_root 本身就无效，不尝试服务静态文件
-    return false;
   }
 
-  // 使用 HttpContext 获取请求路径，因为它已经去除了查询字符串
-  HttpContext temp_ctx(req_, res_); // 临时创建 ctx 来获取 path()
-  boost::filesystem::path request_path = temp_ctx.path();
+  void write(std::string chunk, WriteCallback on_written) override
+  {
+    enqueue(std::move(chunk), std::move(on_written), false);
+  }
 
-  // 如果请求的是根路径，尝试提供 index.html
-  if (request_path == "/")
+  void finish(WriteCallback on_finished) override
   {
-    request_path = "/index.html";
+    enqueue({}, std::move(on_finished), true);
   }
 
-  boost::filesystem::path full_local_path = web_root_path_ / request_path.relative_path();
-  boost::system::error_code ec;
+private:
+  void enqueue(std::string chunk, WriteCallback on_written, bool last)
+  {
+    net::dispatch(session_->lowest_layer().get_executor(),
+                  [session = session_, generation = generation_, chunk = std::move(chunk),
+                    on_written = std::move(on_written), last]() mutable
+                  {
+                    // keep-alive 连接上会话可能已经开始了下一个分块响应，过期的 writer 不能把数据写进去
+                    if (generation != session->chunk_generation_)
+                    {
+                      return session->reject_chunk(std::move(on_written));
+                    }
+                    session->enqueue_chunk(std::move(chunk), std::move(on_written), last);
+                  });
+  }
 
-  // 1. 规范化路径以防止目录遍历攻击 (e.g., /../)
-  full_local_path = boost::filesystem::canonical(full_local_path, ec);
+  std::shared_ptr<HttpSession> session_;
+  // 创建时所属响应的序号
+  std::uint64_t generation_;
+};
 
-  // 如果规范化失败 (文件不存在、权限问题、路径无效等)
-  if (ec)
+void HttpSession::send_chunked_response()
+{
+  res_.body() = "";
+  sr_.emplace(res_);
+  chunk_queue_.clear();
+  chunk_writing_ = false;
+  chunk_closed_ = false;
+  ++chunk_generation_;
+
+  after_pending_writes([self = shared_from_this()]
   {
-    if (ec == boost::system::errc::no_such_file_or_directory)
+    self->set_expiry(self->options_.timeouts.write);
+    self->with_stream([&self](auto& stream)
     {
-      // 文件不存在，交由动态路由或 404 处理
-      return false;
-    }
-    // 其他错误，例如权限不足或无效路径，直接返回 403
-    http::response<http::string_body> forbidden_res{http::status::forbidden, req_.version()};
-    forbidden_res.keep_alive(req_.keep_alive());
-    forbidden_res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-    forbidden_res.set(http::field::content_type, "text/html");
-    forbidden_res.body() = fmt::format("<h1>403 Forbidden</h1><p>Access denied due to invalid path: {}. Error: {}</p>",
-                                       request_path.string(), ec.message());
-    forbidden_res.prepare_payload();
-    send_response(std::move(forbidden_res));
-    return true; // 已处理请求
-  }
-
-  // 2. 安全检查：确保规范化后的路径仍在 Web 根目录内
-  const std::string& full_path_str = full_local_path.string();
-  const std::string& root_path_str = canonical_web_root_path_.string();
-  if (full_path_str.substr(0, root_path_str.size()) != root_path_str)
-  {
-    http::response<http::string_body> forbidden_res{http::status::forbidden, req_.version()};
-    forbidden_res.keep_alive(req_.keep_alive());
-    forbidden_res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-    forbidden_res.set(http::field::content_type, "text/html");
-    forbidden_res.body() = fmt::format(
-      "<h1>403 Forbidden</h1><p>Access denied: Path traversal attempt detected for {}.</p>", request_path.string());
-    forbidden_res.prepare_payload();
-    send_response(std::move(forbidden_res));
-    return true; // 已处理请求
-  }
-
-  // 3. 检查是否为目录
-  if (boost::filesystem::is_directory(full_local_path, ec))
+      http::async_write_header(stream, *self->sr_, beast::bind_front_handler(&HttpSession::on_write_header, self));
+    });
+  });
+}
+
+void HttpSession::queue_response(std::unique_ptr<PendingResponse> response)
+{
+  const bool keep_alive = response->keep_alive();
+  pending_responses_.push_back(std::move(response));
+
+  // 读缓冲中已经有下一个完整的请求时先处理它，之后把这些响应合并为一次写操作
+  if (keep_alive && pending_responses_.size() < options_.max_pipelined_requests && parse_buffered_request())
+  {
+    ++stats_.pipelined_requests;
+    net::post(lowest_layer().get_executor(), beast::bind_front_handler(&HttpSession::process_request, shared_from_this()));
+    return;
+  }
+  flush_pending_responses();
+}
+
+void HttpSession::after_pending_writes(std::function<void()> start)
+{
+  if (pending_responses_.empty())
   {
+    start();
+    return;
+  }
+  deferred_write_ = std::move(start);
+  flush_pending_responses();
+}
+
+void HttpSession::flush_pending_responses()
+{
+  write_buffers_.clear();
+  std::size_t responses = 0;
+  for (auto& pending : pending_responses_)
+  {
+    beast::error_code ec;
+    const bool complete = pending->prepare(write_buffers_, ec);
     if (ec)
     {
-      /* 错误处理 */
-    }
-    // 如果是目录，尝试提供 index.html
-    boost::filesystem::path index_file_path = full_local_path / "index.html";
-    if (boost::filesystem::is_regular_file(index_file_path, ec))
-    {
-      full_local_path = index_file_path; // 将路径指向 index.html
+      fmt::print(stderr, "HttpSession serialize response error: {}\n", ec.message());
+      return;
     }
-    else
+    ++responses;
+    // 只取出了一部分的响应写完之前，后面的响应不能跟着写出
+    if (!complete)
     {
-      // 目录不包含 index.html，且不允许目录列表
-      http::response<http::string_body> forbidden_res{http::status::forbidden, req_.version()};
-      forbidden_res.keep_alive(req_.keep_alive());
-      forbidden_res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-      forbidden_res.set(http::field::content_type, "text/html");
-      forbidden_res.body() = fmt::format("<h1>403 Forbidden</h1><p>Directory listing not allowed for {}.</p>",
-                                         request_path.string());
-      forbidden_res.prepare_payload();
-      send_response(std::move(forbidden_res));
-      return true; // 已处理请求
+      break;
     }
   }
-
-  // 4. 最终检查：确保是常规文件
-  if (!boost::filesystem::is_regular_file(full_local_path, ec) || ec)
+  if (responses > 1)
   {
-    // 如果不是常规文件，或者存在其他错误，交由动态路由或 404 处理
-    return false;
+    ++stats_.gathered_writes;
   }
 
-  // 5. 文件存在且是常规文件，现在开始发送文件
-  http::response<http::file_body> file_res;
-  file_res.version(req_.version());
-  file_res.keep_alive(req_.keep_alive());
-  file_res.result(http::status::ok); // 默认 200 OK
-  file_res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+  set_expiry(options_.timeouts.write);
+  with_stream([this](auto& stream)
+  {
+    net::async_write(stream, write_buffers_,
+                     beast::bind_front_handler(&HttpSession::on_write_pending, shared_from_this()));
+  });
+}
 
-  // 打开文件
-  file_res.body().open(full_local_path.string().c_str(), beast::file_mode::scan, ec);
+void HttpSession::on_write_pending(beast::error_code ec, std::size_t bytes_transferred)
+{
+  boost::ignore_unused(bytes_transferred);
+  write_buffers_.clear();
   if (ec)
   {
-    fmt::print(stderr, "Error opening file {}: {}\n", full_local_path.string(), ec.message());
-    http::response<http::string_body> internal_error_res{http::status::internal_server_error, req_.version()};
-    internal_error_res.keep_alive(req_.keep_alive());
-    internal_error_res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-    internal_error_res.set(http::field::content_type, "text/html");
-    internal_error_res.body() = "<h1>500 Internal Server Error</h1><p>Could not open the requested file.</p>";
-    internal_error_res.prepare_payload();
-    send_response(std::move(internal_error_res));
-    return true; // 已处理请求
+    pending_responses_.clear();
+    return on_write(false, ec, bytes_transferred);
   }
 
-  // 设置 Content-Type
-  std::string extension = full_local_path.extension().string();
-  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower); // 转换为小写
-  file_res.set(http::field::content_type, mime_type_from_extension(extension));
+  bool keep_alive = true;
+  for (auto& pending : pending_responses_)
+  {
+    pending->consume();
+  }
+  while (!pending_responses_.empty() && pending_responses_.front()->is_done())
+  {
+    keep_alive = pending_responses_.front()->keep_alive();
+    pending_responses_.pop_front();
+  }
+  if (!pending_responses_.empty())
+  {
+    // 响应体由多段组成（例如 file_body），继续写剩下的部分
+    return flush_pending_responses();
+  }
+
+  if (!keep_alive)
+  {
+    return on_write(false, {}, 0);
+  }
+  if (deferred_write_)
+  {
+    auto start = std::move(deferred_write_);
+    deferred_write_ = nullptr;
+    return start();
+  }
+  if (pipeline_error_)
+  {
+    // 预读时遇到的解析错误，在前面的响应都写完之后再处理
+    return on_read(std::exchange(pipeline_error_, {}), 0);
+  }
+  on_write(true, {}, 0);
+}
 
-  // 准备 payload (这会自动设置 Content-Length)
-  file_res.prepare_payload();
+void HttpSession::on_write_header(beast::error_code ec, std::size_t bytes_transferred)
+{
+  boost::ignore_unused(bytes_transferred);
+  if (ec == beast::error::timeout)
+  {
+    ++stats_.write_timeouts;
+    return;
+  }
+  if (ec)
+  {
+    fmt::print(stderr, "HttpSession on_write_header error: {}\n", ec.message());
+    return;
+  }
 
-  // 发送响应
-  send_response(std::move(file_res));
-  return true; // 静态文件已处理
+  try
+  {
+    if (const auto& generator = ctx->get_chunk_generator())
+    {
+      chunk_generator_ = generator;
+      do_pull_chunk();
+    }
+    else if (const auto& handler = ctx->get_async_stream_handler())
+    {
+      handler(std::make_shared<AsyncChunkWriter>(shared_from_this()));
+    }
+    else if (const auto legacy_handler = ctx->get_stream_handler())
+    {
+      legacy_handler(*ctx, [this](const std::string& buffer)
+      {
+        enqueue_chunk(buffer, nullptr, false);
+        return !chunk_closed_;
+      });
+      enqueue_chunk({}, nullptr, true);
+    }
+    else
+    {
+      enqueue_chunk({}, nullptr, true);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    fmt::print(stderr, "HttpSession stream handler exception: {}\n", e.what());
+    abort_stream("stream handler");
+  }
 }
 
-void HttpSession::send_chunked_response()
+void HttpSession::enqueue_chunk(std::string data, ChunkWriter::WriteCallback on_written, bool last)
 {
-  res_.body() = "";
-  sr_.emplace(res_);
+  if (chunk_closed_)
+  {
+    return reject_chunk(std::move(on_written));
+  }
+
+  // 空数据块在分块编码里就是结束块，不能原样写出
+  if (data.empty() && !last)
+  {
+    if (on_written)
+    {
+      net::post(lowest_layer().get_executor(), [on_written = std::move(on_written)]()
+      {
+        on_written({});
+      });
+    }
+    return;
+  }
 
-  http::async_write_header(stream_, *sr_,
-                           beast::bind_front_handler(
-                             &HttpSession::on_write_header,
-                             shared_from_this()));
+  chunk_closed_ = last;
+  chunk_queue_.push_back({std::move(data), std::move(on_written), last});
+  if (!chunk_writing_)
+  {
+    chunk_writing_ = true;
+    do_write_chunk();
+  }
 }
 
-void HttpSession::send_response(http::message_generator msg)
+void HttpSession::reject_chunk(ChunkWriter::WriteCallback on_written)
 {
-  bool keep_alive = msg.keep_alive();
-  beast::async_write(stream_, std::move(msg),
-                     beast::bind_front_handler(&HttpSession::on_write, shared_from_this(), keep_alive));
+  if (on_written)
+  {
+    net::post(lowest_layer().get_executor(), [on_written = std::move(on_written)]()
+    {
+      on_written(net::error::operation_aborted);
+    });
+  }
 }
 
-void HttpSession::on_write_header(beast::error_code ec, std::size_t bytes_transferred)
+void HttpSession::do_write_chunk()
 {
-  boost::ignore_unused(bytes_transferred);
+  const auto& chunk = chunk_queue_.front();
+  set_expiry(options_.timeouts.write);
+  with_stream([this, &chunk](auto& stream)
+  {
+    if (chunk.last)
+    {
+      net::async_write(stream, http::make_chunk_last(),
+                       beast::bind_front_handler(&HttpSession::on_write_chunk, shared_from_this()));
+    }
+    else
+    {
+      net::async_write(stream, http::make_chunk(net::buffer(chunk.data)),
+                       beast::bind_front_handler(&HttpSession::on_write_chunk, shared_from_this()));
+    }
+  });
+}
+
+void HttpSession::on_write_chunk(beast::error_code ec, std::size_t bytes_transferred)
+{
+  PendingChunk chunk = std::move(chunk_queue_.front());
+  chunk_queue_.pop_front();
+
   if (ec)
   {
-    fmt::print(stderr, "HttpSession on_write_header error: {}\n", ec.message());
+    if (ec == beast::error::timeout)
+    {
+      ++stats_.write_timeouts;
+    }
+    else
+    {
+      fmt::print(stderr, "HttpSession on_write_chunk error: {}\n", ec.message());
+    }
+    chunk_closed_ = true;
+    chunk_writing_ = false;
+    chunk_generator_ = nullptr;
+    if (chunk.on_written) chunk.on_written(ec);
+    while (!chunk_queue_.empty())
+    {
+      auto pending = std::move(chunk_queue_.front());
+      chunk_queue_.pop_front();
+      if (pending.on_written) pending.on_written(ec);
+    }
     return;
   }
-  std::thread([self = shared_from_this()]()
+
+  // 回调中可能会继续排入新的数据块
+  if (chunk.on_written) chunk.on_written(ec);
+
+  if (chunk.last)
+  {
+    chunk_writing_ = false;
+    chunk_generator_ = nullptr;
+    return on_write(res_.keep_alive(), ec, bytes_transferred);
+  }
+  if (chunk_queue_.empty())
   {
-    std::mutex mtx;
-    self->ctx->get_stream_handler()(*self->ctx, [self, &mtx](const std::string& buffer)
-    {
-      try
-      {
-        std::unique_lock<std::mutex> lock{mtx};
-        // std::stringstream ss_header;
-        // ss_header << std::hex << buffer.length() << "\r\n" << buffer << "\r\n";
-        // net::write(self->stream_, net::buffer(ss_header.str()));
-
-        std::stringstream ss_header;
-        ss_header << std::hex << buffer.length() << "\r\n";
-        net::write(self->stream_, net::buffer(ss_header.str()));
-        net::write(self->stream_, net::buffer(buffer.data(), buffer.length()));
-        net::write(self->stream_, net::buffer("\r\n", 2));
-        return true;
-      }
-      catch (std::exception& e)
-      {
-        fmt::print(stderr, "Exception: {}\n", e.what());
-        return false;
-      }
-    });
-    self->do_write_final_chunk();
-  }).detach();
+    chunk_writing_ = false;
+    return;
+  }
+  do_write_chunk();
 }
 
-void HttpSession::do_write_final_chunk()
+void HttpSession::do_pull_chunk()
 {
-  net::async_write(stream_, net::buffer("0\r\n\r\n"),
-                   beast::bind_front_handler(
-                     &HttpSession::on_shutdown,
-                     shared_from_this(), res_.keep_alive()));
+  std::optional<std::string> chunk;
+  try
+  {
+    chunk = chunk_generator_();
+  }
+  catch (const std::exception& e)
+  {
+    fmt::print(stderr, "HttpSession chunk generator exception: {}\n", e.what());
+    return abort_stream("chunk generator");
+  }
+
+  if (!chunk)
+  {
+    return enqueue_chunk({}, nullptr, true);
+  }
+  enqueue_chunk(std::move(*chunk), [self = shared_from_this()](beast::error_code ec)
+  {
+    if (!ec && self->chunk_generator_)
+    {
+      self->do_pull_chunk();
+    }
+  }, false);
 }
 
-void HttpSession::on_shutdown(bool keep_alive, beast::error_code ec, std::size_t bytes_transferred)
+void HttpSession::abort_stream(const char* what)
 {
-  on_write(keep_alive, ec, bytes_transferred);
+  // 响应头已经发出，无法再返回错误状态码；不写结束块直接关闭连接，客户端可据此判断响应不完整
+  fmt::print(stderr, "HttpSession aborting chunked response after {} failure\n", what);
+  chunk_closed_ = true;
+  chunk_generator_ = nullptr;
+  beast::error_code ec;
+  lowest_layer().socket().shutdown(tcp::socket::shutdown_both, ec);
 }
 
 void HttpSession::on_write(bool keep_alive, beast::error_code ec, std::size_t bytes_transferred)
 {
   boost::ignore_unused(bytes_transferred);
+  static_file_.reset();
+  // 响应已经写完，不必等到下一个请求再释放上下文（上传的临时文件随之删除）
+  ctx.reset();
+  if (request_arena_)
+  {
+    request_arena_->release();
+  }
 
+  if (ec == beast::error::timeout)
+  {
+    ++stats_.write_timeouts;
+    return;
+  }
   if (ec)
   {
     fmt::print(stderr, "HttpSession on_write error: {}\n", ec.message());
@@ -351,36 +1385,79 @@ void HttpSession::on_write(bool keep_alive, beast::error_code ec, std::size_t by
 
 void HttpSession::do_close()
 {
+  if (auto* stream = std::get_if<SslStream>(&stream_))
+  {
+    // 先发送 close_notify，等待对方回应或超时
+    set_expiry(options_.timeouts.write);
+    stream->async_shutdown(beast::bind_front_handler(&HttpSession::on_shutdown, shared_from_this()));
+    return;
+  }
   beast::error_code ec;
-  stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+  lowest_layer().socket().shutdown(tcp::socket::shutdown_send, ec);
   if (ec)
   {
     fmt::print(stderr, "HttpSession shutdown error: {}\n", ec.message());
   }
 }
 
+void HttpSession::on_shutdown(beast::error_code ec)
+{
+  // 很多客户端收到响应后直接断开，不回应 close_notify，这不算错误；socket 随会话一起关闭
+  boost::ignore_unused(ec);
+}
+
 void HttpSession::handle_websocket_upgrade()
 {
-  ws_session_ = std::make_shared<WebsocketSession>(stream_.release_socket(), websocket_router_,
-                                                   std::string(req_.target()));
+  if (auto* stream = std::get_if<SslStream>(&stream_))
+  {
+    ws_session_ = std::make_shared<WebsocketSession>(std::move(*stream), websocket_router_,
+                                                     std::string(req_.target()), options_.websocket, &stats_);
+  }
+  else
+  {
+    ws_session_ = std::make_shared<WebsocketSession>(std::get<beast::tcp_stream>(stream_).release_socket(),
+                                                     websocket_router_, std::string(req_.target()),
+                                                     options_.websocket, &stats_);
+  }
 
   ws_session_->run_handshake(req_);
 }
 
+void HttpSession::start_http2(const std::string_view received)
+{
+  // stream_ 移交之后本会话不再发起任何操作，随最后一个引用释放
+  std::make_shared<Http2Session>(std::move(stream_), router_, static_files_, options_, stats_)->run(received);
+}
+
+bool HttpSession::is_h2c_upgrade() const
+{
+  // 流式与 multipart 请求的请求体不在 req_ 中，无法作为流 1 交给 Http2Session，按 HTTP/1.1 处理
+  if (is_tls() || !options_.http2.h2c || body_parser_ || multipart_)
+  {
+    return false;
+  }
+  return beast::iequals(req_[http::field::upgrade], "h2c") && req_.count("HTTP2-Settings") == 1;
+}
 
-// 辅助函数：根据文件扩展名获取 MIME 类型
-std::string HttpSession::mime_type_from_extension(const std::string& ext)
+void HttpSession::upgrade_to_http2()
 {
-  if (ext == ".html" || ext == ".htm") return "text/html";
-  if (ext == ".css") return "text/css";
-  if (ext == ".js") return "application/javascript";
-  if (ext == ".json") return "application/json";
-  if (ext == ".png") return "image/png";
-  if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
-  if (ext == ".gif") return "image/gif";
-  if (ext == ".svg") return "image/svg+xml";
-  if (ext == ".pdf") return "application/pdf";
-  if (ext == ".txt") return "text/plain";
-  // Add more MIME types as needed
-  return "application/octet-stream"; // Default for unknown types
+  auto res = std::make_shared<http::response<http::empty_body>>(http::status::switching_protocols, req_.version());
+  res->set(http::field::connection, "Upgrade");
+  res->set(http::field::upgrade, "h2c");
+  set_expiry(options_.timeouts.write);
+  http::async_write(std::get<beast::tcp_stream>(stream_), *res,
+                    [self = shared_from_this(), res](beast::error_code ec, std::size_t)
+                    {
+                      if (ec)
+                      {
+                        if (ec == beast::error::timeout) ++self->stats_.write_timeouts;
+                        return;
+                      }
+                      const std::string settings(self->req_["HTTP2-Settings"]);
+                      const auto data = self->buffer_.data();
+                      std::make_shared<Http2Session>(std::move(self->stream_), self->router_, self->static_files_,
+                                                     self->options_, self->stats_)
+                        ->run_upgraded(settings, std::move(self->req_),
+                                       {static_cast<const char*>(data.data()), data.size()});
+                    });
 }
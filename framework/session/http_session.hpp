@@ -1,12 +1,23 @@
 #ifndef KHTTPD_HTTP_SESSION_HPP
 #define KHTTPD_HTTP_SESSION_HPP
 
-#include <boost/filesystem.hpp>
 #include <boost/beast.hpp>
+#include <boost/beast/ssl.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <memory>
+#include <memory_resource>
+#include <deque>
+#include <functional>
+#include <variant>
+#include <vector>
+#include "context/multipart_body.hpp"
 #include "router/http_router.hpp"
 #include "websocket/websocket_session.hpp"
+#include "session/http_session_options.hpp"
+#include "static_file/byte_range.hpp"
+#include "static_file/static_file_cache.hpp"
 
 
 namespace khttpd::framework
@@ -23,44 +34,210 @@ namespace khttpd::framework
   class HttpSession : public std::enable_shared_from_this<HttpSession>
   {
   public:
-    HttpSession(tcp::socket&& socket, HttpRouter& router, WebsocketRouter& ws_router, const std::string& web_root);
+    // ssl_context 不为空时先完成 TLS 握手，之后的请求与 WebSocket 升级都经由 TLS 收发
+    HttpSession(tcp::socket&& socket, HttpRouter& router, WebsocketRouter& ws_router, StaticFileCache& static_files,
+                const HttpSessionOptions& options, HttpSessionStats& stats, net::ssl::context* ssl_context = nullptr);
 
     // 启动会话
     void run();
 
   private:
-    bool disable_web_root_ = false;
-    beast::tcp_stream stream_;
+    using SslStream = beast::ssl_stream<beast::tcp_stream>;
+
+    // 明文连接直接读写 tcp_stream，TLS 连接读写其上的 ssl_stream；读写操作通过 with_stream 按实际类型发起
+    std::variant<beast::tcp_stream, SslStream> stream_;
     beast::flat_buffer buffer_;
+    std::optional<http::request_parser<http::string_body>> parser_;
+    // multipart/form-data 请求在读到请求头后换成这个 parser，请求体边读边交给 multipart_ 解析
+    std::optional<http::request_parser<MultipartBody>> multipart_parser_;
+    std::shared_ptr<MultipartParser> multipart_;
+    // BodyMode::stream 路由的请求体，由 handler 通过 BodyReader 一块一块读入 body_chunk_
+    std::optional<http::request_parser<http::buffer_body>> body_parser_;
+    std::vector<char> body_chunk_;
+    // 普通路由调用 read_body 时，请求体已经作为一块交出
+    bool buffered_body_read_ = false;
+    bool body_reading_ = false;
+    // 读取进行中时调用了 BodyReader::finish，读取完成后发送响应
+    bool body_finish_requested_ = false;
+    // prepare_body 为当前请求确定的请求体上限
+    std::uint64_t body_limit_ = 0;
     http::request<http::string_body> req_;
     http::response<http::string_body> res_;
     HttpRouter& router_;
     WebsocketRouter& websocket_router_;
-    const boost::filesystem::path web_root_path_;
-    boost::filesystem::path canonical_web_root_path_;
+    StaticFileCache& static_files_;
     std::shared_ptr<WebsocketSession> ws_session_;
     std::optional<http::response_serializer<http::string_body>> sr_;
+    // 请求级内存池，见 HttpSessionOptions::request_arena_size；声明在 ctx 之前，保证 ctx 先析构
+    std::unique_ptr<std::byte[]> arena_buffer_;
+    std::optional<std::pmr::monotonic_buffer_resource> request_arena_;
     std::shared_ptr<HttpContext> ctx = nullptr;
+    const HttpSessionOptions& options_;
+    HttpSessionStats& stats_;
+    bool first_request_ = true;
+
+    static std::variant<beast::tcp_stream, SslStream> make_stream(tcp::socket&& socket, net::ssl::context* ssl_context);
+
+    template <class F>
+    void with_stream(F&& f)
+    {
+      std::visit(std::forward<F>(f), stream_);
+    }
+
+    // 超时、executor 与 socket 都在最底层的 tcp_stream 上
+    beast::tcp_stream& lowest_layer()
+    {
+      return std::visit([](auto& stream) -> beast::tcp_stream& { return beast::get_lowest_layer(stream); }, stream_);
+    }
+
+    bool is_tls() const { return std::holds_alternative<SslStream>(stream_); }
+
+    void set_expiry(std::chrono::milliseconds timeout);
+
+    void do_handshake();
+    void on_handshake(const beast::error_code& ec);
 
     void do_read();
+    // 明文连接的第一个请求：以 HTTP/2 连接前言开头时转交 Http2Session（h2c prior knowledge）
+    void do_read_preface();
+    void on_read_preface(const beast::error_code& ec, std::size_t bytes_transferred);
+    void on_idle(const beast::error_code& ec, std::size_t bytes_transferred);
+    // restart_timer 为 false 时沿用已经设置的 header_read 截止时间（h2c 前言的检测计入读取请求头的时间）
+    void do_read_header(bool restart_timer = true);
+    void on_read_header(const beast::error_code& ec, std::size_t bytes_transferred);
     void on_read(const beast::error_code& ec, std::size_t bytes_transferred);
+    void process_request();
+    // 请求头读完、请求体还没开始时，根据路由选项决定如何读取请求体
+    enum class BodyAction
+    {
+      // 用 parser_ 读入内存，body_limit 已设置
+      read,
+      // BodyMode::stream 路由，由 handler 读取
+      stream,
+      // 换成 multipart_parser_ 边读边解析
+      multipart,
+      // Content-Length 超出限制
+      too_large,
+    };
+
+    BodyAction prepare_body();
+    void read_multipart_body();
+    void start_streamed_request();
+    // 请求无法继续读取（超出限制、multipart 格式错误或写临时文件失败），返回错误并关闭连接
+    void reject_request(http::status status);
+    // 不做 I/O，从 buffer_ 中解析下一个请求到 parser_；返回 true 表示得到了完整的请求
+    bool parse_buffered_request();
 
     void handle_request();
     // 新增：尝试处理静态文件请求
     bool do_serve_static_file();
+    class StaticFileSink;
+
+    // 正在发送的静态文件，响应写完之前一直持有，缓存失效不会影响发送中的内容
+    std::shared_ptr<const StaticFile> static_file_;
+
+#if defined(__linux__)
+    // sendfile 零拷贝发送：响应头经由 beast 写出，响应体直接从文件描述符发送到 socket
+    std::optional<http::response<http::empty_body>> sendfile_res_;
+    std::optional<http::response_serializer<http::empty_body>> sendfile_sr_;
+    std::uint64_t sendfile_offset_ = 0;
+    std::uint64_t sendfile_end_ = 0;
+    // 响应体不经过 tcp_stream，写超时由该定时器负责
+    net::steady_timer sendfile_timer_;
+
+    // range 为空时发送整个文件
+    void send_file_zero_copy(std::shared_ptr<const StaticFile> file, const ByteRange* range = nullptr);
+    void on_sendfile_header(beast::error_code ec, std::size_t bytes_transferred);
+    void do_sendfile();
+    void on_sendfile_wait(beast::error_code ec);
+    void on_sendfile_timeout(beast::error_code ec);
+#endif
+
+    // 流水线：已生成、等待写出的响应，按请求顺序排列
+    class PendingResponse
+    {
+    public:
+      virtual ~PendingResponse() = default;
+
+      // 把接下来要写出的缓冲区追加到 buffers；返回 true 表示已经取出了剩余的全部数据
+      virtual bool prepare(std::vector<net::const_buffer>& buffers, beast::error_code& ec) = 0;
+      // 上一次 prepare 取出的数据已经写出
+      virtual void consume() = 0;
+      virtual bool is_done() = 0;
+      virtual bool keep_alive() const = 0;
+
+      // 静态文件的 span_body 引用缓存中的内容，随响应一起持有
+      std::shared_ptr<const StaticFile> static_file;
+    };
+
+    template <class Body>
+    class PendingResponseImpl;
+
+    std::deque<std::unique_ptr<PendingResponse>> pending_responses_;
+    std::vector<net::const_buffer> write_buffers_;
+    // 分块、sendfile 与 WebSocket 升级需要独占连接，等前面的响应写完再开始
+    std::function<void()> deferred_write_;
+    beast::error_code pipeline_error_;
 
     void send_chunked_response();
-    void send_response(http::message_generator msg);
+    template <class Body>
+    void send_response(http::response<Body>&& res);
+    void queue_response(std::unique_ptr<PendingResponse> response);
+    void after_pending_writes(std::function<void()> start);
+    void flush_pending_responses();
+    void on_write_pending(beast::error_code ec, std::size_t bytes_transferred);
     void on_write_header(beast::error_code ec, std::size_t bytes_transferred);
     void on_write(bool keep_alive, beast::error_code ec, std::size_t bytes_transferred);
 
-    void do_write_final_chunk();
-    void on_shutdown(bool keep_alive, beast::error_code ec, std::size_t);
+    // 流式请求体：BodyReader 的读取都在会话的 executor 上进行
+    class AsyncBodyReader;
+
+    void read_body_chunk(BodyReader::ReadCallback on_chunk);
+    void on_read_body_chunk(const BodyReader::ReadCallback& on_chunk, beast::error_code ec,
+                            std::size_t bytes_transferred);
+    void finish_body_read();
+
+    // 延迟响应：ResponseHandle 完成时在会话的 executor 上调用，error 不为空时交给异常处理器
+    class AsyncResponseHandle;
+
+    void finish_deferred(const std::exception_ptr& error);
+    // 发送 ctx 中设置好的响应；流式请求体没有读完时，发送后关闭连接
+    void send_context_response();
+    void end_streamed_body();
+
+    // 分块响应：所有数据块都经由 chunk_queue_ 在会话的 executor 上依次异步写出
+    class AsyncChunkWriter;
+
+    struct PendingChunk
+    {
+      std::string data;
+      ChunkWriter::WriteCallback on_written;
+      bool last = false;
+    };
+
+    std::deque<PendingChunk> chunk_queue_;
+    bool chunk_writing_ = false;
+    bool chunk_closed_ = false; // 已排入结束块或写出失败，不再接受新数据
+    std::uint64_t chunk_generation_ = 0; // 每个分块响应递增，AsyncChunkWriter 据此识别过期的调用
+    HttpContext::ChunkGenerator chunk_generator_;
+
+    void enqueue_chunk(std::string data, ChunkWriter::WriteCallback on_written, bool last);
+    // 拒绝不再被接受的数据块，回调以 operation_aborted 完成
+    void reject_chunk(ChunkWriter::WriteCallback on_written);
+    void do_write_chunk();
+    void on_write_chunk(beast::error_code ec, std::size_t bytes_transferred);
+    void do_pull_chunk();
+    void abort_stream(const char* what);
     void do_close();
+    void on_shutdown(beast::error_code ec);
 
     void handle_websocket_upgrade();
-    // 辅助函数：根据文件扩展名获取 MIME 类型
-    static std::string mime_type_from_extension(const std::string& ext);
+
+    // 连接交给 Http2Session，received 为已经读到、尚未处理的数据
+    void start_http2(std::string_view received);
+    // 带 "Upgrade: h2c" 的请求：写出 101 之后以 HTTP/2 继续，这个请求作为流 1 处理
+    bool is_h2c_upgrade() const;
+    void upgrade_to_http2();
   };
 }
 #endif // KHTTPD_HTTP_SESSION_HPP
@@ -0,0 +1,127 @@
+// framework/session/http_session_options.hpp
+#ifndef KHTTPD_FRAMEWORK_SESSION_HTTP_SESSION_OPTIONS_HPP
+#define KHTTPD_FRAMEWORK_SESSION_HTTP_SESSION_OPTIONS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "context/multipart_parser.hpp"
+#include "websocket/websocket_deflate.hpp"
+
+namespace khttpd::framework
+{
+  // HttpSession 的超时配置，值为 0 表示不限制
+  struct HttpSessionTimeouts
+  {
+    // keep-alive 连接上，上一个响应写完后等待下一个请求首字节的时间
+    std::chrono::milliseconds keep_alive_idle{std::chrono::seconds(60)};
+    // 读取完整请求头的时间（新连接从 accept 开始计时，TLS 连接包括握手）
+    std::chrono::milliseconds header_read{std::chrono::seconds(30)};
+    // 读取请求体的时间；BodyMode::stream 的请求体每读一块重新计时
+    std::chrono::milliseconds body_read{std::chrono::seconds(120)};
+    // 写出一个完整响应的时间，提供大文件下载时需要相应调大；分块响应的每个块各自重新计时
+    std::chrono::milliseconds write{std::chrono::seconds(120)};
+  };
+
+  // HTTP/2 连接的参数；TLS 连接是否使用 HTTP/2 由 TlsOptions::alpn_protocols 决定
+  struct Http2Options
+  {
+    // 明文连接接受 h2c：以连接前言开头的连接（prior knowledge），以及带 "Upgrade: h2c" 的 HTTP/1.1 请求
+    bool h2c = true;
+    // SETTINGS_MAX_CONCURRENT_STREAMS，超出的流由对端拒绝（REFUSED_STREAM）
+    std::uint32_t max_concurrent_streams = 100;
+    // 每个流的接收窗口。BodyMode::stream 路由的请求体在 handler 读取之后才归还窗口，
+    // 因此 handler 读得慢时客户端会按这个大小暂停发送
+    std::uint32_t initial_window_size = 256 * 1024;
+    // 整个连接的接收窗口，由所有流共享
+    std::uint32_t connection_window_size = 4 * 1024 * 1024;
+    // SETTINGS_MAX_HEADER_LIST_SIZE，解压后请求头的上限
+    std::uint32_t max_header_list_size = 64 * 1024;
+  };
+
+  // 服务端 WebSocket 会话的写队列超过高水位后如何处理新消息
+  enum class SlowConsumerPolicy
+  {
+    // 丢弃新消息，直到队列降到低水位以下
+    drop,
+    // 发送方线程等待队列降到低水位以下，最多 block_timeout，超时后丢弃；
+    // 在运行会话所属 io_context 的线程上发送时不能等待，消息照常入队：IoMode::shared 下是所有 io 线程，
+    // IoMode::per_core 下是会话所在核的线程（包括同一核上其他会话的 handler）
+    block,
+    // 断开连接，on_error 收到 boost::asio::error::no_buffer_space
+    disconnect,
+  };
+
+  // WebSocket 会话输出到 stdout/stderr 的日志级别：error 只输出错误，info 另外输出握手与关闭，
+  // trace 另外为每条收到的消息输出一行（类型与大小，不含内容）
+  enum class WebsocketLogLevel
+  {
+    error,
+    info,
+    trace
+  };
+
+  struct WebsocketOptions
+  {
+    // 单条消息的大小上限
+    std::size_t read_message_max = 32 * 1024 * 1024;
+    // 每个会话写队列（已提交但还没写出的消息）的高水位与低水位，单位为字节
+    std::size_t write_queue_high_watermark = 16 * 1024 * 1024;
+    std::size_t write_queue_low_watermark = 4 * 1024 * 1024;
+    SlowConsumerPolicy slow_consumer = SlowConsumerPolicy::disconnect;
+    std::chrono::milliseconds block_timeout{std::chrono::seconds(5)};
+    // permessage-deflate，默认关闭
+    WebsocketDeflateOptions deflate;
+    WebsocketLogLevel log_level = WebsocketLogLevel::info;
+  };
+
+  struct HttpSessionOptions
+  {
+    HttpSessionTimeouts timeouts;
+    // HTTP/1.1 流水线：读缓冲中已有的后续请求会被立即解析和处理，生成但还没写出的响应最多这么多个，
+    // 之后合并为一次写操作按顺序发送。设为 1 时每个响应写完才处理下一个请求
+    std::size_t max_pipelined_requests = 16;
+    // 每个连接预先分配的请求级内存池大小。HttpContext 本身及其解析缓存（查询/路径参数、表单、Cookie、
+    // 属性等）从中分配，每个请求开始时整体重置；超出部分向堆申请，同样在重置时释放。设为 0 时直接使用堆
+    std::size_t request_arena_size = 8 * 1024;
+    // 请求体的上限，超过时返回 413 并关闭连接；可以由 RouteOptions::body_limit 按路由覆盖，
+    // multipart/form-data 请求使用 multipart.max_total_size
+    std::uint64_t body_limit = 1024 * 1024;
+    // BodyMode::stream 路由每次交给 handler 的最大数据量
+    std::size_t body_chunk_size = 16 * 1024;
+    // multipart/form-data 上传的流式解析、大小限制与临时文件
+    MultipartOptions multipart;
+    Http2Options http2;
+    WebsocketOptions websocket;
+  };
+
+  // 会话因超时被关闭的次数等统计，由 Server 持有，所有 HttpSession 共享
+  struct HttpSessionStats
+  {
+    std::atomic<uint64_t> idle_timeouts{0};
+    std::atomic<uint64_t> header_timeouts{0};
+    std::atomic<uint64_t> body_timeouts{0};
+    std::atomic<uint64_t> write_timeouts{0};
+    // 直接从读缓冲中解析、没有等待前一个响应写完的请求数
+    std::atomic<uint64_t> pipelined_requests{0};
+    // 一次写操作发送了多个响应的次数
+    std::atomic<uint64_t> gathered_writes{0};
+    // 完成的 TLS 握手数，其中通过会话缓存或会话票据恢复的次数，以及失败的握手数
+    std::atomic<uint64_t> tls_handshakes{0};
+    std::atomic<uint64_t> tls_resumed_handshakes{0};
+    std::atomic<uint64_t> tls_handshake_failures{0};
+    // 使用 HTTP/2 的连接数（ALPN、h2c 升级与 prior knowledge），以及在这些连接上处理的请求数
+    std::atomic<uint64_t> http2_connections{0};
+    std::atomic<uint64_t> http2_streams{0};
+    // 所有 WebSocket 会话写队列中的字节数与消息数（当前值），写队列超过高水位的次数，
+    // 以及因此丢弃的消息数与断开的连接数
+    std::atomic<uint64_t> websocket_queued_bytes{0};
+    std::atomic<uint64_t> websocket_queued_messages{0};
+    std::atomic<uint64_t> websocket_backpressure_events{0};
+    std::atomic<uint64_t> websocket_dropped_messages{0};
+    std::atomic<uint64_t> websocket_slow_consumer_disconnects{0};
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_SESSION_HTTP_SESSION_OPTIONS_HPP
@@ -0,0 +1,132 @@
+// framework/static_file/byte_range.cpp
+#include "byte_range.hpp"
+#include "header_value.hpp"
+
+#include <fmt/core.h>
+#include <algorithm>
+#include <charconv>
+#include <optional>
+
+namespace khttpd::framework
+{
+  namespace
+  {
+    std::optional<std::uint64_t> parse_position(std::string_view digits)
+    {
+      if (digits.empty())
+      {
+        return std::nullopt;
+      }
+      std::uint64_t value = 0;
+      const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+      if (error != std::errc() || end != digits.data() + digits.size())
+      {
+        return std::nullopt;
+      }
+      return value;
+    }
+  }
+
+  RangeRequest parse_range_header(std::string_view value, std::uint64_t size, std::size_t max_ranges)
+  {
+    RangeRequest result;
+
+    value = trim(value);
+    const auto equals = value.find('=');
+    if (equals == std::string_view::npos || !iequals(trim(value.substr(0, equals)), "bytes"))
+    {
+      return result;
+    }
+    value.remove_prefix(equals + 1);
+
+    std::vector<ByteRange> ranges;
+    std::size_t specs = 0;
+    while (true)
+    {
+      const auto comma = value.find(',');
+      const std::string_view spec = trim(value.substr(0, comma));
+
+      // 列表中允许出现空元素
+      if (!spec.empty())
+      {
+        if (++specs > max_ranges)
+        {
+          return result;
+        }
+
+        const auto dash = spec.find('-');
+        if (dash == std::string_view::npos)
+        {
+          return result;
+        }
+        const auto first = parse_position(spec.substr(0, dash));
+        const auto last = parse_position(spec.substr(dash + 1));
+
+        if (first)
+        {
+          // first-last 或 first-
+          if (last && *last < *first)
+          {
+            return result;
+          }
+          if (*first < size)
+          {
+            ranges.push_back({*first, last ? std::min(*last, size - 1) : size - 1});
+          }
+        }
+        else if (last)
+        {
+          // -suffix_length
+          if (*last > 0 && size > 0)
+          {
+            ranges.push_back({size - std::min(*last, size), size - 1});
+          }
+        }
+        else
+        {
+          return result;
+        }
+      }
+
+      if (comma == std::string_view::npos)
+      {
+        break;
+      }
+      value.remove_prefix(comma + 1);
+    }
+
+    if (specs == 0)
+    {
+      return result;
+    }
+    if (ranges.empty())
+    {
+      result.status = RangeRequest::Status::unsatisfiable;
+      return result;
+    }
+
+    // 合并重叠或相邻的范围，避免同一段内容被重复请求
+    std::sort(ranges.begin(), ranges.end(), [](const ByteRange& a, const ByteRange& b)
+    {
+      return a.first < b.first;
+    });
+    for (const auto& range : ranges)
+    {
+      if (!result.ranges.empty() && range.first <= result.ranges.back().last + 1)
+      {
+        result.ranges.back().last = std::max(result.ranges.back().last, range.last);
+      }
+      else
+      {
+        result.ranges.push_back(range);
+      }
+    }
+    result.status = RangeRequest::Status::satisfiable;
+    return result;
+  }
+
+  std::string format_content_range(const ByteRange& range, std::uint64_t size)
+  {
+    return fmt::format("bytes {}-{}/{}", range.first, range.last, size);
+  }
+}
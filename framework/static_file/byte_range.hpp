@@ -0,0 +1,52 @@
+// framework/static_file/byte_range.hpp
+#ifndef KHTTPD_FRAMEWORK_STATIC_FILE_BYTE_RANGE_HPP
+#define KHTTPD_FRAMEWORK_STATIC_FILE_BYTE_RANGE_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace khttpd::framework
+{
+  // 闭区间 [first, last]
+  struct ByteRange
+  {
+    std::uint64_t first = 0;
+    std::uint64_t last = 0;
+
+    std::uint64_t length() const
+    {
+      return last - first + 1;
+    }
+
+    bool operator==(const ByteRange& other) const
+    {
+      return first == other.first && last == other.last;
+    }
+  };
+
+  struct RangeRequest
+  {
+    enum class Status
+    {
+      // 没有 Range 头、单位不是 bytes、语法错误或范围过多：忽略 Range，返回完整内容
+      ignored,
+      // 所有范围都落在文件之外：返回 416
+      unsatisfiable,
+      satisfiable,
+    };
+
+    Status status = Status::ignored;
+    // 按起始位置排序，重叠或相邻的范围已经合并
+    std::vector<ByteRange> ranges;
+  };
+
+  // 按 RFC 9110 14.2 解析 Range 头，max_ranges 限制请求中 range-spec 的个数，超过时忽略整个 Range
+  RangeRequest parse_range_header(std::string_view value, std::uint64_t size, std::size_t max_ranges);
+
+  // "bytes first-last/size"
+  std::string format_content_range(const ByteRange& range, std::uint64_t size);
+}
+
+#endif // KHTTPD_FRAMEWORK_STATIC_FILE_BYTE_RANGE_HPP
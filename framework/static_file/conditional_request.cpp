@@ -0,0 +1,112 @@
+// framework/static_file/conditional_request.cpp
+#include "conditional_request.hpp"
+#include "header_value.hpp"
+#include "static_file_cache.hpp"
+
+namespace khttpd::framework
+{
+  namespace
+  {
+    std::string_view strip_weak_prefix(std::string_view etag)
+    {
+      if (etag.size() >= 2 && etag[0] == 'W' && etag[1] == '/')
+      {
+        etag.remove_prefix(2);
+      }
+      return etag;
+    }
+  }
+
+  std::string format_http_date(std::time_t time)
+  {
+    std::tm tm{};
+    gmtime_r(&time, &tm);
+    char buffer[64];
+    const std::size_t length = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buffer, length);
+  }
+
+  std::optional<std::time_t> parse_http_date(std::string_view value)
+  {
+    const std::string text(trim(value));
+    // IMF-fixdate, RFC 850, asctime
+    static const char* const formats[] = {
+      "%a, %d %b %Y %H:%M:%S GMT",
+      "%A, %d-%b-%y %H:%M:%S GMT",
+      "%a %b %e %H:%M:%S %Y",
+    };
+
+    for (const char* format : formats)
+    {
+      std::tm tm{};
+      const char* end = strptime(text.c_str(), format, &tm);
+      if (end != nullptr && *end == '\0')
+      {
+        return timegm(&tm);
+      }
+    }
+    return std::nullopt;
+  }
+
+  bool etag_list_matches(std::string_view if_none_match, std::string_view etag)
+  {
+    if (etag.empty())
+    {
+      return false;
+    }
+    const std::string_view opaque = strip_weak_prefix(etag);
+
+    while (!if_none_match.empty())
+    {
+      const auto comma = if_none_match.find(',');
+      const std::string_view candidate = trim(if_none_match.substr(0, comma));
+      if (candidate == "*" || (!candidate.empty() && strip_weak_prefix(candidate) == opaque))
+      {
+        return true;
+      }
+      if (comma == std::string_view::npos)
+      {
+        break;
+      }
+      if_none_match.remove_prefix(comma + 1);
+    }
+    return false;
+  }
+
+  bool is_not_modified(const StaticFile& file, std::string_view if_none_match, std::string_view if_modified_since)
+  {
+    if (!trim(if_none_match).empty())
+    {
+      return etag_list_matches(if_none_match, file.etag);
+    }
+
+    if (!if_modified_since.empty() && !file.last_modified.empty())
+    {
+      const auto since = parse_http_date(if_modified_since);
+      return since && file.last_write_time <= *since;
+    }
+    return false;
+  }
+
+  bool if_range_matches(const StaticFile& file, std::string_view if_range)
+  {
+    if_range = trim(if_range);
+    if (if_range.empty())
+    {
+      return true;
+    }
+
+    if (if_range.front() == '"' || (if_range.size() > 2 && if_range[0] == 'W' && if_range[1] == '/'))
+    {
+      // 弱 etag 不能用于 If-Range
+      return if_range.front() == '"' && !file.etag.empty() && file.etag.front() == '"' && if_range == file.etag;
+    }
+
+    if (file.last_modified.empty())
+    {
+      return false;
+    }
+    const auto date = parse_http_date(if_range);
+    return date && *date == file.last_write_time;
+  }
+}
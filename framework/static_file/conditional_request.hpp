@@ -0,0 +1,32 @@
+// framework/static_file/conditional_request.hpp
+#ifndef KHTTPD_FRAMEWORK_STATIC_FILE_CONDITIONAL_REQUEST_HPP
+#define KHTTPD_FRAMEWORK_STATIC_FILE_CONDITIONAL_REQUEST_HPP
+
+#include <ctime>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace khttpd::framework
+{
+  struct StaticFile;
+
+  // 格式化为 IMF-fixdate，例如 "Sun, 06 Nov 1994 08:49:37 GMT"
+  std::string format_http_date(std::time_t time);
+
+  // 解析 IMF-fixdate 以及已废弃的 RFC 850 和 asctime 格式，无法解析时返回 std::nullopt
+  std::optional<std::time_t> parse_http_date(std::string_view value);
+
+  // If-None-Match 列表中是否有与 etag 匹配的项，使用弱比较（RFC 9110 13.1.2），"*" 匹配任意 etag
+  bool etag_list_matches(std::string_view if_none_match, std::string_view etag);
+
+  // 按 RFC 9110 13.2.2 的顺序判断 GET/HEAD 请求是否可以返回 304：
+  // 有 If-None-Match 时只看它，否则比较 If-Modified-Since 与文件的修改时间
+  bool is_not_modified(const StaticFile& file, std::string_view if_none_match, std::string_view if_modified_since);
+
+  // If-Range 是否仍然指向当前的文件（RFC 9110 13.1.5）：etag 使用强比较，日期必须与 Last-Modified 完全一致。
+  // 没有 If-Range 时返回 true；不匹配时应忽略 Range 返回完整内容
+  bool if_range_matches(const StaticFile& file, std::string_view if_range);
+}
+
+#endif // KHTTPD_FRAMEWORK_STATIC_FILE_CONDITIONAL_REQUEST_HPP
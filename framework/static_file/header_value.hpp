@@ -0,0 +1,33 @@
+// framework/static_file/header_value.hpp
+#ifndef KHTTPD_FRAMEWORK_STATIC_FILE_HEADER_VALUE_HPP
+#define KHTTPD_FRAMEWORK_STATIC_FILE_HEADER_VALUE_HPP
+
+#include <algorithm>
+#include <string_view>
+
+namespace khttpd::framework
+{
+  // 去掉首尾的空格与制表符（RFC 9110 的 OWS）
+  inline std::string_view trim(std::string_view value)
+  {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+    {
+      value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+    {
+      value.remove_suffix(1);
+    }
+    return value;
+  }
+
+  // 只按 ASCII 忽略大小写比较，与 locale 无关
+  inline bool iequals(std::string_view a, std::string_view b)
+  {
+    const auto lower = [](char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; };
+    return a.size() == b.size() &&
+      std::equal(a.begin(), a.end(), b.begin(), [&](char x, char y) { return lower(x) == lower(y); });
+  }
+}
+
+#endif // KHTTPD_FRAMEWORK_STATIC_FILE_HEADER_VALUE_HPP
@@ -0,0 +1,177 @@
+// framework/static_file/static_file_body.hpp
+#ifndef KHTTPD_FRAMEWORK_STATIC_FILE_STATIC_FILE_BODY_HPP
+#define KHTTPD_FRAMEWORK_STATIC_FILE_STATIC_FILE_BODY_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/file.hpp>
+#include <boost/beast/http/error.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include "static_file/static_file_cache.hpp"
+
+namespace khttpd::framework
+{
+  // 发送 StaticFile 中若干段内容的 Beast Body，每段前面可以带一段固定文本（multipart 的分段头），
+  // 用于 Range 响应。内存中的文件直接引用缓存的内容，其余文件按偏移量读取，不会读入整个文件
+  struct StaticFileBody
+  {
+    struct Part
+    {
+      std::string header;
+      std::uint64_t offset = 0;
+      std::uint64_t length = 0;
+    };
+
+    class value_type
+    {
+    public:
+      std::shared_ptr<const StaticFile> file;
+      std::vector<Part> parts;
+      std::string trailer;
+
+      // 既不在内存中也没有打开的描述符时，按路径打开文件
+      void open(boost::beast::error_code& ec)
+      {
+        ec = {};
+        if (file->in_memory || file->fd >= 0)
+        {
+          return;
+        }
+        file_.open(file->path.c_str(), boost::beast::file_mode::read, ec);
+      }
+
+    private:
+      friend struct StaticFileBody;
+      boost::beast::file file_;
+    };
+
+    static std::uint64_t size(const value_type& body)
+    {
+      std::uint64_t total = body.trailer.size();
+      for (const auto& part : body.parts)
+      {
+        total += part.header.size() + part.length;
+      }
+      return total;
+    }
+
+    class writer
+    {
+    public:
+      using const_buffers_type = boost::asio::const_buffer;
+
+      template <bool isRequest, class Fields>
+      writer(const boost::beast::http::header<isRequest, Fields>&, value_type& body)
+        : body_(body)
+      {
+      }
+
+      void init(boost::beast::error_code& ec)
+      {
+        ec = {};
+      }
+
+      boost::optional<std::pair<const_buffers_type, bool>> get(boost::beast::error_code& ec)
+      {
+        ec = {};
+        while (part_ < body_.parts.size())
+        {
+          const Part& part = body_.parts[part_];
+          if (!header_sent_)
+          {
+            header_sent_ = true;
+            if (!part.header.empty())
+            {
+              return std::make_pair(const_buffers_type(part.header.data(), part.header.size()), true);
+            }
+          }
+
+          if (position_ == part.length)
+          {
+            ++part_;
+            position_ = 0;
+            header_sent_ = false;
+            continue;
+          }
+
+          const StaticFile& file = *body_.file;
+          const std::uint64_t remaining = part.length - position_;
+          if (file.in_memory)
+          {
+            const char* data = file.content.data() + part.offset + position_;
+            position_ = part.length;
+            return std::make_pair(const_buffers_type(data, static_cast<std::size_t>(remaining)), true);
+          }
+
+          const std::size_t amount = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, buffer_.size()));
+          std::size_t bytes = 0;
+#if defined(__unix__) || defined(__APPLE__)
+          if (file.fd >= 0)
+          {
+            // pread 不改变文件位置，可以与其他会话共享描述符
+            const ssize_t n = ::pread(file.fd, buffer_.data(), amount,
+                                      static_cast<off_t>(part.offset + position_));
+            if (n < 0)
+            {
+              ec.assign(errno, boost::system::system_category());
+              return boost::none;
+            }
+            bytes = static_cast<std::size_t>(n);
+          }
+          else
+#endif
+          {
+            body_.file_.seek(part.offset + position_, ec);
+            if (ec)
+            {
+              return boost::none;
+            }
+            bytes = body_.file_.read(buffer_.data(), amount, ec);
+            if (ec)
+            {
+              return boost::none;
+            }
+          }
+
+          if (bytes == 0)
+          {
+            // 文件在发送过程中被截断
+            ec = boost::beast::http::error::short_read;
+            return boost::none;
+          }
+          position_ += bytes;
+          return std::make_pair(const_buffers_type(buffer_.data(), bytes), true);
+        }
+
+        if (!trailer_sent_ && !body_.trailer.empty())
+        {
+          trailer_sent_ = true;
+          return std::make_pair(const_buffers_type(body_.trailer.data(), body_.trailer.size()), false);
+        }
+        return boost::none;
+      }
+
+    private:
+      value_type& body_;
+      std::size_t part_ = 0;
+      std::uint64_t position_ = 0;
+      bool header_sent_ = false;
+      bool trailer_sent_ = false;
+      std::array<char, 16 * 1024> buffer_{};
+    };
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_STATIC_FILE_STATIC_FILE_BODY_HPP
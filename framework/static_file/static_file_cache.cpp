@@ -0,0 +1,787 @@
+// framework/static_file/static_file_cache.cpp
+#include "static_file_cache.hpp"
+#include "conditional_request.hpp"
+#include "compression/compression.hpp"
+
+#include <boost/core/ignore_unused.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <fmt/core.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/post.hpp>
+#include <array>
+#include <sys/inotify.h>
+#endif
+
+namespace khttpd::framework
+{
+  namespace net = boost::asio;
+  namespace fs = boost::filesystem;
+
+  namespace
+  {
+    // FNV-1a，只用于生成 ETag
+    std::uint64_t hash_content(std::string_view data)
+    {
+      std::uint64_t hash = 14695981039346656037ull;
+      for (const unsigned char c : data)
+      {
+        hash ^= c;
+        hash *= 1099511628211ull;
+      }
+      return hash;
+    }
+
+    // 条目占用的内存，包括预压缩变体的内容
+    std::size_t memory_bytes(const StaticFile& file)
+    {
+      std::size_t bytes = file.content.size();
+      for (const auto& variant : file.encoded_variants)
+      {
+        bytes += variant->content.size();
+      }
+      return bytes;
+    }
+
+    long mtime_nanoseconds(const struct stat& st)
+    {
+#if defined(__APPLE__)
+      return st.st_mtimespec.tv_nsec;
+#else
+      return st.st_mtim.tv_nsec;
+#endif
+    }
+
+    // 生成验证器与缓存相关的响应头；内存中的文件应在读入内容之后再调用
+    void describe(StaticFile& file, const StaticFileOptions& options, std::string_view request_path,
+                  const std::string& extension, const struct stat& st)
+    {
+      file.size = static_cast<std::uint64_t>(st.st_size);
+      file.last_write_time = st.st_mtime;
+
+      switch (options.etag)
+      {
+      case ETagMode::none:
+        break;
+      case ETagMode::weak:
+        file.etag = fmt::format("W/\"{:x}-{:x}\"", file.size, static_cast<std::int64_t>(st.st_mtime));
+        break;
+      case ETagMode::strong:
+        if (file.in_memory)
+        {
+          file.etag = fmt::format("\"{:x}-{:016x}\"", file.size, hash_content(file.content));
+        }
+        else
+        {
+          file.etag = fmt::format("\"{:x}-{:x}-{:x}.{:x}\"", static_cast<std::uint64_t>(st.st_ino), file.size,
+                                  static_cast<std::int64_t>(st.st_mtime), mtime_nanoseconds(st));
+        }
+        break;
+      }
+
+      if (options.last_modified)
+      {
+        file.last_modified = format_http_date(st.st_mtime);
+      }
+
+      if (const auto* value = StaticFileCache::match_cache_control(options.cache_control_rules, request_path,
+                                                                   extension))
+      {
+        file.cache_control = *value;
+      }
+      else
+      {
+        file.cache_control = options.default_cache_control;
+      }
+    }
+  }
+
+  StaticFile::~StaticFile()
+  {
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+  }
+
+#if defined(__linux__)
+  // 监听已缓存文件所在的目录（直到 web 根目录）。监听目录而不是文件本身，
+  // 这样原子替换（写临时文件再 rename）和删除后重建也能收到事件
+  class StaticFileCache::Watcher : public std::enable_shared_from_this<Watcher>
+  {
+  public:
+    Watcher(StaticFileCache& cache, const net::any_io_executor& executor, int fd)
+      : cache_(&cache), fd_(fd), stream_(executor, fd)
+    {
+    }
+
+    void start()
+    {
+      do_read();
+    }
+
+    void stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_ = nullptr;
+      }
+      // 描述符只在它所属的 executor 上关闭；io_context 已经停止时由析构函数关闭
+      net::post(stream_.get_executor(), [self = shared_from_this()]()
+      {
+        boost::system::error_code ec;
+        self->stream_.close(ec);
+      });
+    }
+
+    void watch(const fs::path& directory, const fs::path& root)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (fs::path dir = directory; !dir.empty(); dir = dir.parent_path())
+      {
+        if (directories_.find(dir.string()) == directories_.end())
+        {
+          const int wd = ::inotify_add_watch(fd_, dir.c_str(), watch_mask);
+          if (wd < 0)
+          {
+            fmt::print(stderr, "StaticFileCache inotify_add_watch '{}' error: {}\n", dir.string(),
+                       std::strerror(errno));
+            return;
+          }
+          directories_[dir.string()] = wd;
+          watches_[wd] = dir.string();
+        }
+        if (dir == root || dir.string().size() <= root.string().size())
+        {
+          break;
+        }
+      }
+    }
+
+  private:
+    static constexpr uint32_t watch_mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+      IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+    StaticFileCache* cache_;
+    const int fd_;
+    net::posix::stream_descriptor stream_;
+    alignas(inotify_event) std::array<char, 16 * 1024> buffer_{};
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, int> directories_;
+    std::unordered_map<int, std::string> watches_;
+
+    void do_read()
+    {
+      stream_.async_read_some(net::buffer(buffer_),
+                              [self = shared_from_this()](const boost::system::error_code& ec, std::size_t bytes)
+                              {
+                                self->on_read(ec, bytes);
+                              });
+    }
+
+    void on_read(const boost::system::error_code& ec, std::size_t bytes)
+    {
+      if (ec)
+      {
+        if (ec != net::error::operation_aborted)
+        {
+          fmt::print(stderr, "StaticFileCache inotify read error: {}\n", ec.message());
+        }
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!cache_)
+      {
+        return;
+      }
+
+      std::size_t offset = 0;
+      while (offset + sizeof(inotify_event) <= bytes)
+      {
+        inotify_event event{};
+        std::memcpy(&event, buffer_.data() + offset, sizeof(inotify_event));
+        const char* name = buffer_.data() + offset + sizeof(inotify_event);
+        const std::string_view event_name(name, ::strnlen(name, event.len));
+        offset += sizeof(inotify_event) + event.len;
+        handle_event(event, event_name);
+      }
+
+      do_read();
+    }
+
+    void handle_event(const inotify_event& event, std::string_view name)
+    {
+      if (event.mask & IN_Q_OVERFLOW)
+      {
+        // 丢失了事件，无法知道哪些文件变了
+        cache_->clear();
+        return;
+      }
+
+      const auto it = watches_.find(event.wd);
+      if (it == watches_.end())
+      {
+        return;
+      }
+      const std::string directory = it->second;
+
+      if (!name.empty())
+      {
+        cache_->invalidate(directory + "/" + std::string(name));
+      }
+
+      if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED | IN_UNMOUNT))
+      {
+        cache_->invalidate(directory);
+        // 目录被移走后 watch 仍然有效但路径已经不对，移除它，下次缓存时会重新添加
+        if (!(event.mask & IN_IGNORED))
+        {
+          ::inotify_rm_watch(fd_, event.wd);
+        }
+        directories_.erase(directory);
+        watches_.erase(it);
+      }
+    }
+  };
+#else
+  class StaticFileCache::Watcher
+  {
+  public:
+    void stop()
+    {
+    }
+
+    void watch(const fs::path&, const fs::path&)
+    {
+    }
+  };
+#endif
+
+  StaticFileCache::StaticFileCache(const std::string& web_root, StaticFileOptions options)
+    : options_(options),
+      web_root_path_(web_root)
+  {
+    boost::system::error_code ec;
+    // 只在构造时规范化一次 web 根目录
+    canonical_web_root_path_ = fs::canonical(web_root_path_, ec);
+    if (ec)
+    {
+      fmt::print(stderr, "Error canonicalizing web root '{}': {}\n", web_root_path_.string(), ec.message());
+      // web 根目录本身无效时不提供静态文件
+      canonical_web_root_path_.clear();
+    }
+  }
+
+  StaticFileCache::~StaticFileCache()
+  {
+    stop_watching();
+  }
+
+  void StaticFileCache::start_watching(const net::any_io_executor& executor)
+  {
+#if defined(__linux__)
+    if (!options_.cache_enabled || !options_.watch_changes || canonical_web_root_path_.empty())
+    {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (watcher_)
+    {
+      return;
+    }
+
+    const int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+      fmt::print(stderr, "StaticFileCache inotify_init1 error: {}, falling back to stat checks.\n",
+                 std::strerror(errno));
+      return;
+    }
+
+    // 监听开始之前缓存的条目可能已经过期
+    for (auto it = lru_.begin(); it != lru_.end();)
+    {
+      erase(it++);
+    }
+
+    watcher_ = std::make_shared<Watcher>(*this, executor, fd);
+    watcher_->start();
+    watching_ = true;
+#else
+    boost::ignore_unused(executor);
+#endif
+  }
+
+  void StaticFileCache::stop_watching()
+  {
+    std::shared_ptr<Watcher> watcher;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      watcher = std::move(watcher_);
+      watching_ = false;
+    }
+    if (watcher)
+    {
+      watcher->stop();
+    }
+  }
+
+  bool StaticFileCache::watching() const
+  {
+    return watching_;
+  }
+
+  StaticFileLookup StaticFileCache::lookup(std::string_view request_path)
+  {
+    if (!options_.cache_enabled)
+    {
+      return resolve(request_path);
+    }
+
+    std::string key(request_path);
+    std::shared_ptr<const StaticFile> cached;
+    uint64_t epoch;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto it = index_.find(key);
+      if (it != index_.end())
+      {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        cached = it->second->file;
+      }
+      epoch = invalidation_epoch_;
+    }
+
+    if (cached && (watching_ || still_valid(*cached)))
+    {
+      ++stats_.hits;
+      StaticFileLookup result;
+      result.status = StaticFileLookup::Status::found;
+      result.file = std::move(cached);
+      return result;
+    }
+
+    ++stats_.misses;
+    StaticFileLookup result = resolve(request_path);
+    if (result.status == StaticFileLookup::Status::found)
+    {
+      insert(key, result.file, epoch);
+    }
+    else if (cached)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto it = index_.find(key);
+      if (it != index_.end() && it->second->file == cached)
+      {
+        erase(it->second);
+      }
+    }
+    return result;
+  }
+
+  StaticFileLookup StaticFileCache::resolve(std::string_view request_path)
+  {
+    StaticFileLookup result;
+    if (canonical_web_root_path_.empty())
+    {
+      return result;
+    }
+
+    fs::path path{std::string(request_path)};
+    // 如果请求的是根路径，尝试提供 index.html
+    if (path == "/")
+    {
+      path = "/index.html";
+    }
+
+    boost::system::error_code ec;
+    // 1. 规范化路径以防止目录遍历攻击 (e.g., /../)
+    fs::path full_local_path = fs::canonical(web_root_path_ / path.relative_path(), ec);
+    if (ec)
+    {
+      if (ec != boost::system::errc::no_such_file_or_directory)
+      {
+        result.status = StaticFileLookup::Status::invalid_path;
+        result.error = ec.message();
+      }
+      return result;
+    }
+
+    // 2. 安全检查：确保规范化后的路径仍在 Web 根目录内（"/www2" 不算在 "/www" 内）
+    const std::string& full_path_str = full_local_path.string();
+    const std::string& root_path_str = canonical_web_root_path_.string();
+    if (full_path_str.compare(0, root_path_str.size(), root_path_str) != 0 ||
+      (full_path_str.size() > root_path_str.size() && root_path_str.back() != '/' &&
+        full_path_str[root_path_str.size()] != '/'))
+    {
+      result.status = StaticFileLookup::Status::path_traversal;
+      return result;
+    }
+
+    // 3. 目录尝试提供 index.html，不允许目录列表
+    if (fs::is_directory(full_local_path, ec))
+    {
+      const fs::path index_file_path = full_local_path / "index.html";
+      if (!fs::is_regular_file(index_file_path, ec))
+      {
+        result.status = StaticFileLookup::Status::directory_without_index;
+        return result;
+      }
+      full_local_path = index_file_path;
+    }
+
+    auto file = std::make_shared<StaticFile>();
+    file->path = full_local_path.string();
+    std::string extension = full_local_path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    file->content_type = mime_type_from_extension(extension);
+
+    if (options_.cache_enabled)
+    {
+      // 先监听目录再读取内容，读取期间的修改会使这次的结果不被缓存
+      std::shared_ptr<Watcher> watcher;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        watcher = watcher_;
+      }
+      if (watcher)
+      {
+        watcher->watch(full_local_path.parent_path(), canonical_web_root_path_);
+      }
+    }
+
+    result.status = load(*file, request_path, extension, result.error, true);
+    if (result.status != StaticFileLookup::Status::found)
+    {
+      return result;
+    }
+
+    // 5. 预压缩的兄弟文件，与原始文件在同一目录，已经被监听
+    for (const auto& coding : options_.precompressed)
+    {
+      const std::string_view suffix = precompressed_extension(coding);
+      if (suffix.empty())
+      {
+        continue;
+      }
+      auto variant = std::make_shared<StaticFile>();
+      variant->path = file->path + std::string(suffix);
+      variant->content_type = file->content_type;
+      variant->content_encoding = coding;
+      std::string error;
+      // 兄弟文件没有经过规范化，不跟随符号链接，避免指向 web 根目录之外
+      if (load(*variant, request_path, extension, error, false) == StaticFileLookup::Status::found &&
+        variant->size < file->size)
+      {
+        file->encoded_variants.push_back(std::move(variant));
+      }
+    }
+
+    result.file = std::move(file);
+    return result;
+  }
+
+  StaticFileLookup::Status StaticFileCache::load(StaticFile& file, std::string_view request_path,
+                                                 const std::string& extension, std::string& error,
+                                                 bool follow_symlinks) const
+  {
+    if (!options_.cache_enabled)
+    {
+      // 不缓存时保持原来的行为：发送时由 file_body 打开文件
+      struct stat st{};
+      const int status = follow_symlinks ? ::stat(file.path.c_str(), &st) : ::lstat(file.path.c_str(), &st);
+      if (status != 0 || !S_ISREG(st.st_mode))
+      {
+        return StaticFileLookup::Status::not_found;
+      }
+      describe(file, options_, request_path, extension, st);
+      return StaticFileLookup::Status::found;
+    }
+
+    const int fd = ::open(file.path.c_str(), O_RDONLY | O_CLOEXEC | (follow_symlinks ? 0 : O_NOFOLLOW));
+    struct stat st{};
+    if (fd < 0 || ::fstat(fd, &st) != 0)
+    {
+      const int open_error = errno;
+      if (fd >= 0)
+      {
+        ::close(fd);
+      }
+      if (open_error == ENOENT || open_error == ELOOP)
+      {
+        return StaticFileLookup::Status::not_found;
+      }
+      error = std::strerror(open_error);
+      return StaticFileLookup::Status::open_failed;
+    }
+    // 4. 最终检查：确保是常规文件，否则交由动态路由或 404 处理
+    if (!S_ISREG(st.st_mode))
+    {
+      ::close(fd);
+      return StaticFileLookup::Status::not_found;
+    }
+
+    file.size = static_cast<std::uint64_t>(st.st_size);
+    file.last_write_time = st.st_mtime;
+
+    if (file.size <= options_.max_in_memory_file_size)
+    {
+      file.content.resize(file.size);
+      std::size_t read_total = 0;
+      while (read_total < file.size)
+      {
+        const ssize_t n = ::read(fd, file.content.data() + read_total, file.size - read_total);
+        if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (n <= 0)
+        {
+          break;
+        }
+        read_total += static_cast<std::size_t>(n);
+      }
+      ::close(fd);
+      if (read_total != file.size)
+      {
+        // 文件在读取期间被截断
+        error = "file changed while reading";
+        return StaticFileLookup::Status::open_failed;
+      }
+      file.in_memory = true;
+    }
+    else
+    {
+#if defined(__linux__)
+      if (options_.use_sendfile)
+      {
+        // sendfile 显式传入偏移量，不改变文件位置，多个会话可以共享同一个描述符
+        file.fd = fd;
+      }
+      else
+      {
+        ::close(fd);
+      }
+#else
+      ::close(fd);
+#endif
+    }
+    describe(file, options_, request_path, extension, st);
+    return StaticFileLookup::Status::found;
+  }
+
+  bool StaticFileCache::still_valid(const StaticFile& file) const
+  {
+    struct stat st{};
+    if (::stat(file.path.c_str(), &st) != 0)
+    {
+      return false;
+    }
+    if (!S_ISREG(st.st_mode) || static_cast<std::uint64_t>(st.st_size) != file.size ||
+      st.st_mtime != file.last_write_time)
+    {
+      return false;
+    }
+    // 只校验已知的变体；没有 inotify 时新建的预压缩文件要等原始文件变化或条目被淘汰后才生效
+    return std::all_of(file.encoded_variants.begin(), file.encoded_variants.end(),
+                       [this](const auto& variant) { return still_valid(*variant); });
+  }
+
+  void StaticFileCache::insert(const std::string& key, std::shared_ptr<const StaticFile> file, uint64_t epoch)
+  {
+    const std::size_t bytes = memory_bytes(*file);
+    if (bytes > options_.max_cache_bytes || options_.max_entries == 0)
+    {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (epoch != invalidation_epoch_)
+    {
+      return;
+    }
+
+    const auto it = index_.find(key);
+    if (it != index_.end())
+    {
+      erase(it->second);
+    }
+
+    lru_.push_front({key, std::move(file)});
+    index_[key] = lru_.begin();
+    cached_bytes_ += bytes;
+
+    while (cached_bytes_ > options_.max_cache_bytes || lru_.size() > options_.max_entries)
+    {
+      erase(std::prev(lru_.end()));
+      ++stats_.evictions;
+    }
+  }
+
+  void StaticFileCache::erase(std::list<Entry>::iterator it)
+  {
+    cached_bytes_ -= memory_bytes(*it->file);
+    index_.erase(it->key);
+    lru_.erase(it);
+  }
+
+  void StaticFileCache::invalidate(const std::string& local_path)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    invalidate_locked(local_path);
+  }
+
+  void StaticFileCache::invalidate_locked(const std::string& local_path)
+  {
+    ++invalidation_epoch_;
+    // 预压缩文件（包括新建的）变化时使原始文件的条目失效
+    std::string_view base_path = local_path;
+    for (const auto& coding : options_.precompressed)
+    {
+      const std::string_view suffix = precompressed_extension(coding);
+      if (!suffix.empty() && base_path.size() > suffix.size() &&
+        base_path.compare(base_path.size() - suffix.size(), suffix.size(), suffix) == 0)
+      {
+        base_path.remove_suffix(suffix.size());
+        break;
+      }
+    }
+
+    for (auto it = lru_.begin(); it != lru_.end();)
+    {
+      const std::string& path = it->file->path;
+      const bool matches = (path.compare(0, local_path.size(), local_path) == 0 &&
+          (path.size() == local_path.size() || path[local_path.size()] == '/')) ||
+        (base_path.size() != local_path.size() && path == base_path);
+      if (matches)
+      {
+        erase(it++);
+        ++stats_.invalidations;
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+  void StaticFileCache::clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++invalidation_epoch_;
+    stats_.invalidations += lru_.size();
+    lru_.clear();
+    index_.clear();
+    cached_bytes_ = 0;
+  }
+
+  std::size_t StaticFileCache::size() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+  }
+
+  std::size_t StaticFileCache::cached_bytes() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cached_bytes_;
+  }
+
+  const StaticFileOptions& StaticFileCache::options() const
+  {
+    return options_;
+  }
+
+  const StaticFileCacheStats& StaticFileCache::stats() const
+  {
+    return stats_;
+  }
+
+  const std::string* StaticFileCache::match_cache_control(const std::vector<CacheControlRule>& rules,
+                                                         std::string_view request_path, const std::string& extension)
+  {
+    for (const auto& rule : rules)
+    {
+      if (rule.match.empty())
+      {
+        continue;
+      }
+      if (rule.match.front() == '.')
+      {
+        const bool matches = rule.match.size() == extension.size() &&
+          std::equal(rule.match.begin(), rule.match.end(), extension.begin(),
+                     [](unsigned char a, unsigned char b) { return std::tolower(a) == b; });
+        if (matches)
+        {
+          return &rule.value;
+        }
+      }
+      else if (request_path.compare(0, rule.match.size(), rule.match) == 0)
+      {
+        return &rule.value;
+      }
+    }
+    return nullptr;
+  }
+
+  std::string_view StaticFileCache::precompressed_extension(std::string_view coding)
+  {
+    if (coding == "br") return ".br";
+    if (coding == "zstd") return ".zst";
+    if (coding == "gzip") return ".gz";
+    return {};
+  }
+
+  std::shared_ptr<const StaticFile> select_encoded_variant(const std::shared_ptr<const StaticFile>& file,
+                                                           std::string_view accept_encoding)
+  {
+    if (file->encoded_variants.empty() || accept_encoding.empty())
+    {
+      return file;
+    }
+    // 客户端更偏好 identity 时（例如 "identity, gzip;q=0.5"）发送原始文件
+    const std::shared_ptr<const StaticFile>* best = &file;
+    double best_quality = content_coding_quality(accept_encoding, "identity");
+    for (const auto& variant : file->encoded_variants)
+    {
+      const double quality = content_coding_quality(accept_encoding, variant->content_encoding);
+      if (quality > best_quality)
+      {
+        best = &variant;
+        best_quality = quality;
+      }
+    }
+    return *best;
+  }
+
+  // 辅助函数：根据文件扩展名获取 MIME 类型
+  std::string StaticFileCache::mime_type_from_extension(const std::string& ext)
+  {
+    if (ext == ".html" || ext == ".htm") return "text/html";
+    if (ext == ".css") return "text/css";
+    if (ext == ".js") return "application/javascript";
+    if (ext == ".json") return "application/json";
+    if (ext == ".png") return "image/png";
+    if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
+    if (ext == ".gif") return "image/gif";
+    if (ext == ".svg") return "image/svg+xml";
+    if (ext == ".pdf") return "application/pdf";
+    if (ext == ".txt") return "text/plain";
+    // Add more MIME types as needed
+    return "application/octet-stream"; // Default for unknown types
+  }
+}
@@ -0,0 +1,202 @@
+// framework/static_file/static_file_cache.hpp
+#ifndef KHTTPD_FRAMEWORK_STATIC_FILE_STATIC_FILE_CACHE_HPP
+#define KHTTPD_FRAMEWORK_STATIC_FILE_STATIC_FILE_CACHE_HPP
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/filesystem/path.hpp>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace khttpd::framework
+{
+  enum class ETagMode
+  {
+    // 不发送 ETag，只依赖 Last-Modified
+    none,
+    // W/"大小-修改时间"，只保证语义等价
+    weak,
+    // 内存中的文件使用内容哈希，其余文件使用 inode、大小和纳秒级修改时间
+    strong,
+  };
+
+  struct CacheControlRule
+  {
+    // 以 "." 开头时按扩展名匹配（不区分大小写），以 "/" 开头时按请求路径前缀匹配
+    std::string match;
+    // Cache-Control 的值，例如 "public, max-age=31536000, immutable"
+    std::string value;
+  };
+
+  struct StaticFileOptions
+  {
+    // 关闭后每个请求都重新解析路径并用 file_body 发送文件
+    bool cache_enabled = true;
+    // 缓存在内存中的文件内容总字节数上限
+    std::size_t max_cache_bytes = 64 * 1024 * 1024;
+    // 缓存条目数上限，只缓存元数据的大文件也计入
+    std::size_t max_entries = 4096;
+    // 不超过该大小的文件内容读入内存，更大的文件只缓存元数据和打开的文件描述符
+    std::size_t max_in_memory_file_size = 256 * 1024;
+    // 大文件使用 sendfile(2) 零拷贝发送（仅 Linux）
+    bool use_sendfile = true;
+    // 使用 inotify 监听文件变化并使缓存失效（仅 Linux）；不可用时每次命中都 stat 一次校验
+    bool watch_changes = true;
+
+    ETagMode etag = ETagMode::strong;
+    bool last_modified = true;
+    // 按顺序匹配，第一条匹配的规则生效；都不匹配时使用 default_cache_control，为空则不发送
+    std::vector<CacheControlRule> cache_control_rules;
+    std::string default_cache_control;
+
+    // 一个 Range 请求最多包含的范围个数，超过时忽略 Range 返回完整内容
+    std::size_t max_ranges = 16;
+
+    // 按偏好顺序查找的预压缩兄弟文件的编码：br -> .br，zstd -> .zst，gzip -> .gz。
+    // 客户端接受时发送 app.js.gz 等文件代替 app.js，为空则关闭
+    std::vector<std::string> precompressed = {"br", "zstd", "gzip"};
+  };
+
+  // 已解析的静态文件，缓存与正在发送它的会话共享
+  struct StaticFile
+  {
+    StaticFile() = default;
+    StaticFile(const StaticFile&) = delete;
+    StaticFile& operator=(const StaticFile&) = delete;
+    ~StaticFile();
+
+    // 规范化后的本地路径
+    std::string path;
+    std::string content_type;
+    std::uint64_t size = 0;
+    std::time_t last_write_time = 0;
+
+    // 预先生成的响应头，为空表示不发送
+    std::string etag;
+    std::string last_modified;
+    std::string cache_control;
+
+    // 小文件的内容
+    bool in_memory = false;
+    std::string content;
+
+    // 大文件保持打开以便 sendfile，-1 表示发送时再按 path 打开
+    int fd = -1;
+
+    // 预压缩变体的 Content-Encoding，原始文件为空
+    std::string content_encoding;
+    // 存在且比原始文件小的预压缩兄弟文件，按 StaticFileOptions::precompressed 的顺序
+    std::vector<std::shared_ptr<const StaticFile>> encoded_variants;
+  };
+
+  // 按 Accept-Encoding 选择 file 的预压缩变体，没有可接受的变体时返回 file 本身
+  std::shared_ptr<const StaticFile> select_encoded_variant(const std::shared_ptr<const StaticFile>& file,
+                                                           std::string_view accept_encoding);
+
+  struct StaticFileLookup
+  {
+    enum class Status
+    {
+      // 文件不存在，交由动态路由或 404 处理
+      not_found,
+      // 路径无法规范化（权限不足等），error 中为原因
+      invalid_path,
+      // 规范化后的路径不在 web 根目录内
+      path_traversal,
+      // 请求的是目录且目录下没有 index.html
+      directory_without_index,
+      // 文件存在但无法读取，error 中为原因
+      open_failed,
+      found,
+    };
+
+    Status status = Status::not_found;
+    std::shared_ptr<const StaticFile> file;
+    std::string error;
+  };
+
+  struct StaticFileCacheStats
+  {
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<uint64_t> invalidations{0};
+  };
+
+  // 静态文件解析结果的有界 LRU 缓存，以请求路径为键，由 Server 持有、所有 HttpSession 共享
+  class StaticFileCache
+  {
+  public:
+    StaticFileCache(const std::string& web_root, StaticFileOptions options);
+    ~StaticFileCache();
+
+    StaticFileCache(const StaticFileCache&) = delete;
+    StaticFileCache& operator=(const StaticFileCache&) = delete;
+
+    // request_path 为不含查询字符串的请求路径，例如 "/css/site.css"
+    StaticFileLookup lookup(std::string_view request_path);
+
+    // 在 executor 上读取 inotify 事件；平台不支持或 watch_changes 关闭时什么也不做
+    void start_watching(const boost::asio::any_io_executor& executor);
+    void stop_watching();
+    bool watching() const;
+
+    // 使本地路径 local_path 及其下所有文件的缓存失效
+    void invalidate(const std::string& local_path);
+    void clear();
+
+    std::size_t size() const;
+    std::size_t cached_bytes() const;
+    const StaticFileOptions& options() const;
+    const StaticFileCacheStats& stats() const;
+
+    static std::string mime_type_from_extension(const std::string& ext);
+    // 预压缩编码对应的文件后缀，例如 "gzip" -> ".gz"，不支持的编码返回空
+    static std::string_view precompressed_extension(std::string_view coding);
+    // 按 rules 的顺序返回第一条匹配规则的值，extension 应为小写
+    static const std::string* match_cache_control(const std::vector<CacheControlRule>& rules,
+                                                  std::string_view request_path, const std::string& extension);
+
+  private:
+    struct Entry
+    {
+      std::string key;
+      std::shared_ptr<const StaticFile> file;
+    };
+
+    class Watcher;
+
+    const StaticFileOptions options_;
+    const boost::filesystem::path web_root_path_;
+    boost::filesystem::path canonical_web_root_path_;
+
+    mutable std::mutex mutex_;
+    // 表头为最近使用的条目
+    std::list<Entry> lru_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::size_t cached_bytes_ = 0;
+    // 每次失效都会递增；解析期间发生过失效的结果不放入缓存，避免缓存到旧内容
+    uint64_t invalidation_epoch_ = 0;
+
+    std::shared_ptr<Watcher> watcher_;
+    std::atomic<bool> watching_{false};
+    StaticFileCacheStats stats_;
+
+    StaticFileLookup resolve(std::string_view request_path);
+    StaticFileLookup::Status load(StaticFile& file, std::string_view request_path, const std::string& extension,
+                                  std::string& error, bool follow_symlinks) const;
+    bool still_valid(const StaticFile& file) const;
+    void insert(const std::string& key, std::shared_ptr<const StaticFile> file, uint64_t epoch);
+    void erase(std::list<Entry>::iterator it);
+    void invalidate_locked(const std::string& local_path);
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_STATIC_FILE_STATIC_FILE_CACHE_HPP
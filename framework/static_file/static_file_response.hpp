@@ -0,0 +1,283 @@
+// framework/static_file/static_file_response.hpp
+#ifndef KHTTPD_FRAMEWORK_STATIC_FILE_STATIC_FILE_RESPONSE_HPP
+#define KHTTPD_FRAMEWORK_STATIC_FILE_STATIC_FILE_RESPONSE_HPP
+
+#include <boost/beast/core/file.hpp>
+#include <boost/beast/http/empty_body.hpp>
+#include <boost/beast/http/file_body.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/beast/http/span_body.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <boost/beast/version.hpp>
+#include <fmt/core.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "static_file/byte_range.hpp"
+#include "static_file/conditional_request.hpp"
+#include "static_file/static_file_body.hpp"
+#include "static_file/static_file_cache.hpp"
+
+namespace khttpd::framework
+{
+  // 静态文件响应共用的响应头
+  template <class Body>
+  void set_static_file_headers(boost::beast::http::response<Body>& res, const StaticFile& file)
+  {
+    namespace http = boost::beast::http;
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::accept_ranges, "bytes");
+    if (!file.etag.empty()) res.set(http::field::etag, file.etag);
+    if (!file.last_modified.empty()) res.set(http::field::last_modified, file.last_modified);
+    if (!file.cache_control.empty()) res.set(http::field::cache_control, file.cache_control);
+    if (!file.content_encoding.empty()) res.set(http::field::content_encoding, file.content_encoding);
+    // 有预压缩变体时，响应内容取决于 Accept-Encoding，原始文件的响应也要告知缓存
+    if (!file.content_encoding.empty() || !file.encoded_variants.empty())
+    {
+      res.set(http::field::vary, "Accept-Encoding");
+    }
+  }
+
+  inline std::string make_multipart_boundary()
+  {
+    static std::atomic<std::uint64_t> counter{0};
+    return fmt::format("khttpd{:x}{:x}", std::chrono::steady_clock::now().time_since_epoch().count(), ++counter);
+  }
+
+  // 为静态文件请求生成响应（304、416、Range、HEAD 与完整内容），HttpSession 与 Http2Session 共用。
+  // Sink 负责发送，需要提供：
+  //   template <class Body> void send(http::response<Body>&& res, std::shared_ptr<const StaticFile> file);
+  //     file 不为空时由 sink 持有到响应写完，span_body 引用的是缓存中的内容
+  //   bool send_file_zero_copy(std::shared_ptr<const StaticFile>& file, const ByteRange* range);
+  //     连接支持 sendfile 时接管发送并返回 true；range 为空表示整个文件
+  template <class Request, class Sink>
+  class StaticFileResponder
+  {
+  public:
+    StaticFileResponder(const Request& req, const StaticFileOptions& options, Sink& sink)
+      : req_(req), options_(options), sink_(sink)
+    {
+    }
+
+    // 按 StaticFileCache::lookup 的结果响应；文件不存在时返回 false，交由动态路由或 404 处理
+    bool respond(StaticFileLookup lookup, const std::string& request_path)
+    {
+      namespace http = boost::beast::http;
+      switch (lookup.status)
+      {
+      case StaticFileLookup::Status::not_found:
+        return false;
+      case StaticFileLookup::Status::invalid_path:
+        // 例如权限不足或无效路径，直接返回 403
+        send_error(http::status::forbidden,
+                   fmt::format("<h1>403 Forbidden</h1><p>Access denied due to invalid path: {}. Error: {}</p>",
+                               request_path, lookup.error));
+        return true;
+      case StaticFileLookup::Status::path_traversal:
+        send_error(http::status::forbidden,
+                   fmt::format("<h1>403 Forbidden</h1><p>Access denied: Path traversal attempt detected for {}.</p>",
+                               request_path));
+        return true;
+      case StaticFileLookup::Status::directory_without_index:
+        // 目录不包含 index.html，且不允许目录列表
+        send_error(http::status::forbidden,
+                   fmt::format("<h1>403 Forbidden</h1><p>Directory listing not allowed for {}.</p>", request_path));
+        return true;
+      case StaticFileLookup::Status::open_failed:
+        fmt::print(stderr, "Error opening file for {}: {}\n", request_path, lookup.error);
+        send_error(http::status::internal_server_error,
+                   "<h1>500 Internal Server Error</h1><p>Could not open the requested file.</p>");
+        return true;
+      case StaticFileLookup::Status::found:
+        break;
+      }
+
+      send_file(std::move(lookup.file));
+      return true;
+    }
+
+    void send_error(boost::beast::http::status status, std::string body)
+    {
+      namespace http = boost::beast::http;
+      http::response<http::string_body> res{status, req_.version()};
+      res.keep_alive(req_.keep_alive());
+      res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+      res.set(http::field::content_type, "text/html");
+      res.body() = std::move(body);
+      res.prepare_payload();
+      sink_.send(std::move(res), nullptr);
+    }
+
+  private:
+    const Request& req_;
+    const StaticFileOptions& options_;
+    Sink& sink_;
+
+    void send_file(std::shared_ptr<const StaticFile> file)
+    {
+      namespace http = boost::beast::http;
+      // 选中的变体有自己的大小和 ETag，之后的 304、Range 与 HEAD 处理都针对它
+      file = select_encoded_variant(file, req_[http::field::accept_encoding]);
+
+      // 客户端已有相同的内容，只需返回 304
+      if (is_not_modified(*file, req_[http::field::if_none_match], req_[http::field::if_modified_since]))
+      {
+        http::response<http::empty_body> res{http::status::not_modified, req_.version()};
+        res.keep_alive(req_.keep_alive());
+        set_static_file_headers(res, *file);
+        sink_.send(std::move(res), nullptr);
+        return;
+      }
+
+      // Range 只对 GET 有效；If-Range 不匹配时说明客户端手里的是旧版本，忽略 Range 返回完整内容
+      const auto range_header = req_[http::field::range];
+      if (req_.method() == http::verb::get && !range_header.empty() &&
+        if_range_matches(*file, req_[http::field::if_range]))
+      {
+        const RangeRequest range = parse_range_header(range_header, file->size, options_.max_ranges);
+        if (range.status == RangeRequest::Status::unsatisfiable)
+        {
+          http::response<http::empty_body> res{http::status::range_not_satisfiable, req_.version()};
+          res.keep_alive(req_.keep_alive());
+          set_static_file_headers(res, *file);
+          res.set(http::field::content_range, fmt::format("bytes */{}", file->size));
+          res.content_length(0);
+          sink_.send(std::move(res), nullptr);
+          return;
+        }
+        if (range.status == RangeRequest::Status::satisfiable)
+        {
+          send_ranges(std::move(file), range.ranges);
+          return;
+        }
+      }
+
+      const bool head_only = req_.method() == http::verb::head;
+
+      if (head_only && (file->in_memory || file->fd >= 0))
+      {
+        http::response<http::empty_body> res{http::status::ok, req_.version()};
+        res.keep_alive(req_.keep_alive());
+        set_static_file_headers(res, *file);
+        res.set(http::field::content_type, file->content_type);
+        res.content_length(file->size);
+        sink_.send(std::move(res), nullptr);
+        return;
+      }
+
+      if (file->in_memory)
+      {
+        // 直接引用缓存中的内容，不复制；sink 持有 file，保证写完之前内容有效
+        http::response<http::span_body<const char>> res{http::status::ok, req_.version()};
+        res.keep_alive(req_.keep_alive());
+        set_static_file_headers(res, *file);
+        res.set(http::field::content_type, file->content_type);
+        res.body() = {file->content.data(), file->content.size()};
+        res.prepare_payload();
+        sink_.send(std::move(res), std::move(file));
+        return;
+      }
+
+      if (file->fd >= 0 && sink_.send_file_zero_copy(file, nullptr))
+      {
+        return;
+      }
+
+      // 未缓存或不支持 sendfile 时，按路径打开文件
+      http::response<http::file_body> file_res;
+      file_res.version(req_.version());
+      file_res.keep_alive(req_.keep_alive());
+      file_res.result(http::status::ok); // 默认 200 OK
+      set_static_file_headers(file_res, *file);
+
+      boost::beast::error_code ec;
+      file_res.body().open(file->path.c_str(), boost::beast::file_mode::scan, ec);
+      if (ec)
+      {
+        fmt::print(stderr, "Error opening file {}: {}\n", file->path, ec.message());
+        send_error(http::status::internal_server_error,
+                   "<h1>500 Internal Server Error</h1><p>Could not open the requested file.</p>");
+        return;
+      }
+
+      file_res.set(http::field::content_type, file->content_type);
+
+      // 准备 payload (这会自动设置 Content-Length)
+      file_res.prepare_payload();
+
+      sink_.send(std::move(file_res), nullptr);
+    }
+
+    void send_ranges(std::shared_ptr<const StaticFile> file, const std::vector<ByteRange>& ranges)
+    {
+      namespace http = boost::beast::http;
+      if (ranges.size() == 1)
+      {
+        const ByteRange& range = ranges.front();
+        if (file->in_memory)
+        {
+          http::response<http::span_body<const char>> res{http::status::partial_content, req_.version()};
+          res.keep_alive(req_.keep_alive());
+          set_static_file_headers(res, *file);
+          res.set(http::field::content_type, file->content_type);
+          res.set(http::field::content_range, format_content_range(range, file->size));
+          res.body() = {file->content.data() + range.first, static_cast<std::size_t>(range.length())};
+          res.prepare_payload();
+          sink_.send(std::move(res), std::move(file));
+          return;
+        }
+        if (file->fd >= 0 && sink_.send_file_zero_copy(file, &range))
+        {
+          return;
+        }
+      }
+
+      http::response<StaticFileBody> res{http::status::partial_content, req_.version()};
+      res.keep_alive(req_.keep_alive());
+      set_static_file_headers(res, *file);
+
+      auto& body = res.body();
+      if (ranges.size() == 1)
+      {
+        res.set(http::field::content_type, file->content_type);
+        res.set(http::field::content_range, format_content_range(ranges.front(), file->size));
+        body.parts.push_back({{}, ranges.front().first, ranges.front().length()});
+      }
+      else
+      {
+        const std::string boundary = make_multipart_boundary();
+        res.set(http::field::content_type, "multipart/byteranges; boundary=" + boundary);
+        for (const auto& range : ranges)
+        {
+          body.parts.push_back({
+            fmt::format("\r\n--{}\r\nContent-Type: {}\r\nContent-Range: {}\r\n\r\n", boundary, file->content_type,
+                        format_content_range(range, file->size)),
+            range.first, range.length()
+          });
+        }
+        body.trailer = fmt::format("\r\n--{}--\r\n", boundary);
+      }
+      body.file = std::move(file);
+
+      boost::beast::error_code ec;
+      body.open(ec);
+      if (ec)
+      {
+        fmt::print(stderr, "Error opening file {}: {}\n", body.file->path, ec.message());
+        send_error(http::status::internal_server_error,
+                   "<h1>500 Internal Server Error</h1><p>Could not open the requested file.</p>");
+        return;
+      }
+
+      res.prepare_payload();
+      sink_.send(std::move(res), nullptr);
+    }
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_STATIC_FILE_STATIC_FILE_RESPONSE_HPP
@@ -2,11 +2,16 @@
 #include "framework/client/websocket_client.hpp"
 #include <gtest/gtest.h>
 #include <boost/json.hpp>
+#include <atomic>
 #include <map>
+#include <optional>
 #include <thread>
 #include <iostream>
 
 #include "io_context_pool.hpp"
+#include "framework/server.hpp"
+#include <boost/filesystem.hpp>
+#include <boost/asio/use_future.hpp>
 
 using namespace khttpd::framework::client;
 namespace http = boost::beast::http;
@@ -415,3 +420,457 @@ TEST_F(ClientTest, ThreadPoolVerify)
   WAIT_FOR_ASYNC(f1);
   WAIT_FOR_ASYNC(f2);
 }
+
+// ==========================================
+// 连接池测试（本地服务端）
+// ==========================================
+
+class ConnectionPoolTest : public ::testing::Test
+{
+protected:
+  // 端口由系统分配，见 Server::local_endpoint
+  static unsigned short port;
+
+  // Server::stop 会停止全局 IO 池，整个测试套件共用一个服务端，客户端使用自己的 io_context
+  static std::shared_ptr<khttpd::framework::Server> server_;
+  static std::thread server_thread_;
+
+  boost::asio::io_context ioc_;
+  std::optional<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work_;
+  std::thread thread_;
+  std::shared_ptr<HttpClient> client_;
+
+  static void SetUpTestSuite()
+  {
+    khttpd::framework::ServerOptions options;
+    options.io_mode = khttpd::framework::IoMode::per_core;
+    // 服务端较快地关闭空闲连接，用来验证取用时的检查
+    options.session.timeouts.keep_alive_idle = std::chrono::milliseconds(200);
+    server_ = std::make_shared<khttpd::framework::Server>(
+      boost::asio::ip::tcp::endpoint{boost::asio::ip::make_address("127.0.0.1"), 0},
+      boost::filesystem::temp_directory_path().string(), 4, options);
+    port = server_->local_endpoint().port();
+    auto& router = server_->get_http_router();
+    router.get("/ping", [](khttpd::framework::HttpContext& ctx) { ctx.set_body("pong"); });
+    router.get("/slow", [](khttpd::framework::HttpContext& ctx)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      ctx.set_body("slow");
+    });
+    router.get("/close", [](khttpd::framework::HttpContext& ctx)
+    {
+      ctx.get_response().keep_alive(false);
+      ctx.set_body("bye");
+    });
+    server_thread_ = std::thread([server = server_] { server->run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+
+  static void TearDownTestSuite()
+  {
+    server_->stop();
+    server_thread_.join();
+    server_.reset();
+  }
+
+  void SetUp() override
+  {
+    work_.emplace(boost::asio::make_work_guard(ioc_));
+    thread_ = std::thread([this] { ioc_.run(); });
+    client_ = std::make_shared<HttpClient>(ioc_);
+    client_->set_base_url("http://127.0.0.1:" + std::to_string(port));
+    client_->set_timeout(std::chrono::seconds(5));
+  }
+
+  void TearDown() override
+  {
+    client_.reset();
+    work_.reset();
+    ioc_.stop();
+    thread_.join();
+  }
+
+  http::response<http::string_body> get(const std::string& path)
+  {
+    return client_->request_sync(http::verb::get, path, {}, "", {});
+  }
+};
+
+std::shared_ptr<khttpd::framework::Server> ConnectionPoolTest::server_;
+std::thread ConnectionPoolTest::server_thread_;
+unsigned short ConnectionPoolTest::port = 0;
+
+TEST_F(ConnectionPoolTest, ReusesKeepAliveConnections)
+{
+  for (int i = 0; i < 5; ++i)
+  {
+    EXPECT_EQ(get("/ping").body(), "pong");
+  }
+  const auto& stats = client_->get_connection_pool_stats();
+  EXPECT_EQ(stats.connections_created, 1u);
+  EXPECT_EQ(stats.connections_reused, 4u);
+}
+
+TEST_F(ConnectionPoolTest, DoesNotReuseClosedConnections)
+{
+  EXPECT_EQ(get("/close").body(), "bye");
+  EXPECT_EQ(get("/ping").body(), "pong");
+  const auto& stats = client_->get_connection_pool_stats();
+  EXPECT_EQ(stats.connections_created, 2u);
+  EXPECT_EQ(stats.connections_reused, 0u);
+}
+
+TEST_F(ConnectionPoolTest, QueuesRequestsOverPerHostLimit)
+{
+  ConnectionPoolOptions options;
+  options.max_connections_per_host = 2;
+  client_->set_connection_pool(options);
+
+  constexpr int count = 10;
+  std::atomic<int> ok{0};
+  std::promise<void> done;
+  auto future = done.get_future();
+  std::atomic<int> remaining{count};
+  for (int i = 0; i < count; ++i)
+  {
+    client_->request(http::verb::get, "/slow", {}, "", {}, [&](auto ec, auto res)
+    {
+      if (!ec && res.body() == "slow") ++ok;
+      if (--remaining == 0) done.set_value();
+    });
+  }
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  EXPECT_EQ(ok, count);
+  const auto& stats = client_->get_connection_pool_stats();
+  EXPECT_EQ(stats.connections_created, 2u);
+  EXPECT_EQ(stats.connections_reused, 8u);
+  EXPECT_EQ(stats.requests_queued, 8u);
+}
+
+TEST_F(ConnectionPoolTest, EvictsConnectionsClosedByServer)
+{
+  EXPECT_EQ(get("/ping").body(), "pong");
+  // 服务端关闭空闲连接之后，取用时的检查会发现并丢弃它
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  EXPECT_EQ(get("/ping").body(), "pong");
+  const auto& stats = client_->get_connection_pool_stats();
+  EXPECT_EQ(stats.connections_created, 2u);
+  EXPECT_EQ(stats.connections_evicted, 1u);
+  EXPECT_EQ(stats.requests_retried, 0u);
+}
+
+TEST_F(ConnectionPoolTest, SweepsExpiredIdleConnections)
+{
+  ConnectionPoolOptions options;
+  options.idle_timeout = std::chrono::seconds(1);
+  client_->set_connection_pool(options);
+  EXPECT_EQ(get("/ping").body(), "pong");
+  // 之后不再使用连接池，过期的空闲连接由定时器关闭
+  std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+  EXPECT_EQ(client_->get_connection_pool_stats().connections_evicted, 1u);
+}
+
+TEST_F(ConnectionPoolTest, ReplaysOnlyIdempotentRequests)
+{
+  // 每个连接上只响应第一个请求，第二个请求读完之后不响应、直接关闭：请求已经送达，但客户端收不到响应
+  boost::asio::io_context server_ioc;
+  boost::asio::ip::tcp::acceptor acceptor(server_ioc, {boost::asio::ip::make_address("127.0.0.1"), 0});
+  std::atomic<int> posts{0};
+  std::atomic<int> gets{0};
+  std::thread server([&]
+  {
+    // POST 用到一个连接，GET 用到两个（第二个用于重发）
+    for (int connection = 0; connection < 3; ++connection)
+    {
+      boost::asio::ip::tcp::socket socket(server_ioc);
+      boost::system::error_code ec;
+      acceptor.accept(socket, ec);
+      if (ec)
+      {
+        return;
+      }
+      boost::beast::flat_buffer buffer;
+      for (int n = 0;; ++n)
+      {
+        http::request<http::string_body> req;
+        http::read(socket, buffer, req, ec);
+        if (ec)
+        {
+          break;
+        }
+        ++(req.method() == http::verb::post ? posts : gets);
+        if (n > 0)
+        {
+          break;
+        }
+        http::response<http::string_body> res{http::status::ok, 11};
+        res.body() = "ok";
+        res.prepare_payload();
+        http::write(socket, res, ec);
+      }
+    }
+  });
+
+  auto client = std::make_shared<HttpClient>(ioc_);
+  client->set_base_url("http://127.0.0.1:" + std::to_string(acceptor.local_endpoint().port()));
+  client->set_timeout(std::chrono::seconds(5));
+
+  // 复用的连接失败时，POST 可能已经被服务端处理，不能重发
+  EXPECT_EQ(client->request_sync(http::verb::post, "/order", {}, "item", {}).body(), "ok");
+  EXPECT_THROW(client->request_sync(http::verb::post, "/order", {}, "item", {}), boost::system::system_error);
+  EXPECT_EQ(posts, 2);
+  EXPECT_EQ(client->get_connection_pool_stats().requests_retried, 0u);
+
+  // GET 换新连接重发一次
+  EXPECT_EQ(client->request_sync(http::verb::get, "/ping", {}, "", {}).body(), "ok");
+  EXPECT_EQ(client->request_sync(http::verb::get, "/ping", {}, "", {}).body(), "ok");
+  EXPECT_EQ(gets, 3);
+  EXPECT_EQ(client->get_connection_pool_stats().requests_retried, 1u);
+
+  client.reset();
+  server.join();
+}
+
+TEST_F(ConnectionPoolTest, SyncRequestOnIoThreadRunsInline)
+{
+  // ioc_ 只有一个线程：在这个线程上阻塞等待 ioc_ 完成请求必然死锁
+  std::promise<std::string> body;
+  auto future = body.get_future();
+  boost::asio::post(ioc_, [&]
+  {
+    try
+    {
+      body.set_value(get("/ping").body());
+    }
+    catch (const std::exception& e)
+    {
+      body.set_value(e.what());
+    }
+  });
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  EXPECT_EQ(future.get(), "pong");
+  // 内联路径使用私有的连接，不经过客户端的连接池
+  EXPECT_EQ(client_->get_connection_pool_stats().connections_created, 0u);
+}
+
+TEST_F(ConnectionPoolTest, AsyncRequestWithCompletionTokens)
+{
+  auto future = client_->async_request(http::verb::get, "/ping", {}, "", {}, boost::asio::use_future);
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  EXPECT_EQ(future.get().body(), "pong");
+
+  std::promise<std::string> body;
+  auto callback_future = body.get_future();
+  client_->async_request(http::verb::get, "/ping", {}, "", {}, [&](boost::beast::error_code ec, auto res)
+  {
+    EXPECT_FALSE(ec);
+    body.set_value(res.body());
+  });
+  ASSERT_EQ(callback_future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  EXPECT_EQ(callback_future.get(), "pong");
+}
+
+// ==========================================
+// DNS 缓存测试（本地桩解析器）
+// ==========================================
+
+class DnsCacheTest : public ::testing::Test
+{
+protected:
+  using Endpoints = DnsCache::Endpoints;
+
+  struct PendingLookup
+  {
+    std::string host;
+    DnsCache::ResolveHandler handler;
+  };
+
+  boost::asio::io_context ioc_;
+  std::vector<PendingLookup> pending_;
+
+  // 解析请求先挂起，由测试决定何时、以什么结果完成
+  std::shared_ptr<DnsCache> make_cache(DnsCacheOptions options = {})
+  {
+    return std::make_shared<DnsCache>(options, [this](const auto&, const std::string& host, const std::string&,
+                                                      DnsCache::ResolveHandler handler)
+    {
+      pending_.push_back({host, std::move(handler)});
+    });
+  }
+
+  static Endpoints endpoints(std::initializer_list<const char*> addresses)
+  {
+    Endpoints result;
+    for (const auto* address : addresses)
+    {
+      result.emplace_back(boost::asio::ip::make_address(address), 80);
+    }
+    return result;
+  }
+
+  void complete(boost::beast::error_code ec, Endpoints result)
+  {
+    ASSERT_FALSE(pending_.empty());
+    auto lookup = std::move(pending_.front());
+    pending_.erase(pending_.begin());
+    lookup.handler(ec, std::move(result));
+    ioc_.poll();
+    ioc_.restart();
+  }
+
+  // 返回同步或投递到 io_context 上完成的结果
+  std::optional<std::pair<boost::beast::error_code, Endpoints>> resolve(DnsCache& cache, const std::string& host)
+  {
+    std::optional<std::pair<boost::beast::error_code, Endpoints>> result;
+    cache.resolve(ioc_.get_executor(), host, "80", [&result](auto ec, auto eps)
+    {
+      result.emplace(ec, std::move(eps));
+    });
+    ioc_.poll();
+    ioc_.restart();
+    return result;
+  }
+};
+
+TEST_F(DnsCacheTest, CachesResultsWithinTtl)
+{
+  auto cache = make_cache();
+  std::optional<std::pair<boost::beast::error_code, Endpoints>> first;
+  cache->resolve(ioc_.get_executor(), "example.test", "80", [&](auto ec, auto eps) { first.emplace(ec, eps); });
+  ASSERT_EQ(pending_.size(), 1u);
+  complete({}, endpoints({"10.0.0.1"}));
+  ASSERT_TRUE(first);
+  EXPECT_FALSE(first->first);
+  EXPECT_EQ(first->second, endpoints({"10.0.0.1"}));
+
+  const auto second = resolve(*cache, "example.test");
+  ASSERT_TRUE(second);
+  EXPECT_EQ(second->second, endpoints({"10.0.0.1"}));
+  EXPECT_TRUE(pending_.empty());
+  EXPECT_EQ(cache->stats().lookups, 1u);
+  EXPECT_EQ(cache->stats().hits, 1u);
+  EXPECT_EQ(cache->stats().misses, 1u);
+}
+
+TEST_F(DnsCacheTest, CoalescesConcurrentLookups)
+{
+  auto cache = make_cache();
+  int completed = 0;
+  for (int i = 0; i < 3; ++i)
+  {
+    cache->resolve(ioc_.get_executor(), "example.test", "80", [&](auto ec, auto eps)
+    {
+      EXPECT_FALSE(ec);
+      EXPECT_EQ(eps.size(), 1u);
+      ++completed;
+    });
+  }
+  ASSERT_EQ(pending_.size(), 1u);
+  complete({}, endpoints({"10.0.0.1"}));
+  EXPECT_EQ(completed, 3);
+  EXPECT_EQ(cache->stats().lookups, 1u);
+  EXPECT_EQ(cache->stats().coalesced, 2u);
+}
+
+TEST_F(DnsCacheTest, ServesStaleEntriesWhileRefreshing)
+{
+  DnsCacheOptions options;
+  options.ttl = std::chrono::milliseconds(20);
+  options.stale_ttl = std::chrono::seconds(60);
+  auto cache = make_cache(options);
+  resolve(*cache, "example.test");
+  complete({}, endpoints({"10.0.0.1"}));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  // 旧结果立即返回，同时只发起一次刷新
+  auto stale = resolve(*cache, "example.test");
+  ASSERT_TRUE(stale);
+  EXPECT_EQ(stale->second, endpoints({"10.0.0.1"}));
+  stale = resolve(*cache, "example.test");
+  ASSERT_TRUE(stale);
+  EXPECT_EQ(pending_.size(), 1u);
+  EXPECT_EQ(cache->stats().stale_hits, 2u);
+
+  complete({}, endpoints({"10.0.0.2"}));
+  const auto fresh = resolve(*cache, "example.test");
+  ASSERT_TRUE(fresh);
+  EXPECT_EQ(fresh->second, endpoints({"10.0.0.2"}));
+  EXPECT_EQ(cache->stats().hits, 1u);
+}
+
+TEST_F(DnsCacheTest, KeepsStaleEntryWhenRefreshFails)
+{
+  DnsCacheOptions options;
+  options.ttl = std::chrono::milliseconds(20);
+  auto cache = make_cache(options);
+  resolve(*cache, "example.test");
+  complete({}, endpoints({"10.0.0.1"}));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  resolve(*cache, "example.test");
+  complete(boost::asio::error::host_not_found, {});
+  const auto result = resolve(*cache, "example.test");
+  ASSERT_TRUE(result);
+  EXPECT_FALSE(result->first);
+  EXPECT_EQ(result->second, endpoints({"10.0.0.1"}));
+  EXPECT_EQ(cache->stats().failures, 1u);
+}
+
+TEST_F(DnsCacheTest, DoesNotCacheFailures)
+{
+  auto cache = make_cache();
+  resolve(*cache, "missing.test");
+  complete(boost::asio::error::host_not_found, {});
+  EXPECT_EQ(cache->size(), 0u);
+
+  const auto result = resolve(*cache, "missing.test");
+  EXPECT_FALSE(result);
+  EXPECT_EQ(pending_.size(), 1u);
+}
+
+TEST_F(DnsCacheTest, RotatesOverMultipleAddresses)
+{
+  auto cache = make_cache();
+  resolve(*cache, "example.test");
+  complete({}, endpoints({"10.0.0.1", "10.0.0.2", "::1"}));
+
+  std::vector<boost::asio::ip::address> firsts;
+  for (int i = 0; i < 3; ++i)
+  {
+    const auto result = resolve(*cache, "example.test");
+    ASSERT_TRUE(result);
+    ASSERT_EQ(result->second.size(), 3u);
+    firsts.push_back(result->second.front().address());
+  }
+  EXPECT_NE(firsts[0], firsts[1]);
+  EXPECT_NE(firsts[1], firsts[2]);
+  EXPECT_NE(firsts[0], firsts[2]);
+}
+
+TEST_F(DnsCacheTest, SkipsLookupForAddressLiterals)
+{
+  auto cache = make_cache();
+  const auto v4 = resolve(*cache, "127.0.0.1");
+  ASSERT_TRUE(v4);
+  EXPECT_EQ(v4->second, endpoints({"127.0.0.1"}));
+  const auto v6 = resolve(*cache, "[::1]");
+  ASSERT_TRUE(v6);
+  EXPECT_EQ(v6->second, endpoints({"::1"}));
+  EXPECT_TRUE(pending_.empty());
+  EXPECT_EQ(cache->stats().lookups, 0u);
+}
+
+TEST_F(DnsCacheTest, EvictsOldestEntryOverLimit)
+{
+  DnsCacheOptions options;
+  options.max_entries = 2;
+  auto cache = make_cache(options);
+  for (const auto* host : {"a.test", "b.test", "c.test"})
+  {
+    resolve(*cache, host);
+    complete({}, endpoints({"10.0.0.1"}));
+  }
+  EXPECT_EQ(cache->size(), 2u);
+  resolve(*cache, "a.test");
+  EXPECT_EQ(pending_.size(), 1u);
+}
@@ -0,0 +1,373 @@
+#include "gtest/gtest.h"
+#include "compression/compression.hpp"
+#include "interceptor/compression_interceptor.hpp"
+#include <zlib.h>
+#include <zstd.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace khttpd::framework;
+namespace http = boost::beast::http;
+
+namespace
+{
+  // window_bits: 31 为 gzip，15 为 zlib（HTTP deflate）
+  std::string inflate_all(const std::string& input, int window_bits)
+  {
+    z_stream stream{};
+    EXPECT_EQ(inflateInit2(&stream, window_bits), Z_OK);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    std::string out;
+    char buffer[4096];
+    int result;
+    do
+    {
+      stream.next_out = reinterpret_cast<Bytef*>(buffer);
+      stream.avail_out = sizeof(buffer);
+      result = inflate(&stream, Z_SYNC_FLUSH);
+      out.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    while (result == Z_OK && (stream.avail_in > 0 || stream.avail_out == 0));
+    inflateEnd(&stream);
+    return out;
+  }
+
+  std::string zstd_decompress_all(const std::string& input)
+  {
+    ZSTD_DCtx* context = ZSTD_createDCtx();
+    ZSTD_inBuffer in{input.data(), input.size(), 0};
+    std::string out;
+    char buffer[4096];
+    while (in.pos < in.size)
+    {
+      ZSTD_outBuffer buffer_out{buffer, sizeof(buffer), 0};
+      const std::size_t result = ZSTD_decompressStream(context, &buffer_out, &in);
+      if (ZSTD_isError(result))
+      {
+        ADD_FAILURE() << ZSTD_getErrorName(result);
+        break;
+      }
+      out.append(buffer, buffer_out.pos);
+    }
+    ZSTD_freeDCtx(context);
+    return out;
+  }
+
+  std::string decompress(ContentCoding coding, const std::string& input)
+  {
+    switch (coding)
+    {
+    case ContentCoding::gzip:
+      return inflate_all(input, 15 + 16);
+    case ContentCoding::deflate:
+      return inflate_all(input, 15);
+    case ContentCoding::zstd:
+      return zstd_decompress_all(input);
+    }
+    return {};
+  }
+
+  std::string sample_text(std::size_t size)
+  {
+    std::string text;
+    while (text.size() < size)
+    {
+      text += "khttpd compresses repetitive text very well. ";
+    }
+    text.resize(size);
+    return text;
+  }
+}
+
+TEST(ContentCodingTest, QualityValues)
+{
+  EXPECT_DOUBLE_EQ(content_coding_quality("gzip, deflate", "gzip"), 1.0);
+  EXPECT_DOUBLE_EQ(content_coding_quality("gzip;q=0.5, br", "gzip"), 0.5);
+  EXPECT_DOUBLE_EQ(content_coding_quality("GZIP ; Q=0.3", "gzip"), 0.3);
+  EXPECT_DOUBLE_EQ(content_coding_quality("x-gzip", "gzip"), 1.0);
+  EXPECT_DOUBLE_EQ(content_coding_quality("br", "gzip"), 0.0);
+  EXPECT_DOUBLE_EQ(content_coding_quality("*;q=0.2", "zstd"), 0.2);
+  EXPECT_DOUBLE_EQ(content_coding_quality("gzip;q=0, *", "gzip"), 0.0);
+}
+
+TEST(ContentCodingTest, NegotiationPrefersClientThenServerOrder)
+{
+  const std::vector<std::string> available = {"zstd", "gzip", "deflate"};
+  EXPECT_EQ(negotiate_content_coding("gzip, deflate, br, zstd", available), "zstd");
+  EXPECT_EQ(negotiate_content_coding("gzip, zstd;q=0.5", available), "gzip");
+  EXPECT_EQ(negotiate_content_coding("deflate", available), "deflate");
+  EXPECT_EQ(negotiate_content_coding("br", available), std::nullopt);
+  EXPECT_EQ(negotiate_content_coding("*;q=0", available), std::nullopt);
+}
+
+TEST(ContentCodingTest, RoundTripsEveryCoding)
+{
+  const std::string input = sample_text(64 * 1024);
+  for (const auto coding : {ContentCoding::gzip, ContentCoding::deflate, ContentCoding::zstd})
+  {
+    const std::string compressed = compress(coding, input, coding == ContentCoding::zstd ? 3 : 6);
+    EXPECT_LT(compressed.size(), input.size() / 4) << content_coding_name(coding);
+    EXPECT_EQ(decompress(coding, compressed), input) << content_coding_name(coding);
+  }
+}
+
+TEST(ContentCodingTest, FlushedChunksDecodeWithoutTheTrailer)
+{
+  for (const auto coding : {ContentCoding::gzip, ContentCoding::deflate, ContentCoding::zstd})
+  {
+    auto compressor = StreamCompressor::create(coding, 1);
+    std::string out;
+    compressor->write("first chunk,", out, true);
+    // 刷新之后，已经输出的部分即可单独解出
+    EXPECT_EQ(decompress(coding, out), "first chunk,") << content_coding_name(coding);
+    compressor->write("second chunk", out, true);
+    compressor->finish(out);
+    EXPECT_EQ(decompress(coding, out), "first chunk,second chunk") << content_coding_name(coding);
+  }
+}
+
+class CompressionInterceptorTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    req.version(11);
+    req.method(http::verb::get);
+    req.target("/data");
+    req.set(http::field::accept_encoding, "gzip, deflate");
+    ctx = std::make_shared<HttpContext>(req, res);
+    res.result(http::status::ok);
+    res.set(http::field::content_type, "text/plain; charset=utf-8");
+  }
+
+  HttpContext::Request req;
+  HttpContext::Response res;
+  std::shared_ptr<HttpContext> ctx;
+};
+
+TEST_F(CompressionInterceptorTest, CompressesLargeStringBodies)
+{
+  const std::string body = sample_text(8 * 1024);
+  ctx->set_body(body);
+  res.set(http::field::etag, "\"v1\"");
+
+  CompressionInterceptor interceptor;
+  interceptor.handle_response(*ctx);
+
+  EXPECT_EQ(res[http::field::content_encoding], "gzip");
+  EXPECT_EQ(res[http::field::vary], "Accept-Encoding");
+  EXPECT_EQ(res[http::field::etag], "\"v1-gzip\"");
+  EXPECT_EQ(res[http::field::content_length], std::to_string(res.body().size()));
+  EXPECT_EQ(inflate_all(res.body(), 15 + 16), body);
+}
+
+TEST_F(CompressionInterceptorTest, UsesConfiguredLevelAndEncodings)
+{
+  const std::string body = sample_text(8 * 1024);
+  ctx->set_body(body);
+  req.set(http::field::accept_encoding, "gzip, zstd");
+
+  CompressionOptions options;
+  options.encodings = {ContentCoding::zstd};
+  options.zstd_level = 19;
+  CompressionInterceptor interceptor(options);
+  interceptor.handle_response(*ctx);
+
+  EXPECT_EQ(res[http::field::content_encoding], "zstd");
+  EXPECT_EQ(zstd_decompress_all(res.body()), body);
+}
+
+TEST_F(CompressionInterceptorTest, SkipsIneligibleResponses)
+{
+  CompressionInterceptor interceptor;
+
+  // 小于 min_size
+  ctx->set_body("small");
+  interceptor.handle_response(*ctx);
+  EXPECT_EQ(res.body(), "small");
+  EXPECT_EQ(res.find(http::field::content_encoding), res.end());
+
+  // 不可压缩的类型
+  ctx->set_body(sample_text(4096));
+  res.set(http::field::content_type, "image/png");
+  interceptor.handle_response(*ctx);
+  EXPECT_EQ(res.find(http::field::content_encoding), res.end());
+
+  // no-transform
+  res.set(http::field::content_type, "text/plain");
+  res.set(http::field::cache_control, "public, no-transform");
+  interceptor.handle_response(*ctx);
+  EXPECT_EQ(res.find(http::field::content_encoding), res.end());
+
+  // 客户端不接受任何支持的编码，但仍需告知缓存
+  res.erase(http::field::cache_control);
+  req.set(http::field::accept_encoding, "br, gzip;q=0");
+  interceptor.handle_response(*ctx);
+  EXPECT_EQ(res.find(http::field::content_encoding), res.end());
+  EXPECT_EQ(res[http::field::vary], "Accept-Encoding");
+  EXPECT_EQ(res.body(), sample_text(4096));
+}
+
+TEST_F(CompressionInterceptorTest, WrapsPullGenerators)
+{
+  int next = 0;
+  ctx->chunked_pull([&next]() -> std::optional<std::string>
+  {
+    if (next == 3)
+    {
+      return std::nullopt;
+    }
+    return "chunk-" + std::to_string(next++) + ";";
+  });
+
+  CompressionInterceptor interceptor;
+  interceptor.handle_response(*ctx);
+  EXPECT_EQ(res[http::field::content_encoding], "gzip");
+  EXPECT_TRUE(res.chunked());
+
+  const auto& generator = ctx->get_chunk_generator();
+  ASSERT_TRUE(generator);
+  std::string stream;
+  while (auto chunk = generator())
+  {
+    // 每块都已刷新，到目前为止收到的数据都能解出
+    stream += *chunk;
+    if (next < 3)
+    {
+      EXPECT_EQ(inflate_all(stream, 15 + 16).size(), static_cast<std::size_t>(next) * 8);
+    }
+  }
+  EXPECT_EQ(inflate_all(stream, 15 + 16), "chunk-0;chunk-1;chunk-2;");
+}
+
+TEST_F(CompressionInterceptorTest, WrapsPushWriters)
+{
+  class CollectingWriter : public ChunkWriter
+  {
+  public:
+    std::string data;
+    bool finished = false;
+
+    void write(std::string chunk, WriteCallback on_written) override
+    {
+      data += chunk;
+      if (on_written) on_written({});
+    }
+
+    void finish(WriteCallback on_finished) override
+    {
+      finished = true;
+      if (on_finished) on_finished({});
+    }
+  };
+
+  req.set(http::field::accept_encoding, "deflate");
+  ctx->chunked_push([](std::shared_ptr<ChunkWriter> writer)
+  {
+    writer->write("hello ", [writer](boost::beast::error_code)
+    {
+      writer->write("world");
+      writer->finish();
+    });
+  });
+
+  CompressionInterceptor interceptor;
+  interceptor.handle_response(*ctx);
+  EXPECT_EQ(res[http::field::content_encoding], "deflate");
+
+  auto collector = std::make_shared<CollectingWriter>();
+  ctx->get_async_stream_handler()(collector);
+  EXPECT_TRUE(collector->finished);
+  EXPECT_EQ(inflate_all(collector->data, 15), "hello world");
+}
+
+TEST_F(CompressionInterceptorTest, ConcurrentPushWritesKeepTheStreamIntact)
+{
+  class LockedCollectingWriter : public ChunkWriter
+  {
+  public:
+    std::mutex mutex;
+    std::string data;
+
+    void write(std::string chunk, WriteCallback on_written) override
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        data += chunk;
+      }
+      if (on_written) on_written({});
+    }
+
+    void finish(WriteCallback on_finished) override
+    {
+      if (on_finished) on_finished({});
+    }
+  };
+
+  constexpr int threads = 8;
+  constexpr int chunks = 200;
+  req.set(http::field::accept_encoding, "gzip");
+  ctx->chunked_push([](std::shared_ptr<ChunkWriter> writer)
+  {
+    std::vector<std::thread> writers;
+    for (int t = 0; t < threads; ++t)
+    {
+      writers.emplace_back([writer, t]
+      {
+        for (int i = 0; i < chunks; ++i)
+        {
+          writer->write(std::string(1, static_cast<char>('a' + t)) + std::to_string(i) + ";");
+        }
+      });
+    }
+    for (auto& thread : writers)
+    {
+      thread.join();
+    }
+    writer->finish();
+  });
+
+  CompressionInterceptor interceptor;
+  interceptor.handle_response(*ctx);
+  auto collector = std::make_shared<LockedCollectingWriter>();
+  ctx->get_async_stream_handler()(collector);
+
+  // 各线程的块之间可以交错，但每个块都要完整地解出来，且同一线程的块保持顺序
+  const std::string body = inflate_all(collector->data, 15 + 16);
+  std::vector<int> next(threads, 0);
+  std::size_t start = 0;
+  for (std::size_t end = body.find(';'); end != std::string::npos; end = body.find(';', start))
+  {
+    const int t = body[start] - 'a';
+    ASSERT_GE(t, 0);
+    ASSERT_LT(t, threads);
+    EXPECT_EQ(body.substr(start + 1, end - start - 1), std::to_string(next[t]++));
+    start = end + 1;
+  }
+  EXPECT_EQ(start, body.size());
+  EXPECT_EQ(next, std::vector<int>(threads, chunks));
+}
+
+TEST_F(CompressionInterceptorTest, WrapsLegacyStreamHandlers)
+{
+  ctx->chunked([](HttpContext&, const HttpContext::WriteHandler& write)
+  {
+    write("legacy ");
+    write("stream");
+  });
+
+  CompressionInterceptor interceptor;
+  interceptor.handle_response(*ctx);
+
+  std::string stream;
+  ctx->get_stream_handler()(*ctx, [&stream](const std::string& buffer)
+  {
+    stream += buffer;
+    return true;
+  });
+  EXPECT_EQ(inflate_all(stream, 15 + 16), "legacy stream");
+}
@@ -1,6 +1,8 @@
 #include "framework/context/http_context.hpp"
 #include <gtest/gtest.h>
 #include <boost/beast/http/empty_body.hpp> // For empty body requests
+#include <array>
+#include <memory_resource>
 
 namespace beast = boost::beast;
 namespace http = beast::http;
@@ -57,6 +59,61 @@ TEST(HttpContextTest, QueryParameters)
   ASSERT_FALSE(ctx.get_query_param("non_existent").has_value());
 }
 
+TEST(HttpContextTest, ViewAccessorsBorrowFromRequest)
+{
+  http::request<http::string_body> req = make_request(http::verb::post, "/search?q=plain&name=a%20b+c&flag&q=second",
+                                                      11, "payload");
+  http::response<http::string_body> res;
+  khttpd_fw::HttpContext ctx = create_context(req, res);
+
+  // 无需解码的值直接引用请求行
+  const auto target = req.target();
+  auto q = ctx.query_param_view("q");
+  ASSERT_TRUE(q.has_value());
+  ASSERT_EQ(*q, "plain");
+  ASSERT_GE(q->data(), target.data());
+  ASSERT_LT(q->data(), target.data() + target.size());
+
+  ASSERT_EQ(ctx.query_param_view("name").value(), "a b c");
+  ASSERT_EQ(ctx.query_param_view("flag").value(), "");
+  ASSERT_FALSE(ctx.query_param_view("missing").has_value());
+
+  ASSERT_EQ(ctx.body_view(), "payload");
+  ASSERT_EQ(ctx.body_view().data(), req.body().data());
+}
+
+TEST(HttpContextTest, PathParamViews)
+{
+  http::request<http::string_body> req = make_request(http::verb::get, "/users/42/posts/7");
+  http::response<http::string_body> res;
+  khttpd_fw::HttpContext ctx = create_context(req, res);
+
+  const std::string& path = ctx.path();
+  khttpd_fw::ParamList params;
+  params.push_back("id", std::string_view(path).substr(7, 2));
+  params.push_back("post", std::string_view(path).substr(16, 1));
+  ctx.set_path_params(params);
+
+  ASSERT_EQ(ctx.path_param_view("id").value(), "42");
+  ASSERT_EQ(ctx.path_param_view("post").value(), "7");
+  ASSERT_EQ(ctx.get_path_param("id").value(), "42");
+  ASSERT_FALSE(ctx.path_param_view("other").has_value());
+
+  // 超过内联容量时退回堆存储
+  khttpd_fw::ParamList many;
+  std::vector<std::string> names;
+  for (size_t i = 0; i < khttpd_fw::ParamList::inline_capacity + 4; ++i)
+  {
+    names.push_back("p" + std::to_string(i));
+  }
+  for (const auto& name : names)
+  {
+    many.push_back(name, name);
+  }
+  ASSERT_EQ(many.size(), khttpd_fw::ParamList::inline_capacity + 4);
+  ASSERT_EQ(many.find("p18").value(), "p18");
+}
+
 TEST(HttpContextTest, Headers)
 {
   http::request<http::string_body> req = make_request(http::verb::get, "/");
@@ -238,3 +295,34 @@ TEST(HttpContextTest, SetCookie)
   ASSERT_TRUE(found_foo);
   ASSERT_TRUE(found_user);
 }
+
+TEST(HttpContextTest, CachesAllocateFromGivenResource)
+{
+  http::request<http::string_body> req = make_request(
+    http::verb::post, "/submit?greeting=hello+from+a+fairly+long+query+value&id=7", 11,
+    "title=a+form+value+longer+than+sso&tag=x");
+  req.set(http::field::content_type, "application/x-www-form-urlencoded");
+  req.set(http::field::cookie, "a_rather_long_cookie_name=a_rather_long_cookie_value; short=1");
+  http::response<http::string_body> res;
+
+  // 上游为 null_memory_resource：缓存若绕过传入的 resource 或超出缓冲区都会抛出 bad_alloc
+  std::array<std::byte, 16 * 1024> buffer{};
+  std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+
+  for (int round = 0; round < 3; ++round)
+  {
+    {
+      khttpd_fw::HttpContext ctx(req, res, &arena);
+      ASSERT_EQ(ctx.query_param_view("greeting").value(), "hello from a fairly long query value");
+      ASSERT_EQ(ctx.get_query_param("id").value(), "7");
+      ASSERT_EQ(ctx.get_form_param("title").value(), "a form value longer than sso");
+      ASSERT_EQ(ctx.get_cookie("a_rather_long_cookie_name").value(), "a_rather_long_cookie_value");
+      ASSERT_EQ(ctx.get_cookies("short").size(), 1u);
+
+      ctx.set_attribute("an_attribute_name_longer_than_sso", 42);
+      ASSERT_EQ(ctx.get_attribute_as<int>("an_attribute_name_longer_than_sso").value(), 42);
+    }
+    // 与 HttpSession 一样，上下文析构后整体回收，下一个请求重新使用同一块缓冲区
+    arena.release();
+  }
+}
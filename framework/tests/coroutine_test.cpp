@@ -0,0 +1,149 @@
+#include "gtest/gtest.h"
+#include "awaitable.hpp"
+
+#if defined(KHTTPD_HAS_COROUTINES)
+#include "server.hpp"
+#include "client/http_client.hpp"
+#include "router/awaitable_handler.hpp"
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_future.hpp>
+#include <boost/filesystem.hpp>
+#include <future>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+using namespace khttpd::framework;
+namespace http = boost::beast::http;
+namespace net = boost::asio;
+
+namespace
+{
+  class PostHeaderInterceptor : public Interceptor
+  {
+  public:
+    void handle_response(HttpContext& ctx) override
+    {
+      ctx.set_header("X-Post", "done");
+    }
+  };
+}
+
+class CoroutineTest : public ::testing::Test
+{
+protected:
+  // 端口由系统分配，见 Server::local_endpoint
+  unsigned short port = 0;
+
+  std::shared_ptr<Server> server_;
+  std::thread server_thread_;
+  // 客户端使用自己的 io_context，与服务端的线程分开
+  net::io_context ioc_;
+  std::optional<net::executor_work_guard<net::io_context::executor_type>> work_;
+  std::thread client_thread_;
+  std::shared_ptr<client::HttpClient> client_;
+
+  void SetUp() override
+  {
+    ServerOptions options;
+    options.io_mode = IoMode::per_core;
+    // 只有一个工作线程：协程挂起时如果占用线程，其他请求就无法处理
+    server_ = std::make_shared<Server>(tcp::endpoint{net::ip::make_address("127.0.0.1"), 0},
+                                       boost::filesystem::temp_directory_path().string(), 1, options);
+    port = server_->local_endpoint().port();
+    server_->add_interceptor(std::make_shared<PostHeaderInterceptor>());
+    auto& router = server_->get_http_router();
+    router.get("/fast", [](HttpContext& ctx) { ctx.set_body("fast"); });
+    router.get("/sleep", co_handler([](HttpContext& ctx) -> Awaitable<>
+    {
+      net::steady_timer timer(co_await net::this_coro::executor, std::chrono::milliseconds(300));
+      co_await timer.async_wait(net::use_awaitable);
+      ctx.set_body("slept");
+    }));
+    router.get("/throw", co_handler([](HttpContext&) -> Awaitable<>
+    {
+      co_await net::post(co_await net::this_coro::executor, net::use_awaitable);
+      throw std::runtime_error("coroutine failed");
+    }));
+    router.get("/fanout", co_handler([this](HttpContext& ctx) -> Awaitable<>
+    {
+      const auto a = co_await client_->get("/fast");
+      const auto b = co_await client_->get("/sleep");
+      ctx.set_body(a.body() + "+" + b.body());
+    }));
+    server_thread_ = std::thread([server = server_] { server->run(); });
+
+    work_.emplace(net::make_work_guard(ioc_));
+    client_thread_ = std::thread([this] { ioc_.run(); });
+    client_ = std::make_shared<client::HttpClient>(ioc_);
+    client_->set_base_url("http://127.0.0.1:" + std::to_string(port));
+    client_->set_timeout(std::chrono::seconds(5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+
+  void TearDown() override
+  {
+    server_->stop();
+    server_thread_.join();
+    client_.reset();
+    work_.reset();
+    ioc_.stop();
+    client_thread_.join();
+  }
+
+  // 在客户端的 io_context 上以协程发起请求
+  std::future<http::response<http::string_body>> co_get(const std::string& path)
+  {
+    return net::co_spawn(ioc_, client_->get(path), net::use_future);
+  }
+};
+
+TEST_F(CoroutineTest, ClientCallsCanBeAwaited)
+{
+  auto future = co_get("/fast");
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  EXPECT_EQ(future.get().body(), "fast");
+}
+
+TEST_F(CoroutineTest, SuspendedHandlerDoesNotHoldWorkerThread)
+{
+  const auto started = std::chrono::steady_clock::now();
+  auto slow = co_get("/sleep");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  auto fast = co_get("/fast");
+
+  ASSERT_EQ(fast.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  EXPECT_EQ(fast.get().body(), "fast");
+  EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(250));
+
+  ASSERT_EQ(slow.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  const auto res = slow.get();
+  EXPECT_EQ(res.body(), "slept");
+  // 协程结束后仍然运行后置拦截器
+  EXPECT_EQ(res["X-Post"], "done");
+}
+
+TEST_F(CoroutineTest, ExceptionsReachExceptionHandlers)
+{
+  auto future = co_get("/throw");
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  const auto res = future.get();
+  EXPECT_EQ(res.result(), http::status::internal_server_error);
+  EXPECT_NE(res.body().find("coroutine failed"), std::string::npos);
+}
+
+TEST_F(CoroutineTest, HandlersCanAwaitClientCalls)
+{
+  auto future = co_get("/fanout");
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  EXPECT_EQ(future.get().body(), "fast+slept");
+}
+
+#else
+
+TEST(CoroutineTest, RequiresCpp20)
+{
+  GTEST_SKIP() << "build with --//framework:cpp20 to enable the coroutine API";
+}
+
+#endif
@@ -0,0 +1,352 @@
+#include "gtest/gtest.h"
+#include "server.hpp"
+#include "test_server.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <nghttp2/nghttp2.h>
+#include <fstream>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace khttpd::framework;
+namespace http = boost::beast::http;
+
+namespace
+{
+  // HTTP2-Settings 请求头使用不带填充的 base64url
+  std::string base64url(const uint8_t* data, std::size_t size)
+  {
+    static constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    std::string out;
+    uint32_t bits = 0;
+    int count = 0;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      bits = (bits << 8) | data[i];
+      count += 8;
+      while (count >= 6)
+      {
+        count -= 6;
+        out += alphabet[(bits >> count) & 0x3f];
+      }
+    }
+    if (count > 0)
+    {
+      out += alphabet[(bits << (6 - count)) & 0x3f];
+    }
+    return out;
+  }
+
+  struct H2Response
+  {
+    int status = 0;
+    std::string body;
+    uint32_t error_code = 0;
+    bool closed = false;
+  };
+
+  // 基于 nghttp2 客户端会话的阻塞式 HTTP/2 客户端，只用于测试
+  class H2Client
+  {
+  public:
+    explicit H2Client(const tcp::endpoint& endpoint) : socket_(ioc_)
+    {
+      socket_.connect(endpoint);
+      nghttp2_session_callbacks* callbacks;
+      nghttp2_session_callbacks_new(&callbacks);
+      nghttp2_session_callbacks_set_on_header_callback(
+        callbacks, [](nghttp2_session*, const nghttp2_frame* frame, const uint8_t* name, size_t namelen,
+                      const uint8_t* value, size_t valuelen, uint8_t, void* user_data)
+        {
+          auto* self = static_cast<H2Client*>(user_data);
+          if (std::string_view(reinterpret_cast<const char*>(name), namelen) == ":status")
+          {
+            self->responses_[frame->hd.stream_id].status =
+              std::stoi(std::string(reinterpret_cast<const char*>(value), valuelen));
+          }
+          return 0;
+        });
+      nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
+        callbacks, [](nghttp2_session*, uint8_t, int32_t stream_id, const uint8_t* data, size_t len,
+                      void* user_data)
+        {
+          static_cast<H2Client*>(user_data)->responses_[stream_id].body.append(
+            reinterpret_cast<const char*>(data), len);
+          return 0;
+        });
+      nghttp2_session_callbacks_set_on_stream_close_callback(
+        callbacks, [](nghttp2_session*, int32_t stream_id, uint32_t error_code, void* user_data)
+        {
+          auto& response = static_cast<H2Client*>(user_data)->responses_[stream_id];
+          response.error_code = error_code;
+          response.closed = true;
+          return 0;
+        });
+      nghttp2_session_client_new(&session_, callbacks, this);
+      nghttp2_session_callbacks_del(callbacks);
+      // 连接前言之后必须紧跟客户端的 SETTINGS 帧
+      nghttp2_submit_settings(session_, NGHTTP2_FLAG_NONE, nullptr, 0);
+    }
+
+    ~H2Client()
+    {
+      nghttp2_session_del(session_);
+    }
+
+    // 不发送连接前言，直接以 HTTP/1.1 请求升级到 h2c，升级后的响应属于流 1
+    bool upgrade(const std::string& target)
+    {
+      nghttp2_settings_entry entry{NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100};
+      uint8_t payload[16];
+      const auto len = nghttp2_pack_settings_payload(payload, sizeof(payload), &entry, 1);
+      const std::string settings = base64url(payload, static_cast<std::size_t>(len));
+
+      net::write(socket_, net::buffer("GET " + target + " HTTP/1.1\r\nHost: localhost\r\n"
+                                      "Connection: Upgrade, HTTP2-Settings\r\nUpgrade: h2c\r\n"
+                                      "HTTP2-Settings: " + settings + "\r\n\r\n"));
+      http::response_parser<http::empty_body> parser;
+      http::read_header(socket_, buffer_, parser);
+      if (parser.get().result() != http::status::switching_protocols)
+      {
+        return false;
+      }
+      nghttp2_session_upgrade2(session_, payload, len, 0, nullptr);
+      return true;
+    }
+
+    int32_t get(const std::string& path)
+    {
+      return submit("GET", path, "");
+    }
+
+    int32_t submit(const std::string& method, const std::string& path, const std::string& body)
+    {
+      const std::string length = std::to_string(body.size());
+      std::vector<nghttp2_nv> headers{
+        make_nv(":method", method), make_nv(":scheme", "http"), make_nv(":authority", "localhost"),
+        make_nv(":path", path),
+      };
+      if (!body.empty())
+      {
+        headers.push_back(make_nv("content-length", length));
+      }
+      bodies_.push_back(body);
+      nghttp2_data_provider provider{};
+      provider.source.ptr = &bodies_.back();
+      provider.read_callback = [](nghttp2_session*, int32_t, uint8_t* buf, size_t length, uint32_t* data_flags,
+                                  nghttp2_data_source* source, void*) -> ssize_t
+      {
+        auto* remaining = static_cast<std::string*>(source->ptr);
+        const auto n = std::min(length, remaining->size());
+        std::copy_n(remaining->data(), n, buf);
+        remaining->erase(0, n);
+        if (remaining->empty())
+        {
+          *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+        }
+        return static_cast<ssize_t>(n);
+      };
+      return nghttp2_submit_request(session_, nullptr, headers.data(), headers.size(),
+                                    body.empty() ? nullptr : &provider, nullptr);
+    }
+
+    // 只发送请求头、不结束流，之后也不发送请求体
+    int32_t open(const std::string& method, const std::string& path)
+    {
+      const nghttp2_nv headers[] = {
+        make_nv(":method", method), make_nv(":scheme", "http"), make_nv(":authority", "localhost"),
+        make_nv(":path", path),
+      };
+      return nghttp2_submit_headers(session_, NGHTTP2_FLAG_NONE, -1, nullptr, headers, std::size(headers), nullptr);
+    }
+
+    // 收发帧，直到给出的流全部关闭
+    void wait(const std::vector<int32_t>& streams)
+    {
+      auto done = [&]
+      {
+        for (auto id : streams)
+        {
+          if (!responses_[id].closed)
+          {
+            return false;
+          }
+        }
+        return true;
+      };
+      flush();
+      while (!done())
+      {
+        if (buffer_.size() == 0)
+        {
+          buffer_.commit(socket_.read_some(buffer_.prepare(64 * 1024)));
+        }
+        const auto* data = static_cast<const uint8_t*>(buffer_.data().data());
+        nghttp2_session_mem_recv(session_, data, buffer_.size());
+        buffer_.consume(buffer_.size());
+        flush();
+      }
+    }
+
+    H2Response& response(int32_t stream_id)
+    {
+      return responses_[stream_id];
+    }
+
+  private:
+    net::io_context ioc_;
+    tcp::socket socket_;
+    boost::beast::flat_buffer buffer_;
+    nghttp2_session* session_ = nullptr;
+    std::map<int32_t, H2Response> responses_;
+    std::list<std::string> bodies_;
+
+    // nghttp2_submit_request 会复制请求头，name 与 value 只需在提交期间有效
+    static nghttp2_nv make_nv(std::string_view name, std::string_view value)
+    {
+      return {reinterpret_cast<uint8_t*>(const_cast<char*>(name.data())),
+              reinterpret_cast<uint8_t*>(const_cast<char*>(value.data())), name.size(), value.size(),
+              NGHTTP2_NV_FLAG_NONE};
+    }
+
+    void flush()
+    {
+      const uint8_t* data;
+      ssize_t len;
+      while ((len = nghttp2_session_mem_send(session_, &data)) > 0)
+      {
+        net::write(socket_, net::buffer(data, static_cast<std::size_t>(len)));
+      }
+    }
+  };
+}
+
+class Http2Test : public HttpServerTest
+{
+protected:
+  void SetUp() override
+  {
+    HttpServerTest::SetUp();
+    std::ofstream((root_ / "big.bin").string(), std::ios::binary) << std::string(1024 * 1024, 'b');
+  }
+
+  void start(ServerOptions options = {})
+  {
+    auto& router = create(std::move(options));
+    router.post("/small", [](HttpContext& ctx)
+    {
+      ctx.set_body(std::to_string(ctx.body_view().size()));
+    }, {1024, BodyMode::buffer});
+    // 异步 handler 在另一个线程上完成，期间同一连接上的其他流照常处理
+    router.get_async("/async/:id", [this](HttpContext& ctx, std::shared_ptr<ResponseHandle> response)
+    {
+      later([&ctx, response = std::move(response)]
+      {
+        ctx.set_body("async " + ctx.get_path_param("id").value_or(""));
+        response->complete();
+      }, std::chrono::milliseconds(200));
+    });
+    server_.run();
+  }
+};
+
+TEST_F(Http2Test, MultiplexesStreamsOnOneConnection)
+{
+  start();
+  H2Client client(server_.endpoint());
+  const auto echo = client.get("/echo/1");
+  const auto file = client.get("/big.bin");
+  const auto stream = client.get("/stream");
+  const auto missing = client.get("/missing");
+  client.wait({echo, file, stream, missing});
+
+  EXPECT_EQ(client.response(echo).body, "echo 1");
+  EXPECT_EQ(client.response(file).status, 200);
+  EXPECT_EQ(client.response(file).body.size(), 1024u * 1024u);
+  EXPECT_EQ(client.response(stream).body, "012");
+  EXPECT_EQ(client.response(missing).status, 404);
+
+  // 连接在流结束后保持可用
+  const auto again = client.get("/echo/2");
+  client.wait({again});
+  EXPECT_EQ(client.response(again).body, "echo 2");
+  EXPECT_EQ(server_->get_session_stats().http2_connections, 1u);
+  EXPECT_EQ(server_->get_session_stats().http2_streams, 5u);
+}
+
+TEST_F(Http2Test, UpgradesFromHttp11)
+{
+  start();
+  H2Client client(server_.endpoint());
+  ASSERT_TRUE(client.upgrade("/echo/up"));
+  const auto next = client.get("/echo/next");
+  client.wait({1, next});
+  EXPECT_EQ(client.response(1).body, "echo up");
+  EXPECT_EQ(client.response(next).body, "echo next");
+}
+
+TEST_F(Http2Test, AppliesRouteBodyLimit)
+{
+  start();
+  H2Client client(server_.endpoint());
+  const auto accepted = client.submit("POST", "/small", std::string(1000, 'x'));
+  const auto rejected = client.submit("POST", "/small", std::string(2000, 'x'));
+  client.wait({accepted, rejected});
+  EXPECT_EQ(client.response(accepted).body, "1000");
+  EXPECT_EQ(client.response(rejected).status, 413);
+}
+
+TEST_F(Http2Test, RefusesStreamsOverConcurrencyLimit)
+{
+  ServerOptions options;
+  options.session.http2.max_concurrent_streams = 2;
+  start(options);
+  H2Client client(server_.endpoint());
+  // 客户端还没有收到服务端的 SETTINGS，会一次发出全部请求
+  std::vector<int32_t> streams;
+  for (int i = 0; i < 4; ++i)
+  {
+    streams.push_back(client.get("/echo/" + std::to_string(i)));
+  }
+  client.wait(streams);
+  EXPECT_EQ(client.response(streams[0]).body, "echo 0");
+  EXPECT_EQ(client.response(streams[1]).body, "echo 1");
+  EXPECT_EQ(client.response(streams[3]).error_code, static_cast<uint32_t>(NGHTTP2_REFUSED_STREAM));
+}
+
+TEST_F(Http2Test, DeferredStreamDoesNotBlockOtherStreams)
+{
+  start();
+  H2Client client(server_.endpoint());
+  const auto deferred = client.get("/async/1");
+  const auto echo = client.get("/echo/2");
+  client.wait({echo});
+  EXPECT_EQ(client.response(echo).body, "echo 2");
+  EXPECT_FALSE(client.response(deferred).closed);
+
+  client.wait({deferred});
+  EXPECT_EQ(client.response(deferred).status, 200);
+  EXPECT_EQ(client.response(deferred).body, "async 1");
+}
+
+TEST_F(Http2Test, ResetsStreamWhenBodyReadTimesOut)
+{
+  ServerOptions options;
+  options.session.timeouts.body_read = std::chrono::milliseconds(200);
+  start(options);
+  H2Client client(server_.endpoint());
+  const auto stalled = client.open("POST", "/small");
+  client.wait({stalled});
+  EXPECT_EQ(client.response(stalled).error_code, static_cast<uint32_t>(NGHTTP2_CANCEL));
+  EXPECT_EQ(server_->get_session_stats().body_timeouts, 1u);
+
+  // 只重置这个流，连接上的其他请求照常处理
+  const auto echo = client.get("/echo/1");
+  client.wait({echo});
+  EXPECT_EQ(client.response(echo).body, "echo 1");
+}
@@ -0,0 +1,509 @@
+#include "gtest/gtest.h"
+#include "server.hpp"
+#include "test_server.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/filesystem.hpp>
+#include <fmt/core.h>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace khttpd::framework;
+namespace http = boost::beast::http;
+namespace fs = boost::filesystem;
+
+// 逐块读取请求体，读完后以 "字节数 块数" 响应
+struct BodyCounter : std::enable_shared_from_this<BodyCounter>
+{
+  BodyCounter(HttpContext& ctx, std::shared_ptr<BodyReader> reader) : ctx(ctx), reader(std::move(reader))
+  {
+  }
+
+  void read()
+  {
+    reader->read([self = shared_from_this()](boost::beast::error_code ec, std::string_view chunk)
+    {
+      self->on_chunk(ec, chunk);
+    });
+  }
+
+  void on_chunk(boost::beast::error_code ec, std::string_view chunk)
+  {
+    if (ec || chunk.empty())
+    {
+      ctx.set_body(ec ? ec.message() : fmt::format("{} {}", bytes, chunks));
+      reader->finish();
+      return;
+    }
+    bytes += chunk.size();
+    ++chunks;
+    read();
+  }
+
+  HttpContext& ctx;
+  std::shared_ptr<BodyReader> reader;
+  std::size_t bytes = 0;
+  std::size_t chunks = 0;
+};
+
+// 后置拦截器：用来确认异步 handler 完成后仍然运行
+class PostHeaderInterceptor : public Interceptor
+{
+public:
+  void handle_response(HttpContext& ctx) override
+  {
+    ctx.set_header("X-Post", "done");
+  }
+};
+
+class HttpSessionTest : public HttpServerTest
+{
+protected:
+  void SetUp() override
+  {
+    HttpServerTest::SetUp();
+    std::ofstream((root_ / "hello.txt").string(), std::ios::binary) << "static hello";
+  }
+
+  void start(ServerOptions options = {})
+  {
+    auto& router = create(std::move(options));
+    router.post("/upload", [](HttpContext& ctx)
+    {
+      const auto* files = ctx.get_uploaded_files("upload");
+      if (!files || files->size() != 1)
+      {
+        ctx.set_status(http::status::bad_request);
+        return;
+      }
+      const MultipartFile& file = files->front();
+      std::ifstream in(file.path, std::ios::binary);
+      const std::string content{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+      ctx.set_body(fmt::format("{} {} {} {}", ctx.get_multipart_field("title").value_or(""),
+                               file.in_memory() ? "memory" : "disk", file.size, content.size()));
+    });
+    // 流式读取请求体：统计收到的字节数与块数；X-Reject 请求头演示只根据请求头拒绝请求
+    RouteOptions ingest;
+    ingest.body_limit = 8 * 1024 * 1024;
+    ingest.body_mode = BodyMode::stream;
+    router.post("/ingest", [](HttpContext& ctx)
+    {
+      if (ctx.get_header("X-Reject"))
+      {
+        ctx.set_status(http::status::forbidden);
+        return;
+      }
+      ctx.read_body([&ctx](std::shared_ptr<BodyReader> reader)
+      {
+        std::make_shared<BodyCounter>(ctx, std::move(reader))->read();
+      });
+    }, ingest);
+    router.post("/small", [](HttpContext& ctx)
+    {
+      ctx.set_body(std::to_string(ctx.body_view().size()));
+    }, {1024, BodyMode::buffer});
+    // 异步 handler：在其他线程上等待一段时间后完成或失败
+    router.get_async("/async/:id", [this](HttpContext& ctx, std::shared_ptr<ResponseHandle> response)
+    {
+      later([&ctx, response = std::move(response)]
+      {
+        ctx.set_body("async " + ctx.get_path_param("id").value_or(""));
+        response->complete();
+      });
+    });
+    router.get_async("/async-fail", [this](HttpContext&, std::shared_ptr<ResponseHandle> response)
+    {
+      later([response = std::move(response)]
+      {
+        response->fail(std::make_exception_ptr(std::runtime_error("upstream failed")));
+      });
+    });
+    router.get_async("/async-dropped", [](HttpContext& ctx, std::shared_ptr<ResponseHandle>)
+    {
+      ctx.set_body("dropped");
+    });
+    auto exceptions = std::make_shared<ExceptionDispatcher>();
+    exceptions->on<std::runtime_error>([](const std::runtime_error& e, HttpContext& ctx)
+    {
+      ctx.set_status(http::status::bad_gateway);
+      ctx.set_body(e.what());
+    });
+    router.add_exception_handler(exceptions);
+    server_->add_interceptor(std::make_shared<PostHeaderInterceptor>());
+    router.post("/length", [](HttpContext& ctx)
+    {
+      ctx.set_body(std::to_string(ctx.body_view().size()));
+    });
+    // 远大于内核收发缓冲区的响应，客户端不读取时服务端的写操作会停住
+    router.get("/big", [](HttpContext& ctx)
+    {
+      ctx.set_body(std::string(32 * 1024 * 1024, 'x'));
+    });
+    server_.run();
+  }
+
+  // 一次写出所有请求，再按顺序读回响应
+  std::vector<http::response<http::string_body>> pipeline(const std::vector<std::string>& targets)
+  {
+    net::io_context ioc;
+    tcp::socket socket(ioc);
+    socket.connect(server_.endpoint());
+
+    std::string requests;
+    for (const auto& target : targets)
+    {
+      requests += "GET " + target + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    }
+    net::write(socket, net::buffer(requests));
+
+    std::vector<http::response<http::string_body>> responses;
+    boost::beast::flat_buffer buffer;
+    for (std::size_t i = 0; i < targets.size(); ++i)
+    {
+      http::response<http::string_body> res;
+      http::read(socket, buffer, res);
+      responses.push_back(std::move(res));
+    }
+    return responses;
+  }
+};
+
+TEST_F(HttpSessionTest, AnswersPipelinedRequestsInOrder)
+{
+  start();
+  const auto responses = pipeline({"/echo/1", "/echo/2", "/hello.txt", "/missing", "/echo/3"});
+  ASSERT_EQ(responses.size(), 5u);
+  EXPECT_EQ(responses[0].body(), "echo 1");
+  EXPECT_EQ(responses[1].body(), "echo 2");
+  EXPECT_EQ(responses[2].body(), "static hello");
+  EXPECT_EQ(responses[3].result(), http::status::not_found);
+  EXPECT_EQ(responses[4].body(), "echo 3");
+  EXPECT_GE(server_->get_session_stats().pipelined_requests, 1u);
+}
+
+TEST_F(HttpSessionTest, StreamingResponseWaitsForEarlierPipelinedResponses)
+{
+  start();
+  const auto responses = pipeline({"/echo/a", "/stream", "/echo/b"});
+  ASSERT_EQ(responses.size(), 3u);
+  EXPECT_EQ(responses[0].body(), "echo a");
+  EXPECT_EQ(responses[1].body(), "012");
+  EXPECT_EQ(responses[2].body(), "echo b");
+}
+
+TEST_F(HttpSessionTest, PipeliningCanBeDisabled)
+{
+  ServerOptions options;
+  options.session.max_pipelined_requests = 1;
+  start(options);
+  const auto responses = pipeline({"/echo/1", "/echo/2", "/echo/3"});
+  ASSERT_EQ(responses.size(), 3u);
+  EXPECT_EQ(responses[2].body(), "echo 3");
+  EXPECT_EQ(server_->get_session_stats().pipelined_requests, 0u);
+  EXPECT_EQ(server_->get_session_stats().gathered_writes, 0u);
+}
+
+namespace
+{
+  std::string upload_request(std::size_t file_size)
+  {
+    const std::string boundary = "khttpd-test-boundary";
+    const std::string body = "--" + boundary + "\r\n"
+      "Content-Disposition: form-data; name=\"title\"\r\n\r\n"
+      "report\r\n"
+      "--" + boundary + "\r\n"
+      "Content-Disposition: form-data; name=\"upload\"; filename=\"data.bin\"\r\n\r\n" +
+      std::string(file_size, 'x') + "\r\n"
+      "--" + boundary + "--\r\n";
+    return "POST /upload HTTP/1.1\r\nHost: localhost\r\n"
+      "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n"
+      "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+  }
+
+  http::response<http::string_body> send_raw(const tcp::endpoint& endpoint, const std::string& request)
+  {
+    net::io_context ioc;
+    tcp::socket socket(ioc);
+    socket.connect(endpoint);
+    boost::system::error_code ec;
+    net::write(socket, net::buffer(request), ec);
+
+    boost::beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(socket, buffer, res, ec);
+    return res;
+  }
+}
+
+TEST_F(HttpSessionTest, StreamsMultipartUploadsToTemporaryFiles)
+{
+  ServerOptions options;
+  options.session.multipart.memory_threshold = 4096;
+  options.session.multipart.temp_directory = root_.string();
+  start(options);
+
+  const auto res = send_raw(server_.endpoint(), upload_request(10 * 1024 * 1024));
+  EXPECT_EQ(res.result(), http::status::ok);
+  EXPECT_EQ(res.body(), "report disk 10485760 10485760");
+
+  // 响应写完后上下文被释放，临时文件随之删除
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  std::size_t uploads = 0;
+  for (const auto& entry : fs::directory_iterator(root_))
+  {
+    uploads += entry.path().filename().string().rfind("khttpd-upload-", 0) == 0;
+  }
+  EXPECT_EQ(uploads, 0u);
+}
+
+TEST_F(HttpSessionTest, RejectsOversizedUploads)
+{
+  ServerOptions options;
+  options.session.multipart.max_file_size = 64 * 1024;
+  start(options);
+
+  const auto res = send_raw(server_.endpoint(), upload_request(256 * 1024));
+  EXPECT_EQ(res.result(), http::status::payload_too_large);
+  EXPECT_FALSE(res.keep_alive());
+}
+
+namespace
+{
+  std::string post_request(const std::string& target, std::size_t size, const std::string& extra_headers = "")
+  {
+    return "POST " + target + " HTTP/1.1\r\nHost: localhost\r\n" + extra_headers +
+      "Content-Length: " + std::to_string(size) + "\r\n\r\n" + std::string(size, 'x');
+  }
+}
+
+TEST_F(HttpSessionTest, StreamsRequestBodyToHandler)
+{
+  ServerOptions options;
+  options.session.body_chunk_size = 64 * 1024;
+  start(options);
+
+  // 超过默认 body_limit，但在路由的 8 MiB 之内
+  const std::size_t size = 5 * 1024 * 1024;
+  const auto res = send_raw(server_.endpoint(), post_request("/ingest", size));
+  EXPECT_EQ(res.result(), http::status::ok);
+  const auto separator = res.body().find(' ');
+  ASSERT_NE(separator, std::string::npos);
+  EXPECT_EQ(res.body().substr(0, separator), std::to_string(size));
+  EXPECT_GE(std::stoul(res.body().substr(separator + 1)), size / options.session.body_chunk_size);
+  EXPECT_TRUE(res.keep_alive());
+}
+
+TEST_F(HttpSessionTest, StreamedRequestsCanBeRejectedFromHeaders)
+{
+  start();
+  const auto rejected = send_raw(server_.endpoint(), post_request("/ingest", 1024 * 1024, "X-Reject: 1\r\n"));
+  EXPECT_EQ(rejected.result(), http::status::forbidden);
+  EXPECT_FALSE(rejected.keep_alive());
+
+  // Content-Length 超出路由的 body_limit 时不调用 handler
+  const auto too_large = send_raw(server_.endpoint(), post_request("/ingest", 9 * 1024 * 1024));
+  EXPECT_EQ(too_large.result(), http::status::payload_too_large);
+  EXPECT_FALSE(too_large.keep_alive());
+}
+
+TEST_F(HttpSessionTest, AppliesRouteBodyLimit)
+{
+  start();
+  const auto accepted = send_raw(server_.endpoint(), post_request("/small", 1000));
+  EXPECT_EQ(accepted.body(), "1000");
+
+  const auto rejected = send_raw(server_.endpoint(), post_request("/small", 2000));
+  EXPECT_EQ(rejected.result(), http::status::payload_too_large);
+
+  // 流水线中的请求同样在读完请求头后检查：前一个响应照常返回，超出限制的请求得到 413
+  net::io_context ioc;
+  tcp::socket socket(ioc);
+  socket.connect(server_.endpoint());
+  net::write(socket, net::buffer("GET /echo/1 HTTP/1.1\r\nHost: localhost\r\n\r\n" + post_request("/small", 2000)));
+  boost::beast::flat_buffer buffer;
+  http::response<http::string_body> first;
+  http::response<http::string_body> second;
+  http::read(socket, buffer, first);
+  http::read(socket, buffer, second);
+  EXPECT_EQ(first.body(), "echo 1");
+  EXPECT_EQ(second.result(), http::status::payload_too_large);
+}
+
+TEST_F(HttpSessionTest, AsyncHandlerCompletesFromAnotherThread)
+{
+  start();
+  auto pending = std::async(std::launch::async, [this] { return pipeline({"/async/1"}); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // 唯一的工作线程没有被挂起的请求占用
+  const auto started = std::chrono::steady_clock::now();
+  const auto other = pipeline({"/echo/2"});
+  EXPECT_EQ(other[0].body(), "echo 2");
+  EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(200));
+
+  const auto responses = pending.get();
+  EXPECT_EQ(responses[0].body(), "async 1");
+  EXPECT_EQ(responses[0]["X-Post"], "done");
+}
+
+TEST_F(HttpSessionTest, PipelinedRequestsWaitForDeferredResponse)
+{
+  start();
+  const auto responses = pipeline({"/echo/1", "/async/2", "/echo/3"});
+  ASSERT_EQ(responses.size(), 3u);
+  EXPECT_EQ(responses[0].body(), "echo 1");
+  EXPECT_EQ(responses[1].body(), "async 2");
+  EXPECT_EQ(responses[2].body(), "echo 3");
+}
+
+TEST_F(HttpSessionTest, AsyncHandlerFailuresReachExceptionHandlers)
+{
+  start();
+  const auto responses = pipeline({"/async-fail", "/echo/1"});
+  EXPECT_EQ(responses[0].result(), http::status::bad_gateway);
+  EXPECT_EQ(responses[0].body(), "upstream failed");
+  EXPECT_EQ(responses[1].body(), "echo 1");
+}
+
+TEST_F(HttpSessionTest, DroppedResponseHandleCompletesResponse)
+{
+  start();
+  const auto responses = pipeline({"/async-dropped"});
+  EXPECT_EQ(responses[0].body(), "dropped");
+  EXPECT_EQ(responses[0]["X-Post"], "done");
+}
+
+namespace
+{
+  // 轮询等待条件成立，最多 3 秒
+  bool eventually(const std::function<bool()>& condition)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    while (!condition())
+    {
+      if (std::chrono::steady_clock::now() > deadline)
+      {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+  }
+
+  // 服务端因超时关闭连接后，客户端的读取以错误结束而不是读到响应
+  bool closed_by_peer(tcp::socket& socket)
+  {
+    char byte;
+    boost::system::error_code ec;
+    socket.read_some(net::buffer(&byte, 1), ec);
+    return ec == net::error::eof || ec == net::error::connection_reset;
+  }
+}
+
+TEST_F(HttpSessionTest, IdleTimeoutClosesKeepAliveConnection)
+{
+  ServerOptions options;
+  options.session.timeouts.keep_alive_idle = std::chrono::milliseconds(200);
+  start(options);
+
+  net::io_context ioc;
+  tcp::socket socket(ioc);
+  socket.connect(server_.endpoint());
+  net::write(socket, net::buffer(std::string("GET /echo/1 HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+  boost::beast::flat_buffer buffer;
+  http::response<http::string_body> res;
+  http::read(socket, buffer, res);
+  EXPECT_EQ(res.body(), "echo 1");
+
+  const auto& stats = server_->get_session_stats();
+  EXPECT_TRUE(eventually([&] { return stats.idle_timeouts == 1; }));
+  EXPECT_TRUE(closed_by_peer(socket));
+  EXPECT_EQ(stats.header_timeouts, 0u);
+}
+
+TEST_F(HttpSessionTest, HeaderTimeoutClosesSlowRequest)
+{
+  ServerOptions options;
+  options.session.timeouts.header_read = std::chrono::milliseconds(200);
+  start(options);
+
+  net::io_context ioc;
+  tcp::socket socket(ioc);
+  socket.connect(server_.endpoint());
+  // 请求头没有以空行结束
+  net::write(socket, net::buffer(std::string("GET /echo/1 HTTP/1.1\r\nHost: localhost\r\n")));
+
+  const auto& stats = server_->get_session_stats();
+  EXPECT_TRUE(eventually([&] { return stats.header_timeouts == 1; }));
+  EXPECT_TRUE(closed_by_peer(socket));
+  EXPECT_EQ(stats.idle_timeouts, 0u);
+}
+
+TEST_F(HttpSessionTest, HeaderTimeoutCoversTrickledPreface)
+{
+  ServerOptions options;
+  options.session.timeouts.header_read = std::chrono::milliseconds(300);
+  start(options);
+
+  net::io_context ioc;
+  tcp::socket socket(ioc);
+  socket.connect(server_.endpoint());
+  // HTTP/2 连接前言每 50ms 发送一个字节，共约 1.2 秒，单次间隔都在 header_read 之内
+  const std::string preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r";
+  for (const char byte : preface)
+  {
+    boost::system::error_code ec;
+    net::write(socket, net::buffer(&byte, 1), ec);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  const auto& stats = server_->get_session_stats();
+  EXPECT_EQ(stats.header_timeouts, 1u);
+  EXPECT_TRUE(closed_by_peer(socket));
+}
+
+TEST_F(HttpSessionTest, BodyTimeoutClosesSlowUpload)
+{
+  ServerOptions options;
+  options.session.timeouts.body_read = std::chrono::milliseconds(200);
+  start(options);
+
+  net::io_context ioc;
+  tcp::socket socket(ioc);
+  socket.connect(server_.endpoint());
+  // 声明 100 字节的请求体，只发送 10 字节
+  net::write(socket, net::buffer("POST /length HTTP/1.1\r\nHost: localhost\r\nContent-Length: 100\r\n\r\n" +
+                                 std::string(10, 'x')));
+
+  const auto& stats = server_->get_session_stats();
+  EXPECT_TRUE(eventually([&] { return stats.body_timeouts == 1; }));
+  EXPECT_TRUE(closed_by_peer(socket));
+  EXPECT_EQ(stats.header_timeouts, 0u);
+}
+
+TEST_F(HttpSessionTest, WriteTimeoutClosesClientThatStopsReading)
+{
+  ServerOptions options;
+  options.session.timeouts.write = std::chrono::milliseconds(200);
+  start(options);
+
+  net::io_context ioc;
+  tcp::socket socket(ioc);
+  socket.open(tcp::v4());
+  socket.set_option(net::socket_base::receive_buffer_size(4096));
+  socket.connect(server_.endpoint());
+  net::write(socket, net::buffer(std::string("GET /big HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+
+  // 不读取响应，服务端的写操作在内核缓冲区写满后停住，超时后关闭连接
+  const auto& stats = server_->get_session_stats();
+  EXPECT_TRUE(eventually([&] { return stats.write_timeouts == 1; }));
+  EXPECT_EQ(stats.idle_timeouts, 0u);
+}
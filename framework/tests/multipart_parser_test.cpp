@@ -0,0 +1,223 @@
+#include "gtest/gtest.h"
+#include "context/multipart_parser.hpp"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace khttpd::framework;
+namespace fs = boost::filesystem;
+
+namespace
+{
+  const std::string boundary = "----khttpdBoundary7MA4YWxk";
+
+  std::string make_body(const std::string& file_content)
+  {
+    return "preamble is ignored\r\n"
+      "--" + boundary + "\r\n"
+      "Content-Disposition: form-data; name=\"title\"\r\n\r\n"
+      "hello\r\nworld\r\n"
+      "--" + boundary + "  \r\n"
+      "Content-Disposition: form-data; name=\"upload\"; filename=\"a \\\"b\\\".bin\"\r\n"
+      "Content-Type: application/octet-stream\r\n\r\n" +
+      file_content + "\r\n"
+      "--" + boundary + "\r\n"
+      "Content-Disposition: form-data; name=\"empty\"\r\n\r\n"
+      "\r\n"
+      "--" + boundary + "--\r\n"
+      "epilogue is ignored";
+  }
+
+  // 内容里夹杂类似分隔符的片段，检验分块边界处的匹配
+  std::string sample_content(std::size_t size)
+  {
+    std::string content;
+    while (content.size() < size)
+    {
+      content += "\r\n--" + boundary.substr(0, 10) + " data \r\n-";
+    }
+    content.resize(size);
+    return content;
+  }
+
+  std::string read_file(const std::string& path)
+  {
+    std::ifstream in(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+  }
+}
+
+TEST(MultipartParserTest, ExtractsBoundary)
+{
+  EXPECT_EQ(multipart_boundary("multipart/form-data; boundary=abc"), "abc");
+  EXPECT_EQ(multipart_boundary("Multipart/Form-Data; charset=utf-8; boundary=\"a b;c\""), "a b;c");
+  EXPECT_EQ(multipart_boundary("multipart/form-data; boundary=abc; foo=bar"), "abc");
+  EXPECT_EQ(multipart_boundary("multipart/form-data"), std::nullopt);
+  EXPECT_EQ(multipart_boundary("multipart/mixed; boundary=abc"), std::nullopt);
+  EXPECT_EQ(multipart_boundary("application/json"), std::nullopt);
+}
+
+TEST(MultipartParserTest, SameResultForAnyChunking)
+{
+  const std::string content = sample_content(3000);
+  const std::string body = make_body(content);
+  MultipartOptions options;
+
+  for (const std::size_t chunk : {body.size(), std::size_t(1), std::size_t(7), std::size_t(64)})
+  {
+    MultipartParser parser(boundary, options);
+    for (std::size_t offset = 0; offset < body.size(); offset += chunk)
+    {
+      ASSERT_TRUE(parser.feed(std::string_view(body).substr(offset, chunk))) << parser.error_message();
+    }
+    ASSERT_TRUE(parser.finish()) << parser.error_message();
+
+    const MultipartFormData data = parser.release();
+    ASSERT_EQ(data.fields.size(), 2u) << "chunk " << chunk;
+    EXPECT_EQ(data.fields[0].first, "title");
+    EXPECT_EQ(data.fields[0].second, "hello\r\nworld");
+    EXPECT_EQ(data.fields[1].first, "empty");
+    EXPECT_EQ(data.fields[1].second, "");
+    ASSERT_EQ(data.files.size(), 1u);
+    const MultipartFile& file = data.files[0].second;
+    EXPECT_EQ(data.files[0].first, "upload");
+    EXPECT_EQ(file.filename, "a \"b\".bin");
+    EXPECT_EQ(file.content_type, "application/octet-stream");
+    EXPECT_TRUE(file.in_memory());
+    EXPECT_EQ(file.size, content.size());
+    EXPECT_EQ(file.data, content);
+  }
+}
+
+TEST(MultipartParserTest, SpillsLargeFilesToTemporaryFiles)
+{
+  const std::string content = sample_content(200 * 1024);
+  const std::string body = make_body(content);
+  MultipartOptions options;
+  options.memory_threshold = 16 * 1024;
+
+  std::string temp_path;
+  {
+    MultipartParser parser(boundary, options);
+    for (std::size_t offset = 0; offset < body.size(); offset += 4096)
+    {
+      ASSERT_TRUE(parser.feed(std::string_view(body).substr(offset, 4096))) << parser.error_message();
+    }
+    ASSERT_TRUE(parser.finish());
+
+    const MultipartFormData data = parser.release();
+    ASSERT_EQ(data.files.size(), 1u);
+    const MultipartFile& file = data.files[0].second;
+    EXPECT_FALSE(file.in_memory());
+    EXPECT_TRUE(file.data.empty());
+    EXPECT_EQ(file.size, content.size());
+    temp_path = file.path;
+    EXPECT_EQ(read_file(temp_path), content);
+  }
+  // 最后一个持有者析构后临时文件被删除
+  EXPECT_FALSE(fs::exists(temp_path));
+}
+
+TEST(MultipartParserTest, SaveAsMovesTheTemporaryFile)
+{
+  const std::string content = sample_content(100 * 1024);
+  MultipartOptions options;
+  options.memory_threshold = 1024;
+  const fs::path destination = fs::temp_directory_path() / fs::unique_path("khttpd-saved-%%%%-%%%%");
+
+  {
+    MultipartParser parser(boundary, options);
+    ASSERT_TRUE(parser.feed(make_body(content)));
+    ASSERT_TRUE(parser.finish());
+    const MultipartFormData data = parser.release();
+    ASSERT_TRUE(data.files[0].second.save_as(destination.string()));
+    EXPECT_FALSE(fs::exists(data.files[0].second.path));
+  }
+  EXPECT_EQ(read_file(destination.string()), content);
+  fs::remove(destination);
+}
+
+TEST(MultipartParserTest, EnforcesLimits)
+{
+  const std::string body = make_body(sample_content(10 * 1024));
+
+  MultipartOptions file_limit;
+  file_limit.max_file_size = 4096;
+  MultipartParser file_parser(boundary, file_limit);
+  EXPECT_FALSE(file_parser.feed(body));
+  EXPECT_EQ(file_parser.error(), MultipartParser::Error::too_large);
+
+  MultipartOptions total_limit;
+  total_limit.max_total_size = body.size() - 1;
+  MultipartParser total_parser(boundary, total_limit);
+  EXPECT_FALSE(total_parser.feed(body));
+  EXPECT_EQ(total_parser.error(), MultipartParser::Error::too_large);
+
+  MultipartOptions part_limit;
+  part_limit.max_parts = 2;
+  MultipartParser part_parser(boundary, part_limit);
+  EXPECT_FALSE(part_parser.feed(body));
+  EXPECT_EQ(part_parser.error(), MultipartParser::Error::too_large);
+
+  MultipartOptions field_limit;
+  field_limit.max_field_size = 4;
+  MultipartParser field_parser(boundary, field_limit);
+  EXPECT_FALSE(field_parser.feed(body));
+  EXPECT_EQ(field_parser.error(), MultipartParser::Error::too_large);
+}
+
+TEST(MultipartParserTest, RejectsTruncatedBodies)
+{
+  const std::string body = make_body("data");
+  MultipartOptions options;
+  MultipartParser parser(boundary, options);
+  ASSERT_TRUE(parser.feed(std::string_view(body).substr(0, body.size() / 2)));
+  EXPECT_FALSE(parser.finish());
+  EXPECT_EQ(parser.error(), MultipartParser::Error::malformed);
+}
+
+TEST(MultipartParserTest, StreamsFilesToSink)
+{
+  class StringSink : public MultipartSink
+  {
+  public:
+    explicit StringSink(std::string& out) : out_(out)
+    {
+    }
+
+    bool write(std::string_view data) override
+    {
+      out_.append(data);
+      return true;
+    }
+
+    bool finish(MultipartFile& file) override
+    {
+      file.path = "memory://" + file.filename;
+      return true;
+    }
+
+  private:
+    std::string& out_;
+  };
+
+  const std::string content = sample_content(50 * 1024);
+  std::string received;
+  MultipartOptions options;
+  options.memory_threshold = 1024;
+  options.file_sink = [&received](const MultipartPartInfo& part) -> std::unique_ptr<MultipartSink>
+  {
+    EXPECT_EQ(part.name, "upload");
+    return std::make_unique<StringSink>(received);
+  };
+
+  MultipartParser parser(boundary, options);
+  ASSERT_TRUE(parser.feed(make_body(content)));
+  ASSERT_TRUE(parser.finish());
+  const MultipartFormData data = parser.release();
+  EXPECT_EQ(received, content);
+  EXPECT_EQ(data.files[0].second.size, content.size());
+  EXPECT_EQ(data.files[0].second.path, "memory://a \"b\".bin");
+  EXPECT_FALSE(data.files[0].second.temp_file);
+}
@@ -4,6 +4,7 @@
 #include "framework/context/websocket_context.hpp"
 #include "framework/exception/exception_handler.hpp" // Added
 #include <gtest/gtest.h>
+#include <fmt/core.h>
 #include <boost/beast/http/empty_body.hpp>
 #include <boost/beast/core/error.hpp> // For boost::beast::error_code
 #include <boost/asio/io_context.hpp>
@@ -209,6 +210,193 @@ TEST(HttpRouterTest, LastPathParamAllowsSlashes)
 }
 
 
+TEST(HttpRouterTest, StaticSegmentBeatsParamAtAnyDepth)
+{
+  khttpd_fw::HttpRouter router;
+  TestHandlerData data;
+
+  router.get("/users/:id/posts", [&](khttpd_fw::HttpContext& ctx)
+  {
+    data.called = true;
+    data.path_param_value = "param:" + ctx.get_path_param("id").value_or("");
+  });
+  router.get("/users/me/posts", [&](khttpd_fw::HttpContext& ctx)
+  {
+    data.called = true;
+    data.path_param_value = "static";
+  });
+  router.get("/users/me/settings", [&](khttpd_fw::HttpContext& ctx)
+  {
+    data.called = true;
+    data.path_param_value = "settings";
+  });
+
+  http::request<http::string_body> req = make_request(http::verb::get, "/users/me/posts");
+  http::response<http::string_body> res;
+  auto ctx = create_http_context(req, res);
+  router.dispatch(ctx);
+  ASSERT_TRUE(data.called);
+  ASSERT_EQ(data.path_param_value, "static");
+
+  // "me" 的静态子树中没有 "likes"，需要回退到 :id 分支
+  reset_handler_data(data);
+  router.get("/users/:id/likes", [&](khttpd_fw::HttpContext& ctx)
+  {
+    data.called = true;
+    data.path_param_value = "likes:" + ctx.get_path_param("id").value_or("");
+  });
+  req = make_request(http::verb::get, "/users/me/likes");
+  res = {};
+  auto ctx2 = create_http_context(req, res);
+  router.dispatch(ctx2);
+  ASSERT_TRUE(data.called);
+  ASSERT_EQ(data.path_param_value, "likes:me");
+}
+
+TEST(HttpRouterTest, TrailingSlashAndEmptySegments)
+{
+  khttpd_fw::HttpRouter router;
+  TestHandlerData data;
+
+  router.get("/users", [&](khttpd_fw::HttpContext& ctx)
+  {
+    data.called = true;
+  });
+  router.get("/users/:id", [&](khttpd_fw::HttpContext& ctx)
+  {
+    data.called = true;
+    data.path_param_value = ctx.get_path_param("id").value_or("<none>");
+  });
+
+  // 与正则实现一致：最后一个参数可以匹配空串
+  http::request<http::string_body> req = make_request(http::verb::get, "/users/");
+  http::response<http::string_body> res;
+  auto ctx = create_http_context(req, res);
+  router.dispatch(ctx);
+  ASSERT_TRUE(data.called);
+  ASSERT_EQ(data.path_param_value, "");
+
+  reset_handler_data(data);
+  req = make_request(http::verb::get, "/user");
+  res = {};
+  auto ctx2 = create_http_context(req, res);
+  router.dispatch(ctx2);
+  ASSERT_FALSE(data.called);
+  ASSERT_EQ(ctx2.get_response().result(), http::status::not_found);
+}
+
+TEST(HttpRouterTest, EmbeddedParamFallsBackToRegex)
+{
+  khttpd_fw::HttpRouter router;
+  TestHandlerData data;
+
+  router.get("/download/file-:name.txt", [&](khttpd_fw::HttpContext& ctx)
+  {
+    data.called = true;
+    data.path_param_value = ctx.get_path_param("name").value_or("");
+  });
+
+  http::request<http::string_body> req = make_request(http::verb::get, "/download/file-report.txt");
+  http::response<http::string_body> res;
+  auto ctx = create_http_context(req, res);
+  router.dispatch(ctx);
+  ASSERT_TRUE(data.called);
+  ASSERT_EQ(data.path_param_value, "report");
+}
+
+TEST(HttpRouterTest, MoreSpecificRegexRouteBeatsTreeRoute)
+{
+  khttpd_fw::HttpRouter router;
+  std::string hit;
+
+  router.get("/download/:file", [&](khttpd_fw::HttpContext& ctx)
+  {
+    hit = "tree:" + ctx.get_path_param("file").value_or("");
+  });
+  router.get("/download/file-:name.txt", [&](khttpd_fw::HttpContext& ctx)
+  {
+    hit = "regex:" + ctx.get_path_param("name").value_or("");
+  }, {2048, khttpd_fw::BodyMode::buffer});
+
+  // 正则路由有三个字面段，比前缀树中的 "/download/:file" 更具体
+  http::request<http::string_body> req = make_request(http::verb::get, "/download/file-report.txt");
+  http::response<http::string_body> res;
+  auto ctx = create_http_context(req, res);
+  router.dispatch(ctx);
+  EXPECT_EQ(hit, "regex:report");
+  const auto* options = router.find_route_options(http::verb::get, "/download/file-report.txt");
+  ASSERT_NE(options, nullptr);
+  EXPECT_EQ(options->body_limit, 2048u);
+
+  // 正则路由不匹配时仍由前缀树中的路由处理
+  req = make_request(http::verb::get, "/download/image.png");
+  res = {};
+  auto ctx2 = create_http_context(req, res);
+  router.dispatch(ctx2);
+  EXPECT_EQ(hit, "tree:image.png");
+  options = router.find_route_options(http::verb::get, "/download/image.png");
+  ASSERT_NE(options, nullptr);
+  EXPECT_FALSE(options->body_limit);
+
+  // 更具体的正则路由不接受该方法时（GET 可能由静态文件处理）回到前缀树中的路由
+  hit.clear();
+  router.post("/upload/file-:name.txt", [&](khttpd_fw::HttpContext&) { hit = "regex post"; });
+  router.get("/upload/:file", [&](khttpd_fw::HttpContext&) { hit = "tree get"; });
+  req = make_request(http::verb::get, "/upload/file-a.txt");
+  res = {};
+  auto ctx3 = create_http_context(req, res);
+  router.dispatch(ctx3);
+  EXPECT_EQ(hit, "tree get");
+}
+
+TEST(HttpRouterTest, MostSpecificTreeRouteWinsAcrossBranches)
+{
+  khttpd_fw::HttpRouter router;
+  std::string hit;
+
+  // 末尾参数可以匹配 "profile/edit"，但另一个分支上的路由有两个字面段，更具体
+  router.get("/users/:rest", [&](khttpd_fw::HttpContext& ctx)
+  {
+    hit = "rest:" + ctx.get_path_param("rest").value_or("");
+  });
+  router.get("/:kind/profile/edit", [&](khttpd_fw::HttpContext& ctx)
+  {
+    hit = "edit:" + ctx.get_path_param("kind").value_or("");
+  });
+
+  http::request<http::string_body> req = make_request(http::verb::get, "/users/profile/edit");
+  http::response<http::string_body> res;
+  auto ctx = create_http_context(req, res);
+  router.dispatch(ctx);
+  EXPECT_EQ(hit, "edit:users");
+
+  req = make_request(http::verb::get, "/users/profile/view");
+  res = {};
+  auto ctx2 = create_http_context(req, res);
+  router.dispatch(ctx2);
+  EXPECT_EQ(hit, "rest:profile/view");
+}
+
+TEST(HttpRouterTest, ManyRoutes)
+{
+  khttpd_fw::HttpRouter router;
+  std::string hit;
+
+  for (int i = 0; i < 300; ++i)
+  {
+    router.get(fmt::format("/api/v1/resource{}/:id", i), [&hit, i](khttpd_fw::HttpContext& ctx)
+    {
+      hit = fmt::format("{}:{}", i, ctx.get_path_param("id").value_or(""));
+    });
+  }
+
+  http::request<http::string_body> req = make_request(http::verb::get, "/api/v1/resource257/abc");
+  http::response<http::string_body> res;
+  auto ctx = create_http_context(req, res);
+  router.dispatch(ctx);
+  ASSERT_EQ(hit, "257:abc");
+}
+
 TEST(HttpRouterTest, MethodNotAllowed)
 {
   khttpd_fw::HttpRouter router;
@@ -238,6 +426,42 @@ TEST(HttpRouterTest, MethodNotAllowed)
   ASSERT_FALSE(allow_header.find("PUT") != std::string::npos);
 }
 
+TEST(HttpRouterTest, FindRouteOptions)
+{
+  khttpd_fw::HttpRouter router;
+  khttpd_fw::RouteOptions ingest;
+  ingest.body_limit = 64 * 1024 * 1024;
+  ingest.body_mode = khttpd_fw::BodyMode::stream;
+
+  router.post("/ingest/:stream", [](khttpd_fw::HttpContext&)
+  {
+  }, ingest);
+  router.get("/ingest/:stream", [](khttpd_fw::HttpContext&)
+  {
+  });
+  router.put("/files/file-:name.bin", [](khttpd_fw::HttpContext&)
+  {
+  }, {1024, khttpd_fw::BodyMode::buffer});
+
+  const auto* options = router.find_route_options(http::verb::post, "/ingest/events");
+  ASSERT_NE(options, nullptr);
+  EXPECT_EQ(options->body_limit, 64u * 1024 * 1024);
+  EXPECT_EQ(options->body_mode, khttpd_fw::BodyMode::stream);
+
+  options = router.find_route_options(http::verb::get, "/ingest/events");
+  ASSERT_NE(options, nullptr);
+  EXPECT_FALSE(options->body_limit);
+  EXPECT_EQ(options->body_mode, khttpd_fw::BodyMode::buffer);
+
+  options = router.find_route_options(http::verb::put, "/files/file-a.bin");
+  ASSERT_NE(options, nullptr);
+  EXPECT_EQ(options->body_limit, 1024u);
+
+  // 方法不匹配（之后会返回 405）或没有路由时使用会话的默认设置
+  EXPECT_EQ(router.find_route_options(http::verb::delete_, "/ingest/events"), nullptr);
+  EXPECT_EQ(router.find_route_options(http::verb::post, "/missing"), nullptr);
+}
+
 // --- Exception Handling Tests ---
 
 class TestException : public std::runtime_error
@@ -0,0 +1,110 @@
+#include "gtest/gtest.h"
+#include "server.hpp"
+#include "test_server.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/filesystem.hpp>
+#include <csignal>
+#include <functional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace khttpd::framework;
+namespace http = boost::beast::http;
+
+class ServerTest : public ::testing::Test
+{
+protected:
+  TestServer server_;
+
+  void start(int num_threads, ServerOptions options)
+  {
+    auto& server = server_.create(boost::filesystem::temp_directory_path().string(), num_threads, options);
+    // 响应中带上处理请求的线程，用来检查连接与线程的对应关系
+    server.get_http_router().get("/thread", [](HttpContext& ctx)
+    {
+      ctx.set_body(std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())));
+    });
+    server_.run();
+  }
+};
+
+TEST_F(ServerTest, PerCoreModeServesManyConnections)
+{
+  ServerOptions options;
+  options.io_mode = IoMode::per_core;
+  start(4, options);
+
+  constexpr int connections = 16;
+  constexpr int requests = 3;
+  net::io_context ioc;
+  std::vector<tcp::socket> sockets;
+  for (int i = 0; i < connections; ++i)
+  {
+    sockets.emplace_back(ioc).connect(server_.endpoint());
+  }
+
+  std::set<std::string> threads;
+  boost::beast::flat_buffer buffer;
+  for (int round = 0; round < requests; ++round)
+  {
+    for (int i = 0; i < connections; ++i)
+    {
+      net::write(sockets[i], net::buffer(std::string("GET /thread HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+    }
+    for (int i = 0; i < connections; ++i)
+    {
+      http::response<http::string_body> res;
+      buffer.clear();
+      http::read(sockets[i], buffer, res);
+      ASSERT_EQ(res.result(), http::status::ok);
+      threads.insert(res.body());
+    }
+  }
+
+  // 每个连接从 accept 到关闭都留在同一个线程上，所以线程数不会超过 io_context 数
+  EXPECT_LE(threads.size(), 4u);
+#if defined(SO_REUSEPORT)
+  // 内核按连接在各个 SO_REUSEPORT acceptor 之间分散负载，16 个连接全部落在同一个线程上几乎不可能
+  EXPECT_GT(threads.size(), 1u);
+#endif
+}
+
+TEST_F(ServerTest, PerCoreConnectionsStayOnOneThread)
+{
+  ServerOptions options;
+  options.io_mode = IoMode::per_core;
+  start(4, options);
+
+  net::io_context ioc;
+  for (int i = 0; i < 8; ++i)
+  {
+    tcp::socket socket(ioc);
+    socket.connect(server_.endpoint());
+    boost::beast::flat_buffer buffer;
+    std::set<std::string> threads;
+    for (int round = 0; round < 5; ++round)
+    {
+      net::write(socket, net::buffer(std::string("GET /thread HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+      http::response<http::string_body> res;
+      http::read(socket, buffer, res);
+      threads.insert(res.body());
+    }
+    EXPECT_EQ(threads.size(), 1u);
+  }
+}
+
+TEST_F(ServerTest, PerCoreModeStopsOnSignal)
+{
+  ServerOptions options;
+  options.io_mode = IoMode::per_core;
+  start(2, options);
+
+  // 信号在第 0 个 io_context 上处理，run() 随之返回
+  std::raise(SIGTERM);
+  server_.join();
+}
@@ -0,0 +1,369 @@
+#include "gtest/gtest.h"
+#include "static_file/static_file_cache.hpp"
+#include "static_file/byte_range.hpp"
+#include "static_file/conditional_request.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <fstream>
+#include <string>
+
+using namespace khttpd::framework;
+namespace fs = boost::filesystem;
+
+class StaticFileCacheTest : public ::testing::Test
+{
+protected:
+  fs::path base_;
+  fs::path root_;
+
+  void SetUp() override
+  {
+    base_ = fs::temp_directory_path() / fs::unique_path("khttpd-static-%%%%-%%%%");
+    root_ = base_ / "www";
+    fs::create_directories(root_ / "docs");
+    fs::create_directories(root_ / "empty");
+    fs::create_directories(base_ / "www2");
+    write_file(root_ / "index.html", "<h1>home</h1>");
+    write_file(root_ / "docs" / "index.html", "<h1>docs</h1>");
+    write_file(root_ / "style.CSS", "body{}");
+    write_file(base_ / "www2" / "secret.txt", "secret");
+  }
+
+  void TearDown() override
+  {
+    boost::system::error_code ec;
+    fs::remove_all(base_, ec);
+  }
+
+  static void write_file(const fs::path& path, const std::string& content)
+  {
+    std::ofstream(path.string(), std::ios::binary | std::ios::trunc) << content;
+  }
+};
+
+TEST_F(StaticFileCacheTest, ServesSmallFilesFromMemoryAndCachesThem)
+{
+  StaticFileCache cache(root_.string(), {});
+
+  auto first = cache.lookup("/style.CSS");
+  ASSERT_EQ(first.status, StaticFileLookup::Status::found);
+  EXPECT_TRUE(first.file->in_memory);
+  EXPECT_EQ(first.file->content, "body{}");
+  EXPECT_EQ(first.file->size, 6u);
+  EXPECT_EQ(first.file->content_type, "text/css");
+
+  auto second = cache.lookup("/style.CSS");
+  ASSERT_EQ(second.status, StaticFileLookup::Status::found);
+  EXPECT_EQ(second.file, first.file);
+  EXPECT_EQ(cache.stats().misses, 1u);
+  EXPECT_EQ(cache.stats().hits, 1u);
+  EXPECT_EQ(cache.size(), 1u);
+  EXPECT_EQ(cache.cached_bytes(), 6u);
+}
+
+TEST_F(StaticFileCacheTest, ResolvesIndexFilesAndRejectsBadPaths)
+{
+  StaticFileCache cache(root_.string(), {});
+
+  auto root = cache.lookup("/");
+  ASSERT_EQ(root.status, StaticFileLookup::Status::found);
+  EXPECT_EQ(root.file->content, "<h1>home</h1>");
+  EXPECT_EQ(root.file->content_type, "text/html");
+
+  auto docs = cache.lookup("/docs");
+  ASSERT_EQ(docs.status, StaticFileLookup::Status::found);
+  EXPECT_EQ(docs.file->content, "<h1>docs</h1>");
+
+  EXPECT_EQ(cache.lookup("/empty").status, StaticFileLookup::Status::directory_without_index);
+  EXPECT_EQ(cache.lookup("/missing.txt").status, StaticFileLookup::Status::not_found);
+  // "www2" 与 "www" 前缀相同，但不在 web 根目录内
+  EXPECT_EQ(cache.lookup("/../www2/secret.txt").status, StaticFileLookup::Status::path_traversal);
+}
+
+TEST_F(StaticFileCacheTest, LargeFilesAreNotKeptInMemory)
+{
+  StaticFileOptions options;
+  options.max_in_memory_file_size = 16;
+  StaticFileCache cache(root_.string(), options);
+
+  write_file(root_ / "large.bin", std::string(1024, 'x'));
+  auto result = cache.lookup("/large.bin");
+  ASSERT_EQ(result.status, StaticFileLookup::Status::found);
+  EXPECT_FALSE(result.file->in_memory);
+  EXPECT_TRUE(result.file->content.empty());
+  EXPECT_EQ(result.file->size, 1024u);
+#if defined(__linux__)
+  EXPECT_GE(result.file->fd, 0);
+#endif
+  EXPECT_EQ(cache.cached_bytes(), 0u);
+  EXPECT_EQ(cache.size(), 1u);
+}
+
+TEST_F(StaticFileCacheTest, EvictsLeastRecentlyUsedEntries)
+{
+  StaticFileOptions options;
+  options.max_entries = 2;
+  StaticFileCache cache(root_.string(), options);
+
+  ASSERT_EQ(cache.lookup("/index.html").status, StaticFileLookup::Status::found);
+  ASSERT_EQ(cache.lookup("/style.CSS").status, StaticFileLookup::Status::found);
+  ASSERT_EQ(cache.lookup("/index.html").status, StaticFileLookup::Status::found);
+  ASSERT_EQ(cache.lookup("/docs/index.html").status, StaticFileLookup::Status::found);
+
+  EXPECT_EQ(cache.size(), 2u);
+  EXPECT_EQ(cache.stats().evictions, 1u);
+
+  // style.CSS 最久未使用，已被淘汰
+  cache.lookup("/index.html");
+  cache.lookup("/style.CSS");
+  EXPECT_EQ(cache.stats().hits, 2u);
+  EXPECT_EQ(cache.stats().misses, 4u);
+}
+
+TEST_F(StaticFileCacheTest, StatCheckDetectsChangesWithoutWatcher)
+{
+  StaticFileCache cache(root_.string(), {});
+
+  ASSERT_EQ(cache.lookup("/style.CSS").file->content, "body{}");
+  write_file(root_ / "style.CSS", "body{color:red}");
+  EXPECT_EQ(cache.lookup("/style.CSS").file->content, "body{color:red}");
+
+  fs::remove(root_ / "style.CSS");
+  EXPECT_EQ(cache.lookup("/style.CSS").status, StaticFileLookup::Status::not_found);
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST_F(StaticFileCacheTest, DisabledCacheResolvesEveryRequest)
+{
+  StaticFileOptions options;
+  options.cache_enabled = false;
+  StaticFileCache cache(root_.string(), options);
+
+  auto result = cache.lookup("/style.CSS");
+  ASSERT_EQ(result.status, StaticFileLookup::Status::found);
+  EXPECT_FALSE(result.file->in_memory);
+  EXPECT_EQ(result.file->fd, -1);
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST_F(StaticFileCacheTest, GeneratesValidatorsAndCacheControl)
+{
+  StaticFileOptions options;
+  options.cache_control_rules = {
+    {"/docs/", "no-cache"},
+    {".css", "public, max-age=31536000, immutable"},
+  };
+  options.default_cache_control = "public, max-age=60";
+  StaticFileCache cache(root_.string(), options);
+
+  auto css = cache.lookup("/style.CSS").file;
+  ASSERT_TRUE(css);
+  EXPECT_EQ(css->cache_control, "public, max-age=31536000, immutable");
+  ASSERT_FALSE(css->etag.empty());
+  EXPECT_EQ(css->etag.front(), '"');
+  EXPECT_EQ(css->last_modified, format_http_date(css->last_write_time));
+
+  EXPECT_EQ(cache.lookup("/docs/index.html").file->cache_control, "no-cache");
+  EXPECT_EQ(cache.lookup("/").file->cache_control, "public, max-age=60");
+
+  // 内容不同则强 ETag 不同
+  EXPECT_NE(cache.lookup("/docs/index.html").file->etag, cache.lookup("/index.html").file->etag);
+
+  options.etag = ETagMode::weak;
+  options.last_modified = false;
+  StaticFileCache weak_cache(root_.string(), options);
+  auto weak = weak_cache.lookup("/style.CSS").file;
+  EXPECT_EQ(weak->etag.rfind("W/\"", 0), 0u);
+  EXPECT_TRUE(weak->last_modified.empty());
+}
+
+TEST(ConditionalRequestTest, HttpDates)
+{
+  EXPECT_EQ(format_http_date(784111777), "Sun, 06 Nov 1994 08:49:37 GMT");
+  EXPECT_EQ(parse_http_date("Sun, 06 Nov 1994 08:49:37 GMT"), std::optional<std::time_t>(784111777));
+  EXPECT_EQ(parse_http_date("Sunday, 06-Nov-94 08:49:37 GMT"), std::optional<std::time_t>(784111777));
+  EXPECT_EQ(parse_http_date("Sun Nov  6 08:49:37 1994"), std::optional<std::time_t>(784111777));
+  EXPECT_FALSE(parse_http_date("yesterday"));
+  EXPECT_FALSE(parse_http_date(""));
+}
+
+TEST(ConditionalRequestTest, EtagListUsesWeakComparison)
+{
+  EXPECT_TRUE(etag_list_matches("\"abc\"", "\"abc\""));
+  EXPECT_TRUE(etag_list_matches("W/\"abc\"", "\"abc\""));
+  EXPECT_TRUE(etag_list_matches("\"x\", W/\"abc\" ,\"y\"", "W/\"abc\""));
+  EXPECT_TRUE(etag_list_matches("*", "\"abc\""));
+  EXPECT_FALSE(etag_list_matches("\"abcd\"", "\"abc\""));
+  EXPECT_FALSE(etag_list_matches("\"abc\"", ""));
+}
+
+TEST(ConditionalRequestTest, IfNoneMatchTakesPrecedence)
+{
+  StaticFile file;
+  file.etag = "\"v1\"";
+  file.last_write_time = 784111777;
+  file.last_modified = format_http_date(file.last_write_time);
+
+  EXPECT_TRUE(is_not_modified(file, "\"v1\"", ""));
+  EXPECT_TRUE(is_not_modified(file, "", "Sun, 06 Nov 1994 08:49:37 GMT"));
+  EXPECT_TRUE(is_not_modified(file, "", "Mon, 07 Nov 1994 00:00:00 GMT"));
+  EXPECT_FALSE(is_not_modified(file, "", "Sat, 05 Nov 1994 00:00:00 GMT"));
+  EXPECT_FALSE(is_not_modified(file, "", "not a date"));
+  // If-None-Match 不匹配时忽略 If-Modified-Since
+  EXPECT_FALSE(is_not_modified(file, "\"v0\"", "Mon, 07 Nov 1994 00:00:00 GMT"));
+  EXPECT_FALSE(is_not_modified(file, "", ""));
+}
+
+TEST(ConditionalRequestTest, IfRangeUsesStrongComparison)
+{
+  StaticFile file;
+  file.etag = "\"v1\"";
+  file.last_write_time = 784111777;
+  file.last_modified = format_http_date(file.last_write_time);
+
+  EXPECT_TRUE(if_range_matches(file, ""));
+  EXPECT_TRUE(if_range_matches(file, "\"v1\""));
+  EXPECT_FALSE(if_range_matches(file, "W/\"v1\""));
+  EXPECT_FALSE(if_range_matches(file, "\"v2\""));
+  EXPECT_TRUE(if_range_matches(file, "Sun, 06 Nov 1994 08:49:37 GMT"));
+  EXPECT_FALSE(if_range_matches(file, "Mon, 07 Nov 1994 08:49:37 GMT"));
+
+  file.etag = "W/\"v1\"";
+  EXPECT_FALSE(if_range_matches(file, "W/\"v1\""));
+}
+
+TEST(ByteRangeTest, ParsesSingleAndSuffixRanges)
+{
+  using Status = RangeRequest::Status;
+
+  auto range = parse_range_header("bytes=0-499", 1000, 16);
+  ASSERT_EQ(range.status, Status::satisfiable);
+  EXPECT_EQ(range.ranges, (std::vector<ByteRange>{{0, 499}}));
+
+  range = parse_range_header("bytes=500-", 1000, 16);
+  EXPECT_EQ(range.ranges, (std::vector<ByteRange>{{500, 999}}));
+
+  range = parse_range_header("bytes=-200", 1000, 16);
+  EXPECT_EQ(range.ranges, (std::vector<ByteRange>{{800, 999}}));
+
+  range = parse_range_header("Bytes = -5000", 1000, 16);
+  EXPECT_EQ(range.ranges, (std::vector<ByteRange>{{0, 999}}));
+
+  range = parse_range_header("bytes=900-5000", 1000, 16);
+  EXPECT_EQ(range.ranges, (std::vector<ByteRange>{{900, 999}}));
+  EXPECT_EQ(format_content_range(range.ranges.front(), 1000), "bytes 900-999/1000");
+}
+
+TEST(ByteRangeTest, MergesOverlappingRanges)
+{
+  auto range = parse_range_header("bytes=500-600, 0-99, 601-700,, 50-120, 900-", 1000, 16);
+  ASSERT_EQ(range.status, RangeRequest::Status::satisfiable);
+  EXPECT_EQ(range.ranges, (std::vector<ByteRange>{{0, 120}, {500, 700}, {900, 999}}));
+}
+
+TEST_F(StaticFileCacheTest, FindsPrecompressedSiblings)
+{
+  write_file(root_ / "app.js", std::string(1000, 'a'));
+  write_file(root_ / "app.js.gz", "gzip-bytes");
+  write_file(root_ / "app.js.br", "br-bytes");
+  // 比原始文件大的变体没有意义
+  write_file(root_ / "app.js.zst", std::string(2000, 'z'));
+
+  StaticFileCache cache(root_.string(), {});
+  const auto lookup = cache.lookup("/app.js");
+  ASSERT_EQ(lookup.status, StaticFileLookup::Status::found);
+  const auto& file = lookup.file;
+  ASSERT_EQ(file->encoded_variants.size(), 2u);
+  EXPECT_EQ(file->encoded_variants[0]->content_encoding, "br");
+  EXPECT_EQ(file->encoded_variants[0]->content, "br-bytes");
+  EXPECT_EQ(file->encoded_variants[1]->content_encoding, "gzip");
+  EXPECT_EQ(file->encoded_variants[1]->content_type, "application/javascript");
+  EXPECT_NE(file->encoded_variants[1]->etag, file->etag);
+  EXPECT_EQ(cache.cached_bytes(), 1000u + 10u + 8u);
+
+  EXPECT_EQ(select_encoded_variant(file, "gzip, deflate, br")->content_encoding, "br");
+  EXPECT_EQ(select_encoded_variant(file, "gzip, br;q=0.5")->content_encoding, "gzip");
+  EXPECT_EQ(select_encoded_variant(file, "deflate"), file);
+  EXPECT_EQ(select_encoded_variant(file, ""), file);
+  EXPECT_EQ(select_encoded_variant(file, "identity, gzip;q=0.5"), file);
+
+  // 预压缩文件变化时原始文件的条目失效
+  cache.invalidate((fs::canonical(root_) / "app.js.gz").string());
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST_F(StaticFileCacheTest, IgnoresPrecompressedSymlinksAndCanBeDisabled)
+{
+  write_file(root_ / "page.html", std::string(1000, 'p'));
+  write_file(base_ / "www2" / "page.html.gz", "outside");
+  fs::create_symlink(base_ / "www2" / "page.html.gz", root_ / "page.html.gz");
+
+  StaticFileCache cache(root_.string(), {});
+  EXPECT_TRUE(cache.lookup("/page.html").file->encoded_variants.empty());
+
+  fs::remove(root_ / "page.html.gz");
+  write_file(root_ / "page.html.gz", "inside");
+  StaticFileOptions options;
+  options.precompressed.clear();
+  StaticFileCache disabled(root_.string(), options);
+  EXPECT_TRUE(disabled.lookup("/page.html").file->encoded_variants.empty());
+}
+
+TEST(ByteRangeTest, InvalidOrUnsatisfiableRanges)
+{
+  using Status = RangeRequest::Status;
+
+  EXPECT_EQ(parse_range_header("bytes=1000-", 1000, 16).status, Status::unsatisfiable);
+  EXPECT_EQ(parse_range_header("bytes=-0", 1000, 16).status, Status::unsatisfiable);
+  EXPECT_EQ(parse_range_header("bytes=0-", 0, 16).status, Status::unsatisfiable);
+  // 只要有一个范围可以满足就不是 416
+  EXPECT_EQ(parse_range_header("bytes=2000-3000, 10-20", 1000, 16).status, Status::satisfiable);
+
+  EXPECT_EQ(parse_range_header("items=0-10", 1000, 16).status, Status::ignored);
+  EXPECT_EQ(parse_range_header("bytes=20-10", 1000, 16).status, Status::ignored);
+  EXPECT_EQ(parse_range_header("bytes=abc", 1000, 16).status, Status::ignored);
+  EXPECT_EQ(parse_range_header("bytes=-", 1000, 16).status, Status::ignored);
+  EXPECT_EQ(parse_range_header("bytes=", 1000, 16).status, Status::ignored);
+  EXPECT_EQ(parse_range_header("bytes=0-1,2-3,4-5", 1000, 2).status, Status::ignored);
+}
+
+#if defined(__linux__)
+TEST_F(StaticFileCacheTest, InotifyInvalidatesChangedFiles)
+{
+  boost::asio::io_context ioc;
+  StaticFileCache cache(root_.string(), {});
+  cache.start_watching(ioc.get_executor());
+  ASSERT_TRUE(cache.watching());
+
+  ASSERT_EQ(cache.lookup("/docs/index.html").file->content, "<h1>docs</h1>");
+  ASSERT_EQ(cache.lookup("/index.html").file->content, "<h1>home</h1>");
+
+  write_file(root_ / "docs" / "index.html", "<h1>new docs</h1>");
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (cache.stats().invalidations == 0 && std::chrono::steady_clock::now() < deadline)
+  {
+    ioc.run_for(std::chrono::milliseconds(10));
+  }
+
+  // 一次写入会产生多个事件，全部处理完再检查
+  ioc.run_for(std::chrono::milliseconds(50));
+  EXPECT_GE(cache.stats().invalidations, 1u);
+  EXPECT_EQ(cache.size(), 1u);
+  EXPECT_EQ(cache.lookup("/docs/index.html").file->content, "<h1>new docs</h1>");
+  ASSERT_EQ(cache.size(), 2u);
+
+  // 目录被整体改名时，目录下的所有条目都会失效
+  fs::rename(root_ / "docs", root_ / "docs-old");
+  const auto rename_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (cache.size() > 1 && std::chrono::steady_clock::now() < rename_deadline)
+  {
+    ioc.run_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(cache.size(), 1u);
+  EXPECT_EQ(cache.lookup("/docs/index.html").status, StaticFileLookup::Status::not_found);
+
+  cache.stop_watching();
+  ioc.run_for(std::chrono::milliseconds(10));
+}
+#endif
@@ -0,0 +1,150 @@
+// framework/tests/test_server.hpp
+#ifndef KHTTPD_FRAMEWORK_TESTS_TEST_SERVER_HPP
+#define KHTTPD_FRAMEWORK_TESTS_TEST_SERVER_HPP
+
+#include "gtest/gtest.h"
+#include "server.hpp"
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace khttpd::framework
+{
+  // 测试用的服务器：监听 127.0.0.1 上由系统分配的端口（见 Server::local_endpoint），在后台线程上运行。
+  // create 之后注册路由与拦截器，再调用 run；析构时停止
+  class TestServer
+  {
+  public:
+    TestServer() = default;
+    TestServer(const TestServer&) = delete;
+    TestServer& operator=(const TestServer&) = delete;
+
+    ~TestServer()
+    {
+      stop();
+    }
+
+    Server& create(const std::string& web_root, int num_threads = 1, const ServerOptions& options = {})
+    {
+      stop();
+      server_ = std::make_shared<Server>(tcp::endpoint{net::ip::make_address("127.0.0.1"), 0}, web_root,
+                                         num_threads, options);
+      endpoint_ = server_->local_endpoint();
+      return *server_;
+    }
+
+    void run()
+    {
+      thread_ = std::thread([server = server_] { server->run(); });
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    // 等待 run() 自行返回（例如收到了 SIGTERM），不调用 Server::stop
+    void join()
+    {
+      if (thread_.joinable())
+      {
+        thread_.join();
+      }
+    }
+
+    // 停止并销毁服务器，之后可以重新 create
+    void stop()
+    {
+      if (thread_.joinable())
+      {
+        server_->stop();
+        thread_.join();
+      }
+      server_.reset();
+    }
+
+    Server* operator->() const
+    {
+      return server_.get();
+    }
+
+    const tcp::endpoint& endpoint() const
+    {
+      return endpoint_;
+    }
+
+  private:
+    std::shared_ptr<Server> server_;
+    std::thread thread_;
+    tcp::endpoint endpoint_;
+  };
+
+  // HTTP/1.1 与 HTTP/2 会话测试共用的夹具：临时目录作为 web_root，per_core 模式的服务器，
+  // 以及模拟数据库或上游调用的工作线程。子类在 create 返回的路由上注册各自协议的路由，再调用 server_.run()
+  class HttpServerTest : public ::testing::Test
+  {
+  protected:
+    boost::filesystem::path root_;
+    TestServer server_;
+
+    void SetUp() override
+    {
+      root_ = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("khttpd-test-%%%%-%%%%");
+      boost::filesystem::create_directories(root_);
+    }
+
+    void TearDown() override
+    {
+      for (auto& worker : workers_)
+      {
+        worker.join();
+      }
+      server_.stop();
+      boost::system::error_code ec;
+      boost::filesystem::remove_all(root_, ec);
+    }
+
+    // 注册两种协议都用到的 /echo/:id 与 /stream（分三块输出 "012"）
+    HttpRouter& create(ServerOptions options)
+    {
+      // 共享模式的 IoContextPool 是进程级单例，停止后不能重启；per_core 模式每个 Server 有自己的线程池
+      options.io_mode = IoMode::per_core;
+      auto& router = server_.create(root_.string(), 1, options).get_http_router();
+      router.get("/echo/:id", [](HttpContext& ctx)
+      {
+        ctx.set_body("echo " + ctx.get_path_param("id").value_or(""));
+      });
+      router.get("/stream", [](HttpContext& ctx)
+      {
+        ctx.chunked_pull([i = 0]() mutable -> std::optional<std::string>
+        {
+          if (i == 3)
+          {
+            return std::nullopt;
+          }
+          return std::to_string(i++);
+        });
+      });
+      return router;
+    }
+
+    // 在工作线程上等待 delay 后执行 fn，异步 handler 用它完成响应；TearDown 时等待所有工作线程
+    void later(std::function<void()> fn, std::chrono::milliseconds delay = std::chrono::milliseconds(300))
+    {
+      std::lock_guard<std::mutex> lock(workers_mutex_);
+      workers_.emplace_back([fn = std::move(fn), delay]
+      {
+        std::this_thread::sleep_for(delay);
+        fn();
+      });
+    }
+
+  private:
+    std::mutex workers_mutex_;
+    std::vector<std::thread> workers_;
+  };
+}
+
+#endif // KHTTPD_FRAMEWORK_TESTS_TEST_SERVER_HPP
@@ -0,0 +1,216 @@
+#include "gtest/gtest.h"
+#include "server.hpp"
+#include "test_server.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/filesystem.hpp>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+using namespace khttpd::framework;
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace fs = boost::filesystem;
+
+namespace
+{
+  // 用 OpenSSL 生成 CN 为 common_name 的自签名证书（P-256 密钥），写入 dir 下的 PEM 文件
+  TlsCertificate make_self_signed(const fs::path& dir, const std::string& common_name)
+  {
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EVP_PKEY_keygen_init(key_ctx);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(key_ctx, &key);
+    EVP_PKEY_CTX_free(key_ctx);
+
+    X509* cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>(common_name.c_str()),
+                               -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_sign(cert, key, EVP_sha256());
+
+    TlsCertificate result{(dir / (common_name + ".crt")).string(), (dir / (common_name + ".key")).string()};
+    FILE* out = std::fopen(result.certificate_chain_file.c_str(), "wb");
+    PEM_write_X509(out, cert);
+    std::fclose(out);
+    out = std::fopen(result.private_key_file.c_str(), "wb");
+    PEM_write_PrivateKey(out, key, nullptr, nullptr, 0, nullptr, nullptr);
+    std::fclose(out);
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return result;
+  }
+
+  std::string peer_common_name(SSL* ssl)
+  {
+    X509* cert = SSL_get_peer_certificate(ssl);
+    if (!cert)
+    {
+      return {};
+    }
+    char buffer[256] = {};
+    X509_NAME_get_text_by_NID(X509_get_subject_name(cert), NID_commonName, buffer, sizeof(buffer));
+    X509_free(cert);
+    return buffer;
+  }
+}
+
+class TlsTest : public ::testing::Test
+{
+protected:
+  fs::path root_;
+  TestServer server_;
+  net::io_context ioc_;
+  ssl::context client_ctx_{ssl::context::tls_client};
+
+  void SetUp() override
+  {
+    root_ = fs::temp_directory_path() / fs::unique_path("khttpd-tls-%%%%-%%%%");
+    fs::create_directories(root_);
+    client_ctx_.set_verify_mode(ssl::verify_none);
+    // 客户端缓存会话，SSL_get1_session 才能拿到 TLS 1.3 握手后收到的票据
+    SSL_CTX_set_session_cache_mode(client_ctx_.native_handle(), SSL_SESS_CACHE_CLIENT);
+  }
+
+  void TearDown() override
+  {
+    server_.stop();
+    boost::system::error_code ec;
+    fs::remove_all(root_, ec);
+  }
+
+  void start(TlsOptions tls)
+  {
+    ServerOptions options;
+    options.io_mode = IoMode::per_core;
+    options.ssl_context = make_server_ssl_context(tls);
+    server_.create(root_.string(), 1, options).get_http_router().get("/echo/:id", [](HttpContext& ctx)
+    {
+      ctx.set_body("echo " + ctx.get_path_param("id").value_or(""));
+    });
+    server_.run();
+  }
+
+  // 建立 TLS 连接，发送一个请求；server_name 非空时发送 SNI，session 非空时尝试恢复会话
+  std::unique_ptr<beast::ssl_stream<beast::tcp_stream>> connect(const std::string& server_name = {},
+                                                                SSL_SESSION* session = nullptr)
+  {
+    auto stream = std::make_unique<beast::ssl_stream<beast::tcp_stream>>(ioc_, client_ctx_);
+    if (!server_name.empty())
+    {
+      SSL_set_tlsext_host_name(stream->native_handle(), server_name.c_str());
+    }
+    if (session)
+    {
+      SSL_set_session(stream->native_handle(), session);
+    }
+    beast::get_lowest_layer(*stream).connect(server_.endpoint());
+    stream->handshake(ssl::stream_base::client);
+    return stream;
+  }
+
+  static std::string get(beast::ssl_stream<beast::tcp_stream>& stream, const std::string& target)
+  {
+    http::request<http::string_body> req{http::verb::get, target, 11};
+    req.set(http::field::host, "localhost");
+    http::write(stream, req);
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(stream, buffer, res);
+    return res.body();
+  }
+};
+
+TEST_F(TlsTest, ServesHttpsRequests)
+{
+  start({make_self_signed(root_, "default.test")});
+
+  auto stream = connect();
+  EXPECT_EQ(get(*stream, "/echo/1"), "echo 1");
+  EXPECT_EQ(get(*stream, "/echo/2"), "echo 2");
+  EXPECT_GE(SSL_version(stream->native_handle()), TLS1_2_VERSION);
+  EXPECT_EQ(server_->get_session_stats().tls_handshakes.load(), 1u);
+}
+
+TEST_F(TlsTest, RejectsPlainHttp)
+{
+  start({make_self_signed(root_, "default.test")});
+
+  beast::tcp_stream stream(ioc_);
+  stream.connect(server_.endpoint());
+  http::request<http::string_body> req{http::verb::get, "/echo/1", 11};
+  http::write(stream, req);
+  beast::flat_buffer buffer;
+  http::response<http::string_body> res;
+  beast::error_code ec;
+  http::read(stream, buffer, res, ec);
+  EXPECT_TRUE(ec);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(server_->get_session_stats().tls_handshake_failures.load(), 1u);
+}
+
+TEST_F(TlsTest, SelectsCertificateBySni)
+{
+  TlsOptions tls{make_self_signed(root_, "default.test")};
+  tls.sni_certificates["api.test"] = make_self_signed(root_, "api.test");
+  tls.sni_certificates["*.apps.test"] = make_self_signed(root_, "wildcard.apps.test");
+  start(tls);
+
+  auto stream = connect();
+  EXPECT_EQ(peer_common_name(stream->native_handle()), "default.test");
+  stream = connect("API.test");
+  EXPECT_EQ(peer_common_name(stream->native_handle()), "api.test");
+  EXPECT_EQ(get(*stream, "/echo/sni"), "echo sni");
+  stream = connect("one.apps.test");
+  EXPECT_EQ(peer_common_name(stream->native_handle()), "wildcard.apps.test");
+  stream = connect("a.b.apps.test");
+  EXPECT_EQ(peer_common_name(stream->native_handle()), "default.test");
+  stream = connect("unknown.test");
+  EXPECT_EQ(peer_common_name(stream->native_handle()), "default.test");
+}
+
+TEST_F(TlsTest, ResumesSessions)
+{
+  for (bool tickets : {true, false})
+  {
+    SCOPED_TRACE(tickets ? "tickets" : "session cache");
+    TlsOptions tls{make_self_signed(root_, "default.test")};
+    tls.session_tickets = tickets;
+    start(tls);
+
+    auto first = connect();
+    // TLS 1.3 的会话票据在握手之后才发送，读完一个响应后客户端才能拿到可恢复的会话
+    EXPECT_EQ(get(*first, "/echo/1"), "echo 1");
+    SSL_SESSION* session = SSL_get1_session(first->native_handle());
+    ASSERT_NE(session, nullptr);
+    EXPECT_FALSE(SSL_session_reused(first->native_handle()));
+
+    auto second = connect({}, session);
+    EXPECT_TRUE(SSL_session_reused(second->native_handle()));
+    EXPECT_EQ(get(*second, "/echo/2"), "echo 2");
+    SSL_SESSION_free(session);
+
+    EXPECT_EQ(server_->get_session_stats().tls_handshakes.load(), 2u);
+    EXPECT_EQ(server_->get_session_stats().tls_resumed_handshakes.load(), 1u);
+
+    first.reset();
+    second.reset();
+    server_.stop();
+  }
+}
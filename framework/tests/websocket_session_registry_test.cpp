@@ -0,0 +1,113 @@
+#include "gtest/gtest.h"
+#include "websocket/websocket_session.hpp"
+#include "websocket/websocket_session_registry.hpp"
+#include "websocket/websocket_topics.hpp"
+#include <boost/asio/io_context.hpp>
+#include <thread>
+#include <vector>
+
+using namespace khttpd::framework;
+
+class WebsocketSessionRegistryTest : public ::testing::Test
+{
+protected:
+  net::io_context ioc_;
+  WebsocketRouter router_;
+
+  std::shared_ptr<WebsocketSession> make_session()
+  {
+    return std::make_shared<WebsocketSession>(tcp::socket(ioc_), router_, "/ws");
+  }
+};
+
+TEST_F(WebsocketSessionRegistryTest, AddsFindsAndRemovesById)
+{
+  WebsocketSessionRegistry registry(4);
+  const auto a = make_session();
+  const auto b = make_session();
+  registry.add(a);
+  registry.add(b);
+  registry.add(a);
+  EXPECT_EQ(registry.size(), 2u);
+  EXPECT_EQ(registry.find(a->id), a);
+
+  EXPECT_TRUE(registry.remove(a->id));
+  EXPECT_FALSE(registry.remove(a->id));
+  EXPECT_EQ(registry.find(a->id), nullptr);
+  EXPECT_EQ(registry.size(), 1u);
+}
+
+TEST_F(WebsocketSessionRegistryTest, BulkFindSkipsUnknownIds)
+{
+  WebsocketSessionRegistry registry(8);
+  std::vector<std::string> ids;
+  for (int i = 0; i < 100; ++i)
+  {
+    const auto session = make_session();
+    registry.add(session);
+    ids.push_back(session->id);
+  }
+  ids.push_back("missing");
+  EXPECT_EQ(registry.find(ids).size(), 100u);
+}
+
+TEST_F(WebsocketSessionRegistryTest, ConcurrentChurnKeepsCountConsistent)
+{
+  WebsocketSessionRegistry registry;
+  std::vector<std::vector<std::shared_ptr<WebsocketSession>>> sessions(4);
+  for (auto& own : sessions)
+  {
+    for (int i = 0; i < 200; ++i)
+    {
+      own.push_back(make_session());
+    }
+  }
+
+  std::vector<std::thread> threads;
+  for (const auto& own : sessions)
+  {
+    threads.emplace_back([&registry, &own]
+    {
+      for (int round = 0; round < 50; ++round)
+      {
+        for (const auto& session : own)
+        {
+          registry.add(session);
+        }
+        for (std::size_t i = 0; i < own.size(); i += 2)
+        {
+          registry.remove(own[i]->id);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+  EXPECT_EQ(registry.size(), 4u * 100u);
+}
+
+TEST_F(WebsocketSessionRegistryTest, TopicsTrackSubscriptions)
+{
+  WebsocketTopics topics;
+  const auto a = make_session();
+  const auto b = make_session();
+  EXPECT_TRUE(topics.subscribe("prices", a));
+  EXPECT_FALSE(topics.subscribe("prices", a));
+  EXPECT_TRUE(topics.subscribe("prices", b));
+  EXPECT_TRUE(topics.subscribe("news", a));
+  EXPECT_EQ(topics.subscriber_count("prices"), 2u);
+
+  EXPECT_TRUE(topics.unsubscribe("prices", *b));
+  EXPECT_FALSE(topics.unsubscribe("prices", *b));
+  EXPECT_EQ(topics.subscriber_count("prices"), 1u);
+
+  topics.unsubscribe_all(*a);
+  EXPECT_EQ(topics.subscriber_count("prices"), 0u);
+  EXPECT_EQ(topics.subscriber_count("news"), 0u);
+  // 主题随最后一个订阅者移除，之后可以重新订阅
+  EXPECT_TRUE(topics.subscribe("prices", b));
+  EXPECT_EQ(topics.subscriber_count("prices"), 1u);
+  topics.unsubscribe_all(*b);
+}
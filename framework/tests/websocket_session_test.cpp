@@ -0,0 +1,337 @@
+#include "gtest/gtest.h"
+#include "server.hpp"
+#include "test_server.hpp"
+#include "websocket/websocket_session.hpp"
+#include "websocket/websocket_session_registry.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace khttpd::framework;
+namespace fs = boost::filesystem;
+
+class WebsocketSessionTest : public ::testing::Test
+{
+protected:
+  TestServer server_;
+  // on_open 中执行的发送逻辑
+  std::function<void(WebsocketContext&)> on_open_;
+  std::function<void(WebsocketContext&)> on_message_;
+  std::atomic<int> errors_{0};
+
+  // IoMode::shared 用的是进程内唯一的 IoContextPool，停止后不能重新启动，整个测试程序里只能用一次
+  void start(ServerOptions options = {}, IoMode io_mode = IoMode::per_core)
+  {
+    options.io_mode = io_mode;
+    auto& router = server_.create(fs::temp_directory_path().string(), 1, options).get_websocket_router();
+    router.add_handler("/ws", [this](WebsocketContext& ctx) { if (on_open_) on_open_(ctx); },
+                       [this](WebsocketContext& ctx) { if (on_message_) on_message_(ctx); },
+                       {}, [this](WebsocketContext&) { ++errors_; });
+    server_.run();
+  }
+
+  void connect(ws::stream<tcp::socket>& client)
+  {
+    client.next_layer().connect(server_.endpoint());
+    client.read_message_max(64 * 1024 * 1024);
+    client.handshake("127.0.0.1", "/ws");
+  }
+};
+
+TEST_F(WebsocketSessionTest, SerializesConcurrentSends)
+{
+  on_open_ = [](WebsocketContext& ctx)
+  {
+    // 多个线程同时向同一个会话发送
+    std::thread([id = ctx.id]
+    {
+      std::vector<std::thread> senders;
+      for (int t = 0; t < 4; ++t)
+      {
+        senders.emplace_back([id, t]
+        {
+          for (int i = 0; i < 100; ++i)
+          {
+            WebsocketSession::send_message(id, std::string(1000 + t, static_cast<char>('a' + t)), true);
+          }
+        });
+      }
+      for (auto& sender : senders)
+      {
+        sender.join();
+      }
+    }).detach();
+  };
+  start();
+
+  net::io_context ioc;
+  ws::stream<tcp::socket> client(ioc);
+  connect(client);
+  int counts[4] = {};
+  for (int i = 0; i < 400; ++i)
+  {
+    beast::flat_buffer buffer;
+    client.read(buffer);
+    const std::string message = beast::buffers_to_string(buffer.data());
+    const int t = message[0] - 'a';
+    ASSERT_GE(t, 0);
+    ASSERT_LT(t, 4);
+    ASSERT_EQ(message, std::string(1000 + t, message[0]));
+    ++counts[t];
+  }
+  for (const int count : counts)
+  {
+    EXPECT_EQ(count, 100);
+  }
+  EXPECT_EQ(server_->get_session_stats().websocket_dropped_messages, 0u);
+}
+
+TEST_F(WebsocketSessionTest, DisconnectsSlowConsumer)
+{
+  ServerOptions options;
+  options.session.websocket.write_queue_high_watermark = 256 * 1024;
+  options.session.websocket.write_queue_low_watermark = 64 * 1024;
+  options.session.websocket.slow_consumer = SlowConsumerPolicy::disconnect;
+  // 在 strand 上连续发送，第一条写完之前队列就会超过高水位
+  on_open_ = [](WebsocketContext& ctx)
+  {
+    for (int i = 0; i < 16; ++i)
+    {
+      ctx.send(std::string(64 * 1024, 'x'));
+    }
+  };
+  start(options);
+
+  net::io_context ioc;
+  ws::stream<tcp::socket> client(ioc);
+  connect(client);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  const auto& stats = server_->get_session_stats();
+  EXPECT_EQ(stats.websocket_slow_consumer_disconnects, 1u);
+  EXPECT_EQ(stats.websocket_queued_bytes, 0u);
+  EXPECT_EQ(errors_, 1);
+}
+
+TEST_F(WebsocketSessionTest, DropsMessagesOverHighWatermark)
+{
+  ServerOptions options;
+  options.session.websocket.write_queue_high_watermark = 256 * 1024;
+  options.session.websocket.write_queue_low_watermark = 64 * 1024;
+  options.session.websocket.slow_consumer = SlowConsumerPolicy::drop;
+  on_open_ = [](WebsocketContext& ctx)
+  {
+    for (int i = 0; i < 16; ++i)
+    {
+      ctx.send(std::string(64 * 1024, 'x'));
+    }
+  };
+  start(options);
+
+  net::io_context ioc;
+  ws::stream<tcp::socket> client(ioc);
+  connect(client);
+  // 高水位以内的 4 条照常送达，其余被丢弃，连接保持
+  for (int i = 0; i < 4; ++i)
+  {
+    beast::flat_buffer buffer;
+    client.read(buffer);
+    EXPECT_EQ(buffer.size(), 64u * 1024u);
+  }
+  const auto& stats = server_->get_session_stats();
+  EXPECT_EQ(stats.websocket_dropped_messages, 12u);
+  EXPECT_EQ(stats.websocket_backpressure_events, 1u);
+  EXPECT_EQ(stats.websocket_slow_consumer_disconnects, 0u);
+  EXPECT_EQ(errors_, 0);
+}
+
+class WebsocketSessionIoModeTest : public WebsocketSessionTest, public ::testing::WithParamInterface<IoMode>
+{
+};
+
+TEST_P(WebsocketSessionIoModeTest, BlockPolicyDoesNotWaitOnSharedIoThread)
+{
+  ServerOptions options;
+  options.session.websocket.write_queue_high_watermark = 1024 * 1024;
+  options.session.websocket.write_queue_low_watermark = 256 * 1024;
+  options.session.websocket.slow_consumer = SlowConsumerPolicy::block;
+  options.session.websocket.block_timeout = std::chrono::seconds(1);
+  std::mutex mutex;
+  std::vector<std::string> ids;
+  on_open_ = [&](WebsocketContext& ctx)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ids.push_back(ctx.id);
+  };
+  // 接收方在收到 "sent" 之前不读，写出的数据远超套接字缓冲区。per_core 模式下两个会话在同一个 io 线程上，
+  // shared 模式下目标会话的写操作也要靠 io 线程推进：在 handler 里等待只会等到 block_timeout
+  on_message_ = [&](WebsocketContext& ctx)
+  {
+    std::string id;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      id = ids.front();
+    }
+    for (int i = 0; i < 16; ++i)
+    {
+      WebsocketSession::send_message(id, std::string(4 * 1024 * 1024, 'x'), true);
+    }
+    ctx.send("sent", true);
+  };
+  start(options, GetParam());
+
+  net::io_context ioc;
+  ws::stream<tcp::socket> receiver(ioc);
+  connect(receiver);
+  ws::stream<tcp::socket> sender(ioc);
+  connect(sender);
+
+  const auto started = std::chrono::steady_clock::now();
+  sender.write(net::buffer(std::string("go")));
+  beast::flat_buffer reply;
+  sender.read(reply);
+  EXPECT_EQ(beast::buffers_to_string(reply.data()), "sent");
+  EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(1));
+
+  // 没有等待也没有丢弃，全部入队
+  ASSERT_EQ(server_->get_session_stats().websocket_dropped_messages, 0u);
+  for (int i = 0; i < 16; ++i)
+  {
+    beast::flat_buffer buffer;
+    receiver.read(buffer);
+    EXPECT_EQ(buffer.size(), 4u * 1024u * 1024u);
+  }
+
+  // shared 模式的 io_context 比 Server 活得久，停止前先关闭连接，会话不会留到进程退出时才析构
+  receiver.close(ws::close_code::normal);
+  sender.close(ws::close_code::normal);
+  std::lock_guard<std::mutex> lock(mutex);
+  for (int i = 0; i < 100 && !WebsocketSessionRegistry::instance().find(ids).empty(); ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_TRUE(WebsocketSessionRegistry::instance().find(ids).empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(IoModes, WebsocketSessionIoModeTest, ::testing::Values(IoMode::per_core, IoMode::shared),
+                         [](const ::testing::TestParamInfo<IoMode>& info)
+                         {
+                           return info.param == IoMode::shared ? "shared" : "per_core";
+                         });
+
+TEST_F(WebsocketSessionTest, PublishesToTopicSubscribers)
+{
+  on_open_ = [](WebsocketContext& ctx)
+  {
+    ctx.subscribe("ticker");
+    // 重复订阅不会收到两份
+    EXPECT_FALSE(ctx.subscribe("ticker"));
+  };
+  start();
+  auto& router = server_->get_websocket_router();
+
+  net::io_context ioc;
+  std::vector<std::unique_ptr<ws::stream<tcp::socket>>> clients;
+  for (int i = 0; i < 3; ++i)
+  {
+    clients.push_back(std::make_unique<ws::stream<tcp::socket>>(ioc));
+    connect(*clients.back());
+  }
+  for (int i = 0; i < 50 && router.subscriber_count("ticker") < 3; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(router.subscriber_count("ticker"), 3u);
+  EXPECT_EQ(router.publish("ticker", "tick 1"), 3u);
+  EXPECT_EQ(router.publish("other", "nobody"), 0u);
+  for (const auto& client : clients)
+  {
+    beast::flat_buffer buffer;
+    client->read(buffer);
+    EXPECT_EQ(beast::buffers_to_string(buffer.data()), "tick 1");
+  }
+
+  // 关闭的会话自动退订
+  clients.back()->close(ws::close_code::normal);
+  clients.pop_back();
+  for (int i = 0; i < 50 && router.subscriber_count("ticker") > 2; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(router.publish("ticker", "tick 2"), 2u);
+  for (const auto& client : clients)
+  {
+    beast::flat_buffer buffer;
+    client->read(buffer);
+    EXPECT_EQ(beast::buffers_to_string(buffer.data()), "tick 2");
+  }
+}
+
+TEST_F(WebsocketSessionTest, NegotiatesPermessageDeflate)
+{
+  ServerOptions options;
+  options.session.websocket.deflate.enabled = true;
+  options.session.websocket.deflate.threshold = 64;
+  const std::string payload = R"([{"symbol":"ABC","price":12.5,"volume":1000},)" + std::string(4096, ' ') + "]";
+  on_open_ = [payload](WebsocketContext& ctx)
+  {
+    ctx.send(payload);
+    ctx.send("short");
+  };
+  start(options);
+
+  net::io_context ioc;
+  ws::stream<tcp::socket> client(ioc);
+  ws::permessage_deflate deflate;
+  deflate.client_enable = true;
+  client.set_option(deflate);
+  client.next_layer().connect(server_.endpoint());
+  ws::response_type res;
+  client.handshake(res, "127.0.0.1", "/ws");
+  EXPECT_NE(res[http::field::sec_websocket_extensions].find("permessage-deflate"), std::string::npos);
+
+  beast::flat_buffer buffer;
+  client.read(buffer);
+  EXPECT_EQ(beast::buffers_to_string(buffer.data()), payload);
+  buffer.clear();
+  client.read(buffer);
+  EXPECT_EQ(beast::buffers_to_string(buffer.data()), "short");
+}
+
+TEST_F(WebsocketSessionTest, HandsReceivedMessagesToHandler)
+{
+  std::vector<std::string> received;
+  std::mutex mutex;
+  on_message_ = [&](WebsocketContext& ctx)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      received.push_back(ctx.message);
+    }
+    // handler 可以拿走消息内容，下一条消息不受影响
+    const std::string message = std::move(ctx.message);
+    ctx.send(std::to_string(message.size()), true);
+  };
+  start();
+
+  net::io_context ioc;
+  ws::stream<tcp::socket> client(ioc);
+  connect(client);
+  // 先大后小，复用的缓冲区不能残留上一条的内容
+  const std::vector<std::string> messages = {std::string(256 * 1024, 'a'), "bc", std::string(1, '\0'), "", "defg"};
+  for (const auto& message : messages)
+  {
+    client.binary(message.size() == 1);
+    client.write(net::buffer(message));
+    beast::flat_buffer buffer;
+    client.read(buffer);
+    EXPECT_EQ(beast::buffers_to_string(buffer.data()), std::to_string(message.size()));
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  EXPECT_EQ(received, messages);
+}
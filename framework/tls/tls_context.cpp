@@ -0,0 +1,173 @@
+// framework/tls/tls_context.cpp
+#include "tls_context.hpp"
+#include <fmt/core.h>
+#include <openssl/ssl.h>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace khttpd::framework
+{
+  namespace
+  {
+    // 所有 context 使用同一个 session id context，SNI 切换证书后缓存的会话仍然可以恢复
+    constexpr unsigned char session_id_context[] = "khttpd";
+
+    std::string to_lower(std::string value)
+    {
+      std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c)
+      {
+        return static_cast<char>(std::tolower(c));
+      });
+      return value;
+    }
+
+    // 默认 context 与各个 SNI 证书的 context，由 make_server_ssl_context 返回的 shared_ptr 持有
+    struct ServerSslContexts
+    {
+      ssl::context context{ssl::context::tls_server};
+      // 键为小写的主机名或 "*." 开头的通配名
+      std::vector<std::pair<std::string, std::unique_ptr<ssl::context>>> sni_contexts;
+      // TlsOptions::alpn_protocols 的线路格式：每个协议名前加一个长度字节
+      std::vector<unsigned char> alpn_protocols;
+
+      ssl::context* find(const std::string_view name)
+      {
+        const std::string host = to_lower(std::string(name));
+        for (auto& [key, context] : sni_contexts)
+        {
+          if (key == host)
+          {
+            return context.get();
+          }
+        }
+        const auto dot = host.find('.');
+        if (dot == std::string::npos)
+        {
+          return nullptr;
+        }
+        const std::string wildcard = "*" + host.substr(dot);
+        for (auto& [key, context] : sni_contexts)
+        {
+          if (key == wildcard)
+          {
+            return context.get();
+          }
+        }
+        return nullptr;
+      }
+    };
+
+    void configure(ssl::context& context, const TlsCertificate& certificate)
+    {
+      context.set_options(ssl::context::default_workarounds | ssl::context::no_sslv2 | ssl::context::no_sslv3 |
+        ssl::context::no_tlsv1 | ssl::context::no_tlsv1_1 | ssl::context::single_dh_use);
+
+      boost::system::error_code ec;
+      context.use_certificate_chain_file(certificate.certificate_chain_file, ec);
+      if (ec)
+      {
+        throw std::runtime_error(fmt::format("Failed to load certificate chain '{}': {}",
+                                             certificate.certificate_chain_file, ec.message()));
+      }
+      context.use_private_key_file(certificate.private_key_file, ssl::context::pem, ec);
+      if (ec)
+      {
+        throw std::runtime_error(fmt::format("Failed to load private key '{}': {}",
+                                             certificate.private_key_file, ec.message()));
+      }
+      SSL_CTX_set_session_id_context(context.native_handle(), session_id_context, sizeof(session_id_context) - 1);
+    }
+
+    // ClientHello 中带有 SNI 时调用，切换到对应主机名的证书；会话缓存与票据密钥仍然使用最初的 context
+    int select_certificate(SSL* ssl, int* alert, void* arg)
+    {
+      (void)alert;
+      const char* host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+      if (!host)
+      {
+        return SSL_TLSEXT_ERR_NOACK;
+      }
+      if (ssl::context* context = static_cast<ServerSslContexts*>(arg)->find(host))
+      {
+        SSL_set_SSL_CTX(ssl, context->native_handle());
+      }
+      return SSL_TLSEXT_ERR_OK;
+    }
+
+    // 按服务端的偏好从客户端提供的协议中选择；没有共同的协议时不回应 ALPN，连接按 HTTP/1.1 处理
+    int select_protocol(SSL* ssl, const unsigned char** out, unsigned char* out_length, const unsigned char* in,
+                        unsigned int in_length, void* arg)
+    {
+      (void)ssl;
+      const auto& protocols = static_cast<ServerSslContexts*>(arg)->alpn_protocols;
+      unsigned char* selected = nullptr;
+      if (SSL_select_next_proto(&selected, out_length, protocols.data(), static_cast<unsigned int>(protocols.size()),
+                                in, in_length) != OPENSSL_NPN_NEGOTIATED)
+      {
+        return SSL_TLSEXT_ERR_NOACK;
+      }
+      *out = selected;
+      return SSL_TLSEXT_ERR_OK;
+    }
+  }
+
+  std::shared_ptr<ssl::context> make_server_ssl_context(const TlsOptions& options)
+  {
+    auto contexts = std::make_shared<ServerSslContexts>();
+    SSL_CTX* native = contexts->context.native_handle();
+    configure(contexts->context, options.certificate);
+
+    if (options.session_cache_size > 0)
+    {
+      SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_SERVER);
+      SSL_CTX_sess_set_cache_size(native, static_cast<long>(options.session_cache_size));
+    }
+    else
+    {
+      SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_OFF);
+    }
+    SSL_CTX_set_timeout(native, static_cast<long>(options.session_timeout.count()));
+    if (!options.session_tickets)
+    {
+      SSL_CTX_set_options(native, SSL_OP_NO_TICKET);
+    }
+
+    if (!options.sni_certificates.empty())
+    {
+      for (const auto& [host, certificate] : options.sni_certificates)
+      {
+        auto context = std::make_unique<ssl::context>(ssl::context::tls_server);
+        configure(*context, certificate);
+        contexts->sni_contexts.emplace_back(to_lower(host), std::move(context));
+      }
+      SSL_CTX_set_tlsext_servername_callback(native, select_certificate);
+      SSL_CTX_set_tlsext_servername_arg(native, contexts.get());
+    }
+
+    for (const auto& protocol : options.alpn_protocols)
+    {
+      if (protocol.empty() || protocol.size() > 255)
+      {
+        throw std::invalid_argument(fmt::format("Invalid ALPN protocol '{}'", protocol));
+      }
+      contexts->alpn_protocols.push_back(static_cast<unsigned char>(protocol.size()));
+      contexts->alpn_protocols.insert(contexts->alpn_protocols.end(), protocol.begin(), protocol.end());
+    }
+    if (!contexts->alpn_protocols.empty())
+    {
+      // SNI 切换 context 之后才选择协议，每个 context 都要设置
+      SSL_CTX_set_alpn_select_cb(native, select_protocol, contexts.get());
+      for (auto& [host, context] : contexts->sni_contexts)
+      {
+        SSL_CTX_set_alpn_select_cb(context->native_handle(), select_protocol, contexts.get());
+      }
+    }
+
+    // 别名构造：外部只看到默认 context，SNI context 与它同生共死
+    return {contexts, &contexts->context};
+  }
+}
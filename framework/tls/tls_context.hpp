@@ -0,0 +1,46 @@
+// framework/tls/tls_context.hpp
+#ifndef KHTTPD_FRAMEWORK_TLS_TLS_CONTEXT_HPP
+#define KHTTPD_FRAMEWORK_TLS_TLS_CONTEXT_HPP
+
+#include <boost/asio/ssl/context.hpp>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace khttpd::framework
+{
+  namespace ssl = boost::asio::ssl;
+
+  // PEM 格式的证书链与私钥文件
+  struct TlsCertificate
+  {
+    std::string certificate_chain_file;
+    std::string private_key_file;
+  };
+
+  struct TlsOptions
+  {
+    // 客户端没有发送 SNI，或者没有匹配的主机名时使用的证书
+    TlsCertificate certificate;
+    // 按 SNI 主机名选择的证书，键为 "example.com" 或 "*.example.com"（只匹配一级子域名），不区分大小写
+    std::map<std::string, TlsCertificate> sni_certificates;
+    // 服务端会话缓存的条目数，用于 session id 恢复（TLS 1.2）和关闭票据时的 TLS 1.3 恢复；0 表示关闭
+    std::size_t session_cache_size = 20 * 1024;
+    // 缓存的会话与签发的票据的有效期
+    std::chrono::seconds session_timeout{2 * 60 * 60};
+    // 无状态会话票据（RFC 5077 与 TLS 1.3 PSK），票据密钥由 TLS 库在进程内生成，重启后旧票据失效
+    bool session_tickets = true;
+    // ALPN 协议，按服务端的偏好排列；协商出 "h2" 的连接使用 HTTP/2，为空时不处理 ALPN
+    std::vector<std::string> alpn_protocols{"h2", "http/1.1"};
+  };
+
+  // 创建服务端使用的 ssl::context：只允许 TLS 1.2 及以上版本，加载证书，按 options 启用会话缓存、
+  // 会话票据、ALPN 与 SNI 证书选择。各个 SNI 证书的 context 由返回的 shared_ptr 一并持有。
+  // 证书无法加载时抛出 std::runtime_error
+  std::shared_ptr<ssl::context> make_server_ssl_context(const TlsOptions& options);
+}
+
+#endif // KHTTPD_FRAMEWORK_TLS_TLS_CONTEXT_HPP
@@ -0,0 +1,45 @@
+// framework/websocket/websocket_deflate.hpp
+#ifndef KHTTPD_FRAMEWORK_WEBSOCKET_DEFLATE_HPP
+#define KHTTPD_FRAMEWORK_WEBSOCKET_DEFLATE_HPP
+
+#include <boost/beast/core/role.hpp>
+#include <boost/beast/websocket/option.hpp>
+#include <cstddef>
+
+namespace khttpd::framework
+{
+  // permessage-deflate（RFC 7692）的参数，服务端 WebsocketSession 与客户端 WebsocketClient 共用。
+  // 只有双方都提供该扩展时才会启用，协商失败时照常以不压缩的方式通信
+  struct WebsocketDeflateOptions
+  {
+    bool enabled = false;
+    // 服务端与客户端压缩方向的 LZ77 窗口大小（9-15），越小占用内存越少、压缩率越低
+    int server_max_window_bits = 15;
+    int client_max_window_bits = 15;
+    // 每条消息单独压缩，不沿用前一条消息的字典：压缩率下降，但两端不必在消息之间保留压缩状态
+    bool server_no_context_takeover = false;
+    bool client_no_context_takeover = false;
+    // zlib 压缩级别（0-9）与内存级别（1-9）
+    int level = 6;
+    int memory_level = 4;
+    // 小于这个字节数的消息不压缩
+    std::size_t threshold = 256;
+  };
+
+  inline boost::beast::websocket::permessage_deflate make_permessage_deflate(const WebsocketDeflateOptions& options,
+                                                                            boost::beast::role_type role)
+  {
+    boost::beast::websocket::permessage_deflate deflate;
+    deflate.server_enable = options.enabled && role == boost::beast::role_type::server;
+    deflate.client_enable = options.enabled && role == boost::beast::role_type::client;
+    deflate.server_max_window_bits = options.server_max_window_bits;
+    deflate.client_max_window_bits = options.client_max_window_bits;
+    deflate.server_no_context_takeover = options.server_no_context_takeover;
+    deflate.client_no_context_takeover = options.client_no_context_takeover;
+    deflate.compLevel = options.level;
+    deflate.memLevel = options.memory_level;
+    deflate.msg_size_threshold = options.threshold;
+    return deflate;
+  }
+}
+#endif // KHTTPD_FRAMEWORK_WEBSOCKET_DEFLATE_HPP
@@ -1,31 +1,66 @@
 // framework/websocket/websocket_session.cpp
 #include "websocket_session.hpp"
 #include "context/websocket_context.hpp"
+#include "websocket_session_registry.hpp"
+#include "websocket_topics.hpp"
 #include <fmt/core.h>
+#include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
 namespace khttpd::framework
 {
-  std::mutex WebsocketSession::m_sessions_mutex{};
-  std::map<std::string, std::shared_ptr<WebsocketSession>> WebsocketSession::m_sessions_id_{};
-  std::mutex WebsocketSession::m_gen_mutex{};
-  boost::uuids::random_generator WebsocketSession::gen{};
-
   WebsocketSession::WebsocketSession(tcp::socket&& socket, WebsocketRouter& ws_router,
-                                     const std::string& initial_path)
-    : ws_(std::move(socket)),
+                                     const std::string& initial_path, const WebsocketOptions& options,
+                                     HttpSessionStats* stats)
+    : ws_(std::in_place_type<PlainWebsocket>, std::move(socket)),
+      strand_(net::make_strand(std::get<PlainWebsocket>(ws_).get_executor())),
+      websocket_router_(ws_router),
+      initial_path_(initial_path),
+      options_(options),
+      stats_(stats)
+  {
+    init();
+  }
+
+  WebsocketSession::WebsocketSession(beast::ssl_stream<beast::tcp_stream>&& stream, WebsocketRouter& ws_router,
+                                     const std::string& initial_path, const WebsocketOptions& options,
+                                     HttpSessionStats* stats)
+    : ws_(std::in_place_type<SslWebsocket>, std::move(stream)),
+      strand_(net::make_strand(std::get<SslWebsocket>(ws_).get_executor())),
       websocket_router_(ws_router),
-      initial_path_(initial_path)
+      initial_path_(initial_path),
+      options_(options),
+      stats_(stats)
+  {
+    // HTTP 会话设置的超时不再适用
+    beast::get_lowest_layer(std::get<SslWebsocket>(ws_)).expires_never();
+    init();
+  }
+
+  WebsocketSession::~WebsocketSession()
   {
+    // 没写出的消息不再计入全局统计
+    if (stats_)
     {
-      std::unique_lock<std::mutex> lock(m_gen_mutex);
-      id = boost::uuids::to_string(gen());
+      stats_->websocket_queued_bytes.fetch_sub(queued_bytes_.load(), std::memory_order_relaxed);
+      stats_->websocket_queued_messages.fetch_sub(queued_messages_.load(), std::memory_order_relaxed);
     }
-    ws_.read_message_max(32 * 1024 * 1024);
-    ws_.set_option(ws::stream_base::decorator([](ws::response_type& res)
+  }
+
+  void WebsocketSession::init()
+  {
+    // 每个线程一个生成器，建立连接时不再争用同一把锁
+    thread_local boost::uuids::random_generator gen;
+    id = boost::uuids::to_string(gen());
+    with_ws([this](auto& ws)
     {
-      res.set(http::field::server, std::string(BOOST_BEAST_VERSION_STRING) + " khttpd-websocket");
-    }));
+      ws.read_message_max(options_.read_message_max);
+      ws.set_option(make_permessage_deflate(options_.deflate, beast::role_type::server));
+      ws.set_option(ws::stream_base::decorator([](ws::response_type& res)
+      {
+        res.set(http::field::server, std::string(BOOST_BEAST_VERSION_STRING) + " khttpd-websocket");
+      }));
+    });
   }
 
 
@@ -37,13 +72,13 @@ namespace khttpd::framework
       do_close(ec);
       return;
     }
-    fmt::print("WebSocket handshake successful for path: {}\n", initial_path_);
-
-    WebsocketContext open_ctx(shared_from_this(), initial_path_);
+    if (options_.log_level >= WebsocketLogLevel::info)
     {
-      std::unique_lock<std::mutex> lock{m_sessions_mutex};
-      m_sessions_id_[id] = shared_from_this();
+      fmt::print("WebSocket handshake successful for path: {}\n", initial_path_);
     }
+
+    WebsocketContext open_ctx(shared_from_this(), initial_path_);
+    WebsocketSessionRegistry::instance().add(shared_from_this());
     websocket_router_.dispatch_open(initial_path_, open_ctx);
 
     do_read();
@@ -51,8 +86,13 @@ namespace khttpd::framework
 
   void WebsocketSession::do_read()
   {
-    ws_.async_read(buffer_,
-                   beast::bind_front_handler(&WebsocketSession::on_read, shared_from_this()));
+    read_dynamic_buffer_.emplace(read_buffer_);
+    with_ws([this](auto& ws)
+    {
+      ws.async_read(*read_dynamic_buffer_,
+                    net::bind_executor(strand_, beast::bind_front_handler(&WebsocketSession::on_read,
+                                                                          shared_from_this())));
+    });
   }
 
   void WebsocketSession::on_read(beast::error_code ec, std::size_t bytes_transferred)
@@ -61,34 +101,56 @@ namespace khttpd::framework
 
     if (ec == ws::error::closed)
     {
-      fmt::print("WebSocket connection for path '{}' closed by client.\n", initial_path_);
+      if (options_.log_level >= WebsocketLogLevel::info)
+      {
+        fmt::print("WebSocket connection for path '{}' closed by client.\n", initial_path_);
+      }
       do_close(ec);
       return;
     }
     if (ec)
     {
-      fmt::print(stderr, "WebSocket read error for path '{}': {}\n", initial_path_, ec.message());
+      if (!closed_)
+      {
+        fmt::print(stderr, "WebSocket read error for path '{}': {}\n", initial_path_, ec.message());
+      }
       do_close(ec);
       return;
     }
 
-    std::string received_message = beast::buffers_to_string(buffer_.data());
-    bool is_text = ws_.got_text();
-
-    fmt::print("Received WS message on path '{}': {}\n", initial_path_, received_message);
-
-    buffer_.consume(buffer_.size());
+    bool is_text = with_ws([](auto& ws) { return ws.got_text(); });
+    if (options_.log_level >= WebsocketLogLevel::trace)
+    {
+      fmt::print("Received WS {} message on path '{}': {} bytes\n", is_text ? "text" : "binary", initial_path_,
+                 read_buffer_.size());
+    }
 
-    WebsocketContext message_ctx(shared_from_this(), received_message, is_text, initial_path_);
+    // 消息内容移动给 handler，不复制
+    WebsocketContext message_ctx(shared_from_this(), std::move(read_buffer_), is_text, initial_path_);
     websocket_router_.dispatch_message(initial_path_, message_ctx);
+    // handler 没有拿走内容时收回字符串，下一条消息复用它的容量
+    read_buffer_ = std::move(message_ctx.message);
+    read_buffer_.clear();
 
     do_read();
   }
 
   void WebsocketSession::send_message(const std::string& msg, bool is_text_msg)
   {
-    auto ss = std::make_shared<const std::string>(msg);
-    do_write(ss, is_text_msg);
+    if (!admit(msg.size(), true))
+    {
+      return;
+    }
+    enqueue({std::make_shared<const std::string>(msg), is_text_msg});
+  }
+
+  void WebsocketSession::send_shared(std::shared_ptr<const std::string> msg, bool is_text, bool may_block)
+  {
+    if (!admit(msg->size(), may_block))
+    {
+      return;
+    }
+    enqueue({std::move(msg), is_text});
   }
 
   bool WebsocketSession::send_message(const std::string& id, const std::string& msg, bool is_text)
@@ -98,82 +160,268 @@ namespace khttpd::framework
 
   size_t WebsocketSession::send_message(const std::vector<std::string>& ids, const std::string& msg, bool is_text)
   {
-    std::unique_lock<std::mutex> lock{m_sessions_mutex};
-    size_t count = 0;
-    for (const auto& id : ids)
+    const auto sessions = WebsocketSessionRegistry::instance().find(ids);
+    if (sessions.empty())
+    {
+      return 0;
+    }
+    const auto shared = std::make_shared<const std::string>(msg);
+    for (const auto& session : sessions)
+    {
+      session->send_shared(shared, is_text);
+    }
+    return sessions.size();
+  }
+
+  bool WebsocketSession::on_io_thread() const
+  {
+    const auto executor = strand_.get_inner_executor();
+    if (const auto* io = executor.target<net::io_context::executor_type>())
+    {
+      return io->running_in_this_thread();
+    }
+    // IoMode::shared 下套接字的执行器是共享 io_context 上的 strand，要看的是它底下的 io_context
+    if (const auto* strand = executor.target<net::strand<net::io_context::executor_type>>())
     {
-      auto item = m_sessions_id_.find(id);
-      if (item == m_sessions_id_.end())
+      return strand->get_inner_executor().running_in_this_thread();
+    }
+    return strand_.running_in_this_thread();
+  }
+
+  bool WebsocketSession::admit(const std::size_t size, const bool may_block)
+  {
+    if (slow_consumer_.load(std::memory_order_relaxed))
+    {
+      return false;
+    }
+    const std::size_t queued = queued_bytes_.load(std::memory_order_relaxed);
+    if (backpressured_.load(std::memory_order_acquire))
+    {
+      // 与 release 并发时可能错过清除，这里再按低水位判断一次
+      if (queued <= options_.write_queue_low_watermark)
       {
-        continue;
+        end_backpressure();
+        return true;
       }
-      item->second->send_message(msg, is_text);
-      count++;
     }
-    return count;
+    else if (queued + size <= options_.write_queue_high_watermark)
+    {
+      return true;
+    }
+    // 队列为空时超过高水位的单条消息照常发送
+    if (queued == 0)
+    {
+      return true;
+    }
+    if (!backpressured_.exchange(true, std::memory_order_acq_rel) && stats_)
+    {
+      stats_->websocket_backpressure_events.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    switch (options_.slow_consumer)
+    {
+    case SlowConsumerPolicy::disconnect:
+      if (!slow_consumer_.exchange(true))
+      {
+        net::post(strand_, beast::bind_front_handler(&WebsocketSession::disconnect_slow_consumer,
+                                                     shared_from_this()));
+      }
+      return false;
+    case SlowConsumerPolicy::block:
+      // 在运行会话所属 io_context 的线程上等待，会卡住这个线程上的写操作（per_core 模式下 io_context 只有这一个线程）；
+      // 同一 io_context 上其他会话的 handler 向这个会话发送时也是如此，不只是它自己的 strand
+      if (may_block && !on_io_thread())
+      {
+        std::unique_lock<std::mutex> lock(drain_mutex_);
+        if (drained_.wait_for(lock, options_.block_timeout, [this]
+        {
+          return !backpressured_.load(std::memory_order_acquire) || slow_consumer_.load() || closed_.load();
+        }) && !slow_consumer_.load() && !closed_.load())
+        {
+          return true;
+        }
+        break;
+      }
+      return true;
+    case SlowConsumerPolicy::drop:
+      break;
+    }
+    if (stats_)
+    {
+      stats_->websocket_dropped_messages.fetch_add(1, std::memory_order_relaxed);
+    }
+    return false;
   }
 
-  void WebsocketSession::do_write(std::shared_ptr<const std::string> ss, bool is_text_msg)
+  void WebsocketSession::enqueue(PendingMessage message)
   {
-    // 设置消息是文本还是二进制
-    ws_.text(is_text_msg);
-
-    // --- 检查消息大小，决定是否分片 ---
-    if (ss->length() < auto_fragment_threshold_)
+    const std::size_t size = message.data->size();
+    queued_bytes_.fetch_add(size, std::memory_order_relaxed);
+    queued_messages_.fetch_add(1, std::memory_order_relaxed);
+    if (stats_)
     {
-      // 消息不大，直接发送，无需分片。
-      // 这可以避免为小消息创建 vector 和 buffer sequence 的开销。
-      ws_.async_write(net::buffer(*ss),
-                      beast::bind_front_handler(&WebsocketSession::on_write, shared_from_this()));
+      stats_->websocket_queued_bytes.fetch_add(size, std::memory_order_relaxed);
+      stats_->websocket_queued_messages.fetch_add(1, std::memory_order_relaxed);
     }
-    else
+    // 已经在会话所在的线程上（例如 handler 中发送或主题的分发任务）时直接入队
+    net::dispatch(strand_, [self = shared_from_this(), message = std::move(message)]() mutable
     {
-      // 消息很大，需要分片发送。
-      // 1. 创建一个缓冲区序列（vector of const_buffer）的 shared_ptr。
-      //    必须用 shared_ptr 来管理，因为它需要在异步操作期间保持存活。
-      auto buffer_sequence_ptr = std::make_shared<std::vector<net::const_buffer>>();
+      if (self->closed_)
+      {
+        self->release(message.data->size());
+        return;
+      }
+      self->write_queue_.push_back(std::move(message));
+      if (!self->writing_)
+      {
+        self->writing_ = true;
+        self->do_write();
+      }
+    });
+  }
 
-      // 2. 预留空间以提高效率
-      buffer_sequence_ptr->reserve(ss->length() / fragment_size_ + 1);
+  void WebsocketSession::do_write()
+  {
+    with_ws([this](auto& ws)
+    {
+      const auto& ss = write_queue_.front().data;
+      // 设置消息是文本还是二进制
+      ws.text(write_queue_.front().is_text);
 
-      // 3. 将大字符串切分成多个 buffer，并添加到序列中。
-      //    这个过程不会拷贝字符串数据，net::const_buffer 只是一个视图。
-      size_t offset = 0;
-      while (offset < ss->length())
+      // --- 检查消息大小，决定是否分片 ---
+      if (ss->length() < auto_fragment_threshold_)
       {
-        size_t current_chunk_size = std::min(fragment_size_, ss->length() - offset);
-        buffer_sequence_ptr->emplace_back(ss->data() + offset, current_chunk_size);
-        offset += current_chunk_size;
+        // 消息不大，直接发送，无需分片。
+        // 这可以避免为小消息创建 vector 和 buffer sequence 的开销。
+        ws.async_write(net::buffer(*ss), net::bind_executor(
+                         strand_, beast::bind_front_handler(&WebsocketSession::on_write, shared_from_this())));
       }
+      else
+      {
+        // 消息很大，需要分片发送。
+        // 1. 创建一个缓冲区序列（vector of const_buffer）的 shared_ptr。
+        //    必须用 shared_ptr 来管理，因为它需要在异步操作期间保持存活。
+        auto buffer_sequence_ptr = std::make_shared<std::vector<net::const_buffer>>();
 
-      // 4. 调用 async_write，传入缓冲区序列。
-      //    Beast 会自动将序列中的每个 buffer 作为一帧来发送。
-      ws_.async_write(
-        *buffer_sequence_ptr, // 传入缓冲区序列
-        [ss, buffer_sequence_ptr, self = shared_from_this()](beast::error_code ec, std::size_t bytes)
+        // 2. 预留空间以提高效率
+        buffer_sequence_ptr->reserve(ss->length() / fragment_size_ + 1);
+
+        // 3. 将大字符串切分成多个 buffer，并添加到序列中。
+        //    这个过程不会拷贝字符串数据，net::const_buffer 只是一个视图。
+        size_t offset = 0;
+        while (offset < ss->length())
         {
-          // 这个 lambda 的作用是确保 ss 和 buffer_sequence_ptr 的生命周期
-          // 能够覆盖整个异步写操作。当 on_write 被调用时，它们依然有效。
-          self->on_write(ec, bytes);
+          size_t current_chunk_size = std::min(fragment_size_, ss->length() - offset);
+          buffer_sequence_ptr->emplace_back(ss->data() + offset, current_chunk_size);
+          offset += current_chunk_size;
         }
-      );
-    }
+
+        // 4. 调用 async_write，传入缓冲区序列。
+        //    消息本身由写队列持有，直到 on_write 把它出队
+        ws.async_write(
+          *buffer_sequence_ptr, // 传入缓冲区序列
+          net::bind_executor(strand_, [buffer_sequence_ptr, self = shared_from_this()](beast::error_code ec,
+                                                                                       std::size_t bytes)
+          {
+            self->on_write(ec, bytes);
+          })
+        );
+      }
+    });
   }
 
   void WebsocketSession::on_write(beast::error_code ec, std::size_t bytes_transferred)
   {
     boost::ignore_unused(bytes_transferred);
 
+    const std::size_t size = write_queue_.front().data->size();
+    write_queue_.pop_front();
+    release(size);
+
     if (ec)
     {
-      fmt::print(stderr, "WebSocket write error for path '{}': {}\n", initial_path_, ec.message());
+      writing_ = false;
+      if (!closed_)
+      {
+        fmt::print(stderr, "WebSocket write error for path '{}': {}\n", initial_path_, ec.message());
+      }
       do_close(ec);
       return;
     }
+
+    // 关闭后其余消息已由 do_close 丢弃
+    if (write_queue_.empty() || closed_)
+    {
+      writing_ = false;
+      return;
+    }
+    do_write();
+  }
+
+  void WebsocketSession::release(const std::size_t size)
+  {
+    const std::size_t remaining = queued_bytes_.fetch_sub(size, std::memory_order_relaxed) - size;
+    queued_messages_.fetch_sub(1, std::memory_order_relaxed);
+    if (stats_)
+    {
+      stats_->websocket_queued_bytes.fetch_sub(size, std::memory_order_relaxed);
+      stats_->websocket_queued_messages.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (remaining <= options_.write_queue_low_watermark && backpressured_.load(std::memory_order_relaxed))
+    {
+      end_backpressure();
+    }
+  }
+
+  void WebsocketSession::end_backpressure()
+  {
+    {
+      std::lock_guard<std::mutex> lock(drain_mutex_);
+      backpressured_.store(false, std::memory_order_release);
+    }
+    drained_.notify_all();
+  }
+
+  void WebsocketSession::disconnect_slow_consumer()
+  {
+    if (closed_)
+    {
+      return;
+    }
+    fmt::print(stderr, "WebSocket write queue for path '{}' exceeded {} bytes, disconnecting.\n", initial_path_,
+               options_.write_queue_high_watermark);
+    if (stats_)
+    {
+      stats_->websocket_slow_consumer_disconnects.fetch_add(1, std::memory_order_relaxed);
+    }
+    // 直接关闭底层连接：对端不读数据，关闭握手也写不出去。挂起的读写随之以 operation_aborted 完成
+    beast::error_code ignored;
+    with_ws([&ignored](auto& ws) { beast::get_lowest_layer(ws).socket().close(ignored); });
+    do_close(net::error::no_buffer_space);
   }
 
   void WebsocketSession::do_close(beast::error_code ec)
   {
+    // 读写两个方向都可能报错，只处理第一次
+    if (closed_)
+    {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(drain_mutex_);
+      closed_ = true;
+    }
+    drained_.notify_all();
+    // 正在写的消息由 on_write 出队
+    while (write_queue_.size() > (writing_ ? 1 : 0))
+    {
+      release(write_queue_.back().data->size());
+      write_queue_.pop_back();
+    }
+
+    // 出错关闭的会话同样要从注册表与订阅的主题中移除
+    WebsocketSessionRegistry::instance().remove(id);
+    WebsocketTopics::instance().unsubscribe_all(*this);
     if (ec && ec != ws::error::closed && ec != boost::asio::error::eof)
     {
       WebsocketContext error_ctx(shared_from_this(), initial_path_, ec);
@@ -182,17 +430,6 @@ namespace khttpd::framework
     else
     {
       WebsocketContext close_ctx(shared_from_this(), initial_path_, ec);
-      {
-        std::unique_lock<std::mutex> lock{m_sessions_mutex};
-        for (auto item = m_sessions_id_.begin(); item != m_sessions_id_.end(); ++item)
-        {
-          if (item->first == id)
-          {
-            m_sessions_id_.erase(item);
-            break;
-          }
-        }
-      }
       websocket_router_.dispatch_close(initial_path_, close_ctx);
     }
   }
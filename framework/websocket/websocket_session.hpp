@@ -3,11 +3,20 @@
 #define KHTTPD_FRAMEWORK_WEBSOCKET_SESSION_HPP
 
 #include <boost/beast.hpp>
+#include <boost/beast/ssl.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
-#include <boost/uuid/uuid_generators.hpp>
+#include <variant>
+#include <vector>
 #include "router/websocket_router.hpp"
+#include "session/http_session_options.hpp"
 
 namespace khttpd::framework
 {
@@ -20,13 +29,41 @@ namespace khttpd::framework
   class WebsocketSession : public std::enable_shared_from_this<WebsocketSession>
   {
   public:
-    WebsocketSession(tcp::socket&& socket, WebsocketRouter& ws_router, const std::string& initial_path);
-    virtual ~WebsocketSession() = default;
+    // stats 为空时不统计写队列
+    WebsocketSession(tcp::socket&& socket, WebsocketRouter& ws_router, const std::string& initial_path,
+                     const WebsocketOptions& options = {}, HttpSessionStats* stats = nullptr);
+    // 由 HTTPS 连接升级而来（wss），TLS 握手已经完成
+    WebsocketSession(beast::ssl_stream<beast::tcp_stream>&& stream, WebsocketRouter& ws_router,
+                     const std::string& initial_path, const WebsocketOptions& options = {},
+                     HttpSessionStats* stats = nullptr);
+    virtual ~WebsocketSession();
 
     template <class Body, class Allocator>
     void run_handshake(http::request<Body, http::basic_fields<Allocator>> req);
 
+    // 可以在任意线程调用。消息进入写队列，由会话的 strand 依次写出；
+    // 队列超过高水位时按 WebsocketOptions::slow_consumer 处理
     virtual void send_message(const std::string& msg, bool is_text);
+    // 与 send_message 相同，但消息内容由调用方共享，多个会话发送同一条消息时不再逐个复制。
+    // may_block 为 false 时 block 策略不等待，消息照常入队
+    void send_shared(std::shared_ptr<const std::string> msg, bool is_text, bool may_block = true);
+
+    // 连接所属 io_context 的执行器（不是会话的 strand）
+    net::any_io_executor get_executor() const
+    {
+      return strand_.get_inner_executor();
+    }
+
+    // 写队列中还没写出的字节数与消息数
+    std::size_t queued_bytes() const
+    {
+      return queued_bytes_.load(std::memory_order_relaxed);
+    }
+
+    std::size_t queued_messages() const
+    {
+      return queued_messages_.load(std::memory_order_relaxed);
+    }
 
     static bool send_message(const std::string& id, const std::string& msg, bool is_text);
     static size_t send_message(const std::vector<std::string>& ids, const std::string& msg, bool is_text);
@@ -35,14 +72,45 @@ namespace khttpd::framework
     std::string id;
 
   private:
-    ws::stream<beast::tcp_stream> ws_;
-    beast::flat_buffer buffer_;
+    using PlainWebsocket = ws::stream<beast::tcp_stream>;
+    using SslWebsocket = ws::stream<beast::ssl_stream<beast::tcp_stream>>;
+
+    struct PendingMessage
+    {
+      std::shared_ptr<const std::string> data;
+      bool is_text;
+    };
+
+    // 读写操作通过 with_ws 按实际的流类型发起
+    std::variant<PlainWebsocket, SslWebsocket> ws_;
+    // 所有完成回调与写队列都在这个 strand 上执行
+    net::strand<net::any_io_executor> strand_;
+    // 收到的消息直接读进这个字符串，交给 handler 时移动出去，处理完再收回来复用容量。
+    // 读操作持有 read_dynamic_buffer_ 的引用，每次发起读时重新构造
+    std::string read_buffer_;
+    std::optional<net::dynamic_string_buffer<char, std::char_traits<char>, std::allocator<char>>> read_dynamic_buffer_;
     WebsocketRouter& websocket_router_;
     std::string initial_path_;
-    static std::mutex m_gen_mutex;
-    static boost::uuids::random_generator gen;
-    static std::mutex m_sessions_mutex;
-    static std::map<std::string, std::shared_ptr<WebsocketSession>> m_sessions_id_;
+    WebsocketOptions options_;
+    HttpSessionStats* stats_;
+
+    std::deque<PendingMessage> write_queue_;
+    bool writing_ = false;
+    // 入队时在发送方线程上更新，用于判断水位
+    std::atomic<std::size_t> queued_bytes_{0};
+    std::atomic<std::size_t> queued_messages_{0};
+    // 超过高水位后置位，写出到低水位以下时清除
+    std::atomic<bool> backpressured_{false};
+    std::atomic<bool> slow_consumer_{false};
+    std::atomic<bool> closed_{false};
+    // block 策略下等待队列排空的发送方
+    std::mutex drain_mutex_;
+    std::condition_variable drained_;
+    // 订阅的主题，关闭时据此退订；由 WebsocketTopics 维护
+    std::mutex topics_mutex_;
+    std::vector<std::string> topics_;
+
+    friend class WebsocketTopics;
 
     // --- 新增常量 ---
     // 定义分片大小，例如 16KB。这是一个可以调整的参数。
@@ -50,19 +118,39 @@ namespace khttpd::framework
     // 定义一个阈值，小于这个大小的消息不进行分片，直接发送。
     static constexpr size_t const auto_fragment_threshold_ = fragment_size_ * 2;
 
+    template <class F>
+    decltype(auto) with_ws(F&& f)
+    {
+      return std::visit(std::forward<F>(f), ws_);
+    }
+
+    void init();
     void on_handshake(beast::error_code ec);
     void do_read();
     void on_read(beast::error_code ec, std::size_t bytes_transferred);
-    void do_write(std::shared_ptr<const std::string> ss, bool is_text);
+    // 当前线程正在运行会话所属的 io_context
+    bool on_io_thread() const;
+    // 按水位与策略决定消息是否入队
+    bool admit(std::size_t size, bool may_block);
+    void enqueue(PendingMessage message);
+    void do_write();
     void on_write(beast::error_code ec, std::size_t bytes_transferred);
+    // 消息写出或被丢弃后归还队列占用
+    void release(std::size_t size);
+    // 唤醒 block 策略下等待的发送方
+    void end_backpressure();
+    void disconnect_slow_consumer();
     void do_close(beast::error_code ec = {});
   };
 
   template <class Body, class Allocator>
   void WebsocketSession::run_handshake(http::request<Body, http::basic_fields<Allocator>> req)
   {
-    ws_.async_accept(req,
-                     beast::bind_front_handler(&WebsocketSession::on_handshake, shared_from_this()));
+    with_ws([this, &req](auto& ws)
+    {
+      ws.async_accept(req, net::bind_executor(strand_, beast::bind_front_handler(&WebsocketSession::on_handshake,
+                                                                                 shared_from_this())));
+    });
   }
 }
 #endif // KHTTPD_FRAMEWORK_WEBSOCKET_SESSION_HPP
@@ -0,0 +1,93 @@
+// framework/websocket/websocket_session_registry.cpp
+#include "websocket_session_registry.hpp"
+#include "websocket_session.hpp"
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
+namespace khttpd::framework
+{
+  WebsocketSessionRegistry::WebsocketSessionRegistry(std::size_t shard_count)
+  {
+    std::size_t count = 1;
+    while (count < shard_count)
+    {
+      count <<= 1;
+    }
+    shards_ = std::make_unique<Shard[]>(count);
+    shard_mask_ = count - 1;
+  }
+
+  WebsocketSessionRegistry& WebsocketSessionRegistry::instance()
+  {
+    static WebsocketSessionRegistry registry;
+    return registry;
+  }
+
+  void WebsocketSessionRegistry::add(const std::shared_ptr<WebsocketSession>& session)
+  {
+    Shard& shard = shards_[shard_index(session->id)];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.sessions.insert_or_assign(session->id, session).second)
+    {
+      size_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  bool WebsocketSessionRegistry::remove(const std::string& id)
+  {
+    // 会话在锁外析构
+    std::shared_ptr<WebsocketSession> removed;
+    {
+      Shard& shard = shards_[shard_index(id)];
+      std::unique_lock<std::shared_mutex> lock(shard.mutex);
+      const auto it = shard.sessions.find(id);
+      if (it == shard.sessions.end())
+      {
+        return false;
+      }
+      removed = std::move(it->second);
+      shard.sessions.erase(it);
+    }
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  std::shared_ptr<WebsocketSession> WebsocketSessionRegistry::find(const std::string& id) const
+  {
+    const Shard& shard = shards_[shard_index(id)];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    const auto it = shard.sessions.find(id);
+    return it == shard.sessions.end() ? nullptr : it->second;
+  }
+
+  std::vector<std::shared_ptr<WebsocketSession>> WebsocketSessionRegistry::find(
+    const std::vector<std::string>& ids) const
+  {
+    std::vector<std::pair<std::size_t, const std::string*>> by_shard;
+    by_shard.reserve(ids.size());
+    for (const auto& id : ids)
+    {
+      by_shard.emplace_back(shard_index(id), &id);
+    }
+    std::sort(by_shard.begin(), by_shard.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<std::shared_ptr<WebsocketSession>> found;
+    found.reserve(ids.size());
+    for (std::size_t i = 0; i < by_shard.size();)
+    {
+      const Shard& shard = shards_[by_shard[i].first];
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      for (const std::size_t index = by_shard[i].first; i < by_shard.size() && by_shard[i].first == index; ++i)
+      {
+        const auto it = shard.sessions.find(*by_shard[i].second);
+        if (it != shard.sessions.end())
+        {
+          found.push_back(it->second);
+        }
+      }
+    }
+    return found;
+  }
+}
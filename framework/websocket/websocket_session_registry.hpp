@@ -0,0 +1,61 @@
+// framework/websocket/websocket_session_registry.hpp
+#ifndef KHTTPD_FRAMEWORK_WEBSOCKET_SESSION_REGISTRY_HPP
+#define KHTTPD_FRAMEWORK_WEBSOCKET_SESSION_REGISTRY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace khttpd::framework
+{
+  class WebsocketSession;
+
+  // 已打开的 WebSocket 会话，按 id 索引。
+  // id 按哈希分到多个分片，每个分片一把读写锁：打开与关闭只锁一个分片，按 id 发送消息只加读锁，
+  // 批量发送时每个涉及的分片只锁一次。找到的会话在锁外使用
+  class WebsocketSessionRegistry
+  {
+  public:
+    // shard_count 向上取整为 2 的幂
+    explicit WebsocketSessionRegistry(std::size_t shard_count = 64);
+
+    WebsocketSessionRegistry(const WebsocketSessionRegistry&) = delete;
+    WebsocketSessionRegistry& operator=(const WebsocketSessionRegistry&) = delete;
+
+    // 服务端所有 WebsocketSession 共用的注册表
+    static WebsocketSessionRegistry& instance();
+
+    void add(const std::shared_ptr<WebsocketSession>& session);
+    bool remove(const std::string& id);
+    std::shared_ptr<WebsocketSession> find(const std::string& id) const;
+    // 按分片分组查找，结果中不包含不存在的 id
+    std::vector<std::shared_ptr<WebsocketSession>> find(const std::vector<std::string>& ids) const;
+
+    std::size_t size() const
+    {
+      return size_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    // 独占缓存行，避免相邻分片的锁互相干扰
+    struct alignas(64) Shard
+    {
+      mutable std::shared_mutex mutex;
+      std::unordered_map<std::string, std::shared_ptr<WebsocketSession>> sessions;
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    std::size_t shard_mask_;
+    std::atomic<std::size_t> size_{0};
+
+    std::size_t shard_index(const std::string& id) const
+    {
+      return std::hash<std::string>{}(id) & shard_mask_;
+    }
+  };
+}
+#endif // KHTTPD_FRAMEWORK_WEBSOCKET_SESSION_REGISTRY_HPP
@@ -0,0 +1,210 @@
+// framework/websocket/websocket_topics.cpp
+#include "websocket_topics.hpp"
+#include "websocket_session.hpp"
+#include <algorithm>
+
+namespace khttpd::framework
+{
+  namespace
+  {
+    const void* context_key(const net::any_io_executor& executor)
+    {
+      return &net::query(executor, net::execution::context);
+    }
+  }
+
+  WebsocketTopics& WebsocketTopics::instance()
+  {
+    static WebsocketTopics topics;
+    return topics;
+  }
+
+  std::shared_ptr<WebsocketTopics::Topic> WebsocketTopics::find(const std::string& topic) const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const auto it = topics_.find(topic);
+    return it == topics_.end() ? nullptr : it->second;
+  }
+
+  bool WebsocketTopics::subscribe(const std::string& topic, const std::shared_ptr<WebsocketSession>& session)
+  {
+    // 先锁会话再锁主题，与 unsubscribe_all 的顺序一致：关闭之后不会再加入新的主题
+    std::lock_guard<std::mutex> session_lock(session->topics_mutex_);
+    if (session->closed_ || std::find(session->topics_.begin(), session->topics_.end(), topic) !=
+      session->topics_.end())
+    {
+      return false;
+    }
+
+    while (true)
+    {
+      auto entry = find(topic);
+      if (!entry)
+      {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto& slot = topics_[topic];
+        if (!slot)
+        {
+          slot = std::make_shared<Topic>();
+        }
+        entry = slot;
+      }
+
+      std::lock_guard<std::mutex> lock(entry->mutex);
+      // 最后一个订阅者退订时主题会被移除，这时重新查找
+      if (entry->erased)
+      {
+        continue;
+      }
+      const auto executor = session->get_executor();
+      Group& group = entry->groups[context_key(executor)];
+      if (!group.executor)
+      {
+        group.executor = executor;
+      }
+      auto members = group.members ? std::make_shared<Members>(*group.members) : std::make_shared<Members>();
+      group.index.emplace(session->id, members->size());
+      members->push_back(session);
+      group.members = std::move(members);
+      ++entry->size;
+      break;
+    }
+    session->topics_.push_back(topic);
+    return true;
+  }
+
+  bool WebsocketTopics::unsubscribe(const std::string& topic, WebsocketSession& session)
+  {
+    {
+      std::lock_guard<std::mutex> session_lock(session.topics_mutex_);
+      const auto it = std::find(session.topics_.begin(), session.topics_.end(), topic);
+      if (it == session.topics_.end())
+      {
+        return false;
+      }
+      session.topics_.erase(it);
+    }
+    return remove(topic, session);
+  }
+
+  void WebsocketTopics::unsubscribe_all(WebsocketSession& session)
+  {
+    std::vector<std::string> topics;
+    {
+      std::lock_guard<std::mutex> session_lock(session.topics_mutex_);
+      topics.swap(session.topics_);
+    }
+    for (const auto& topic : topics)
+    {
+      remove(topic, session);
+    }
+  }
+
+  bool WebsocketTopics::remove(const std::string& topic, const WebsocketSession& session)
+  {
+    const auto entry = find(topic);
+    if (!entry)
+    {
+      return false;
+    }
+    // 从组中删除时与末尾交换，组内的顺序不重要
+    std::shared_ptr<WebsocketSession> removed;
+    bool empty = false;
+    {
+      std::lock_guard<std::mutex> lock(entry->mutex);
+      const auto group_it = entry->groups.find(context_key(session.get_executor()));
+      if (group_it == entry->groups.end())
+      {
+        return false;
+      }
+      Group& group = group_it->second;
+      const auto index_it = group.index.find(session.id);
+      if (index_it == group.index.end())
+      {
+        return false;
+      }
+      const std::size_t index = index_it->second;
+      group.index.erase(index_it);
+      auto members = std::make_shared<Members>(*group.members);
+      removed = std::move((*members)[index]);
+      if (index + 1 != members->size())
+      {
+        (*members)[index] = std::move(members->back());
+        group.index[(*members)[index]->id] = index;
+      }
+      members->pop_back();
+      if (members->empty())
+      {
+        entry->groups.erase(group_it);
+      }
+      else
+      {
+        group.members = std::move(members);
+      }
+      empty = --entry->size == 0;
+    }
+
+    if (empty)
+    {
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+      std::lock_guard<std::mutex> topic_lock(entry->mutex);
+      const auto it = topics_.find(topic);
+      if (entry->size == 0 && it != topics_.end() && it->second == entry)
+      {
+        entry->erased = true;
+        topics_.erase(it);
+      }
+    }
+    return true;
+  }
+
+  std::size_t WebsocketTopics::publish(const std::string& topic, std::shared_ptr<const std::string> msg,
+                                       const bool is_text)
+  {
+    const auto entry = find(topic);
+    if (!entry)
+    {
+      return 0;
+    }
+
+    // 在锁内每组只复制一个列表指针，入队在各自的 io 线程上进行
+    std::vector<std::pair<net::any_io_executor, std::shared_ptr<const Members>>> snapshots;
+    std::size_t count;
+    {
+      std::lock_guard<std::mutex> lock(entry->mutex);
+      count = entry->size;
+      snapshots.reserve(entry->groups.size());
+      for (const auto& [key, group] : entry->groups)
+      {
+        snapshots.emplace_back(group.executor, group.members);
+      }
+    }
+
+    for (const auto& [executor, members] : snapshots)
+    {
+      for (std::size_t begin = 0; begin < members->size(); begin += fanout_batch)
+      {
+        net::post(executor, [members, msg, is_text, begin]
+        {
+          const std::size_t end = std::min(begin + fanout_batch, members->size());
+          for (std::size_t i = begin; i < end; ++i)
+          {
+            (*members)[i]->send_shared(msg, is_text, false);
+          }
+        });
+      }
+    }
+    return count;
+  }
+
+  std::size_t WebsocketTopics::subscriber_count(const std::string& topic) const
+  {
+    const auto entry = find(topic);
+    if (!entry)
+    {
+      return 0;
+    }
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    return entry->size;
+  }
+}
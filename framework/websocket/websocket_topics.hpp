@@ -0,0 +1,74 @@
+// framework/websocket/websocket_topics.hpp
+#ifndef KHTTPD_FRAMEWORK_WEBSOCKET_TOPICS_HPP
+#define KHTTPD_FRAMEWORK_WEBSOCKET_TOPICS_HPP
+
+#include <boost/asio/any_io_executor.hpp>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace khttpd::framework
+{
+  class WebsocketSession;
+
+  // WebSocket 会话的发布/订阅主题。
+  // 订阅者按连接所在的 io_context 分组；发布时消息内容只构造一份，所有订阅者共享，
+  // 每组订阅者按 fanout_batch 切分成若干任务投递到该组的 io_context 上入队，分发工作由各个 io 线程分担。
+  // 会话关闭时自动退订
+  class WebsocketTopics
+  {
+  public:
+    // 一个分发任务处理的订阅者数
+    static constexpr std::size_t fanout_batch = 1024;
+
+    WebsocketTopics() = default;
+    WebsocketTopics(const WebsocketTopics&) = delete;
+    WebsocketTopics& operator=(const WebsocketTopics&) = delete;
+
+    // 服务端所有 WebsocketSession 共用的主题表
+    static WebsocketTopics& instance();
+
+    // 已经订阅或会话已关闭时返回 false
+    bool subscribe(const std::string& topic, const std::shared_ptr<WebsocketSession>& session);
+    bool unsubscribe(const std::string& topic, WebsocketSession& session);
+    void unsubscribe_all(WebsocketSession& session);
+
+    // 返回发布时的订阅者数。消息进入各订阅者的写队列，受各自的水位限制；
+    // 分发在 io 线程上进行，SlowConsumerPolicy::block 不会等待
+    std::size_t publish(const std::string& topic, std::shared_ptr<const std::string> msg, bool is_text);
+    std::size_t subscriber_count(const std::string& topic) const;
+
+  private:
+    using Members = std::vector<std::shared_ptr<WebsocketSession>>;
+
+    struct Group
+    {
+      boost::asio::any_io_executor executor;
+      // 写时复制：订阅与退订时替换成新的列表，发布时只在锁内复制这个指针，正在分发的旧列表不受影响
+      std::shared_ptr<const Members> members;
+      // 会话 id -> members 中的下标，退订时与末尾交换后删除
+      std::unordered_map<std::string, std::size_t> index;
+    };
+
+    struct Topic
+    {
+      mutable std::mutex mutex;
+      // 以 io_context 的地址分组
+      std::unordered_map<const void*, Group> groups;
+      std::size_t size = 0;
+      // 已从 topics_ 中移除，订阅时需要重新查找
+      bool erased = false;
+    };
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Topic>> topics_;
+
+    std::shared_ptr<Topic> find(const std::string& topic) const;
+    bool remove(const std::string& topic, const WebsocketSession& session);
+  };
+}
+#endif // KHTTPD_FRAMEWORK_WEBSOCKET_TOPICS_HPP